@@ -0,0 +1,235 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file CachePolicy.tcc
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace acl
+{
+
+/**
+ * @brief A snapshot of a cache's counters
+ */
+struct CacheStats {
+    uint64_t hits = 0;          //<! Lookups that found their key
+    uint64_t misses = 0;        //<! Lookups that did not find their key
+    uint64_t evictions = 0;     //<! Entries removed to make room
+    uint64_t rejections = 0;    //<! Insertions refused by the admission policy
+
+    /**
+     * @brief Returns hits / (hits + misses), or 0 if there have been no lookups
+     */
+    double hit_rate() const
+    {
+        uint64_t total = hits + misses;
+        return total ? static_cast<double>(hits) / total : 0;
+    }
+};
+
+/**
+ * @brief Counters kept by a cache.  Updated with relaxed atomics so they can be
+ *      bumped from any thread without extra locking.
+ */
+struct CacheCounters {
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+    std::atomic<uint64_t> rejections;
+
+    CacheCounters() { reset(); }
+
+    void reset()
+    {
+        hits.store(0, std::memory_order_relaxed);
+        misses.store(0, std::memory_order_relaxed);
+        evictions.store(0, std::memory_order_relaxed);
+        rejections.store(0, std::memory_order_relaxed);
+    }
+
+    CacheStats snapshot() const
+    {
+        CacheStats stats;
+        stats.hits = hits.load(std::memory_order_relaxed);
+        stats.misses = misses.load(std::memory_order_relaxed);
+        stats.evictions = evictions.load(std::memory_order_relaxed);
+        stats.rejections = rejections.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+/**
+ * @brief Decides whether a new entry may displace the entry a cache would evict.
+ *
+ * Implementations must be thread safe; a cache calls them while holding its
+ * own lock, possibly from several shards at once.
+ *
+ * @tparam K The key class used by the cache
+ */
+template<class K> class AdmissionPolicy
+{
+public:
+    virtual ~AdmissionPolicy() {}
+
+    /**
+     * @brief Called for every lookup and insertion of a key
+     */
+    virtual void record_access(const K& key) = 0;
+
+    /**
+     * @brief Returns true if candidate should be cached at the expense of victim
+     */
+    virtual bool admit(const K& candidate, const K& victim) = 0;
+};
+
+/**
+ * @brief TinyLFU admission: admits a new entry only if it has been accessed more
+ *      often than the entry it would replace.
+ *
+ * Access frequencies are estimated with a count-min sketch of 4 rows of
+ * saturating 4-bit-range counters.  After a sample of 10 accesses per counter
+ * all counters are halved, so old popularity fades.  This keeps one-off scans
+ * from flushing frequently used entries out of an LRU cache.
+ *
+ * @tparam K The key class used by the cache
+ * @tparam Hash Hash function for K
+ */
+template<class K, class Hash = std::hash<K>> class TinyLfuAdmission: public AdmissionPolicy<K>
+{
+public:
+    TinyLfuAdmission(size_t expectedEntries = 1024);
+    virtual ~TinyLfuAdmission() {}
+
+    virtual void record_access(const K& key);
+    virtual bool admit(const K& candidate, const K& victim);
+    virtual unsigned estimate(const K& key);    //<! Estimated recent access count
+    virtual void clear();
+
+protected:
+    static const int DEPTH = 4;                 //<! Rows in the sketch
+    static const uint8_t MAX_COUNT = 15;        //<! Counters saturate here
+
+    size_t index(uint64_t hash, int row) const;
+    void age();
+
+    std::unique_ptr<std::atomic<uint8_t>[]> m_counters;     //<! DEPTH rows of m_width counters
+    size_t m_width;                                         //<! Counters per row (power of two)
+    size_t m_sampleSize;                                    //<! Accesses between agings
+    std::atomic_size_t m_accesses;                          //<! Accesses since the last aging
+    Hash m_hash;
+};
+
+/**
+ * @brief Constructor
+ *
+ * @param expectedEntries Roughly the number of entries the cache holds
+ */
+template<class K, class Hash> TinyLfuAdmission<K,Hash>::
+TinyLfuAdmission(size_t expectedEntries): m_accesses(0)
+{
+    m_width = 16;
+    while (m_width < expectedEntries) {
+        m_width <<= 1;
+    }
+    m_sampleSize = 10 * m_width;
+
+    m_counters.reset(new std::atomic<uint8_t>[DEPTH * m_width]);
+    clear();
+}
+
+/**
+ * @brief Resets every counter to zero
+ */
+template<class K, class Hash> void TinyLfuAdmission<K,Hash>::
+clear()
+{
+    for (size_t i = 0; i < DEPTH * m_width; i++) {
+        m_counters[i].store(0, std::memory_order_relaxed);
+    }
+    m_accesses.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the counter for a hash in the given row
+ */
+template<class K, class Hash> size_t TinyLfuAdmission<K,Hash>::
+index(uint64_t hash, int row) const
+{
+    static const uint64_t seeds[DEPTH] = {
+        0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL,
+        0x94d049bb133111ebULL, 0xff51afd7ed558ccdULL
+    };
+
+    uint64_t h = (hash + seeds[row]) * seeds[(row + 1) % DEPTH];
+    h ^= h >> 32;
+    return row * m_width + (h & (m_width - 1));
+}
+
+/**
+ * @brief Counts an access to a key
+ */
+template<class K, class Hash> void TinyLfuAdmission<K,Hash>::
+record_access(const K& key)
+{
+    uint64_t hash = static_cast<uint64_t>(m_hash(key));
+    for (int row = 0; row < DEPTH; row++) {
+        std::atomic<uint8_t>& counter = m_counters[index(hash, row)];
+        uint8_t value = counter.load(std::memory_order_relaxed);
+        if (value < MAX_COUNT) {
+            counter.store(value + 1, std::memory_order_relaxed);   // A lost update only costs accuracy
+        }
+    }
+
+    if (m_accesses.fetch_add(1, std::memory_order_relaxed) + 1 == m_sampleSize) {
+        age();
+    }
+}
+
+/**
+ * @brief Halves every counter.  Called by the thread that completes a sample.
+ */
+template<class K, class Hash> void TinyLfuAdmission<K,Hash>::
+age()
+{
+    for (size_t i = 0; i < DEPTH * m_width; i++) {
+        uint8_t value = m_counters[i].load(std::memory_order_relaxed);
+        m_counters[i].store(value >> 1, std::memory_order_relaxed);
+    }
+    m_accesses.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the estimated number of recent accesses to a key
+ */
+template<class K, class Hash> unsigned TinyLfuAdmission<K,Hash>::
+estimate(const K& key)
+{
+    uint64_t hash = static_cast<uint64_t>(m_hash(key));
+    unsigned result = MAX_COUNT;
+    for (int row = 0; row < DEPTH; row++) {
+        unsigned value = m_counters[index(hash, row)].load(std::memory_order_relaxed);
+        if (value < result) {
+            result = value;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Admits the candidate only if it is used more often than the victim
+ */
+template<class K, class Hash> bool TinyLfuAdmission<K,Hash>::
+admit(const K& candidate, const K& victim)
+{
+    return estimate(candidate) > estimate(victim);
+}
+}
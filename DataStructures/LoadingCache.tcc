@@ -0,0 +1,247 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file LoadingCache.tcc
+ **/
+
+#pragma once
+
+#include "LruCache.tcc"
+#include "ThreadPool.h"
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+
+namespace acl
+{
+
+/**
+ * @brief An LruCache that loads missing values itself and never loads the same
+ *      key twice at once.
+ *
+ * Concurrent misses on a key share one load: the first caller starts the
+ * loader and every other caller waits on the same shared_future.  The value
+ * is added to the cache before the load is marked finished, so there is no
+ * window in which a second load can start.  The in-flight table is guarded
+ * by the cache's own mutex, so a lookup and the in-flight check take one lock.
+ *
+ * If the loader throws, the exception is delivered to every waiter and
+ * nothing is cached; the next request loads again.
+ *
+ * @tparam K The key class used to access elements
+ * @tparam V The cached object type
+ */
+template<class K, class V> class LoadingCache: public LruCache<K,V>
+{
+protected:
+    typedef typename LruCache<K,V>::Q Q;
+
+public:
+    typedef std::function<V(const K&)> Loader;      //<! Produces the value for a key
+
+    LoadingCache(ThreadPool* pool = nullptr);
+    virtual ~LoadingCache();
+    virtual V get_or_load(const K& key, Loader loader);
+    virtual std::shared_future<V> get_or_load_async(const K& key, Loader loader);
+    virtual void setLoaderPool(ThreadPool* pool = nullptr);
+    virtual size_t loads_in_flight();
+
+protected:
+    typedef std::shared_ptr<std::promise<V>> Promise;
+    enum class Lookup { Hit, InFlight, Miss };      //<! What start_load() found
+
+    virtual Lookup start_load(const K& key, V& value, std::shared_future<V>& future, Promise& promise);
+    virtual void run_load(const K& key, const Loader& loader, Promise promise);
+
+    std::map<K, std::shared_future<V>> m_inFlight;  //<! Loads that have started but not finished
+    ThreadPool* m_loaderPool;                       //<! Pool for asynchronous loads
+    size_t m_loadsRunning = 0;                      //<! Loads whose completion touches this cache
+    std::condition_variable_any m_loadCv;           //<! Signalled when a load finishes
+};
+
+/**
+ * @brief Constructor
+ *
+ * @param pool Pool that runs loaders started by get_or_load_async()
+ */
+template<class K, class V> LoadingCache<K,V>::
+LoadingCache(ThreadPool* pool): m_loaderPool(pool) {}
+
+/**
+ * @brief Destructor.  Waits for running loads to finish.
+ */
+template<class K, class V> LoadingCache<K,V>::
+~LoadingCache()
+{
+    std::unique_lock<std::recursive_mutex> lock(Q::m);
+    m_loadCv.wait(lock, [this] {return m_loadsRunning == 0;});
+}
+
+/**
+ * @brief Sets the pool that runs loaders started by get_or_load_async()
+ *
+ * @param pool The pool, or nullptr to load on the calling thread.  The pool must
+ *      outlive the cache.
+ */
+template<class K, class V> void LoadingCache<K,V>::
+setLoaderPool(ThreadPool* pool)
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    m_loaderPool = pool;
+}
+
+/**
+ * @brief Returns the number of keys currently being loaded
+ */
+template<class K, class V> size_t LoadingCache<K,V>::
+loads_in_flight()
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    return m_inFlight.size();
+}
+
+/**
+ * @brief Looks up a key and, on a miss, either joins the load in flight or
+ *      registers a new one.
+ *
+ * @param key The key
+ * @param[out] value Set on a hit
+ * @param[out] future Set unless it is a hit: the load to wait on
+ * @param[out] promise Set on a miss, when the caller must run the load
+ * @return Hit, InFlight to wait on another caller's load, or Miss to run one
+ */
+template<class K, class V> typename LoadingCache<K,V>::Lookup LoadingCache<K,V>::
+start_load(const K& key, V& value, std::shared_future<V>& future, Promise& promise)
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+
+    if (this->get_value(key, value)) {  //Recursive mutex allows for multiple locks from the same thread
+        return Lookup::Hit;
+    }
+
+    auto it = m_inFlight.find(key);
+    if (it != m_inFlight.end()) {
+        future = it->second;
+        return Lookup::InFlight;
+    }
+
+    promise = Promise(new std::promise<V>());
+    future = promise->get_future().share();
+    m_inFlight.emplace(key, future);
+    m_loadsRunning++;
+    return Lookup::Miss;
+}
+
+/**
+ * @brief Runs the loader, caches the value, and fulfils the promise.
+ */
+template<class K, class V> void LoadingCache<K,V>::
+run_load(const K& key, const Loader& loader, Promise promise)
+{
+    bool loaded = false;
+    V value;
+    std::exception_ptr error;
+
+    try {
+        value = loader(key);
+        loaded = true;
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    // add_to_cache() takes the lock itself and releases it to run the cleanup
+    // handler, which a held lock here would prevent.  A caller arriving in
+    // between finds the value in the cache, so no second load starts.
+    if (loaded) {
+        this->add_to_cache(key, value);
+    }
+    {
+        std::lock_guard<std::recursive_mutex> lock(Q::m);
+        m_inFlight.erase(key);
+    }
+
+    if (loaded) {
+        promise->set_value(value);
+    } else {
+        promise->set_exception(error);
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    m_loadsRunning--;
+    m_loadCv.notify_all();
+}
+
+/**
+ * @brief Returns the cached value for a key, loading it on the calling thread
+ *      if no other thread is already loading it.
+ *
+ * @param key The key
+ * @param loader Called with the key to produce the value on a miss
+ * @return The value.  Rethrows anything the loader threw.
+ */
+template<class K, class V> V LoadingCache<K,V>::
+get_or_load(const K& key, Loader loader)
+{
+    V value;
+    std::shared_future<V> future;
+    Promise promise;
+
+    switch (start_load(key, value, future, promise)) {
+    case Lookup::Hit:
+        return value;
+    case Lookup::Miss:
+        run_load(key, loader, promise);
+        break;
+    case Lookup::InFlight:
+        break;
+    }
+    return future.get();
+}
+
+/**
+ * @brief Returns a future for the value of a key.  On a miss the load runs on
+ *      the loader pool; without a pool, or if the pool will not take the job,
+ *      it runs on the calling thread before this returns.
+ *
+ * A hit needs a ready future of its own, which is made after the cache lock
+ * is released.  Callers that only want a value should use get_or_load(),
+ * which returns hits without making a future at all.
+ *
+ * @param key The key
+ * @param loader Called with the key to produce the value on a miss
+ * @return A future holding the value or the loader's exception
+ */
+template<class K, class V> std::shared_future<V> LoadingCache<K,V>::
+get_or_load_async(const K& key, Loader loader)
+{
+    V value;
+    std::shared_future<V> future;
+    Promise promise;
+
+    Lookup found = start_load(key, value, future, promise);
+    if (found == Lookup::Hit) {
+        std::promise<V> ready;
+        ready.set_value(std::move(value));
+        return ready.get_future().share();
+    }
+    if (found == Lookup::InFlight) {
+        return future;
+    }
+
+    ThreadPool* pool;
+    {
+        std::lock_guard<std::recursive_mutex> lock(Q::m);
+        pool = m_loaderPool;
+    }
+
+    K keyCopy = key;
+    if (!pool || !pool->push_job([this, keyCopy, loader, promise]() { run_load(keyCopy, loader, promise); })) {
+        run_load(key, loader, promise);
+    }
+    return future;
+}
+}
@@ -0,0 +1,526 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file LockFreeQueue.tcc
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TSQueue.tcc"
+
+#ifndef ACL_CACHE_LINE_SIZE
+#define ACL_CACHE_LINE_SIZE 64          //!< Assumed size of a cache line for padding
+#endif
+
+#define LOCKFREE_QUEUE_SPIN_COUNT 128   //!< Polls before a waiter yields
+#define LOCKFREE_QUEUE_YIELD_COUNT 16   //!< Yields before a waiter blocks
+
+namespace acl
+{
+
+/**
+ * @brief Hybrid spin-then-block wait used by the lock-free queues.
+ *
+ * Waiters first poll the condition, then yield, and finally block on a
+ * condition variable.  Notifiers only touch the mutex when somebody is
+ * blocked, so the uncontended path is a fence and an atomic load.
+ */
+class LockFreeQueueWaiter
+{
+public:
+    LockFreeQueueWaiter(): m_waiters(0) {}
+
+    /**
+     * @brief Waits until the predicate returns true or the timeout expires.
+     *
+     * @param p Predicate to test; may have side effects (such as removing
+     *          an element) when it returns true.
+     * @param timeout Milliseconds to wait.  A timeout of 0 tests once.
+     * @return true if the predicate returned true
+     */
+    template<typename Pred> bool wait(Pred p, uint16_t timeout)
+    {
+        if (p()) {
+            return true;
+        }
+        if (!timeout) {
+            return false;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        for (int i = 0; i < LOCKFREE_QUEUE_SPIN_COUNT; i++) {
+            if (p()) {
+                return true;
+            }
+        }
+        for (int i = 0; i < LOCKFREE_QUEUE_YIELD_COUNT; i++) {
+            std::this_thread::yield();
+            if (p()) {
+                return true;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool rc = m_cv.wait_until(lock, deadline, p);
+        m_waiters.fetch_sub(1);
+        return rc;
+    }
+
+    /**
+     * @brief Wakes all blocked waiters.  Call after publishing a change.
+     */
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_all();
+        }
+    }
+
+private:
+    std::mutex m_mutex;                 //!< Mutex for blocked waiters
+    std::condition_variable m_cv;       //!< Condition variable for blocked waiters
+    std::atomic_int m_waiters;          //!< Number of blocked waiters
+};
+
+/**
+ * @brief Rounds a requested capacity up to a power of two (minimum 2)
+ */
+inline size_t lockFreeQueueCapacity(size_t requested)
+{
+    size_t capacity = 2;
+    while (capacity < requested) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/**
+* @brief A bounded, lock-free, single-producer/single-consumer queue
+*
+* Exactly one thread may call enqueue() and exactly one thread may call
+* dequeue()/delete_all() at any time.  The interface follows TSQueue:
+* enqueue() fails when the queue is full, dequeue() waits up to the timeout
+* in milliseconds (spinning briefly before blocking).
+*
+* The capacity is fixed at construction and rounded up to a power of two.
+* set_max_size() may lower the usable size below the capacity but
+* cannot raise it above.
+*
+* @tparam T The type of data to be contained in the queue.  Must be default
+*           constructible.
+*/
+template <typename T> class SPSCQueue
+{
+public:
+    SPSCQueue(size_t capacity = 1024);
+    virtual ~SPSCQueue() {}
+
+    bool enqueue(const T& data, bool force = false);    //<! Add data to the tail of the queue
+    bool dequeue(T& data, uint16_t timeout = 0);        //<! Remove and return data from the head of the queue
+    size_t size() const;                                //<! Return the size of the queue
+    bool empty() const;                                 //<! Returns true if the queue is empty
+    size_t capacity() const;                            //<! Returns the fixed capacity
+    void delete_all();                                  //<! Deletes all elements (consumer only)
+    void set_max_size(size_t size);                     //<! Sets max size
+    size_t get_max_size() const;                        //<! Returns max size
+    bool wait_until_empty(uint16_t timeout = 0);        //<! Waits until queue is empty
+
+protected:
+    bool try_dequeue(T& data);                          //<! Non-blocking dequeue
+
+    std::vector<T> m_buffer;                            //<! Ring storage
+    size_t m_mask;                                      //<! Capacity - 1
+    std::atomic_size_t m_maxSize;                       //<! Maximum size of queue
+    LockFreeQueueWaiter m_dataWaiter;                   //<! Consumers waiting for data
+    LockFreeQueueWaiter m_emptyWaiter;                  //<! Threads waiting for the queue to drain
+
+    char m_pad0[ACL_CACHE_LINE_SIZE];
+    std::atomic_size_t m_head;                          //<! Next index to read (owned by consumer)
+    size_t m_cachedTail = 0;                            //<! Consumer's copy of m_tail
+    char m_pad1[ACL_CACHE_LINE_SIZE];
+    std::atomic_size_t m_tail;                          //<! Next index to write (owned by producer)
+    size_t m_cachedHead = 0;                            //<! Producer's copy of m_head
+    char m_pad2[ACL_CACHE_LINE_SIZE];
+};
+
+/**
+* @brief Constructor
+*
+* @param capacity Number of elements the queue can hold (rounded up to a power of two)
+**/
+template<typename T> SPSCQueue<T>::SPSCQueue(size_t capacity)
+    : m_buffer(lockFreeQueueCapacity(capacity)), m_mask(m_buffer.size() - 1),
+      m_maxSize(DEFAULT_MAX_SIZE), m_head(0), m_tail(0)
+{ }
+
+/**
+* @brief Adds an element to the tail of the queue.  Producer thread only.
+*
+* @param data The data to be added
+* @param force True ignores max_size (but not the capacity)
+* @return false if the queue is full
+*/
+template<typename T> bool SPSCQueue<T>::enqueue(const T& data, bool force)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t limit = m_buffer.size();
+    if (!force && m_maxSize.load(std::memory_order_relaxed) < limit) {
+        limit = m_maxSize.load(std::memory_order_relaxed);
+    }
+
+    if (tail - m_cachedHead >= limit) {
+        m_cachedHead = m_head.load(std::memory_order_acquire);
+        if (tail - m_cachedHead >= limit) {
+            return false;
+        }
+    }
+
+    m_buffer[tail & m_mask] = data;
+    m_tail.store(tail + 1, std::memory_order_release);
+    m_dataWaiter.notify();
+    return true;
+}
+
+/**
+* @brief Removes the head of the queue without waiting.  Consumer thread only.
+*/
+template<typename T> bool SPSCQueue<T>::try_dequeue(T& data)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_cachedTail) {
+        m_cachedTail = m_tail.load(std::memory_order_acquire);
+        if (head == m_cachedTail) {
+            return false;
+        }
+    }
+
+    T& slot = m_buffer[head & m_mask];
+    data = std::move(slot);
+    slot = T();
+    m_head.store(head + 1, std::memory_order_release);
+
+    if (head + 1 == m_cachedTail) {
+        m_emptyWaiter.notify();
+    }
+    return true;
+}
+
+/**
+* @brief Removes and returns the head of the queue.  Consumer thread only.
+* @param timeout How long to wait in milliseconds.  0 does not wait.
+*
+* @return true if data was returned
+*/
+template<typename T> bool SPSCQueue<T>::dequeue(T& data, uint16_t timeout)
+{
+    return m_dataWaiter.wait([this, &data] { return try_dequeue(data); }, timeout);
+}
+
+/**
+* @brief Returns the number of items in the queue
+*/
+template<typename T> size_t SPSCQueue<T>::size() const
+{
+    size_t head = m_head.load(std::memory_order_acquire);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    return tail - head;
+}
+
+/**
+* @brief Returns true if the queue has no elements
+*/
+template<typename T> bool SPSCQueue<T>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+* @brief Returns the number of elements the queue can hold
+*/
+template<typename T> size_t SPSCQueue<T>::capacity() const
+{
+    return m_buffer.size();
+}
+
+/**
+* @brief Removes all elements.  Consumer thread only.
+*/
+template<typename T> void SPSCQueue<T>::delete_all()
+{
+    T data;
+    while (try_dequeue(data)) {}
+    m_emptyWaiter.notify();
+}
+
+/**
+* @brief Sets the maximum number of elements.  Values above the capacity
+* have no effect beyond the capacity.
+*/
+template<typename T> void SPSCQueue<T>::set_max_size(size_t size)
+{
+    m_maxSize = size;
+}
+
+/**
+* @brief Returns the maximum size set by set_max_size()
+*/
+template<typename T> size_t SPSCQueue<T>::get_max_size() const
+{
+    return m_maxSize;
+}
+
+/**
+ * @brief Waits until the queue is empty, then returns.
+ *
+ * @param timeout the maximum number of milliseconds to wait.
+ * NOTE: A timeout of 0 will wait indefinitely.
+ *
+ * @return true if queue got to 0, false if timeout occured
+ */
+template<typename T> bool SPSCQueue<T>::wait_until_empty(uint16_t timeout)
+{
+    if (!timeout) {
+        while (!m_emptyWaiter.wait([this] { return empty(); }, UINT16_MAX)) {}
+        return true;
+    }
+    return m_emptyWaiter.wait([this] { return empty(); }, timeout);
+}
+
+/**
+* @brief A bounded, lock-free, multi-producer/multi-consumer queue
+*
+* Each slot carries a sequence number that tells producers and consumers
+* whether it is free or filled, so threads only contend on the head or tail
+* counter they advance.  The interface follows TSQueue: enqueue() fails when
+* the queue is full, dequeue() waits up to the timeout in milliseconds
+* (spinning briefly before blocking).
+*
+* The capacity is fixed at construction and rounded up to a power of two.
+* set_max_size() may lower the usable size below the capacity, but it is
+* checked against an instantaneous size so concurrent producers may overshoot
+* it by at most one element each.
+*
+* @tparam T The type of data to be contained in the queue.  Must be default
+*           constructible.
+*/
+template <typename T> class MPMCQueue
+{
+public:
+    MPMCQueue(size_t capacity = 1024);
+    virtual ~MPMCQueue() {}
+
+    bool enqueue(const T& data, bool force = false);    //<! Add data to the tail of the queue
+    bool dequeue(T& data, uint16_t timeout = 0);        //<! Remove and return data from the head of the queue
+    size_t size() const;                                //<! Return the size of the queue
+    bool empty() const;                                 //<! Returns true if the queue is empty
+    size_t capacity() const;                            //<! Returns the fixed capacity
+    void delete_all();                                  //<! Deletes all elements
+    void set_max_size(size_t size);                     //<! Sets max size
+    size_t get_max_size() const;                        //<! Returns max size
+    bool wait_until_empty(uint16_t timeout = 0);        //<! Waits until queue is empty
+
+protected:
+    struct Cell {
+        std::atomic_size_t sequence;                    //<! Position this cell is ready for
+        T data;
+    };
+
+    bool try_dequeue(T& data);                          //<! Non-blocking dequeue
+
+    std::vector<Cell> m_buffer;                         //<! Ring storage
+    size_t m_mask;                                      //<! Capacity - 1
+    std::atomic_size_t m_maxSize;                       //<! Maximum size of queue
+    LockFreeQueueWaiter m_dataWaiter;                   //<! Consumers waiting for data
+    LockFreeQueueWaiter m_emptyWaiter;                  //<! Threads waiting for the queue to drain
+
+    char m_pad0[ACL_CACHE_LINE_SIZE];
+    std::atomic_size_t m_enqueuePos;                    //<! Next position to write
+    char m_pad1[ACL_CACHE_LINE_SIZE];
+    std::atomic_size_t m_dequeuePos;                    //<! Next position to read
+    char m_pad2[ACL_CACHE_LINE_SIZE];
+};
+
+/**
+* @brief Constructor
+*
+* @param capacity Number of elements the queue can hold (rounded up to a power of two)
+**/
+template<typename T> MPMCQueue<T>::MPMCQueue(size_t capacity)
+    : m_buffer(lockFreeQueueCapacity(capacity)), m_mask(m_buffer.size() - 1),
+      m_maxSize(DEFAULT_MAX_SIZE), m_enqueuePos(0), m_dequeuePos(0)
+{
+    for (size_t i = 0; i < m_buffer.size(); i++) {
+        m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+/**
+* @brief Adds an element to the tail of the queue
+*
+* @param data The data to be added
+* @param force True ignores max_size (but not the capacity)
+* @return false if the queue is full
+*/
+template<typename T> bool MPMCQueue<T>::enqueue(const T& data, bool force)
+{
+    if (!force && size() >= m_maxSize.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    Cell* cell;
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &m_buffer[pos & m_mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // Full
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->data = data;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    m_dataWaiter.notify();
+    return true;
+}
+
+/**
+* @brief Removes the head of the queue without waiting
+*/
+template<typename T> bool MPMCQueue<T>::try_dequeue(T& data)
+{
+    Cell* cell;
+    size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &m_buffer[pos & m_mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+        if (diff == 0) {
+            if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // Empty
+        } else {
+            pos = m_dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    data = std::move(cell->data);
+    cell->data = T();
+    cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+    if (empty()) {
+        m_emptyWaiter.notify();
+    }
+    return true;
+}
+
+/**
+* @brief Removes and returns the head of the queue
+* @param timeout How long to wait in milliseconds.  0 does not wait.
+*
+* @return true if data was returned
+*/
+template<typename T> bool MPMCQueue<T>::dequeue(T& data, uint16_t timeout)
+{
+    return m_dataWaiter.wait([this, &data] { return try_dequeue(data); }, timeout);
+}
+
+/**
+* @brief Returns the number of items in the queue.  This is a snapshot and
+* may be stale by the time it is returned.
+*/
+template<typename T> size_t MPMCQueue<T>::size() const
+{
+    size_t dequeuePos = m_dequeuePos.load(std::memory_order_acquire);
+    size_t enqueuePos = m_enqueuePos.load(std::memory_order_acquire);
+    if (enqueuePos <= dequeuePos) {
+        return 0;
+    }
+    return enqueuePos - dequeuePos;
+}
+
+/**
+* @brief Returns true if the queue has no elements
+*/
+template<typename T> bool MPMCQueue<T>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+* @brief Returns the number of elements the queue can hold
+*/
+template<typename T> size_t MPMCQueue<T>::capacity() const
+{
+    return m_buffer.size();
+}
+
+/**
+* @brief Removes all elements present when the call is made
+*/
+template<typename T> void MPMCQueue<T>::delete_all()
+{
+    T data;
+    while (try_dequeue(data)) {}
+    m_emptyWaiter.notify();
+}
+
+/**
+* @brief Sets the maximum number of elements.  Values above the capacity
+* have no effect beyond the capacity.
+*/
+template<typename T> void MPMCQueue<T>::set_max_size(size_t size)
+{
+    m_maxSize = size;
+}
+
+/**
+* @brief Returns the maximum size set by set_max_size()
+*/
+template<typename T> size_t MPMCQueue<T>::get_max_size() const
+{
+    return m_maxSize;
+}
+
+/**
+ * @brief Waits until the queue is empty, then returns.
+ *
+ * @param timeout the maximum number of milliseconds to wait.
+ * NOTE: A timeout of 0 will wait indefinitely.
+ *
+ * @return true if queue got to 0, false if timeout occured
+ */
+template<typename T> bool MPMCQueue<T>::wait_until_empty(uint16_t timeout)
+{
+    if (!timeout) {
+        while (!m_emptyWaiter.wait([this] { return empty(); }, UINT16_MAX)) {}
+        return true;
+    }
+    return m_emptyWaiter.wait([this] { return empty(); }, timeout);
+}
+}
@@ -10,11 +10,15 @@
 #pragma once
 
 #include "TSQueue.tcc"
+#include "CachePolicy.tcc"
+#include "ThreadPool.h"
 #include <map>
+#include <vector>
 #include <fstream>
 #include <assert.h>
 #include <random>
 #include "Timer.h"
+#include "Metrics.hpp"
 #include <mutex>
 #include <future>
 #include <ctime>
@@ -31,43 +35,77 @@ template<class K, class V> struct CacheNode {
     //TODO: Try to add this to the LruCache class.  Probably won't work due to inheritance
     K key;
     V value;
+    size_t cost = 1;    //<! Cost charged against the cache's max cost
 };
 
 /**
  * @brief A thread-safe LRU Cache implementaiton.
  *
+ * Keys are kept in an ordered map so that get_lower_bound() is available.
+ * ShardedLruCache is faster for exact-match lookups from many threads.
+ *
  * @tparam K The key class used to access elements
  * @tparam V The cached object type
  */
 template<class K, class V> class LruCache: protected TSQueue<CacheNode<K,V>>
 {
-private:
+protected:
     typedef TSQueue<CacheNode<K,V>> Q;
 
 public:
+    LruCache();
     virtual ~LruCache();
     virtual bool add_to_cache(K, V);
     virtual bool get_value(K, V&);
     virtual bool get_lower_bound(K, V&);
     virtual void empty_cache();
     virtual void setCleanupHandler(std::function<bool(K, V)> handler=nullptr);
+    virtual void setCostFunction(std::function<size_t(const K&, const V&)> cost=nullptr);
+    virtual void setCleanupPool(ThreadPool* pool=nullptr);
+    virtual void set_max_cost(size_t);
+    virtual size_t get_max_cost();
+    virtual size_t get_total_cost();
+    virtual void wait_for_cleanup();
+    virtual void setAdmissionPolicy(std::shared_ptr<AdmissionPolicy<K>> policy=nullptr);
+    virtual CacheStats get_stats();
+    virtual void reset_stats();
     using Q::size;
     using Q::set_max_size;
     using Q::get_max_size;
 
 protected:
     typedef typename Q::QNode QNode;      //<! Defining QNode
+    typedef std::vector<std::shared_ptr<QNode>> NodeList;
     virtual bool push_to_back(std::shared_ptr<QNode>);
+    virtual void collect_victims(size_t cost, NodeList& victims);   //<! Mutex must be held
+    virtual void reinsert(const NodeList& nodes);                   //<! Mutex must be held
+    NodeList run_cleanup(const std::function<bool(K, V)>& handler, const NodeList& victims);
+
     std::map<K, std::weak_ptr<QNode>> keyMap;         // map of Key to weak pointer to QNodes
     std::function<bool(K, V)> m_cleanupHandler;
+    std::function<size_t(const K&, const V&)> m_costFunction;   //<! Cost of an entry; 1 if not set
+    size_t m_maxCost = DEFAULT_MAX_SIZE;                        //<! Maximum total cost
+    size_t m_totalCost = 0;                                     //<! Total cost of all entries
+    ThreadPool* m_cleanupPool = nullptr;                        //<! Pool running the cleanup handler
+    size_t m_pendingCleanups = 0;                               //<! Cleanup jobs queued on the pool
+    std::shared_ptr<AdmissionPolicy<K>> m_admissionPolicy;      //<! Filters insertions into a full cache
+    CacheCounters m_counters;                                   //<! Hit, miss and eviction counts
+    std::condition_variable_any m_cleanupCv;                    //<! Signalled when a cleanup job finishes
 };
 
+/*
+ * @brief Constructor
+ */
+template<class K, class V> LruCache<K,V>::
+LruCache() {}
+
 /*
  * @brief Destructor.  Calls empty_cache()
  */
 template<class K, class V> LruCache<K,V>::
 ~LruCache()
 {
+    wait_for_cleanup();
     empty_cache();
 }
 
@@ -79,6 +117,7 @@ empty_cache()
 {
     std::lock_guard<std::recursive_mutex> lock(Q::m);
     keyMap.clear();
+    m_totalCost = 0;
     Q::delete_all();   //Recursive mutex allows for multiple locks from the same thread
 }
 
@@ -92,9 +131,116 @@ empty_cache()
 template<class K, class V> void LruCache<K,V>::
 setCleanupHandler(std::function<bool(K,V)> handler)
 {
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
     m_cleanupHandler = handler;
 }
 
+/**
+ * @brief Sets the function that reports the cost of an entry, such as its size in bytes.
+ *
+ * The cost is computed once when the entry is added.  Without a cost function
+ * every entry costs 1.  Entries already in the cache keep their cost.
+ *
+ * @param std::function cost the function
+ */
+template<class K, class V> void LruCache<K,V>::
+setCostFunction(std::function<size_t(const K&, const V&)> cost)
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    m_costFunction = cost;
+}
+
+/**
+ * @brief Runs the cleanup handler on a thread pool instead of the inserting thread.
+ *
+ * Each add_to_cache() that evicts submits one job for all of its victims.  The
+ * victims leave the cache immediately; any the handler refuses are put back as
+ * most recently used unless their key has been added again in the meantime.
+ * If the pool will not take the job, the handler runs on the inserting thread.
+ *
+ * @param pool The pool to use, or nullptr to run the handler synchronously.  The
+ *      pool must outlive the cache.
+ */
+template<class K, class V> void LruCache<K,V>::
+setCleanupPool(ThreadPool* pool)
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    m_cleanupPool = pool;
+}
+
+/**
+ * @brief Sets the maximum total cost of the cache.  Entries are evicted when
+ *      either the maximum size or the maximum cost would be exceeded.
+ */
+template<class K, class V> void LruCache<K,V>::
+set_max_cost(size_t cost)
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    m_maxCost = cost;
+}
+
+/**
+ * @brief Returns the maximum total cost of the cache
+ */
+template<class K, class V> size_t LruCache<K,V>::
+get_max_cost()
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    return m_maxCost;
+}
+
+/**
+ * @brief Returns the total cost of the entries in the cache
+ */
+template<class K, class V> size_t LruCache<K,V>::
+get_total_cost()
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    return m_totalCost;
+}
+
+/**
+ * @brief Sets the policy that decides whether a new entry may displace the least
+ *      recently used one when the cache is full.  Without a policy every new
+ *      entry is admitted (plain LRU).
+ *
+ * @param policy The policy, such as a TinyLfuAdmission.  May be shared between caches.
+ */
+template<class K, class V> void LruCache<K,V>::
+setAdmissionPolicy(std::shared_ptr<AdmissionPolicy<K>> policy)
+{
+    std::lock_guard<std::recursive_mutex> lock(Q::m);
+    m_admissionPolicy = policy;
+}
+
+/**
+ * @brief Returns the hit, miss, eviction and rejection counts
+ */
+template<class K, class V> CacheStats LruCache<K,V>::
+get_stats()
+{
+    return m_counters.snapshot();
+}
+
+/**
+ * @brief Resets the hit, miss, eviction and rejection counts
+ */
+template<class K, class V> void LruCache<K,V>::
+reset_stats()
+{
+    m_counters.reset();
+}
+
+/**
+ * @brief Blocks until all cleanup jobs submitted to the cleanup pool have finished
+ */
+template<class K, class V> void LruCache<K,V>::
+wait_for_cleanup()
+{
+    std::unique_lock<std::recursive_mutex> lock(Q::m);
+    m_cleanupCv.wait(lock, [this] {return m_pendingCleanups == 0;});
+}
+
 /**
  * @brief Retrieves the value pointed to by this key
  *
@@ -108,25 +254,29 @@ get_value(K key, V& val)
 {
     std::lock_guard<std::recursive_mutex> lock(Q::m);
 
-    if (!keyMap.count(key)) {
-        return false;
-    } else if (keyMap[key].expired()) {
-        std::cerr << "WE SHOULDN'T SEE THIS OR WE HAVE A PROBLEM" << std::endl;
-        std::cerr << "map size: " << keyMap.size() << " length: " << Q::length;
-        auto node = Q::head;
-        int i = 0;
-
-        while (node) {
-            i++;
-            node = node->prev;
+    auto it = keyMap.find(key);
+    if (it == keyMap.end()) {
+        m_counters.misses++;
+        ACL_METRIC_COUNT("LruCache.misses", 1);
+        if (m_admissionPolicy) {
+            m_admissionPolicy->record_access(key);
         }
+        return false;
+    }
 
-        keyMap.erase(key);
-        //std::cout << " real len: " << i << std::endl;
+    auto node = it->second.lock();
+    if (!node) {
+        std::cerr << "WE SHOULDN'T SEE THIS OR WE HAVE A PROBLEM" << std::endl;
+        std::cerr << "map size: " << keyMap.size() << " length: " << Q::length << std::endl;
+        keyMap.erase(it);
         return false;
     }
 
-    auto node = keyMap[key].lock();
+    m_counters.hits++;
+    ACL_METRIC_COUNT("LruCache.hits", 1);
+    if (m_admissionPolicy) {
+        m_admissionPolicy->record_access(it->first);
+    }
     val = node->data.value;
     push_to_back(node);
     return true;
@@ -145,118 +295,200 @@ get_lower_bound(K key, V& val)
 {
     std::lock_guard<std::recursive_mutex> lock(Q::m);
 
-    if (keyMap.lower_bound(key) == keyMap.end()) {
-        return false;
-    } else if (keyMap.lower_bound(key)->second.expired()) {
-        std::cerr << "WE SHOULDN'T SEE THIS OR WE HAVE A PROBLEM" << std::endl;
-        std::cerr << "map size: " << keyMap.size() << " length: " << Q::length;
-        auto node = Q::head;
-        int i = 0;
-
-        while (node) {
-            i++;
-            node = node->prev;
+    auto it = keyMap.lower_bound(key);
+    if (it == keyMap.end()) {
+        m_counters.misses++;
+        ACL_METRIC_COUNT("LruCache.misses", 1);
+        if (m_admissionPolicy) {
+            m_admissionPolicy->record_access(key);
         }
+        return false;
+    }
 
-        keyMap.erase(key);
-        //std::cout << " real len: " << i << std::endl;
+    auto node = it->second.lock();
+    if (!node) {
+        std::cerr << "WE SHOULDN'T SEE THIS OR WE HAVE A PROBLEM" << std::endl;
+        std::cerr << "map size: " << keyMap.size() << " length: " << Q::length << std::endl;
+        keyMap.erase(it);
         return false;
     }
 
-    auto node = keyMap.lower_bound(key)->second.lock();
+    m_counters.hits++;
+    ACL_METRIC_COUNT("LruCache.hits", 1);
+    if (m_admissionPolicy) {
+        m_admissionPolicy->record_access(it->first);
+    }
     val = node->data.value;
     push_to_back(node);
     return true;
 }
 
 /**
- * @brief This function creates a CacheNode which contains a key and a value,
- *      then adds it to the queue.
+ * @brief Removes least recently used entries until an entry of the given cost
+ *      fits within both the maximum size and maximum cost.  The mutex must be held.
  *
- * @param key The key
- * @param value The value
- * @param force true will push data even if the length is greater than max_size
- *
- * @return
+ * @param cost The cost of the entry about to be added
+ * @param[out] victims The removed nodes, oldest first
  */
-template<class K, class V> bool LruCache<K,V>::
-add_to_cache(K key, V value)
+template<class K, class V> void LruCache<K,V>::
+collect_victims(size_t cost, NodeList& victims)
 {
-    std::unique_lock<std::recursive_mutex> lock(Q::m);
-
-    //Check to see if something needs booted
-    int count = 0;
-    while (Q::length >= Q::max_size && count < 5) {  //Try to boot 5 times.  If still too big, give up.
-        if (!Q::head) {
-            std::cerr << "LruCache::add_to_cache ERROR: Head is null but length is non-zero." << std::endl;
-            break;
-        }
-
+    while (Q::head && (Q::length >= Q::max_size || m_totalCost + cost > m_maxCost)) {
         std::shared_ptr<QNode> temp = Q::head;
         Q::head = Q::head->prev;
         temp->prev = nullptr;
 
         if (Q::head) {
             Q::head->next.reset();
+        } else {
+            Q::tail.reset();            // The victim is still alive, so enqueue would find it
         }
 
         Q::length--;
+        m_totalCost -= temp->data.cost;
         if (keyMap.erase(temp->data.key) == 0) {
-            std::cerr << "LruCache::add_to_cache ERROR: keyMap could not find key" 
-                      << std::endl;
-            //std::cout << "length: " << Q::length << std::endl;
-            //std::cout << "size: " << keyMap.size() << std::endl;
-            auto it = Q::head;
-            int i = 0;
-
-            while(it != nullptr) {
-                it = it->prev;
-                i++;
-            }
-
-            //std::cout << "actual length: " << i << std::endl;
+            std::cerr << "LruCache::add_to_cache ERROR: keyMap could not find key" << std::endl;
+        }
+        victims.push_back(temp);
+    }
+}
+
+/**
+ * @brief Puts nodes back as the most recently used.  Nodes whose key has been
+ *      re-added are dropped.  The mutex must be held.
+ */
+template<class K, class V> void LruCache<K,V>::
+reinsert(const NodeList& nodes)
+{
+    for (auto& node : nodes) {
+        if (keyMap.emplace(node->data.key, node).second) {
+            node->next.reset();
+            node->prev = nullptr;
+            Q::enqueue(node);
+            m_totalCost += node->data.cost;
         }
+    }
+}
 
-        if (m_cleanupHandler) {
-            lock.unlock();
-            bool boot = m_cleanupHandler(temp->data.key, temp->data.value);
-            lock.lock();
+/**
+ * @brief Calls the cleanup handler for each victim.  The mutex must not be held.
+ *
+ * @return The victims the handler refused to boot
+ */
+template<class K, class V> typename LruCache<K,V>::NodeList LruCache<K,V>::
+run_cleanup(const std::function<bool(K, V)>& handler, const NodeList& victims)
+{
+    NodeList refused;
+    for (auto& node : victims) {
+        if (!handler(node->data.key, node->data.value)) {
+            refused.push_back(node);
+        }
+    }
+    return refused;
+}
 
-            if (!boot) {
-                auto it = keyMap.emplace(temp->data.key, temp);
+/**
+ * @brief This function creates a CacheNode which contains a key and a value,
+ *      then adds it to the queue.
+ *
+ * Least recently used entries are evicted first if the new entry would
+ * exceed the maximum size or cost.  The cleanup handler is called once per
+ * victim without the lock held, either on this thread or as one batch on
+ * the cleanup pool.  Refused victims are put back in a single pass, so the
+ * cache may briefly exceed its limits until the next insertion.
+ *
+ * @param key The key
+ * @param value The value
+ *
+ * @return false if the key is already cached, the entry's cost exceeds the maximum
+ *      cost, or the admission policy rejected it
+ */
+template<class K, class V> bool LruCache<K,V>::
+add_to_cache(K key, V value)
+{
+    NodeList victims;               // Declared first so victims are released after the lock
+    std::unique_lock<std::recursive_mutex> lock(Q::m);
 
-                if (it.second) {
-                    Q::enqueue(temp);
-                } else {
-                    std::cerr << "LruCache::add_to_cache ERROR: couldn't resubmit after failed boot" << std::endl;
-                }
+    if (keyMap.count(key)) {
+        return false;
+    }
+
+    size_t cost = m_costFunction ? m_costFunction(key, value) : 1;
+    if (cost > m_maxCost) {
+        return false;
+    }
+
+    // A full cache asks the admission policy whether the new entry is worth
+    // more than the least recently used one
+    if (m_admissionPolicy) {
+        m_admissionPolicy->record_access(key);
+        if (Q::head && (Q::length >= Q::max_size || m_totalCost + cost > m_maxCost) &&
+                !m_admissionPolicy->admit(key, Q::head->data.key)) {
+            m_counters.rejections++;
+            ACL_METRIC_COUNT("LruCache.rejections", 1);
+            return false;
+        }
+    }
+
+    //Check to see if something needs booted
+    collect_victims(cost, victims);
+    m_counters.evictions += victims.size();
+    ACL_METRIC_COUNT("LruCache.evictions", victims.size());
+
+    if (!victims.empty() && m_cleanupHandler) {
+        std::function<bool(K, V)> handler = m_cleanupHandler;
+        ThreadPool* pool = m_cleanupPool;
+        bool queued = false;
+
+        // The lock is released before submitting: a full blocking pool would
+        // otherwise wait here while its workers wait for the lock in the job
+        if (pool) {
+            m_pendingCleanups++;
+        }
+        lock.unlock();
+        if (pool) {
+            queued = pool->push_job([this, handler, victims]() {
+                NodeList refused = run_cleanup(handler, victims);
+
+                std::lock_guard<std::recursive_mutex> lock(Q::m);
+                reinsert(refused);
+                m_pendingCleanups--;
+                m_cleanupCv.notify_all();
+            });
+        }
+        NodeList refused;
+        if (!queued) {
+            refused = run_cleanup(handler, victims);
+        }
+        lock.lock();
 
-                count++;
-                continue;
-            }
+        if (pool && !queued) {
+            m_pendingCleanups--;
+            m_cleanupCv.notify_all();
         }
+        reinsert(refused);
     }
 
     // Create a CacheNode to put in the queue
     CacheNode<K,V> node;
     node.key = key;
-    node.value = value;
+    node.value = std::move(value);
+    node.cost = cost;
 
     // Create a QNode pointer out of that CacheNode
-    std::shared_ptr<QNode> temp = std::shared_ptr<QNode>(new QNode(node));
+    std::shared_ptr<QNode> temp = std::shared_ptr<QNode>(new QNode(std::move(node)));
 
-    // Put the key in the keySet
+    // Put the key in the keySet.  The lock may have been released for the cleanup handler.
     auto it = keyMap.emplace(key, temp);
 
     if (!it.second) {
-        //std::cerr << "LruCache::add_to_cache ERROR: Failed to add element to map." 
-        //          << std::endl;
         return false;
     }
 
     // Enqueue the CacheNode and notify of a new object in the queue
     Q::enqueue(temp); //Recursive mutex allows for multiple locks from the same thread
     Q::enqueue_cv.notify_one();
+    m_totalCost += cost;
     return true;
 }
 
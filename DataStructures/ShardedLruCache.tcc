@@ -0,0 +1,413 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file ShardedLruCache.tcc
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "TSQueue.tcc"
+#include "CachePolicy.tcc"
+#include "Metrics.hpp"
+
+namespace acl
+{
+
+/**
+ * @brief A thread-safe LRU Cache indexed by a hash table and split into
+ *      independently locked shards.
+ *
+ * Each shard holds an unordered_map whose entries are threaded onto an
+ * intrusive doubly linked list in least- to most-recently-used order, so
+ * lookups, insertions and evictions are O(1) and only contend with other
+ * threads that hit the same shard.
+ *
+ * The maximum size is divided as evenly as possible between the shards so
+ * that their limits add up to get_max_size(), and each shard evicts on its
+ * own, so the cache may begin evicting before the total reaches
+ * get_max_size() when keys are unevenly distributed.
+ *
+ * Use LruCache when ordered access such as get_lower_bound() is needed.
+ *
+ * @tparam K The key class used to access elements
+ * @tparam V The cached object type
+ * @tparam Hash Hash function for K
+ */
+template<class K, class V, class Hash = std::hash<K>> class ShardedLruCache
+{
+public:
+    ShardedLruCache(size_t numShards = 16);
+    virtual ~ShardedLruCache();
+    virtual bool add_to_cache(const K&, V);
+    virtual bool get_value(const K&, V&);
+    virtual void empty_cache();
+    virtual void setCleanupHandler(std::function<bool(K, V)> handler=nullptr);
+    virtual size_t size();
+    virtual void set_max_size(size_t);
+    virtual size_t get_max_size();
+    size_t get_num_shards() const;
+    virtual void setAdmissionPolicy(std::shared_ptr<AdmissionPolicy<K>> policy=nullptr);
+    virtual CacheStats get_stats();
+    virtual void reset_stats();
+
+protected:
+    struct Entry {
+        Entry(V&& v): value(std::move(v)) {}
+
+        V value;
+        const K* key = nullptr;     //<! Points at the key stored in the map
+        Entry* prev = nullptr;      //<! Entry used less recently
+        Entry* next = nullptr;      //<! Entry used more recently
+    };
+
+    struct Shard {
+        std::mutex m;                                   //<! Protects everything in the shard
+        std::unordered_map<K, Entry, Hash> map;         //<! Entries by key
+        Entry* head = nullptr;                          //<! Least recently used entry
+        Entry* tail = nullptr;                          //<! Most recently used entry
+        size_t max_size = DEFAULT_MAX_SIZE;             //<! Maximum entries in this shard
+    };
+
+    Shard& shard_for(const K& key);
+    bool insert(Shard& shard, const K& key, V&& value);     //<! Lock must be held
+    void unlink(Shard& shard, Entry* entry);                //<! Lock must be held
+    void link_back(Shard& shard, Entry* entry);             //<! Lock must be held
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    size_t m_shardMask;                                     //<! Number of shards - 1
+    std::atomic_size_t m_length;                            //<! Entries across all shards
+    std::atomic_size_t m_maxSize;                           //<! Maximum entries across all shards
+    Hash m_hash;
+    std::function<bool(K, V)> m_cleanupHandler;
+    std::shared_ptr<AdmissionPolicy<K>> m_admissionPolicy;  //<! Filters insertions into a full shard
+    CacheCounters m_counters;                               //<! Hit, miss and eviction counts
+};
+
+/**
+ * @brief Constructor
+ *
+ * @param numShards Number of independently locked shards.  Rounded up to a power of two.
+ */
+template<class K, class V, class Hash> ShardedLruCache<K,V,Hash>::
+ShardedLruCache(size_t numShards): m_length(0), m_maxSize(DEFAULT_MAX_SIZE)
+{
+    size_t count = 1;
+    while (count < numShards) {
+        count <<= 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        m_shards.push_back(std::unique_ptr<Shard>(new Shard));
+    }
+    m_shardMask = count - 1;
+    set_max_size(DEFAULT_MAX_SIZE);
+}
+
+/*
+ * @brief Destructor.  Calls empty_cache()
+ */
+template<class K, class V, class Hash> ShardedLruCache<K,V,Hash>::
+~ShardedLruCache()
+{
+    empty_cache();
+}
+
+/**
+ * @brief Returns the shard responsible for a key.
+ *
+ * The hash is remixed so that the shard index does not use the same bits
+ * the shard's own hash table buckets on.
+ */
+template<class K, class V, class Hash> typename ShardedLruCache<K,V,Hash>::Shard&
+ShardedLruCache<K,V,Hash>::shard_for(const K& key)
+{
+    uint64_t h = static_cast<uint64_t>(m_hash(key));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return *m_shards[h & m_shardMask];
+}
+
+/**
+ * @brief Removes an entry from its shard's list.  The lock must be held.
+ */
+template<class K, class V, class Hash> void ShardedLruCache<K,V,Hash>::
+unlink(Shard& shard, Entry* entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        shard.head = entry->next;
+    }
+
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        shard.tail = entry->prev;
+    }
+
+    entry->prev = nullptr;
+    entry->next = nullptr;
+}
+
+/**
+ * @brief Appends an entry as the most recently used.  The lock must be held.
+ */
+template<class K, class V, class Hash> void ShardedLruCache<K,V,Hash>::
+link_back(Shard& shard, Entry* entry)
+{
+    entry->prev = shard.tail;
+    entry->next = nullptr;
+
+    if (shard.tail) {
+        shard.tail->next = entry;
+    } else {
+        shard.head = entry;
+    }
+    shard.tail = entry;
+}
+
+/**
+ * @brief Inserts a new entry as the most recently used.  The lock must be held.
+ *
+ * @return false if the key already exists
+ */
+template<class K, class V, class Hash> bool ShardedLruCache<K,V,Hash>::
+insert(Shard& shard, const K& key, V&& value)
+{
+    auto it = shard.map.emplace(key, Entry(std::move(value)));
+    if (!it.second) {
+        return false;
+    }
+
+    Entry* entry = &it.first->second;
+    entry->key = &it.first->first;
+    link_back(shard, entry);
+    m_length++;
+    return true;
+}
+
+/**
+ * @brief Empties every shard
+ */
+template<class K, class V, class Hash> void ShardedLruCache<K,V,Hash>::
+empty_cache()
+{
+    for (auto& shard : m_shards) {
+        std::lock_guard<std::mutex> lock(shard->m);
+        m_length -= shard->map.size();
+        shard->map.clear();
+        shard->head = nullptr;
+        shard->tail = nullptr;
+    }
+}
+
+/**
+ * @brief Sets the function that is called when something is booted from the cache
+ *
+ * If this function returns false when called, the object will not be booted from the cache!
+ * The handler is called without any shard locked.  Set it before the cache is shared
+ * between threads.
+ *
+ * @param std::function handler the function
+ */
+template<class K, class V, class Hash> void ShardedLruCache<K,V,Hash>::
+setCleanupHandler(std::function<bool(K,V)> handler)
+{
+    m_cleanupHandler = handler;
+}
+
+/**
+ * @brief Retrieves the value pointed to by this key and marks it most recently used
+ *
+ * @param key The key
+ * @param[in] val The return value
+ *
+ * @return true on success.  False on a cache miss
+ */
+template<class K, class V, class Hash> bool ShardedLruCache<K,V,Hash>::
+get_value(const K& key, V& val)
+{
+    if (m_admissionPolicy) {
+        m_admissionPolicy->record_access(key);
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.m);
+
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        m_counters.misses++;
+        ACL_METRIC_COUNT("ShardedLruCache.misses", 1);
+        return false;
+    }
+
+    m_counters.hits++;
+    ACL_METRIC_COUNT("ShardedLruCache.hits", 1);
+    Entry* entry = &it->second;
+    val = entry->value;
+    if (entry != shard.tail) {
+        unlink(shard, entry);
+        link_back(shard, entry);
+    }
+    return true;
+}
+
+/**
+ * @brief Adds a key and value to the cache, evicting the least recently used
+ *      entries of the key's shard if it is full.
+ *
+ * @param key The key
+ * @param value The value
+ *
+ * @return false if the key is already in the cache, its shard has no capacity, or
+ *      the admission policy rejected it
+ */
+template<class K, class V, class Hash> bool ShardedLruCache<K,V,Hash>::
+add_to_cache(const K& key, V value)
+{
+    Shard& shard = shard_for(key);
+    std::unique_lock<std::mutex> lock(shard.m);
+
+    if (shard.map.count(key) || shard.max_size == 0) {
+        return false;
+    }
+
+    // A full shard asks the admission policy whether the new entry is worth
+    // more than the least recently used one
+    if (m_admissionPolicy) {
+        m_admissionPolicy->record_access(key);
+        if (shard.head && shard.map.size() >= shard.max_size &&
+                !m_admissionPolicy->admit(key, *shard.head->key)) {
+            m_counters.rejections++;
+            ACL_METRIC_COUNT("ShardedLruCache.rejections", 1);
+            return false;
+        }
+    }
+
+    //Check to see if something needs booted
+    int count = 0;
+    while (shard.map.size() >= shard.max_size && count < 5) {  //Try to boot 5 times.  If still too big, give up.
+        Entry* victim = shard.head;
+        if (!victim) {
+            break;
+        }
+
+        K victimKey = *victim->key;
+        V victimValue = std::move(victim->value);
+        unlink(shard, victim);
+        shard.map.erase(victimKey);
+        m_length--;
+        m_counters.evictions++;
+        ACL_METRIC_COUNT("ShardedLruCache.evictions", 1);
+
+        if (m_cleanupHandler) {
+            lock.unlock();
+            bool boot = m_cleanupHandler(victimKey, victimValue);
+            lock.lock();
+
+            if (!boot) {
+                if (!insert(shard, victimKey, std::move(victimValue))) {
+                    std::cerr << "ShardedLruCache::add_to_cache ERROR: couldn't resubmit after failed boot" << std::endl;
+                }
+                count++;
+            }
+        }
+    }
+
+    // The lock may have been released for the cleanup handler
+    return insert(shard, key, std::move(value));
+}
+
+/**
+ * @brief Returns the number of entries in the cache
+ */
+template<class K, class V, class Hash> size_t ShardedLruCache<K,V,Hash>::
+size()
+{
+    return m_length;
+}
+
+/**
+ * @brief Sets the maximum number of entries.  Each shard gets size / shards,
+ *      and the first size % shards get one more, so the limits add up to
+ *      size; with fewer entries than shards some shards cache nothing.
+ *      Shards above their new limit are trimmed on their next insertion.
+ */
+template<class K, class V, class Hash> void ShardedLruCache<K,V,Hash>::
+set_max_size(size_t size)
+{
+    m_maxSize = size;
+
+    size_t perShard = size / m_shards.size();
+    size_t remainder = size % m_shards.size();
+
+    for (size_t i = 0; i < m_shards.size(); i++) {
+        std::lock_guard<std::mutex> lock(m_shards[i]->m);
+        m_shards[i]->max_size = perShard + (i < remainder ? 1 : 0);
+    }
+}
+
+/**
+ * @brief Returns the maximum number of entries across all shards
+ */
+template<class K, class V, class Hash> size_t ShardedLruCache<K,V,Hash>::
+get_max_size()
+{
+    return m_maxSize;
+}
+
+/**
+ * @brief Returns the number of shards
+ */
+template<class K, class V, class Hash> size_t ShardedLruCache<K,V,Hash>::
+get_num_shards() const
+{
+    return m_shards.size();
+}
+
+/**
+ * @brief Sets the policy that decides whether a new entry may displace the least
+ *      recently used one when its shard is full.  Without a policy every new
+ *      entry is admitted (plain LRU).  Set it before the cache is shared
+ *      between threads.
+ *
+ * @param policy The policy, such as a TinyLfuAdmission.  May be shared between caches.
+ */
+template<class K, class V, class Hash> void ShardedLruCache<K,V,Hash>::
+setAdmissionPolicy(std::shared_ptr<AdmissionPolicy<K>> policy)
+{
+    m_admissionPolicy = policy;
+}
+
+/**
+ * @brief Returns the hit, miss, eviction and rejection counts
+ */
+template<class K, class V, class Hash> CacheStats ShardedLruCache<K,V,Hash>::
+get_stats()
+{
+    return m_counters.snapshot();
+}
+
+/**
+ * @brief Resets the hit, miss, eviction and rejection counts
+ */
+template<class K, class V, class Hash> void ShardedLruCache<K,V,Hash>::
+reset_stats()
+{
+    m_counters.reset();
+}
+}
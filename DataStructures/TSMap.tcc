@@ -10,6 +10,7 @@
 #pragma once
 
 #include <condition_variable>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <mutex>
@@ -31,56 +32,81 @@ namespace acl
 
     /*
      * \brief Threadsafe wrapper for standard library ordered map class
+     *
+     * Keys are ordered by Compare, which is a template parameter so that
+     * comparisons can be inlined.  Use TSUnorderedMap when ordered lookups
+     * such as lower_bound() are not needed.
+     *
+     * The *_many() functions and transaction() do many operations under one
+     * lock.  With a transparent comparator (one that defines is_transparent,
+     * such as std::less<> in C++14), find() also takes other key types.  From
+     * C++14 on the lookup compares k directly, so for example a
+     * std::string_view lookup does not build a std::string; std::map has no
+     * heterogeneous lookup in C++11, so there k is converted to Key first.
      */
-    template<typename Key, typename Value> class TSMap
+    template<typename Key, typename Value, typename Compare = std::less<Key>> class TSMap
     {
+        public:
+            typedef std::map<Key, Value, Compare> Map;     //!< The wrapped map type
+
         protected:
-            std::map<Key, Value, std::function<bool(Key,Key)>> m_map;     //!< Map of objects
+            std::map<Key, Value, Compare> m_map;     //!< Map of objects
             mutable shared_mutex m_mutex;
     
         public:
-            TSMap();
+            TSMap(const Compare& compare = Compare());
             ~TSMap();
 
             // read functions
-            std::pair<Value, bool>  find(Key k) const;
-            std::pair<Value, bool>  lower_bound(Key k) const;
-            std::pair<std::pair<Key,Value>, bool> lower_bound_key(Key k) const;
-            std::pair<Value, bool>  findInfimum(Key k) const;
-            std::pair<std::pair<Key,Value>, bool>  findInfimum_key(Key k) const;
+            std::pair<Value, bool>  find(const Key& k) const;
+            bool                    find(const Key& k, Value& v) const;
+            std::pair<Value, bool>  lower_bound(const Key& k) const;
+            std::pair<std::pair<Key,Value>, bool> lower_bound_key(const Key& k) const;
+            std::pair<Value, bool>  findInfimum(const Key& k) const;
+            std::pair<std::pair<Key,Value>, bool>  findInfimum_key(const Key& k) const;
             size_t                  size() const;
             bool                    empty() const;
             std::vector<Key>        getKeyList() const;
+            std::vector<std::pair<Value, bool>> find_many(const std::vector<Key>& keys) const;
+            bool                    transaction_ro(std::function<bool(const Map&)> f) const;
+            template<typename K, typename C = Compare, typename = typename C::is_transparent>
+            std::pair<Value, bool>  find(const K& k) const;
+            template<typename K, typename C = Compare, typename = typename C::is_transparent>
+            bool                    find(const K& k, Value& v) const;
     
             // write functions
-            bool                    emplace(Key k, Value v, bool force = false);
+            bool                    emplace(const Key& k, const Value& v, bool force = false);
             template<typename... Args>
-            bool                    createInPlace(Key k, Args... args);
-            std::pair<Value,bool>   replace(Key k, Value v, bool force = true);
-            bool                    erase(Key k, std::function<bool(Key,Value&)> f = nullptr);
-            std::pair<Value, bool>  remove(Key k);
-
-            bool                    perform(Key k, std::function<bool(Key,Value&)> f = nullptr);
-            bool                    perform_ro(Key k, std::function<bool(Key,const Value&)> f = nullptr) const;
+            bool                    createInPlace(const Key& k, Args&&... args);
+            std::pair<Value,bool>   replace(const Key& k, const Value& v, bool force = true);
+            bool                    erase(const Key& k, std::function<bool(const Key&,Value&)> f = nullptr);
+            std::pair<Value, bool>  remove(const Key& k);
+            size_t                  emplace_many(const std::vector<std::pair<Key, Value>>& items, bool force = false);
+            size_t                  erase_many(const std::vector<Key>& keys);
+            bool                    transaction(std::function<bool(Map&)> f);
+
+            bool                    perform(const Key& k, std::function<bool(const Key&,Value&)> f = nullptr);
+            bool                    perform_ro(const Key& k, std::function<bool(const Key&,const Value&)> f = nullptr) const;
             void                    clear();
 
             // function iterators
-            size_t for_each_ro(std::function<bool(Key k, const Value& v)> f) const;
-            size_t for_each(std::function<bool(Key k, Value& v)> f);
-            size_t delete_if(std::function<bool(Key k, Value& v)> f);
+            size_t for_each_ro(std::function<bool(const Key& k, const Value& v)> f) const;
+            size_t for_each(std::function<bool(const Key& k, Value& v)> f);
+            size_t delete_if(std::function<bool(const Key& k, Value& v)> f);
     };
 
     /**
-     * @brief Constructor. Explicitly defines the comparison operator for use by the map.
+     * @brief Constructor.
+     * @param compare The comparison object used to order keys
      **/
-    template<typename Key, typename Value> TSMap<Key, Value>::TSMap()
-        : m_map([](Key k1, Key k2)->bool { return k1 < k2; })
+    template<typename Key, typename Value, typename Compare> TSMap<Key, Value, Compare>::TSMap(const Compare& compare)
+        : m_map(compare)
     { }
 
     /**
      * @brief Destructor. Clears the map
      */
-    template<typename Key, typename Value> TSMap<Key, Value>::~TSMap()
+    template<typename Key, typename Value, typename Compare> TSMap<Key, Value, Compare>::~TSMap()
     {
         clear();
     }
@@ -95,8 +121,8 @@ namespace acl
      *
      * \return The value correspoding to Key k
      */
-    template<typename Key, typename Value> std::pair<Value, bool> TSMap<Key, Value>::
-            find(Key k) const
+    template<typename Key, typename Value, typename Compare> std::pair<Value, bool> TSMap<Key, Value, Compare>::
+            find(const Key& k) const
     {
         acl::shared_lock lock(m_mutex);
         auto it = m_map.find(k);
@@ -106,6 +132,27 @@ namespace acl
         }
         return std::make_pair(Value{}, false);
     }
+
+    /*
+     * \brief Copies a value from the map into v
+     * \param [in] k The key to query the map with
+     * \param [out] v Assigned the value corresponding to Key k; untouched if not found
+     *
+     * \return true if the key was found.  Unlike find(k), Value need not be
+     * default constructible and no empty Value is built on a miss.
+     */
+    template<typename Key, typename Value, typename Compare> bool TSMap<Key, Value, Compare>::
+            find(const Key& k, Value& v) const
+    {
+        acl::shared_lock lock(m_mutex);
+        auto it = m_map.find(k);
+
+        if (it == m_map.end()){
+            return false;
+        }
+        v = it->second;
+        return true;
+    }
     
     /*
      * \brief Retrieves the first value with a key not less than the given k
@@ -114,8 +161,8 @@ namespace acl
      * \return The value with the smallest key greater than or equal t
      * correspoding to Key k
      */
-    template<typename Key, typename Value> std::pair<Value, bool> TSMap<Key, Value>::
-            lower_bound(Key k) const
+    template<typename Key, typename Value, typename Compare> std::pair<Value, bool> TSMap<Key, Value, Compare>::
+            lower_bound(const Key& k) const
     {
         acl::shared_lock lock(m_mutex);
         auto it = m_map.lower_bound(k);
@@ -133,9 +180,9 @@ namespace acl
      * \return The value with the smallest key greater than or equal t
      * correspoding to Key k; also returns the Key of this Value
      */
-    template<typename Key, typename Value> 
-            std::pair<std::pair<Key, Value>, bool> TSMap<Key, Value>::
-            lower_bound_key(Key k) const
+    template<typename Key, typename Value, typename Compare> 
+            std::pair<std::pair<Key, Value>, bool> TSMap<Key, Value, Compare>::
+            lower_bound_key(const Key& k) const
     {
         acl::shared_lock lock(m_mutex);
         auto it = m_map.lower_bound(k);
@@ -154,8 +201,8 @@ namespace acl
      *         Value, if found. The bool is true if a Value is found, 
      *         else false if none is found
      **/
-    template<typename Key,typename Value> 
-            std::pair<Value,bool> TSMap<Key,Value>::findInfimum(Key k) const
+    template<typename Key, typename Value, typename Compare> 
+            std::pair<Value,bool> TSMap<Key, Value, Compare>::findInfimum(const Key& k) const
     {
         acl::shared_lock lock(m_mutex);
         auto it = m_map.lower_bound(k);
@@ -182,8 +229,8 @@ namespace acl
      *         Value, if found. The bool is true if a Value is found, 
      *         else false if none is found
      **/
-    template<typename Key,typename Value> 
-            std::pair<std::pair<Key,Value>,bool> TSMap<Key,Value>::findInfimum_key(Key k) const
+    template<typename Key, typename Value, typename Compare> 
+            std::pair<std::pair<Key,Value>,bool> TSMap<Key, Value, Compare>::findInfimum_key(const Key& k) const
     {
         acl::shared_lock lock(m_mutex);
         auto it = m_map.lower_bound(k);
@@ -205,7 +252,7 @@ namespace acl
     /*
      * \brief returns the number of entries in the map
      */
-    template<typename Key, typename Value> size_t TSMap<Key, Value>::
+    template<typename Key, typename Value, typename Compare> size_t TSMap<Key, Value, Compare>::
             size() const
     {
         acl::shared_lock lock(m_mutex);
@@ -216,14 +263,14 @@ namespace acl
     /*
      * \brief checks if the map is empty
      */
-    template<typename Key, typename Value> bool TSMap<Key, Value>::
+    template<typename Key, typename Value, typename Compare> bool TSMap<Key, Value, Compare>::
             empty() const
     {
         acl::shared_lock lock(m_mutex);
         return m_map.empty();
     }
 
-    template<typename Key, typename Value> std::vector<Key> TSMap<Key, Value>::
+    template<typename Key, typename Value, typename Compare> std::vector<Key> TSMap<Key, Value, Compare>::
             getKeyList() const
     {
         std::vector<Key> keyList;
@@ -235,6 +282,84 @@ namespace acl
         return keyList;
     }
 
+    /*
+     * \brief Looks up several keys under one lock
+     * \param [in] keys The keys to look up
+     *
+     * \return One (value, found) pair per key, in the same order as keys
+     */
+    template<typename Key, typename Value, typename Compare> std::vector<std::pair<Value, bool>> TSMap<Key, Value, Compare>::
+            find_many(const std::vector<Key>& keys) const
+    {
+        std::vector<std::pair<Value, bool>> results;
+        results.reserve(keys.size());
+        acl::shared_lock lock(m_mutex);
+
+        for (const Key& k : keys) {
+            auto it = m_map.find(k);
+            if (it != m_map.end()) {
+                results.emplace_back(it->second, true);
+            } else {
+                results.emplace_back(Value{}, false);
+            }
+        }
+        return results;
+    }
+
+    /*
+     * \brief Runs f on the map under a single read lock
+     * \param [in] f Reads as much of the map as it needs.  It must not call
+     *               back into this TSMap.
+     *
+     * \return The value returned by f
+     */
+    template<typename Key, typename Value, typename Compare> bool TSMap<Key, Value, Compare>::
+            transaction_ro(std::function<bool(const Map&)> f) const
+    {
+        acl::shared_lock lock(m_mutex);
+        return f(m_map);
+    }
+
+    /*
+     * \brief Retrieves a value using a key of another type.  Only available
+     *        when Compare is transparent.
+     * \param [in] k Any value Compare can compare with Key; before C++14 it
+     *        must also be convertible to Key
+     */
+    template<typename Key, typename Value, typename Compare>
+    template<typename K, typename C, typename> std::pair<Value, bool> TSMap<Key, Value, Compare>::
+            find(const K& k) const
+    {
+        Value v{};
+        bool found = find(k, v);
+        return std::make_pair(std::move(v), found);
+    }
+
+    /*
+     * \brief Copies a value into v using a key of another type.  Only
+     *        available when Compare is transparent.
+     * \param [in] k Any value Compare can compare with Key; before C++14 it
+     *        must also be convertible to Key
+     * \param [out] v Assigned the value; untouched if not found
+     */
+    template<typename Key, typename Value, typename Compare>
+    template<typename K, typename C, typename> bool TSMap<Key, Value, Compare>::
+            find(const K& k, Value& v) const
+    {
+        acl::shared_lock lock(m_mutex);
+#if __cplusplus >= 201402L
+        auto it = m_map.find(k);
+#else
+        auto it = m_map.find(Key(k));
+#endif
+
+        if (it == m_map.end()){
+            return false;
+        }
+        v = it->second;
+        return true;
+    }
+
 
     ////////////////////////////////////////
     //           WRITE METHODS            //
@@ -247,17 +372,19 @@ namespace acl
      *
      * return true if no element previously existed, false if one did
      */
-    template<typename Key, typename Value> bool TSMap<Key, Value>::
-            emplace(Key k, Value v, bool force)
+    template<typename Key, typename Value, typename Compare> bool TSMap<Key, Value, Compare>::
+            emplace(const Key& k, const Value& v, bool force)
     {
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
+        auto it = m_map.emplace(k, v);
 
-        if (!force && m_map.find(k) != m_map.end()) {
-            return false;
+        if (!it.second) {
+            if (!force) {
+                return false;
+            }
+            it.first->second = v;
         }
-        m_map.erase(k);
-
-        return m_map.emplace(k, v).second;
+        return true;
     }
 
     /*
@@ -267,14 +394,14 @@ namespace acl
      *
      * return true if the value was successfully created
      */
-    template<typename Key, typename Value>
-    template<typename... Args> bool TSMap<Key,Value>::
-        createInPlace(Key k, Args... args)
+    template<typename Key, typename Value, typename Compare>
+    template<typename... Args> bool TSMap<Key, Value, Compare>::
+        createInPlace(const Key& k, Args&&... args)
     {
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
         auto ret = m_map.emplace(std::piecewise_construct,
                                   std::forward_as_tuple(k),
-                                  std::forward_as_tuple(args...));
+                                  std::forward_as_tuple(std::forward<Args>(args)...));
         return ret.second;
     }
 
@@ -290,20 +417,20 @@ namespace acl
      * note: if nothing was in this location previously, the return Value will
      * be the value that was passed in. 
      */
-    template<typename Key, typename Value> std::pair<Value,bool> TSMap<Key, Value>::
-            replace(Key k, Value v, bool force)
+    template<typename Key, typename Value, typename Compare> std::pair<Value,bool> TSMap<Key, Value, Compare>::
+            replace(const Key& k, const Value& v, bool force)
     {
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
-        Value newVal = v;
-        auto it = m_map.emplace(k, newVal);
+        auto it = m_map.emplace(k, v);
 
         if (!it.second) {
-            newVal = it.first->second;
+            Value oldVal = it.first->second;
             if (force) {
-                m_map[k] = v;
+                it.first->second = v;
             }
+            return std::pair<Value,bool>(oldVal, false);
         }
-        return std::pair<Value,bool>(newVal, it.second);
+        return std::pair<Value,bool>(v, true);
     }
 
     /*
@@ -314,8 +441,8 @@ namespace acl
      *
      * \return true if the element was erased, false otherwise
      */
-    template<typename Key, typename Value> bool TSMap<Key, Value>::
-            erase(Key k, std::function<bool(Key,Value&)> f)
+    template<typename Key, typename Value, typename Compare> bool TSMap<Key, Value, Compare>::
+            erase(const Key& k, std::function<bool(const Key&,Value&)> f)
     {
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
         auto it = m_map.find(k);
@@ -326,7 +453,8 @@ namespace acl
 
         // remove the element if no function or if function returns true
         if (!f || f(k, it->second)) {
-            return m_map.erase(k) == 1;
+            m_map.erase(it);
+            return true;
         } else {
             return false;
         }
@@ -338,20 +466,78 @@ namespace acl
  * \param[in] k The key to find, return, and remove
  * \return A pair of the value and a bool to indicate success
  **/
-    template<typename Key, typename Value> std::pair<Value, bool> TSMap<Key, Value>::
-            remove(Key k)
+    template<typename Key, typename Value, typename Compare> std::pair<Value, bool> TSMap<Key, Value, Compare>::
+            remove(const Key& k)
     {
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
         auto it = m_map.find(k);
 
         if (it != m_map.end()) {
             // Make pair before erasing
-            auto ret = std::make_pair(it->second, true);
-            m_map.erase(k);
+            auto ret = std::make_pair(std::move(it->second), true);
+            m_map.erase(it);
             return ret;
         }
         return std::make_pair(Value{}, false);
     }
+
+    /*
+     * \brief Adds several key-value pairs under one lock
+     * \param [in] items The pairs to add
+     * \param [in] force Overwrite existing values
+     *
+     * \return The number of values stored
+     */
+    template<typename Key, typename Value, typename Compare> size_t TSMap<Key, Value, Compare>::
+            emplace_many(const std::vector<std::pair<Key, Value>>& items, bool force)
+    {
+        size_t stored = 0;
+        std::lock_guard<acl::shared_mutex> lock(m_mutex);
+
+        for (const auto& item : items) {
+            auto it = m_map.emplace(item.first, item.second);
+            if (it.second) {
+                stored++;
+            } else if (force) {
+                it.first->second = item.second;
+                stored++;
+            }
+        }
+        return stored;
+    }
+
+    /*
+     * \brief Erases several keys under one lock
+     * \param [in] keys The keys to erase
+     *
+     * \return The number of entries erased
+     */
+    template<typename Key, typename Value, typename Compare> size_t TSMap<Key, Value, Compare>::
+            erase_many(const std::vector<Key>& keys)
+    {
+        size_t numErased = 0;
+        std::lock_guard<acl::shared_mutex> lock(m_mutex);
+
+        for (const Key& k : keys) {
+            numErased += m_map.erase(k);
+        }
+        return numErased;
+    }
+
+    /*
+     * \brief Runs f on the map under a single write lock, so a series of
+     *        reads and writes happens atomically
+     * \param [in] f Changes the map as needed.  It must not call back into
+     *               this TSMap.
+     *
+     * \return The value returned by f
+     */
+    template<typename Key, typename Value, typename Compare> bool TSMap<Key, Value, Compare>::
+            transaction(std::function<bool(Map&)> f)
+    {
+        std::lock_guard<acl::shared_mutex> lock(m_mutex);
+        return f(m_map);
+    }
     
     /*
      * \brief performs the given function on the key value pair specified
@@ -360,8 +546,8 @@ namespace acl
      *
      * \return The value returned by the fucntion
      */
-    template<typename Key, typename Value> bool TSMap<Key, Value>::
-    perform(Key k, std::function<bool(Key,Value&)> f)
+    template<typename Key, typename Value, typename Compare> bool TSMap<Key, Value, Compare>::
+    perform(const Key& k, std::function<bool(const Key&,Value&)> f)
     {
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
         auto it = m_map.find(k);
@@ -380,8 +566,8 @@ namespace acl
      *
      * \return The value returned by the fucntion
      */
-    template<typename Key, typename Value> bool TSMap<Key, Value>::
-    perform_ro(Key k, std::function<bool(Key,const Value&)> f) const
+    template<typename Key, typename Value, typename Compare> bool TSMap<Key, Value, Compare>::
+    perform_ro(const Key& k, std::function<bool(const Key&,const Value&)> f) const
     {
         acl::shared_lock lock(m_mutex);
         auto it = m_map.find( k );
@@ -396,7 +582,7 @@ namespace acl
     /*
      * \brief Clears all entries from the map
      */
-    template<typename Key, typename Value> void TSMap<Key, Value>::
+    template<typename Key, typename Value, typename Compare> void TSMap<Key, Value, Compare>::
             clear()
     {
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
@@ -415,8 +601,8 @@ namespace acl
      *               should return true on success, false on failure
      * \return number of successful returns from f
      */
-    template<typename Key, typename Value> size_t TSMap<Key, Value>::
-            for_each_ro(std::function<bool(Key k, const Value& v)> f) const
+    template<typename Key, typename Value, typename Compare> size_t TSMap<Key, Value, Compare>::
+            for_each_ro(std::function<bool(const Key& k, const Value& v)> f) const
     {
         size_t numSuccess = 0;
         acl::shared_lock lock(m_mutex);
@@ -436,8 +622,8 @@ namespace acl
      *               should return true on success, false on failure
      * \return number of successful returns from f
      */
-    template<typename Key, typename Value> size_t TSMap<Key, Value>::
-            for_each(std::function<bool(Key k, Value& v)> f)
+    template<typename Key, typename Value, typename Compare> size_t TSMap<Key, Value, Compare>::
+            for_each(std::function<bool(const Key& k, Value& v)> f)
     {
         size_t numSuccess = 0;
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
@@ -458,8 +644,8 @@ namespace acl
      *        returns true on an element, the element is deleted
      * \return the number of entries deleted
      */
-    template<typename Key, typename Value> size_t TSMap<Key, Value>::
-            delete_if(std::function<bool(Key k, Value& v)> f)
+    template<typename Key, typename Value, typename Compare> size_t TSMap<Key, Value, Compare>::
+            delete_if(std::function<bool(const Key& k, Value& v)> f)
     {
         size_t numErased = 0;
         std::lock_guard<acl::shared_mutex> lock(m_mutex);
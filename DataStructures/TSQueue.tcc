@@ -21,7 +21,11 @@
 #include <thread>
 #include <assert.h>
 #include "Timer.h"
+#include "Metrics.hpp"
 #include <fstream>
+#include <iterator>
+#include <type_traits>
+#include <utility>
 
 #pragma once
 
@@ -36,6 +40,10 @@ namespace acl
 * There must be a destructor for any class used in this template, or
 * else there will be a memory leak if the Queue is deleted.
 *
+* Move-only types may be stored using enqueue(T&&), emplace() and push().
+* enqueue(const T&) and peek() copy, so they are member templates rather
+* than virtual, and calling them with a move-only T fails to compile.
+*
 * @tparam T The type of data to be contained in the queue
 */
 template <typename T> class TSQueue
@@ -52,20 +60,24 @@ protected:
 
     virtual void enqueue(std::shared_ptr<QNode> node);   //<! Adds a QNode to the tail of the queue
 
-
 public:
     TSQueue();                                            //<! Constructor
     virtual ~TSQueue();                                   //<! Destructor.  Deletes all data in queue
-    virtual bool enqueue(const T&, bool force = false);   //<! Add data to the tail of the queue
+    template<typename U = T> bool enqueue(const T&, bool force = false);  //<! Copy data to the tail of the queue
+    virtual bool enqueue(T&&, bool force = false);        //<! Move data to the tail of the queue
     virtual bool dequeue(T& data, uint16_t timeout = 0);  //<! Remove and return data from the head of the queue
     virtual bool push(T, bool force = false);             //<! Add data to the head of the queue (as a stack)
     virtual bool pop(T& data, uint16_t timeout = 0);      //<! Pop data off the head of the queue (as a stack)
-    virtual bool peek(T& value, uint16_t timeout = 0);    //<! Peek at the head of the queue
+    template<typename U = T> bool peek(T& value, uint16_t timeout = 0);   //<! Copy the head of the queue
     virtual size_t size();                                //<! Return the size of the queue
     virtual void delete_all();                            //<! Deletes all nodes in the queue
     virtual void set_max_size(size_t);                    //<! Sets max size
     virtual size_t get_max_size();                        //<! Returns max size
     virtual bool wait_until_empty(uint16_t timeout = 0);  //<! Waits until queue is empty
+
+    template<typename... Args> bool emplace(Args&&... args);      //<! Construct data in place at the tail
+    template<typename InputIt> size_t enqueue_bulk(InputIt first, InputIt last, bool force = false);
+    template<typename OutputIt> size_t dequeue_bulk(OutputIt out, size_t max, uint16_t timeout = 0);
 };
 
 //template<class K, class V> struct CacheNode;
@@ -75,9 +87,8 @@ public:
 * @brief Node struct for linked list
 */
 template<typename T> struct TSQueue<T>::QNode {
-    QNode(const T& new_data) {
-        data = new_data;
-    }
+    template<typename... Args> explicit QNode(Args&&... args)
+        : data(std::forward<Args>(args)...) {}
 
     T data;
     std::weak_ptr<QNode> next;   // Node closer to head
@@ -134,8 +145,10 @@ template<typename T> void TSQueue<T>::enqueue(std::shared_ptr<QNode> node)
 * @param data The data to be contained in the Node
 * @param force True will push data even if the length is greater than max_size
 */
-template<typename T> bool TSQueue<T>::enqueue(const T& data, bool force)
+template<typename T> template<typename U> bool TSQueue<T>::enqueue(const T& data, bool force)
 {
+    static_assert(std::is_copy_constructible<U>::value,
+        "TSQueue::enqueue(const T&) copies; use enqueue(T&&) or emplace() for move-only types");
     std::lock_guard<std::recursive_mutex> lock(m);
 
     if (!force && length >= max_size) {
@@ -144,10 +157,122 @@ template<typename T> bool TSQueue<T>::enqueue(const T& data, bool force)
 
     std::shared_ptr<QNode> temp = std::shared_ptr<QNode>(new QNode(data));
     enqueue(temp);      //Recursive mutex allows for multiple locks from the same thread
+    ACL_METRIC_RECORD("TSQueue.depth", length);
+    enqueue_cv.notify_one();
+    return true;
+}
+
+/**
+* @brief Moves data to the tail of the queue.  This is the only way to add
+*        move-only types other than emplace().
+*
+* @param data The data to be moved into the Node
+* @param force True will push data even if the length is greater than max_size
+*/
+template<typename T> bool TSQueue<T>::enqueue(T&& data, bool force)
+{
+    std::lock_guard<std::recursive_mutex> lock(m);
+
+    if (!force && length >= max_size) {
+        return false;
+    }
+
+    enqueue(std::shared_ptr<QNode>(new QNode(std::move(data))));
+    ACL_METRIC_RECORD("TSQueue.depth", length);
+    enqueue_cv.notify_one();
+    return true;
+}
+
+/**
+* @brief Constructs an element in place at the tail of the queue
+*
+* @param args Arguments forwarded to the constructor of T
+* @return false if the queue is at max_size
+*/
+template<typename T> template<typename... Args> bool TSQueue<T>::emplace(Args&&... args)
+{
+    std::lock_guard<std::recursive_mutex> lock(m);
+
+    if (length >= max_size) {
+        return false;
+    }
+
+    enqueue(std::shared_ptr<QNode>(new QNode(std::forward<Args>(args)...)));
+    ACL_METRIC_RECORD("TSQueue.depth", length);
     enqueue_cv.notify_one();
     return true;
 }
 
+/**
+* @brief Adds a range of elements to the tail of the queue under a single
+*        lock, waking consumers once for the whole batch.  Elements are copied
+*        from the range; wrap the iterators in std::make_move_iterator to move.
+*
+* @param first Start of the range
+* @param last End of the range
+* @param force True will add data even if the length is greater than max_size
+* @return The number of elements added.  Stops early when max_size is reached.
+*/
+template<typename T> template<typename InputIt>
+size_t TSQueue<T>::enqueue_bulk(InputIt first, InputIt last, bool force)
+{
+    std::lock_guard<std::recursive_mutex> lock(m);
+
+    size_t count = 0;
+    for (; first != last; ++first) {
+        if (!force && length >= max_size) {
+            break;
+        }
+        enqueue(std::shared_ptr<QNode>(new QNode(*first)));
+        count++;
+    }
+    if (count) {
+        ACL_METRIC_RECORD("TSQueue.depth", length);
+    }
+
+    if (count == 1) {
+        enqueue_cv.notify_one();
+    } else if (count > 1) {
+        enqueue_cv.notify_all();
+    }
+    return count;
+}
+
+/**
+* @brief Removes up to max elements from the head of the queue under a single
+*        lock.  Blocks until at least one element is available.
+*
+* @param out Output iterator that receives the elements (moved out)
+* @param max Maximum number of elements to remove
+* @param timeout How long to block before timeout in milliseconds.
+* @return The number of elements removed
+*/
+template<typename T> template<typename OutputIt>
+size_t TSQueue<T>::dequeue_bulk(OutputIt out, size_t max, uint16_t timeout)
+{
+    std::unique_lock<std::recursive_mutex> lock(m);
+
+    ACL_METRIC_TIMESTAMP(waitStart);
+    if (!max || !enqueue_cv.wait_for(lock, std::chrono::milliseconds(timeout), [this] {return length > 0;})) {
+        return 0;
+    }
+    ACL_METRIC_RECORD_SINCE("TSQueue.wait_ns", waitStart);
+
+    size_t count = 0;
+    while (count < max && length > 0) {
+        *out = std::move(head->data);
+        ++out;
+        head = head->prev;
+        length--;
+        count++;
+    }
+
+    if (!length) {
+        dequeue_cv.notify_all();
+    }
+    return count;
+}
+
 /**
 * @brief Removes and returns the head of the queue.  Blocks if no data is available
 * @param timeout How long to block before timeout in milliseconds.
@@ -158,11 +283,13 @@ template<typename T> bool TSQueue<T>::dequeue(T& data, uint16_t timeout)
 {
     std::unique_lock<std::recursive_mutex> lock(m);
 
+    ACL_METRIC_TIMESTAMP(waitStart);
     if (!enqueue_cv.wait_for(lock, std::chrono::milliseconds(timeout), [this] {return length > 0;})) {
         return false;
     }
+    ACL_METRIC_RECORD_SINCE("TSQueue.wait_ns", waitStart);
 
-    data = head->data;
+    data = std::move(head->data);
     head = head->prev;
     length--;
 
@@ -212,7 +339,7 @@ template<typename T> bool TSQueue<T>::push(T data, bool force)
         return false;
     }
 
-    std::shared_ptr<QNode> temp = std::shared_ptr<QNode>(new QNode(data));
+    std::shared_ptr<QNode> temp = std::shared_ptr<QNode>(new QNode(std::move(data)));
 
     if (head) {
         head->next = temp;
@@ -223,6 +350,7 @@ template<typename T> bool TSQueue<T>::push(T data, bool force)
 
     head = temp;
     length++;
+    ACL_METRIC_RECORD("TSQueue.depth", length);
     enqueue_cv.notify_one();
     return true;
 }
@@ -244,8 +372,9 @@ template<typename T> bool TSQueue<T>::pop( T& data, uint16_t timeout)
 *
 * @return The data in the head of the queue
 */
-template<typename T> bool TSQueue<T>::peek(T& value, uint16_t timeout)
+template<typename T> template<typename U> bool TSQueue<T>::peek(T& value, uint16_t timeout)
 {
+    static_assert(std::is_copy_assignable<U>::value, "TSQueue::peek() copies; use dequeue() for move-only types");
     std::unique_lock<std::recursive_mutex> lock(m);
 
     if (!enqueue_cv.wait_for(lock, std::chrono::milliseconds(timeout), [this] {return length > 0;})) {
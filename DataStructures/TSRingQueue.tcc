@@ -0,0 +1,457 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file TSRingQueue.tcc
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "TSQueue.tcc"
+
+namespace acl
+{
+
+/**
+* @brief A thread-safe queue with the same interface as TSQueue, backed by
+* a contiguous ring buffer instead of individually allocated nodes.
+*
+* Storage grows by doubling when the buffer is full and is never released
+* until the queue is destroyed, so once the queue has reached its working
+* depth enqueue/dequeue/push/pop perform no allocations.  Use reserve() or
+* the constructor to size the buffer up front.
+*
+* Dequeued slots are reset to a default-constructed T so that resources held
+* by the element (shared pointers, buffers) are released promptly.
+*
+* Move-only types may be stored using enqueue(T&&), emplace() and push().
+* enqueue(const T&) and peek() copy, so they are member templates rather
+* than virtual, and calling them with a move-only T fails to compile.
+*
+* @tparam T The type of data to be contained in the queue.  Must be default
+*           constructible.
+*/
+template <typename T> class TSRingQueue
+{
+protected:
+    std::mutex m;                           //<! The mutex that will be used for accessing the queue
+    std::condition_variable enqueue_cv;     //<! The condition variable which waits on blocking dequeue
+    std::condition_variable dequeue_cv;     //<! The condition variable which waits on the queue emptying
+    std::atomic_size_t length;              //<! The length of the queue
+    std::vector<T> buffer;                  //<! Ring storage
+    size_t head = 0;                        //<! Index of the element at the head of the queue
+    size_t max_size = DEFAULT_MAX_SIZE;     //<! Maximum size of queue
+
+    void grow();                            //<! Doubles the storage.  Mutex must be held
+    size_t index(size_t offset) const;      //<! Buffer index offset elements past head
+    T& reserve_tail();                      //<! Grows if needed and returns the slot past the tail.  Mutex must be held
+
+public:
+    TSRingQueue(size_t capacity = 0);                     //<! Constructor
+    virtual ~TSRingQueue();                               //<! Destructor.  Deletes all data in queue
+    template<typename U = T> bool enqueue(const T&, bool force = false);  //<! Copy data to the tail of the queue
+    virtual bool enqueue(T&&, bool force = false);        //<! Move data to the tail of the queue
+    virtual bool dequeue(T& data, uint16_t timeout = 0);  //<! Remove and return data from the head of the queue
+    virtual bool push(T, bool force = false);             //<! Add data to the head of the queue (as a stack)
+    virtual bool pop(T& data, uint16_t timeout = 0);      //<! Pop data off the head of the queue (as a stack)
+    template<typename U = T> bool peek(T& value, uint16_t timeout = 0);   //<! Copy the head of the queue
+    virtual size_t size();                                //<! Return the size of the queue
+    virtual void delete_all();                            //<! Deletes all elements in the queue
+    virtual void set_max_size(size_t);                    //<! Sets max size
+    virtual size_t get_max_size();                        //<! Returns max size
+    virtual bool wait_until_empty(uint16_t timeout = 0);  //<! Waits until queue is empty
+    virtual void reserve(size_t capacity);                //<! Preallocates storage
+    virtual size_t capacity();                            //<! Returns the allocated storage
+
+    template<typename... Args> bool emplace(Args&&... args);      //<! Construct data at the tail
+    template<typename InputIt> size_t enqueue_bulk(InputIt first, InputIt last, bool force = false);
+    template<typename OutputIt> size_t dequeue_bulk(OutputIt out, size_t max, uint16_t timeout = 0);
+};
+
+/**
+* @brief Constructor
+*
+* @param capacity Number of elements to preallocate storage for
+**/
+template<typename T> TSRingQueue<T>::TSRingQueue(size_t capacity): length(0)
+{
+    buffer.resize(capacity);
+}
+
+/**
+* @brief Destructor.  Deletes all elements in the queue
+**/
+template<typename T> TSRingQueue<T>::~TSRingQueue()
+{
+    delete_all();
+}
+
+/**
+* @brief Returns the buffer index that is offset elements past the head.
+*
+* The mutex must be held and the buffer must not be empty.
+*/
+template<typename T> size_t TSRingQueue<T>::index(size_t offset) const
+{
+    size_t i = head + offset;
+    if (i >= buffer.size()) {
+        i -= buffer.size();
+    }
+    return i;
+}
+
+/**
+* @brief Doubles the size of the storage, moving the current elements so
+*        that the head is at index 0.  The mutex must be held.
+*/
+template<typename T> void TSRingQueue<T>::grow()
+{
+    size_t newCapacity = buffer.empty() ? 16 : buffer.size() * 2;
+    std::vector<T> newBuffer(newCapacity);
+
+    for (size_t i = 0; i < length; i++) {
+        newBuffer[i] = std::move(buffer[index(i)]);
+    }
+
+    buffer.swap(newBuffer);
+    head = 0;
+}
+
+/**
+* @brief Returns the free slot just past the tail, growing the storage if it
+*        is full.  The mutex must be held; the caller increments length.
+*/
+template<typename T> T& TSRingQueue<T>::reserve_tail()
+{
+    if (length == buffer.size()) {
+        grow();
+    }
+    return buffer[index(length)];
+}
+
+/**
+* @brief Preallocates storage for at least the specified number of elements
+*
+* @param capacity The number of elements to allocate space for
+*/
+template<typename T> void TSRingQueue<T>::reserve(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m);
+
+    if (capacity <= buffer.size()) {
+        return;
+    }
+
+    std::vector<T> newBuffer(capacity);
+    for (size_t i = 0; i < length; i++) {
+        newBuffer[i] = std::move(buffer[index(i)]);
+    }
+
+    buffer.swap(newBuffer);
+    head = 0;
+}
+
+/**
+* @brief Returns the number of elements storage is allocated for
+*/
+template<typename T> size_t TSRingQueue<T>::capacity()
+{
+    std::lock_guard<std::mutex> lock(m);
+    return buffer.size();
+}
+
+/**
+* @brief Deletes all elements in the queue including their data.  The storage
+*        is kept for reuse.
+*/
+template<typename T> void TSRingQueue<T>::delete_all()
+{
+    std::lock_guard<std::mutex> lock(m);
+
+    for (size_t i = 0; i < length; i++) {
+        buffer[index(i)] = T();
+    }
+
+    head = 0;
+    length = 0;
+    dequeue_cv.notify_all();
+}
+
+/**
+* @brief Adds an element to the tail of the queue
+*
+* @param data The data to be added
+* @param force True will push data even if the length is greater than max_size
+*/
+template<typename T> template<typename U> bool TSRingQueue<T>::enqueue(const T& data, bool force)
+{
+    static_assert(std::is_copy_assignable<U>::value,
+        "TSRingQueue::enqueue(const T&) copies; use enqueue(T&&) or emplace() for move-only types");
+    std::lock_guard<std::mutex> lock(m);
+
+    if (!force && length >= max_size) {
+        return false;
+    }
+
+    reserve_tail() = data;
+    length++;
+    enqueue_cv.notify_one();
+    return true;
+}
+
+/**
+* @brief Moves data to the tail of the queue
+*
+* @param data The data to be added
+* @param force True will push data even if the length is greater than max_size
+*/
+template<typename T> bool TSRingQueue<T>::enqueue(T&& data, bool force)
+{
+    std::lock_guard<std::mutex> lock(m);
+
+    if (!force && length >= max_size) {
+        return false;
+    }
+
+    reserve_tail() = std::move(data);
+    length++;
+    enqueue_cv.notify_one();
+    return true;
+}
+
+/**
+* @brief Constructs an element at the tail of the queue.  The element is
+*        constructed and then moved into its slot.
+*
+* @param args Arguments forwarded to the constructor of T
+* @return false if the queue is at max_size
+*/
+template<typename T> template<typename... Args> bool TSRingQueue<T>::emplace(Args&&... args)
+{
+    std::lock_guard<std::mutex> lock(m);
+
+    if (length >= max_size) {
+        return false;
+    }
+
+    reserve_tail() = T(std::forward<Args>(args)...);
+    length++;
+    enqueue_cv.notify_one();
+    return true;
+}
+
+/**
+* @brief Adds a range of elements to the tail of the queue under a single
+*        lock, waking consumers once for the whole batch.  Elements are copied
+*        from the range; wrap the iterators in std::make_move_iterator to move.
+*
+* @param first Start of the range
+* @param last End of the range
+* @param force True will add data even if the length is greater than max_size
+* @return The number of elements added.  Stops early when max_size is reached.
+*/
+template<typename T> template<typename InputIt>
+size_t TSRingQueue<T>::enqueue_bulk(InputIt first, InputIt last, bool force)
+{
+    std::lock_guard<std::mutex> lock(m);
+
+    size_t count = 0;
+    for (; first != last; ++first) {
+        if (!force && length >= max_size) {
+            break;
+        }
+        reserve_tail() = *first;
+        length++;
+        count++;
+    }
+
+    if (count == 1) {
+        enqueue_cv.notify_one();
+    } else if (count > 1) {
+        enqueue_cv.notify_all();
+    }
+    return count;
+}
+
+/**
+* @brief Removes up to max elements from the head of the queue under a single
+*        lock.  Blocks until at least one element is available.
+*
+* @param out Output iterator that receives the elements (moved out)
+* @param max Maximum number of elements to remove
+* @param timeout How long to block before timeout in milliseconds.
+* @return The number of elements removed
+*/
+template<typename T> template<typename OutputIt>
+size_t TSRingQueue<T>::dequeue_bulk(OutputIt out, size_t max, uint16_t timeout)
+{
+    std::unique_lock<std::mutex> lock(m);
+
+    if (!max || !enqueue_cv.wait_for(lock, std::chrono::milliseconds(timeout), [this] {return length > 0;})) {
+        return 0;
+    }
+
+    size_t count = 0;
+    while (count < max && length > 0) {
+        *out = std::move(buffer[head]);
+        ++out;
+        buffer[head] = T();
+        head = index(1);
+        length--;
+        count++;
+    }
+
+    if (!length) {
+        dequeue_cv.notify_all();
+    }
+    return count;
+}
+
+/**
+* @brief Removes and returns the head of the queue.  Blocks if no data is available
+* @param timeout How long to block before timeout in milliseconds.
+*
+* @return The data contained in the head
+*/
+template<typename T> bool TSRingQueue<T>::dequeue(T& data, uint16_t timeout)
+{
+    std::unique_lock<std::mutex> lock(m);
+
+    if (!enqueue_cv.wait_for(lock, std::chrono::milliseconds(timeout), [this] {return length > 0;})) {
+        return false;
+    }
+
+    data = std::move(buffer[head]);
+    buffer[head] = T();
+    head = index(1);
+    length--;
+
+    if (!length) {
+        dequeue_cv.notify_all();
+    }
+    return true;
+}
+
+/**
+ * @brief Waits until the queue is empty, then returns.
+ * NOTE: Due to the uncertain nature of multithreaded programming,
+ * by the time this function returns, new objects may have been added
+ *
+ * @param timeout the maximum number of milliseconds to wait.
+ * NOTE: A timeout of 0 will wait indefinitely.
+ *
+ * @return true if queue got to 0, false if timeout occured
+ */
+template<typename T> bool TSRingQueue<T>::wait_until_empty(uint16_t timeout)
+{
+    std::unique_lock<std::mutex> lock(m);
+
+    if (!timeout) {
+        dequeue_cv.wait(lock, [this] {return length == 0;});
+        return true;
+    }
+
+    return dequeue_cv.wait_for(lock, std::chrono::milliseconds(timeout),
+                [this] {return length == 0;});
+}
+
+/**
+* @brief Adds an element to the head of the queue (as a stack)
+*
+* @param data The data to be added
+* @param force True will push data even if the length is greater than max_size
+*/
+template<typename T> bool TSRingQueue<T>::push(T data, bool force)
+{
+    std::lock_guard<std::mutex> lock(m);
+
+    if (!force && length >= max_size) {
+        return false;
+    }
+
+    if (length == buffer.size()) {
+        grow();
+    }
+
+    head = (head == 0) ? buffer.size() - 1 : head - 1;
+    buffer[head] = std::move(data);
+    length++;
+    enqueue_cv.notify_one();
+    return true;
+}
+
+/**
+* @brief Removes and returns the head of the queue (stack notation)
+* @param timeout How long to block before timeout in milliseconds.
+*
+* @return The data contained in the head
+*/
+template<typename T> bool TSRingQueue<T>::pop(T& data, uint16_t timeout)
+{
+    return dequeue(data, timeout);
+}
+
+/**
+* @brief Returns the data in the head of the queue without removing it.  Blocks if no data is available
+* @param timeout How long to block before timeout in milliseconds.
+*
+* @return The data in the head of the queue
+*/
+template<typename T> template<typename U> bool TSRingQueue<T>::peek(T& value, uint16_t timeout)
+{
+    static_assert(std::is_copy_assignable<U>::value, "TSRingQueue::peek() copies; use dequeue() for move-only types");
+    std::unique_lock<std::mutex> lock(m);
+
+    if (!enqueue_cv.wait_for(lock, std::chrono::milliseconds(timeout), [this] {return length > 0;})) {
+        return false;
+    }
+
+    value = buffer[head];
+    return true;
+}
+
+/**
+* @brief Returns the number of items in the queue
+*
+* @return the number of items in the queue
+*/
+template<typename T> size_t TSRingQueue<T>::size()
+{
+    return length;
+}
+
+/**
+* @brief Sets the maximum size of the queue.  If the queue is currently
+*           longer than the max size, the queue will not be modified,
+*           but no more elements will be able to be added until the queue
+*           is shorter than the max_size.  Storage is not preallocated;
+*           use reserve() for that.
+*/
+template<typename T> void TSRingQueue<T>::set_max_size(size_t size)
+{
+    std::lock_guard<std::mutex> lock(m);
+    max_size = size;
+}
+
+/**
+* @brief Returns the maximum size of the queue
+*
+* @return the maximum number of items allowed in the queue
+*/
+template<typename T> size_t TSRingQueue<T>::get_max_size()
+{
+    std::lock_guard<std::mutex> lock(m);
+    return max_size;
+}
+}
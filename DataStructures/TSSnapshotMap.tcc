@@ -0,0 +1,411 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file TSSnapshotMap.tcc
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace acl
+{
+
+    /*
+     * \brief Copy-on-write ordered map for read-mostly data that is scanned often
+     *
+     * The map is held as an immutable, versioned snapshot.  Readers take a
+     * reference to the current snapshot and work on it without any lock, so
+     * a long for_each_ro() never blocks writers and a large delete_if() never
+     * blocks readers.  Writers are serialized; each write copies the map,
+     * changes the copy and publishes it as the next version.  Readers that
+     * still hold the old snapshot keep seeing it until they let go.
+     *
+     * A write costs O(n), so group changes with update() where possible.  Use
+     * TSMap when writes are frequent.
+     *
+     * \tparam Key The key type
+     * \tparam Value The value type
+     * \tparam Compare Orders the keys
+     */
+    template<typename Key, typename Value, typename Compare = std::less<Key>> class TSSnapshotMap
+    {
+        public:
+            typedef std::map<Key, Value, Compare> Map;
+
+            /*
+             * \brief One published version of the map
+             */
+            struct Snapshot {
+                Map      map;           //!< The entries
+                uint64_t version;       //!< Increases by one with every published write
+            };
+
+            TSSnapshotMap(const Compare& compare = Compare());
+            ~TSSnapshotMap();
+
+            // read functions
+            std::shared_ptr<const Snapshot> snapshot() const;
+            uint64_t                get_version() const;
+            std::pair<Value, bool>  find(const Key& k) const;
+            bool                    find(const Key& k, Value& v) const;
+            std::pair<Value, bool>  lower_bound(const Key& k) const;
+            size_t                  size() const;
+            bool                    empty() const;
+            std::vector<Key>        getKeyList() const;
+            bool                    perform_ro(const Key& k, std::function<bool(const Key&,const Value&)> f = nullptr) const;
+            size_t                  for_each_ro(std::function<bool(const Key& k, const Value& v)> f) const;
+
+            // write functions
+            bool                    update(std::function<bool(Map& m)> f);
+            bool                    emplace(const Key& k, const Value& v, bool force = false);
+            bool                    erase(const Key& k);
+            std::pair<Value, bool>  remove(const Key& k);
+            bool                    perform(const Key& k, std::function<bool(const Key&,Value&)> f = nullptr);
+            size_t                  delete_if(std::function<bool(const Key& k, const Value& v)> f);
+            void                    clear();
+
+        protected:
+            void publish(std::unique_ptr<Snapshot> next);     //!< Write lock must be held
+
+            std::shared_ptr<const Snapshot> m_snapshot;      //!< Current version; use the atomic accessors
+            std::mutex m_writeMutex;                        //!< Serializes writers
+    };
+
+    /**
+     * @brief Constructor
+     * @param compare The comparison object used to order keys
+     **/
+    template<typename Key, typename Value, typename Compare>
+    TSSnapshotMap<Key, Value, Compare>::TSSnapshotMap(const Compare& compare)
+    {
+        std::shared_ptr<Snapshot> first(new Snapshot{Map(compare), 0});
+        std::atomic_store(&m_snapshot, std::shared_ptr<const Snapshot>(first));
+    }
+
+    /**
+     * @brief Destructor.  Snapshots held by readers stay valid.
+     */
+    template<typename Key, typename Value, typename Compare>
+    TSSnapshotMap<Key, Value, Compare>::~TSSnapshotMap()
+    {
+    }
+
+    /*
+     * \brief Makes next the current version.  The write lock must be held.
+     */
+    template<typename Key, typename Value, typename Compare>
+    void TSSnapshotMap<Key, Value, Compare>::publish(std::unique_ptr<Snapshot> next)
+    {
+        next->version = std::atomic_load(&m_snapshot)->version + 1;
+        std::atomic_store(&m_snapshot, std::shared_ptr<const Snapshot>(std::move(next)));
+    }
+
+    ////////////////////////////////////////
+    //            READ METHODS            //
+    ////////////////////////////////////////
+
+    /*
+     * \brief Returns the current version of the map.  It never changes, so it
+     *        can be iterated for as long as needed without blocking anyone.
+     */
+    template<typename Key, typename Value, typename Compare>
+    std::shared_ptr<const typename TSSnapshotMap<Key, Value, Compare>::Snapshot>
+            TSSnapshotMap<Key, Value, Compare>::snapshot() const
+    {
+        return std::atomic_load(&m_snapshot);
+    }
+
+    /*
+     * \brief Returns the version number of the current snapshot
+     */
+    template<typename Key, typename Value, typename Compare>
+    uint64_t TSSnapshotMap<Key, Value, Compare>::get_version() const
+    {
+        return snapshot()->version;
+    }
+
+    /*
+     * \brief Retrieves a value from the map
+     * \param [in] k The key to query the map with
+     *
+     * \return The value correspoding to Key k
+     */
+    template<typename Key, typename Value, typename Compare>
+    std::pair<Value, bool> TSSnapshotMap<Key, Value, Compare>::find(const Key& k) const
+    {
+        std::shared_ptr<const Snapshot> s = snapshot();
+        auto it = s->map.find(k);
+
+        if (it != s->map.end()) {
+            return std::make_pair(it->second, true);
+        }
+        return std::make_pair(Value{}, false);
+    }
+
+    /*
+     * \brief Copies a value from the map into v
+     * \param [in] k The key to query the map with
+     * \param [out] v Assigned the value corresponding to Key k; untouched if not found
+     *
+     * \return true if the key was found
+     */
+    template<typename Key, typename Value, typename Compare>
+    bool TSSnapshotMap<Key, Value, Compare>::find(const Key& k, Value& v) const
+    {
+        std::shared_ptr<const Snapshot> s = snapshot();
+        auto it = s->map.find(k);
+
+        if (it == s->map.end()) {
+            return false;
+        }
+        v = it->second;
+        return true;
+    }
+
+    /*
+     * \brief Retrieves the first value with a key not less than the given k
+     */
+    template<typename Key, typename Value, typename Compare>
+    std::pair<Value, bool> TSSnapshotMap<Key, Value, Compare>::lower_bound(const Key& k) const
+    {
+        std::shared_ptr<const Snapshot> s = snapshot();
+        auto it = s->map.lower_bound(k);
+
+        if (it != s->map.end()) {
+            return std::make_pair(it->second, true);
+        }
+        return std::make_pair(Value{}, false);
+    }
+
+    /*
+     * \brief returns the number of entries in the current snapshot
+     */
+    template<typename Key, typename Value, typename Compare>
+    size_t TSSnapshotMap<Key, Value, Compare>::size() const
+    {
+        return snapshot()->map.size();
+    }
+
+    /*
+     * \brief checks if the current snapshot is empty
+     */
+    template<typename Key, typename Value, typename Compare>
+    bool TSSnapshotMap<Key, Value, Compare>::empty() const
+    {
+        return snapshot()->map.empty();
+    }
+
+    /*
+     * \brief returns the keys of the current snapshot in order
+     */
+    template<typename Key, typename Value, typename Compare>
+    std::vector<Key> TSSnapshotMap<Key, Value, Compare>::getKeyList() const
+    {
+        std::shared_ptr<const Snapshot> s = snapshot();
+        std::vector<Key> keyList;
+        keyList.reserve(s->map.size());
+
+        for (auto it = s->map.cbegin(); it != s->map.cend(); it++) {
+            keyList.push_back(it->first);
+        }
+        return keyList;
+    }
+
+    /*
+     * \brief performs the given function on the key value pair specified (read-only)
+     * \param [in] k The key of the entry to operate on
+     * \param [in] f The (read-only) function to perform
+     *
+     * \return The value returned by the fucntion
+     */
+    template<typename Key, typename Value, typename Compare>
+    bool TSSnapshotMap<Key, Value, Compare>::
+            perform_ro(const Key& k, std::function<bool(const Key&,const Value&)> f) const
+    {
+        std::shared_ptr<const Snapshot> s = snapshot();
+        auto it = s->map.find(k);
+
+        if (it == s->map.end() || !f) {
+            return false;
+        }
+        return f(k, it->second);
+    }
+
+    /*
+     * \brief Applies f to every element of the current snapshot without
+     *        holding any lock
+     * \param [in] f The function to apply to each element in the map;
+     *               should return true on success, false on failure
+     * \return number of successful returns from f
+     */
+    template<typename Key, typename Value, typename Compare>
+    size_t TSSnapshotMap<Key, Value, Compare>::
+            for_each_ro(std::function<bool(const Key& k, const Value& v)> f) const
+    {
+        std::shared_ptr<const Snapshot> s = snapshot();
+        size_t numSuccess = 0;
+
+        for (auto it = s->map.cbegin(); it != s->map.cend(); it++) {
+            if (f(it->first, it->second)) {
+                numSuccess++;
+            }
+        }
+        return numSuccess;
+    }
+
+
+    ////////////////////////////////////////
+    //           WRITE METHODS            //
+    ////////////////////////////////////////
+
+    /*
+     * \brief Applies a batch of changes as one new version
+     * \param [in] f Changes a private copy of the map.  Return true to publish
+     *               the copy, false to discard it.
+     *
+     * \return true if a new version was published
+     */
+    template<typename Key, typename Value, typename Compare>
+    bool TSSnapshotMap<Key, Value, Compare>::update(std::function<bool(Map& m)> f)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        std::unique_ptr<Snapshot> next(new Snapshot(*std::atomic_load(&m_snapshot)));
+
+        if (!f(next->map)) {
+            return false;
+        }
+        publish(std::move(next));
+        return true;
+    }
+
+    /*
+     * \brief Add a key-value pair to the map
+     * \param [in] k The key associated with Value v
+     * \param [in] v The value to insert into the map
+     * \param [in] force Overwrite an existing value
+     *
+     * return true if the value was stored
+     */
+    template<typename Key, typename Value, typename Compare>
+    bool TSSnapshotMap<Key, Value, Compare>::emplace(const Key& k, const Value& v, bool force)
+    {
+        return update([&](Map& m) {
+            auto it = m.emplace(k, v);
+            if (!it.second) {
+                if (!force) {
+                    return false;
+                }
+                it.first->second = v;
+            }
+            return true;
+        });
+    }
+
+    /*
+     * \brief Erases an entry from the map
+     *
+     * \return true if the element was erased, false otherwise
+     */
+    template<typename Key, typename Value, typename Compare>
+    bool TSSnapshotMap<Key, Value, Compare>::erase(const Key& k)
+    {
+        // Check the current version first so a miss does not copy the map
+        if (!snapshot()->map.count(k)) {
+            return false;
+        }
+        return update([&k](Map& m) { return m.erase(k) == 1; });
+    }
+
+    /**
+     * \brief Returns the value associated with a key and erases it from the map
+     * \return A pair of the value and a bool to indicate success
+     **/
+    template<typename Key, typename Value, typename Compare>
+    std::pair<Value, bool> TSSnapshotMap<Key, Value, Compare>::remove(const Key& k)
+    {
+        std::pair<Value, bool> ret(Value{}, false);
+        update([&](Map& m) {
+            auto it = m.find(k);
+            if (it == m.end()) {
+                return false;
+            }
+            ret = std::make_pair(std::move(it->second), true);
+            m.erase(it);
+            return true;
+        });
+        return ret;
+    }
+
+    /*
+     * \brief performs the given function on a copy of the value and publishes
+     *        the change if the function returns true
+     * \param [in] k The key of the entry to operate on
+     * \param [in] f The function to perform
+     *
+     * \return The value returned by the fucntion
+     */
+    template<typename Key, typename Value, typename Compare>
+    bool TSSnapshotMap<Key, Value, Compare>::
+            perform(const Key& k, std::function<bool(const Key&,Value&)> f)
+    {
+        if (!f) {
+            return false;
+        }
+        return update([&](Map& m) {
+            auto it = m.find(k);
+            return it != m.end() && f(k, it->second);
+        });
+    }
+
+    /*
+     * \brief Removes every element f returns true for, as one new version.
+     *        Readers keep using the previous version while this runs.
+     * \return the number of entries deleted
+     */
+    template<typename Key, typename Value, typename Compare>
+    size_t TSSnapshotMap<Key, Value, Compare>::
+            delete_if(std::function<bool(const Key& k, const Value& v)> f)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        std::shared_ptr<const Snapshot> current = std::atomic_load(&m_snapshot);
+
+        // Build the survivors directly rather than copying everything and erasing
+        std::unique_ptr<Snapshot> next(new Snapshot{Map(current->map.key_comp()), 0});
+        size_t numErased = 0;
+        for (auto it = current->map.cbegin(); it != current->map.cend(); it++) {
+            if (f(it->first, it->second)) {
+                numErased++;
+            } else {
+                next->map.emplace_hint(next->map.end(), *it);
+            }
+        }
+
+        if (numErased) {
+            publish(std::move(next));
+        }
+        return numErased;
+    }
+
+    /*
+     * \brief Publishes an empty version
+     */
+    template<typename Key, typename Value, typename Compare>
+    void TSSnapshotMap<Key, Value, Compare>::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        std::shared_ptr<const Snapshot> current = std::atomic_load(&m_snapshot);
+        publish(std::unique_ptr<Snapshot>(new Snapshot{Map(current->map.key_comp()), 0}));
+    }
+
+}
@@ -0,0 +1,513 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file TSUnorderedMap.tcc
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "shared_mutex.h"
+
+namespace acl
+{
+
+    /*
+     * \brief Threadsafe hash map split into independently locked shards
+     *
+     * Offers the TSMap interface without the ordered lookups.  Each key lives
+     * in one of a power-of-two number of shards, each an unordered_map behind
+     * its own shared_mutex, so operations on different shards never contend.
+     *
+     * size() and empty() are exact.  for_each_ro(), for_each(), delete_if()
+     * and getKeyList() visit one shard at a time, so they see each shard
+     * consistently but may miss or include entries changed in other shards
+     * while they run.
+     *
+     * \tparam Key The key type
+     * \tparam Value The value type
+     * \tparam Hash Hash function for Key
+     * \tparam KeyEqual Equality comparison for Key
+     */
+    template<typename Key, typename Value, typename Hash = std::hash<Key>,
+            typename KeyEqual = std::equal_to<Key>> class TSUnorderedMap
+    {
+        protected:
+            struct Shard {
+                std::unordered_map<Key, Value, Hash, KeyEqual> map;    //!< Entries in this shard
+                mutable shared_mutex m;                                 //!< Protects map
+            };
+
+            Shard&       shard_for(const Key& k);
+            const Shard& shard_for(const Key& k) const;
+
+            std::vector<std::unique_ptr<Shard>> m_shards;    //!< The shards
+            size_t m_shardMask;                             //!< Number of shards - 1
+            std::atomic_size_t m_size;                      //!< Entries across all shards
+            Hash m_hash;
+
+        public:
+            TSUnorderedMap(size_t numShards = 16);
+            ~TSUnorderedMap();
+
+            // read functions
+            std::pair<Value, bool>  find(const Key& k) const;
+            bool                    find(const Key& k, Value& v) const;
+            size_t                  size() const;
+            bool                    empty() const;
+            std::vector<Key>        getKeyList() const;
+            size_t                  get_num_shards() const;
+
+            // write functions
+            bool                    emplace(const Key& k, const Value& v, bool force = false);
+            template<typename... Args>
+            bool                    createInPlace(const Key& k, Args&&... args);
+            std::pair<Value,bool>   replace(const Key& k, const Value& v, bool force = true);
+            bool                    erase(const Key& k, std::function<bool(const Key&,Value&)> f = nullptr);
+            std::pair<Value, bool>  remove(const Key& k);
+
+            bool                    perform(const Key& k, std::function<bool(const Key&,Value&)> f = nullptr);
+            bool                    perform_ro(const Key& k, std::function<bool(const Key&,const Value&)> f = nullptr) const;
+            void                    clear();
+
+            // function iterators
+            size_t for_each_ro(std::function<bool(const Key& k, const Value& v)> f) const;
+            size_t for_each(std::function<bool(const Key& k, Value& v)> f);
+            size_t delete_if(std::function<bool(const Key& k, Value& v)> f);
+    };
+
+    /**
+     * @brief Constructor
+     * @param numShards Number of independently locked shards.  Rounded up to a power of two.
+     **/
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    TSUnorderedMap<Key, Value, Hash, KeyEqual>::TSUnorderedMap(size_t numShards)
+        : m_size(0)
+    {
+        size_t count = 1;
+        while (count < numShards) {
+            count <<= 1;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            m_shards.push_back(std::unique_ptr<Shard>(new Shard));
+        }
+        m_shardMask = count - 1;
+    }
+
+    /**
+     * @brief Destructor. Clears the map
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    TSUnorderedMap<Key, Value, Hash, KeyEqual>::~TSUnorderedMap()
+    {
+        clear();
+    }
+
+    /**
+     * @brief Returns the shard responsible for a key.
+     *
+     * The hash is remixed so that the shard index does not use the same bits
+     * the shard's own hash table buckets on.
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    typename TSUnorderedMap<Key, Value, Hash, KeyEqual>::Shard&
+            TSUnorderedMap<Key, Value, Hash, KeyEqual>::shard_for(const Key& k)
+    {
+        uint64_t h = static_cast<uint64_t>(m_hash(k));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return *m_shards[h & m_shardMask];
+    }
+
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    const typename TSUnorderedMap<Key, Value, Hash, KeyEqual>::Shard&
+            TSUnorderedMap<Key, Value, Hash, KeyEqual>::shard_for(const Key& k) const
+    {
+        return const_cast<TSUnorderedMap*>(this)->shard_for(k);
+    }
+
+    ////////////////////////////////////////
+    //            READ METHODS            //
+    ////////////////////////////////////////
+
+    /*
+     * \brief Retrieves a value from the map
+     * \param [in] k The key to query the map with
+     *
+     * \return The value correspoding to Key k
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    std::pair<Value, bool> TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            find(const Key& k) const
+    {
+        const Shard& shard = shard_for(k);
+        acl::shared_lock lock(shard.m);
+        auto it = shard.map.find(k);
+
+        if (it != shard.map.end()){
+            return std::make_pair(it->second, true);
+        }
+        return std::make_pair(Value{}, false);
+    }
+
+    /*
+     * \brief Copies a value from the map into v
+     * \param [in] k The key to query the map with
+     * \param [out] v Assigned the value corresponding to Key k; untouched if not found
+     *
+     * \return true if the key was found
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    bool TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            find(const Key& k, Value& v) const
+    {
+        const Shard& shard = shard_for(k);
+        acl::shared_lock lock(shard.m);
+        auto it = shard.map.find(k);
+
+        if (it == shard.map.end()){
+            return false;
+        }
+        v = it->second;
+        return true;
+    }
+
+    /*
+     * \brief returns the number of entries in the map
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    size_t TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            size() const
+    {
+        return m_size;
+    }
+
+    /*
+     * \brief checks if the map is empty
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    bool TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            empty() const
+    {
+        return m_size == 0;
+    }
+
+    /*
+     * \brief returns every key in the map, in no particular order
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    std::vector<Key> TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            getKeyList() const
+    {
+        std::vector<Key> keyList;
+        keyList.reserve(m_size);
+
+        for (auto& shard : m_shards) {
+            acl::shared_lock lock(shard->m);
+            for (auto it = shard->map.cbegin(); it != shard->map.cend(); it++) {
+                keyList.push_back(it->first);
+            }
+        }
+        return keyList;
+    }
+
+    /*
+     * \brief returns the number of shards
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    size_t TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            get_num_shards() const
+    {
+        return m_shards.size();
+    }
+
+
+    ////////////////////////////////////////
+    //           WRITE METHODS            //
+    ////////////////////////////////////////
+
+    /*
+     * \brief Add a key-value pair to the map
+     * \param [in] k The key associated with Value v
+     * \param [in] v The value to insert into the map
+     * \param [in] force Overwrite an existing value
+     *
+     * return true if the value was stored
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    bool TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            emplace(const Key& k, const Value& v, bool force)
+    {
+        Shard& shard = shard_for(k);
+        std::lock_guard<acl::shared_mutex> lock(shard.m);
+        auto it = shard.map.emplace(k, v);
+
+        if (!it.second) {
+            if (!force) {
+                return false;
+            }
+            it.first->second = v;
+            return true;
+        }
+        m_size++;
+        return true;
+    }
+
+    /*
+     * \brief Create a value in place in the map
+     * \param [in] k The key associated with Value v
+     * \param [in] args the arguments to the constructor of the Value
+     *
+     * return true if the value was successfully created
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    template<typename... Args> bool TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            createInPlace(const Key& k, Args&&... args)
+    {
+        Shard& shard = shard_for(k);
+        std::lock_guard<acl::shared_mutex> lock(shard.m);
+        auto ret = shard.map.emplace(std::piecewise_construct,
+                                     std::forward_as_tuple(k),
+                                     std::forward_as_tuple(std::forward<Args>(args)...));
+        if (ret.second) {
+            m_size++;
+        }
+        return ret.second;
+    }
+
+    /*
+     * \brief Add a key-value pair to the map
+     * \param [in] k The key associated with Value v
+     * \param [in] v The value to insert into the map
+     *
+     * \return pair containing value previously in the specified index
+     * and bool containing true if no element previously existed, false if one
+     * did previously exist
+     *
+     * note: if nothing was in this location previously, the return Value will
+     * be the value that was passed in.
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    std::pair<Value,bool> TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            replace(const Key& k, const Value& v, bool force)
+    {
+        Shard& shard = shard_for(k);
+        std::lock_guard<acl::shared_mutex> lock(shard.m);
+        auto it = shard.map.emplace(k, v);
+
+        if (!it.second) {
+            Value oldVal = it.first->second;
+            if (force) {
+                it.first->second = v;
+            }
+            return std::pair<Value,bool>(oldVal, false);
+        }
+        m_size++;
+        return std::pair<Value,bool>(v, true);
+    }
+
+    /*
+     * \brief Erases an entry from the map
+     * \param [in] k The key of the entry to erase
+     * \param [in] f The function to perform on the key-value pair.
+     * If this function returns false, the entry will not be erased
+     *
+     * \return true if the element was erased, false otherwise
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    bool TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            erase(const Key& k, std::function<bool(const Key&,Value&)> f)
+    {
+        Shard& shard = shard_for(k);
+        std::lock_guard<acl::shared_mutex> lock(shard.m);
+        auto it = shard.map.find(k);
+
+        if (it == shard.map.end()){
+            return false;
+        }
+
+        // remove the element if no function or if function returns true
+        if (!f || f(k, it->second)) {
+            shard.map.erase(it);
+            m_size--;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * \brief Returns the value associated with a key and erases it from the map;
+     *        If the key is not found, nothing is erased
+     * \param[in] k The key to find, return, and remove
+     * \return A pair of the value and a bool to indicate success
+     **/
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    std::pair<Value, bool> TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            remove(const Key& k)
+    {
+        Shard& shard = shard_for(k);
+        std::lock_guard<acl::shared_mutex> lock(shard.m);
+        auto it = shard.map.find(k);
+
+        if (it != shard.map.end()) {
+            auto ret = std::make_pair(std::move(it->second), true);
+            shard.map.erase(it);
+            m_size--;
+            return ret;
+        }
+        return std::make_pair(Value{}, false);
+    }
+
+    /*
+     * \brief performs the given function on the key value pair specified
+     * \param [in] k The key of the entry to operate on
+     * \param [in] f The function to perform
+     *
+     * \return The value returned by the fucntion
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    bool TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            perform(const Key& k, std::function<bool(const Key&,Value&)> f)
+    {
+        Shard& shard = shard_for(k);
+        std::lock_guard<acl::shared_mutex> lock(shard.m);
+        auto it = shard.map.find(k);
+
+        if (it == shard.map.end() || !f) {
+            return false;
+        }
+        return f(k, it->second);
+    }
+
+    /*
+     * \brief performs the given function on the key value pair specified (read-only)
+     * \param [in] k The key of the entry to operate on
+     * \param [in] f The (read-only) function to perform
+     *
+     * \return The value returned by the fucntion
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    bool TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            perform_ro(const Key& k, std::function<bool(const Key&,const Value&)> f) const
+    {
+        const Shard& shard = shard_for(k);
+        acl::shared_lock lock(shard.m);
+        auto it = shard.map.find(k);
+
+        if (it == shard.map.end() || !f) {
+            return false;
+        }
+        return f(k, it->second);
+    }
+
+    /*
+     * \brief Clears all entries from the map
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    void TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            clear()
+    {
+        for (auto& shard : m_shards) {
+            std::lock_guard<acl::shared_mutex> lock(shard->m);
+            m_size -= shard->map.size();
+            shard->map.clear();
+        }
+    }
+
+
+    ////////////////////////////////////////
+    //         FUNCTION ITERATORS         //
+    ////////////////////////////////////////
+
+    /*
+     * \brief Takes a function pointer and applies it to all
+     *        elements in the map, one shard at a time
+     * \param [in] f The function to apply to each element in the map;
+     *               should return true on success, false on failure
+     * \return number of successful returns from f
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    size_t TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            for_each_ro(std::function<bool(const Key& k, const Value& v)> f) const
+    {
+        size_t numSuccess = 0;
+
+        for (auto& shard : m_shards) {
+            acl::shared_lock lock(shard->m);
+            for (auto it = shard->map.cbegin(); it != shard->map.cend(); it++) {
+                if (f(it->first, it->second)){
+                    numSuccess++;
+                }
+            }
+        }
+        return numSuccess;
+    }
+
+    /*
+     * \brief Takes a function pointer and applies it to all
+     *        elements in the map, one shard at a time
+     * \param [in] f The function to apply to each element in the map;
+     *               should return true on success, false on failure
+     * \return number of successful returns from f
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    size_t TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            for_each(std::function<bool(const Key& k, Value& v)> f)
+    {
+        size_t numSuccess = 0;
+
+        for (auto& shard : m_shards) {
+            std::lock_guard<acl::shared_mutex> lock(shard->m);
+            for (auto it = shard->map.begin(); it != shard->map.end(); it++) {
+                if (f(it->first, it->second)){
+                    numSuccess++;
+                }
+            }
+        }
+        return numSuccess;
+    }
+
+    /*
+     * \brief Iterates through the map and deletes each element that
+     *        meets some condition
+     * \param [in] f Function that takes Key, Value pair and returns
+     *        a boolean, applied to each element; If the function
+     *        returns true on an element, the element is deleted
+     * \return the number of entries deleted
+     */
+    template<typename Key, typename Value, typename Hash, typename KeyEqual>
+    size_t TSUnorderedMap<Key, Value, Hash, KeyEqual>::
+            delete_if(std::function<bool(const Key& k, Value& v)> f)
+    {
+        size_t numErased = 0;
+
+        for (auto& shard : m_shards) {
+            std::lock_guard<acl::shared_mutex> lock(shard->m);
+            for (auto it = shard->map.begin(); it != shard->map.end(); ) {
+                if (f(it->first, it->second)) {
+                    it = shard->map.erase(it);
+                    numErased++;
+                    m_size--;
+                } else {
+                    it++;
+                }
+            }
+        }
+        return numErased;
+    }
+
+}
@@ -0,0 +1,1109 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file AsyncFileIO.cpp
+ **/
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef ACL_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+#include "AsyncFileIO.h"
+
+namespace acl
+{
+namespace filesystem
+{
+namespace
+{
+   thread_local AsyncFileIO* t_reaping = nullptr;          //!<AsyncFileIO whose completions this thread is running
+
+#ifdef _WIN32
+  /**
+   * \brief sets errno from GetLastError(), so that Windows failures are
+   *        reported the same way as POSIX ones
+   **/
+   void set_errno_from_last_error()
+   {
+      switch (GetLastError()) {
+         case ERROR_FILE_NOT_FOUND:
+         case ERROR_PATH_NOT_FOUND:
+            errno = ENOENT;
+            break;
+         case ERROR_ACCESS_DENIED:
+         case ERROR_SHARING_VIOLATION:
+         case ERROR_LOCK_VIOLATION:
+            errno = EACCES;
+            break;
+         case ERROR_FILE_EXISTS:
+         case ERROR_ALREADY_EXISTS:
+            errno = EEXIST;
+            break;
+         case ERROR_DISK_FULL:
+         case ERROR_HANDLE_DISK_FULL:
+            errno = ENOSPC;
+            break;
+         case ERROR_INVALID_PARAMETER:
+         case ERROR_INVALID_HANDLE:
+            errno = EINVAL;
+            break;
+         case ERROR_NOT_ENOUGH_MEMORY:
+         case ERROR_OUTOFMEMORY:
+            errno = ENOMEM;
+            break;
+         default:
+            errno = EIO;
+            break;
+      }
+   }
+
+  /**
+   * \brief returns the handle behind a C runtime descriptor
+   **/
+   HANDLE handle_of(int fd)
+   {
+      return reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+   }
+#endif
+}
+
+   //////////////////////////////////////////////////////////////////////////
+   // AlignedBuffer
+   //////////////////////////////////////////////////////////////////////////
+
+  /**
+   * \brief allocates an aligned buffer
+   * \param [in] size bytes wanted; rounded up to a multiple of alignment
+   * \param [in] alignment a power of two no smaller than sizeof(void*)
+   *
+   * On failure the buffer is empty.
+   **/
+   AlignedBuffer::AlignedBuffer(size_t size, size_t alignment)
+   {
+      if (!size) {
+         return;
+      }
+      size_t rounded = static_cast<size_t>(align_up(size, alignment));
+#ifdef _WIN32
+      m_data = static_cast<char*>(_aligned_malloc(rounded, alignment));
+#else
+      void* p = nullptr;
+      if (posix_memalign(&p, alignment, rounded) == 0) {
+         m_data = static_cast<char*>(p);
+      }
+#endif
+      if (!m_data) {
+         std::cerr << "AlignedBuffer: unable to allocate " << rounded << " bytes" << std::endl;
+         return;
+      }
+      m_size = rounded;
+      m_alignment = alignment;
+   }
+
+   AlignedBuffer::~AlignedBuffer()
+   {
+#ifdef _WIN32
+      _aligned_free(m_data);
+#else
+      free(m_data);
+#endif
+   }
+
+   AlignedBuffer::AlignedBuffer(AlignedBuffer&& other)
+   {
+      *this = std::move(other);
+   }
+
+   AlignedBuffer& AlignedBuffer::operator=(AlignedBuffer&& other)
+   {
+      std::swap(m_data, other.m_data);
+      std::swap(m_size, other.m_size);
+      std::swap(m_alignment, other.m_alignment);
+      return *this;
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+   // File
+   //////////////////////////////////////////////////////////////////////////
+
+   File::File() {}
+
+  /**
+   * \brief opens a file; check is_open() for success
+   * \param [in] name file to open
+   * \param [in] mode bitwise or of File::Mode values
+   **/
+   File::File(std::string name, int mode)
+   {
+      open(name, mode);
+   }
+
+   File::~File()
+   {
+      close();
+   }
+
+   File::File(File&& other)
+   {
+      *this = std::move(other);
+   }
+
+   File& File::operator=(File&& other)
+   {
+      std::swap(m_fd, other.m_fd);
+      std::swap(m_mode, other.m_mode);
+      return *this;
+   }
+
+  /**
+   * \brief opens a file, closing any file already open
+   * \param [in] name file to open
+   * \param [in] mode bitwise or of File::Mode values
+   * \return true on success, false on failure with errno set
+   **/
+   bool File::open(std::string name, int mode)
+   {
+      close();
+#ifdef _WIN32
+      DWORD access = 0;
+      if ((mode & READ) || !(mode & WRITE)) {
+         access |= GENERIC_READ;
+      }
+      if (mode & WRITE) {
+         access |= GENERIC_WRITE;
+      }
+      DWORD creation = OPEN_EXISTING;
+      if ((mode & CREATE) && (mode & TRUNCATE)) {
+         creation = CREATE_ALWAYS;
+      } else if (mode & CREATE) {
+         creation = OPEN_ALWAYS;
+      } else if (mode & TRUNCATE) {
+         creation = TRUNCATE_EXISTING;
+      }
+      DWORD flags = FILE_ATTRIBUTE_NORMAL;
+      if (mode & DIRECT) {
+         flags |= FILE_FLAG_NO_BUFFERING;
+      }
+      if (mode & DSYNC) {
+         flags |= FILE_FLAG_WRITE_THROUGH;
+      }
+
+      HANDLE handle = CreateFileA(name.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, creation, flags, nullptr);
+      if (handle == INVALID_HANDLE_VALUE) {
+         set_errno_from_last_error();
+         int err = errno;
+         std::cerr << "File::open: unable to open " << name << ": " << strerror(err) << std::endl;
+         errno = err;
+         return false;
+      }
+      // Keep a C runtime descriptor so that fd() means the same on every platform
+      int fd = _open_osfhandle(reinterpret_cast<intptr_t>(handle), _O_BINARY);
+      if (fd < 0) {
+         int err = errno;
+         CloseHandle(handle);
+         errno = err;
+         return false;
+      }
+      m_fd = fd;
+      m_mode = mode;
+      return true;
+#else
+      int flags = O_CLOEXEC;
+      if ((mode & READ) && (mode & WRITE)) {
+         flags |= O_RDWR;
+      } else if (mode & WRITE) {
+         flags |= O_WRONLY;
+      } else {
+         flags |= O_RDONLY;
+      }
+      if (mode & CREATE) {
+         flags |= O_CREAT;
+      }
+      if (mode & TRUNCATE) {
+         flags |= O_TRUNC;
+      }
+      if (mode & DSYNC) {
+         flags |= O_DSYNC;
+      }
+#ifdef O_DIRECT
+      if (mode & DIRECT) {
+         flags |= O_DIRECT;
+      }
+#endif
+
+      int fd = ::open(name.c_str(), flags, 0666);
+      if (fd < 0) {
+         int err = errno;
+         std::cerr << "File::open: unable to open " << name << ": " << strerror(err) << std::endl;
+         errno = err;
+         return false;
+      }
+#ifdef __APPLE__
+      if (mode & DIRECT) {
+         fcntl(fd, F_NOCACHE, 1);
+      }
+#endif
+      m_fd = fd;
+      m_mode = mode;
+      return true;
+#endif
+   }
+
+  /**
+   * \brief closes the file if it is open
+   **/
+   void File::close()
+   {
+      if (m_fd >= 0) {
+#ifdef _WIN32
+         _close(m_fd);
+#else
+         ::close(m_fd);
+#endif
+      }
+      m_fd = -1;
+      m_mode = 0;
+   }
+
+  /**
+   * \brief reads from an offset without moving the file offset
+   * \return bytes read, short only at end of file, or -1 on error
+   **/
+   int64_t File::pread(void* data, size_t length, uint64_t offset)
+   {
+      IOVec vec;
+      vec.data = data;
+      vec.length = length;
+      return preadv(&vec, 1, offset);
+   }
+
+  /**
+   * \brief writes at an offset without moving the file offset
+   * \return bytes written or -1 on error
+   **/
+   int64_t File::pwrite(const void* data, size_t length, uint64_t offset)
+   {
+      IOVec vec;
+      vec.data = const_cast<void*>(data);
+      vec.length = length;
+      return pwritev(&vec, 1, offset);
+   }
+
+#ifndef _WIN32
+namespace
+{
+  /**
+   * \brief runs preadv or pwritev until every buffer is done, end of file or an error
+   **/
+   int64_t transfer(int fd, const IOVec* vecs, int count, uint64_t offset, bool write)
+   {
+      std::vector<struct iovec> iov(count);
+      for (int i = 0; i < count; i++) {
+         iov[i].iov_base = vecs[i].data;
+         iov[i].iov_len = vecs[i].length;
+      }
+
+      int64_t done = 0;
+      size_t first = 0;
+      while (first < iov.size()) {
+         if (!iov[first].iov_len) {
+            first++;
+            continue;
+         }
+         int n = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+         ssize_t rc = write ? ::pwritev(fd, &iov[first], n, static_cast<off_t>(offset + done))
+                            : ::preadv(fd, &iov[first], n, static_cast<off_t>(offset + done));
+         if (rc < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            return -1;
+         }
+         if (rc == 0) {
+            break;
+         }
+         done += rc;
+
+         // Skip the buffers that were finished and trim a partly done one
+         size_t left = static_cast<size_t>(rc);
+         while (left && left >= iov[first].iov_len) {
+            left -= iov[first].iov_len;
+            first++;
+         }
+         if (left) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+            iov[first].iov_len -= left;
+         }
+      }
+      return done;
+   }
+}
+#else
+namespace
+{
+  /**
+   * \brief runs ReadFile or WriteFile at explicit offsets until every buffer
+   *        is done, end of file or an error
+   **/
+   int64_t transfer(int fd, const IOVec* vecs, int count, uint64_t offset, bool write)
+   {
+      HANDLE handle = handle_of(fd);
+      if (handle == INVALID_HANDLE_VALUE) {
+         errno = EBADF;
+         return -1;
+      }
+
+      int64_t done = 0;
+      for (int i = 0; i < count; i++) {
+         char* data = static_cast<char*>(vecs[i].data);
+         size_t left = vecs[i].length;
+         while (left) {
+            // The offset goes in an OVERLAPPED, so each call is positional
+            OVERLAPPED overlapped;
+            memset(&overlapped, 0, sizeof(overlapped));
+            uint64_t at = offset + static_cast<uint64_t>(done);
+            overlapped.Offset = static_cast<DWORD>(at);
+            overlapped.OffsetHigh = static_cast<DWORD>(at >> 32);
+
+            DWORD chunk = static_cast<DWORD>(std::min<size_t>(left, 1u << 30));
+            DWORD n = 0;
+            BOOL ok = write ? WriteFile(handle, data, chunk, &n, &overlapped)
+                            : ReadFile(handle, data, chunk, &n, &overlapped);
+            if (!ok) {
+               if (!write && GetLastError() == ERROR_HANDLE_EOF) {
+                  return done;
+               }
+               set_errno_from_last_error();
+               return -1;
+            }
+            if (n == 0) {
+               return done;
+            }
+            done += n;
+            data += n;
+            left -= n;
+         }
+      }
+      return done;
+   }
+}
+#endif
+
+  /**
+   * \brief reads into several buffers from an offset without moving the file offset
+   * \return bytes read, short only at end of file, or -1 on error
+   **/
+   int64_t File::preadv(const IOVec* vecs, int count, uint64_t offset)
+   {
+      return transfer(m_fd, vecs, count, offset, false);
+   }
+
+  /**
+   * \brief writes several buffers at an offset without moving the file offset
+   * \return bytes written or -1 on error
+   **/
+   int64_t File::pwritev(const IOVec* vecs, int count, uint64_t offset)
+   {
+      return transfer(m_fd, vecs, count, offset, true);
+   }
+
+  /**
+   * \brief gets the size of the open file
+   * \return the size in bytes, -1 on error
+   **/
+   int64_t File::size()
+   {
+#ifdef _WIN32
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(handle_of(m_fd), &size)) {
+         set_errno_from_last_error();
+         return -1;
+      }
+      return size.QuadPart;
+#else
+      struct stat s;
+      return fstat(m_fd, &s) == 0 ? s.st_size : -1;
+#endif
+   }
+
+  /**
+   * \brief sets the size of the file, dropping or zero-filling the end
+   * \return true on success, false on failure with errno set
+   **/
+   bool File::truncate(uint64_t size)
+   {
+#ifdef _WIN32
+      FILE_END_OF_FILE_INFO info;
+      info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+      if (!SetFileInformationByHandle(handle_of(m_fd), FileEndOfFileInfo, &info, sizeof(info))) {
+         set_errno_from_last_error();
+         return false;
+      }
+      return true;
+#else
+      return ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#endif
+   }
+
+  /**
+   * \brief reserves disk space for a range so that writing it later does
+   *        not fail for lack of space or fragment the file.  Grows the file
+   *        if the range ends past its end.
+   * \return true on success, false on failure with errno set
+   **/
+   bool File::allocate(uint64_t offset, uint64_t length)
+   {
+#if defined(_WIN32)
+      int64_t current = size();
+      if (current < 0) {
+         return false;
+      }
+      if (static_cast<uint64_t>(current) >= offset + length) {
+         return true;
+      }
+      // An allocation smaller than the file would cut it short, so only
+      // grow.  Reserving clusters does not change the size, so set that as
+      // posix_fallocate() would.
+      FILE_ALLOCATION_INFO info;
+      info.AllocationSize.QuadPart = static_cast<LONGLONG>(offset + length);
+      if (!SetFileInformationByHandle(handle_of(m_fd), FileAllocationInfo, &info, sizeof(info))) {
+         set_errno_from_last_error();
+         return false;
+      }
+      return truncate(offset + length);
+#elif defined(__linux__)
+      int rc = posix_fallocate(m_fd, static_cast<off_t>(offset), static_cast<off_t>(length));
+      if (rc != 0) {
+         errno = rc;
+         return false;
+      }
+      return true;
+#else
+      int64_t current = size();
+      if (current < 0) {
+         return false;
+      }
+      return static_cast<uint64_t>(current) >= offset + length || truncate(offset + length);
+#endif
+   }
+
+  /**
+   * \brief waits for written data to reach the disk
+   * \param [in] dataOnly skip metadata, such as the modification time, that
+   *        is not needed to read the data back (fdatasync)
+   * \return true on success, false on failure with errno set
+   **/
+   bool File::sync(bool dataOnly)
+   {
+#if defined(_WIN32)
+      (void)dataOnly;
+      if (!FlushFileBuffers(handle_of(m_fd))) {
+         set_errno_from_last_error();
+         return false;
+      }
+      return true;
+#elif defined(__APPLE__)
+      (void)dataOnly;
+      return fsync(m_fd) == 0;
+#else
+      return (dataOnly ? fdatasync(m_fd) : fsync(m_fd)) == 0;
+#endif
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+   // IORequest
+   //////////////////////////////////////////////////////////////////////////
+
+  /**
+   * \brief makes a request to read one buffer
+   **/
+   IORequest IORequest::read(File& file, void* data, size_t length, uint64_t offset,
+                             std::function<void(int64_t)> callback)
+   {
+      IORequest r;
+      r.file = &file;
+      r.op = Op::Read;
+      r.offset = offset;
+      r.vecs.resize(1);
+      r.vecs[0].data = data;
+      r.vecs[0].length = length;
+      r.callback = std::move(callback);
+      return r;
+   }
+
+  /**
+   * \brief makes a request to write one buffer
+   **/
+   IORequest IORequest::write(File& file, const void* data, size_t length, uint64_t offset,
+                              std::function<void(int64_t)> callback)
+   {
+      IORequest r = read(file, const_cast<void*>(data), length, offset, std::move(callback));
+      r.op = Op::Write;
+      return r;
+   }
+
+  /**
+   * \brief makes a request to wait for the file's written data to reach
+   *        the disk, like File::sync(true).  Not ordered with requests in
+   *        flight; submit it after their callbacks have run.
+   **/
+   IORequest IORequest::sync(File& file, std::function<void(int64_t)> callback)
+   {
+      IORequest r;
+      r.file = &file;
+      r.op = Op::Sync;
+      r.callback = std::move(callback);
+      return r;
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+   // AsyncFileIO
+   //////////////////////////////////////////////////////////////////////////
+
+#ifdef ACL_HAVE_IO_URING
+  /**
+   * \brief the mapped rings of an io_uring and the requests in flight on it
+   **/
+   struct AsyncFileIO::Ring {
+      static const uint64_t WAKE = ~static_cast<uint64_t>(0);   //!<user_data of the no-op that stops the reaper
+
+      struct Slot {
+         IORequest                  request;
+         std::vector<struct iovec>  iov;
+         size_t                     first = 0;             //!<First iov not yet finished
+         int64_t                    done = 0;              //!<Bytes transferred so far
+      };
+
+      int               fd = -1;
+      void*             sqPtr = MAP_FAILED;
+      size_t            sqSize = 0;
+      void*             cqPtr = MAP_FAILED;
+      size_t            cqSize = 0;
+      io_uring_sqe*     sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+      size_t            sqesSize = 0;
+      unsigned*         sqTail = nullptr;
+      unsigned*         sqMask = nullptr;
+      unsigned*         sqArray = nullptr;
+      unsigned          sqEntries = 0;
+      unsigned*         cqHead = nullptr;
+      unsigned*         cqTail = nullptr;
+      unsigned*         cqMask = nullptr;
+      io_uring_cqe*     cqes = nullptr;
+      std::vector<Slot> slots;                           //!<Indexed by user_data
+      std::vector<uint32_t> free;                         //!<Unused slots
+
+      ~Ring()
+      {
+         if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+         }
+         if (cqPtr != MAP_FAILED && cqPtr != sqPtr) {
+            munmap(cqPtr, cqSize);
+         }
+         if (sqPtr != MAP_FAILED) {
+            munmap(sqPtr, sqSize);
+         }
+         if (fd >= 0) {
+            close(fd);
+         }
+      }
+
+      int enter(unsigned submit, unsigned wait)
+      {
+         return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait,
+                                         wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+      }
+
+      io_uring_sqe* next_sqe(unsigned& tail)
+      {
+         unsigned index = tail & *sqMask;
+         sqArray[index] = index;
+         tail++;
+         io_uring_sqe* sqe = &sqes[index];
+         memset(sqe, 0, sizeof(*sqe));
+         return sqe;
+      }
+
+     /**
+      * \brief fills the next submission entry with what is left of a slot's request
+      **/
+      void queue(uint32_t index, unsigned& tail)
+      {
+         Slot& slot = slots[index];
+         io_uring_sqe* sqe = next_sqe(tail);
+         sqe->fd = slot.request.file->fd();
+         sqe->user_data = index;
+         switch (slot.request.op) {
+            case IORequest::Op::Read:
+            case IORequest::Op::Write:
+               sqe->opcode = slot.request.op == IORequest::Op::Read ? IORING_OP_READV : IORING_OP_WRITEV;
+               sqe->off = slot.request.offset + slot.done;
+               sqe->addr = reinterpret_cast<uint64_t>(slot.iov.data() + slot.first);
+               sqe->len = static_cast<uint32_t>(slot.iov.size() - slot.first);
+               break;
+            case IORequest::Op::Sync:
+               sqe->opcode = IORING_OP_FSYNC;
+               sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+               break;
+         }
+      }
+
+     /**
+      * \brief counts bytes transferred against a slot's buffers
+      * \return true if some buffers are not yet finished
+      **/
+      bool advance(Slot& slot, size_t bytes)
+      {
+         slot.done += bytes;
+         while (slot.first < slot.iov.size() && bytes >= slot.iov[slot.first].iov_len) {
+            bytes -= slot.iov[slot.first].iov_len;
+            slot.first++;
+         }
+         if (bytes) {
+            slot.iov[slot.first].iov_base = static_cast<char*>(slot.iov[slot.first].iov_base) + bytes;
+            slot.iov[slot.first].iov_len -= bytes;
+         }
+         return slot.first < slot.iov.size();
+      }
+
+     /**
+      * \brief hands queued entries to the kernel
+      * \return the number the kernel accepted, which is less than queued
+      *         after an error other than a retryable one; errno is set
+      **/
+      unsigned submit(unsigned queued)
+      {
+         unsigned accepted = 0;
+         while (accepted < queued) {
+            int rc = enter(queued - accepted, 0);
+            if (rc < 0) {
+               if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                  continue;
+               }
+               int err = errno;
+               perror("AsyncFileIO: io_uring_enter");
+               errno = err;
+               break;
+            }
+            accepted += static_cast<unsigned>(rc);
+         }
+         return accepted;
+      }
+
+     /**
+      * \brief takes back the last count entries queued, which the kernel has
+      *        not read; it consumes the submission ring in order
+      **/
+      void unqueue(unsigned count)
+      {
+         __atomic_store_n(sqTail, *sqTail - count, __ATOMIC_RELEASE);
+      }
+   };
+#else
+   struct AsyncFileIO::Ring {};
+#endif
+
+  /**
+   * \brief creates the queue
+   * \param [in] depth the most requests in flight at once
+   * \param [in] backend Auto uses io_uring where the kernel offers it and
+   *        threads otherwise
+   * \param [in] pool pool for the Threads backend, or nullptr to create
+   *        one of four threads.  Must outlive the queue.
+   **/
+   AsyncFileIO::AsyncFileIO(unsigned depth, Backend backend, ThreadPool* pool):
+      m_backend(Backend::Threads), m_depth(std::max(depth, 1u)), m_pool(pool), m_pending(0),
+      m_reaper([this] { reap(); })
+   {
+      if (backend != Backend::Threads && start_ring(m_depth)) {
+         m_backend = Backend::IOUring;
+         m_reaper.Start();
+         return;
+      }
+      if (backend == Backend::IOUring) {
+         std::cerr << "AsyncFileIO: io_uring is not available; using threads" << std::endl;
+      }
+      if (!m_pool) {
+         m_ownPool.reset(new ThreadPool(4, static_cast<int>(m_depth)));
+         m_ownPool->setBlocking(true);
+         m_ownPool->Start();
+         m_pool = m_ownPool.get();
+      }
+   }
+
+  /**
+   * \brief waits for requests in flight, then stops the reaper
+   **/
+   AsyncFileIO::~AsyncFileIO()
+   {
+      wait_all();
+#ifdef ACL_HAVE_IO_URING
+      if (m_ring) {
+         m_reaper.Stop();
+         {
+            // Wake the reaper from io_uring_enter with a no-op
+            std::lock_guard<std::mutex> lock(m_mutex);
+            unsigned tail = *m_ring->sqTail;
+            io_uring_sqe* sqe = m_ring->next_sqe(tail);
+            sqe->opcode = IORING_OP_NOP;
+            sqe->user_data = Ring::WAKE;
+            __atomic_store_n(m_ring->sqTail, tail, __ATOMIC_RELEASE);
+            m_ring->submit(1);
+         }
+         m_reaper.Join();
+      }
+#endif
+      if (m_ownPool) {
+         m_ownPool->Stop();
+         m_ownPool->Join();
+      }
+   }
+
+  /**
+   * \brief sets up an io_uring and maps its rings
+   * \return false if io_uring is not available
+   **/
+   bool AsyncFileIO::start_ring(unsigned depth)
+   {
+#ifdef ACL_HAVE_IO_URING
+      std::unique_ptr<Ring> ring(new Ring);
+      struct io_uring_params p;
+      memset(&p, 0, sizeof(p));
+      // Room for the wake-up no-op on top of a full set of requests
+      ring->fd = static_cast<int>(syscall(__NR_io_uring_setup, depth + 1, &p));
+      if (ring->fd < 0) {
+         return false;
+      }
+
+      ring->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      ring->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+      if (p.features & IORING_FEAT_SINGLE_MMAP) {
+         ring->sqSize = ring->cqSize = std::max(ring->sqSize, ring->cqSize);
+      }
+      ring->sqPtr = mmap(nullptr, ring->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+      if (ring->sqPtr == MAP_FAILED) {
+         return false;
+      }
+      if (p.features & IORING_FEAT_SINGLE_MMAP) {
+         ring->cqPtr = ring->sqPtr;
+      } else {
+         ring->cqPtr = mmap(nullptr, ring->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+         if (ring->cqPtr == MAP_FAILED) {
+            return false;
+         }
+      }
+      ring->sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+      ring->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES));
+      if (ring->sqes == MAP_FAILED) {
+         return false;
+      }
+
+      char* sq = static_cast<char*>(ring->sqPtr);
+      char* cq = static_cast<char*>(ring->cqPtr);
+      ring->sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+      ring->sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+      ring->sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+      ring->sqEntries = p.sq_entries;
+      ring->cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+      ring->cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+      ring->cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+      ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+      ring->slots.resize(depth);
+      for (uint32_t i = depth; i > 0; i--) {
+         ring->free.push_back(i - 1);
+      }
+      m_ring = std::move(ring);
+      return true;
+#else
+      (void)depth;
+      return false;
+#endif
+   }
+
+  /**
+   * \brief queues one request
+   * \return false if the request was not queued; its callback is not called
+   **/
+   bool AsyncFileIO::submit(IORequest request)
+   {
+      std::vector<IORequest> batch;
+      batch.push_back(std::move(request));
+      return submit(batch);
+   }
+
+  /**
+   * \brief queues a batch of requests, moving them out of the vector
+   *
+   * With io_uring, the batch is handed to the kernel with one system call
+   * for each depth requests.
+   *
+   * \return false if the batch could not be queued.  Requests that were
+   *         queued will complete; those that were not are left in the
+   *         vector at their positions, and their callbacks are not called.
+   **/
+   bool AsyncFileIO::submit(std::vector<IORequest>& batch)
+   {
+      for (auto& request : batch) {
+         if (!request.file || !request.file->is_open()) {
+            std::cerr << "AsyncFileIO::submit: request has no open file" << std::endl;
+            return false;
+         }
+      }
+      if (m_ring) {
+         return submit_ring(batch);
+      }
+
+      for (auto& request : batch) {
+         m_pending++;
+         auto job = std::make_shared<IORequest>(std::move(request));
+         if (!m_pool->push_job([this, job]() { run_sync(*job); finish(1); })) {
+            run_sync(*job);
+            finish(1);
+         }
+      }
+      return true;
+   }
+
+  /**
+   * \brief copies a batch into the submission ring and enters the kernel,
+   *        waiting for slots when depth requests are already in flight
+   **/
+   bool AsyncFileIO::submit_ring(std::vector<IORequest>& batch)
+   {
+#ifdef ACL_HAVE_IO_URING
+      std::unique_lock<std::mutex> lock(m_mutex);
+      size_t next = 0;
+      while (next < batch.size()) {
+         while (m_ring->free.empty()) {
+            if (t_reaping == this) {
+               // Only this thread frees slots, so run completions instead of waiting
+               lock.unlock();
+               reap();
+               lock.lock();
+            } else {
+               m_spaceCv.wait(lock);
+            }
+         }
+
+         unsigned tail = *m_ring->sqTail;
+         unsigned queued = 0;
+         std::vector<std::pair<uint32_t, size_t>> slots;    // Slot and batch position of each entry
+         while (next < batch.size() && !m_ring->free.empty() && queued < m_ring->sqEntries) {
+            uint32_t index = m_ring->free.back();
+            m_ring->free.pop_back();
+            slots.push_back(std::make_pair(index, next));
+            Ring::Slot& slot = m_ring->slots[index];
+            slot.request = std::move(batch[next++]);
+            slot.iov.resize(slot.request.vecs.size());
+            for (size_t i = 0; i < slot.iov.size(); i++) {
+               slot.iov[i].iov_base = slot.request.vecs[i].data;
+               slot.iov[i].iov_len = slot.request.vecs[i].length;
+            }
+            slot.first = 0;
+            slot.done = 0;
+            m_ring->queue(index, tail);
+            queued++;
+         }
+         __atomic_store_n(m_ring->sqTail, tail, __ATOMIC_RELEASE);
+         unsigned accepted = m_ring->submit(queued);
+
+         // The reaper needs m_mutex to collect completions, so counting
+         // after the kernel has them cannot race with finish()
+         m_pending += accepted;
+         if (accepted < queued) {
+            // Give the rest back to the caller and free their slots
+            m_ring->unqueue(queued - accepted);
+            for (size_t i = accepted; i < slots.size(); i++) {
+               Ring::Slot& slot = m_ring->slots[slots[i].first];
+               batch[slots[i].second] = std::move(slot.request);
+               slot.request = IORequest();
+               m_ring->free.push_back(slots[i].first);
+            }
+            m_spaceCv.notify_all();
+            return false;
+         }
+      }
+      return true;
+#else
+      (void)batch;
+      return false;
+#endif
+   }
+
+  /**
+   * \brief waits for at least one io_uring completion, then runs the
+   *        callbacks of all that have arrived.  The reaper's main loop.
+   **/
+   void AsyncFileIO::reap()
+   {
+#ifdef ACL_HAVE_IO_URING
+      if (m_ring->enter(0, 1) < 0 && errno != EINTR) {
+         perror("AsyncFileIO: io_uring_enter");
+         m_reaper.sleep(0.001);
+         return;
+      }
+
+      std::vector<std::pair<std::function<void(int64_t)>, int64_t>> done;
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         unsigned head = *m_ring->cqHead;
+         unsigned tail = __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE);
+         unsigned sqTail = *m_ring->sqTail;
+         std::vector<uint32_t> requeued;
+         for (; head != tail; head++) {
+            const io_uring_cqe& cqe = m_ring->cqes[head & *m_ring->cqMask];
+            if (cqe.user_data == Ring::WAKE) {
+               continue;
+            }
+            uint32_t index = static_cast<uint32_t>(cqe.user_data);
+            Ring::Slot& slot = m_ring->slots[index];
+            int64_t result = cqe.res;
+            if (result > 0 && slot.request.op != IORequest::Op::Sync) {
+               // Send the rest of a short transfer back, as File::preadv() would loop
+               if (m_ring->advance(slot, static_cast<size_t>(result))) {
+                  m_ring->queue(index, sqTail);
+                  requeued.push_back(index);
+                  continue;
+               }
+               result = slot.done;
+            } else if (result == 0) {
+               result = slot.done;
+            }
+            done.push_back(std::make_pair(std::move(slot.request.callback), result));
+            slot.request = IORequest();
+            m_ring->free.push_back(index);
+         }
+         __atomic_store_n(m_ring->cqHead, head, __ATOMIC_RELEASE);
+         if (!requeued.empty()) {
+            __atomic_store_n(m_ring->sqTail, sqTail, __ATOMIC_RELEASE);
+            unsigned count = static_cast<unsigned>(requeued.size());
+            unsigned accepted = m_ring->submit(count);
+            if (accepted < count) {
+               // Complete what the kernel would not take with what was
+               // transferred so far, or the error if nothing was
+               int err = errno;
+               m_ring->unqueue(count - accepted);
+               for (size_t i = accepted; i < requeued.size(); i++) {
+                  Ring::Slot& slot = m_ring->slots[requeued[i]];
+                  done.push_back(std::make_pair(std::move(slot.request.callback),
+                                                slot.done > 0 ? slot.done : -static_cast<int64_t>(err)));
+                  slot.request = IORequest();
+                  m_ring->free.push_back(requeued[i]);
+               }
+            }
+         }
+         if (!done.empty()) {
+            m_spaceCv.notify_all();
+         }
+      }
+
+      AsyncFileIO* outer = t_reaping;
+      t_reaping = this;
+      for (auto& d : done) {
+         if (d.first) {
+            d.first(d.second);
+         }
+      }
+      t_reaping = outer;
+      finish(done.size());
+#endif
+   }
+
+  /**
+   * \brief runs a request on the calling thread and calls its callback
+   **/
+   void AsyncFileIO::run_sync(IORequest& request)
+   {
+      int64_t result = 0;
+      switch (request.op) {
+         case IORequest::Op::Read:
+            result = request.file->preadv(request.vecs.data(), static_cast<int>(request.vecs.size()), request.offset);
+            break;
+         case IORequest::Op::Write:
+            result = request.file->pwritev(request.vecs.data(), static_cast<int>(request.vecs.size()), request.offset);
+            break;
+         case IORequest::Op::Sync:
+            result = request.file->sync(true) ? 0 : -1;
+            break;
+      }
+      if (result < 0) {
+         result = -errno;
+      }
+      if (request.callback) {
+         request.callback(result);
+      }
+   }
+
+  /**
+   * \brief counts completed requests and wakes wait_all() when none are left
+   **/
+   void AsyncFileIO::finish(size_t count)
+   {
+      if (!count) {
+         return;
+      }
+      if ((m_pending -= count) == 0) {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_doneCv.notify_all();
+      }
+   }
+
+  /**
+   * \brief waits until every submitted request has completed and its
+   *        callback has returned.  Must not be called from a callback.
+   * \param [in] timeout the longest to wait in seconds; negative waits forever
+   * \return true if nothing is pending
+   **/
+   bool AsyncFileIO::wait_all(double timeout)
+   {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      auto idle = [this] { return m_pending == 0; };
+      if (timeout < 0) {
+         m_doneCv.wait(lock, idle);
+         return true;
+      }
+      return m_doneCv.wait_for(lock, std::chrono::duration<double>(timeout), idle);
+   }
+
+  /**
+   * \brief returns the number of requests submitted but not yet completed
+   **/
+   size_t AsyncFileIO::pending()
+   {
+      return m_pending;
+   }
+}
+}
@@ -0,0 +1,195 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file AsyncFileIO.h
+ **/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <ThreadPool.h>
+#include <ThreadWorker.h>
+
+namespace acl
+{
+namespace filesystem
+{
+   const size_t DIRECT_IO_ALIGNMENT = 4096;                //!<Buffer, offset and length alignment that satisfies O_DIRECT
+
+   /**
+   *  \brief one buffer of a vectored read or write
+   **/
+   struct IOVec {
+      void*  data   = nullptr;
+      size_t length = 0;
+   };
+
+   /**
+   *  \brief owns a block of memory aligned for O_DIRECT transfers
+   *
+   *  The size is rounded up to a multiple of the alignment, so a whole
+   *  buffer is always a valid direct transfer.
+   **/
+   class AlignedBuffer {
+   public:
+      AlignedBuffer(size_t size = 0, size_t alignment = DIRECT_IO_ALIGNMENT);
+      ~AlignedBuffer();
+      AlignedBuffer(AlignedBuffer&& other);
+      AlignedBuffer& operator=(AlignedBuffer&& other);
+      AlignedBuffer(const AlignedBuffer&) = delete;
+      AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+      char*  data()      { return m_data; }
+      size_t size() const { return m_size; }
+      size_t alignment() const { return m_alignment; }
+
+   private:
+      char*  m_data      = nullptr;
+      size_t m_size      = 0;
+      size_t m_alignment = 0;
+   };
+
+   /**
+   *  \brief rounds a size or offset up to a multiple of a power-of-two alignment
+   **/
+   inline uint64_t align_up(uint64_t value, uint64_t alignment = DIRECT_IO_ALIGNMENT)
+   {
+      return (value + alignment - 1) & ~(alignment - 1);
+   }
+
+   /**
+   *  \brief an open file descriptor with positional and vectored I/O
+   *
+   *  Positional calls do not move the file offset, so several threads may
+   *  read and write the same File at once.  Reads and writes retry after
+   *  signals and short transfers, so they return less than asked for only
+   *  at end of file.  Errors are returned as -1 with errno set, like the
+   *  calls they wrap.
+   *
+   *  On Windows the file is opened with CreateFile and transfers use
+   *  ReadFile and WriteFile with the offset in an OVERLAPPED, which do
+   *  move the file pointer; nothing here relies on it.
+   **/
+   class File {
+   public:
+      enum Mode {
+         READ     = 1,                                     //!<Open for reading
+         WRITE    = 2,                                     //!<Open for writing
+         CREATE   = 4,                                     //!<Create the file if it does not exist
+         TRUNCATE = 8,                                     //!<Empty the file on open
+         DIRECT   = 16,                                    //!<Bypass the page cache (O_DIRECT); buffers, offsets and lengths must be aligned
+         DSYNC    = 32                                     //!<Each write returns once its data is on disk (O_DSYNC)
+      };
+
+      File();
+      File(std::string name, int mode);
+      ~File();
+      File(File&& other);
+      File& operator=(File&& other);
+      File(const File&) = delete;
+      File& operator=(const File&) = delete;
+
+      bool     open(std::string name, int mode);
+      void     close();
+      bool     is_open() const { return m_fd >= 0; }
+      int      fd() const { return m_fd; }
+      int      mode() const { return m_mode; }
+
+      int64_t  pread(void* data, size_t length, uint64_t offset);
+      int64_t  pwrite(const void* data, size_t length, uint64_t offset);
+      int64_t  preadv(const IOVec* vecs, int count, uint64_t offset);
+      int64_t  pwritev(const IOVec* vecs, int count, uint64_t offset);
+
+      int64_t  size();
+      bool     truncate(uint64_t size);
+      bool     allocate(uint64_t offset, uint64_t length);
+      bool     sync(bool dataOnly = true);
+
+   private:
+      int m_fd   = -1;
+      int m_mode = 0;
+   };
+
+   /**
+   *  \brief one read, write or sync for AsyncFileIO
+   *
+   *  The file and buffers must stay valid until the callback has run.  The
+   *  callback gets the number of bytes transferred, which is short only at
+   *  end of file, or a negative errno value.
+   **/
+   struct IORequest {
+      enum class Op { Read, Write, Sync };
+
+      File*                          file = nullptr;
+      Op                             op = Op::Read;
+      uint64_t                       offset = 0;
+      std::vector<IOVec>             vecs;                 //!<Buffers, filled or written in order
+      std::function<void(int64_t)>   callback;             //!<Called on the completion thread
+
+      static IORequest read(File& file, void* data, size_t length, uint64_t offset,
+                            std::function<void(int64_t)> callback);
+      static IORequest write(File& file, const void* data, size_t length, uint64_t offset,
+                             std::function<void(int64_t)> callback);
+      static IORequest sync(File& file, std::function<void(int64_t)> callback);
+   };
+
+   /**
+   *  \brief queues batches of file reads and writes and reports their
+   *         completion through callbacks
+   *
+   *  On Linux the requests go to an io_uring, and a whole batch costs one
+   *  system call; one ThreadWorker reaps completions and runs the
+   *  callbacks.  Where io_uring is not available (older kernels, or blocked
+   *  by a container's seccomp policy) each request runs as a job on a
+   *  ThreadPool and its callback runs on the pool thread.
+   *
+   *  At most depth requests are in flight; submit() waits for room beyond
+   *  that.  Callbacks may submit further requests.  The destructor waits
+   *  for requests still in flight.
+   **/
+   class AsyncFileIO {
+   public:
+      enum class Backend { Auto, IOUring, Threads };
+
+      AsyncFileIO(unsigned depth = 256, Backend backend = Backend::Auto, ThreadPool* pool = nullptr);
+      ~AsyncFileIO();
+      AsyncFileIO(const AsyncFileIO&) = delete;
+      AsyncFileIO& operator=(const AsyncFileIO&) = delete;
+
+      bool     submit(IORequest request);
+      bool     submit(std::vector<IORequest>& batch);
+      bool     wait_all(double timeout = -1);
+      size_t   pending();
+      Backend  backend() const { return m_backend; }
+
+   private:
+      struct Ring;
+
+      bool     start_ring(unsigned depth);
+      bool     submit_ring(std::vector<IORequest>& batch);
+      void     reap();
+      void     run_sync(IORequest& request);
+      void     finish(size_t count);
+
+      Backend                       m_backend;
+      unsigned                      m_depth;
+      std::unique_ptr<Ring>         m_ring;                //!<io_uring state, or nullptr for Threads
+      ThreadPool*                   m_pool = nullptr;      //!<Pool for the Threads backend
+      std::unique_ptr<ThreadPool>   m_ownPool;             //!<Set if m_pool was made here
+      std::atomic_size_t            m_pending;             //!<Requests submitted but not completed
+      std::mutex                    m_mutex;               //!<Protects the ring and the condition variables
+      std::condition_variable       m_spaceCv;             //!<Signalled when a ring slot is freed
+      std::condition_variable       m_doneCv;              //!<Signalled when m_pending reaches 0
+      ThreadWorker                  m_reaper;              //!<Reaps io_uring completions
+   };
+}
+}
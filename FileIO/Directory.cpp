@@ -0,0 +1,431 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file Directory.cpp
+ **/
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <TaskGroup.h>
+#include <ThreadPool.h>
+
+#include "Directory.h"
+
+namespace acl
+{
+namespace filesystem
+{
+namespace
+{
+  /**
+   * \brief joins a directory and a name with one slash
+   **/
+   std::string join(const std::string& dir, const char* name)
+   {
+      std::string path = dir;
+      if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\') {
+         path.append("/");
+      }
+      path.append(name);
+      return path;
+   }
+
+   bool is_dot(const char* name)
+   {
+      return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+   }
+
+#ifndef _WIN32
+   FileType type_of(mode_t mode)
+   {
+      if (S_ISREG(mode)) {
+         return FileType::File;
+      }
+      if (S_ISDIR(mode)) {
+         return FileType::Directory;
+      }
+      if (S_ISLNK(mode)) {
+         return FileType::Symlink;
+      }
+      return FileType::Other;
+   }
+
+   FileType type_of_dirent(const struct dirent* ent)
+   {
+#ifdef DT_UNKNOWN
+      switch (ent->d_type) {
+         case DT_UNKNOWN: return FileType::Unknown;
+         case DT_REG:     return FileType::File;
+         case DT_DIR:     return FileType::Directory;
+         case DT_LNK:     return FileType::Symlink;
+         default:         return FileType::Other;
+      }
+#else
+      (void)ent;
+      return FileType::Unknown;
+#endif
+   }
+#endif
+}
+
+#ifdef _WIN32
+   struct DirectoryIterator::State {
+      HANDLE           find = INVALID_HANDLE_VALUE;
+      WIN32_FIND_DATAA data;
+      bool             pending = false;                    //!<data holds an entry not yet returned
+
+      ~State()
+      {
+         if (find != INVALID_HANDLE_VALUE) {
+            FindClose(find);
+         }
+      }
+   };
+#else
+   struct DirectoryIterator::State {
+      DIR* dir = nullptr;
+
+      ~State()
+      {
+         if (dir) {
+            closedir(dir);
+         }
+      }
+   };
+#endif
+
+  /**
+   * \brief opens a directory for listing; check is_open() for success
+   * \param [in] path the directory
+   * \param [in] withStat fill in the size and modification time of each entry
+   **/
+   DirectoryIterator::DirectoryIterator(std::string path, bool withStat):
+      m_path(path), m_withStat(withStat)
+   {
+      std::unique_ptr<State> state(new State);
+#ifdef _WIN32
+      state->find = FindFirstFileA(join(path, "*").c_str(), &state->data);
+      if (state->find == INVALID_HANDLE_VALUE) {
+         m_error = ENOENT;
+         return;
+      }
+      state->pending = true;
+#else
+      state->dir = opendir(path.c_str());
+      if (!state->dir) {
+         m_error = errno;
+         return;
+      }
+#endif
+      m_state = std::move(state);
+   }
+
+   DirectoryIterator::~DirectoryIterator() {}
+
+  /**
+   * \brief returns true if the directory could be opened
+   **/
+   bool DirectoryIterator::is_open() const
+   {
+      return m_state != nullptr;
+   }
+
+  /**
+   * \brief reads the next entry
+   * \param [out] entry filled in with the entry
+   * \return false at the end of the listing or on an error; see error()
+   **/
+   bool DirectoryIterator::next(DirectoryEntry& entry)
+   {
+      if (!m_state) {
+         return false;
+      }
+#ifdef _WIN32
+      while (true) {
+         if (!m_state->pending && !FindNextFileA(m_state->find, &m_state->data)) {
+            m_error = GetLastError() == ERROR_NO_MORE_FILES ? 0 : EIO;
+            return false;
+         }
+         m_state->pending = false;
+         const WIN32_FIND_DATAA& data = m_state->data;
+         if (is_dot(data.cFileName)) {
+            continue;
+         }
+
+         // The find data carries the metadata, so it is always filled in
+         entry.name = data.cFileName;
+         entry.path = join(m_path, data.cFileName);
+         if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+            entry.type = FileType::Symlink;
+         } else if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            entry.type = FileType::Directory;
+         } else {
+            entry.type = FileType::File;
+         }
+         entry.hasStat = true;
+         entry.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+         uint64_t ticks = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+                          data.ftLastWriteTime.dwLowDateTime;
+         entry.modTime = ticks / 10 - 11644473600000000ULL;   // 100 ns ticks since 1601 to usec since 1970
+         return true;
+      }
+#else
+      while (true) {
+         errno = 0;
+         struct dirent* ent = readdir(m_state->dir);
+         if (!ent) {
+            m_error = errno;
+            return false;
+         }
+         if (is_dot(ent->d_name)) {
+            continue;
+         }
+
+         entry.name = ent->d_name;
+         entry.path = join(m_path, ent->d_name);
+         entry.type = type_of_dirent(ent);
+         entry.hasStat = false;
+         entry.size = 0;
+         entry.modTime = 0;
+
+         // Only stat when asked to, or when the file system does not record types
+         if (m_withStat || entry.type == FileType::Unknown) {
+            struct stat s;
+            if (fstatat(dirfd(m_state->dir), ent->d_name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+               entry.type = type_of(s.st_mode);
+               entry.hasStat = true;
+               entry.size = static_cast<uint64_t>(s.st_size);
+#ifdef __APPLE__
+               entry.modTime = s.st_mtimespec.tv_sec * 1000000ULL + s.st_mtimespec.tv_nsec / 1000;
+#else
+               entry.modTime = s.st_mtim.tv_sec * 1000000ULL + s.st_mtim.tv_nsec / 1000;
+#endif
+            }
+         }
+         return true;
+      }
+#endif
+   }
+
+namespace
+{
+   typedef std::function<bool(const DirectoryEntry&)> Visitor;
+
+  /**
+   * \brief lists one directory, queueing or recursing into its subdirectories
+   **/
+   void walk_one(const std::string& path, const Visitor& visit, bool withStat, TaskGroup* group,
+                 std::atomic<uint64_t>& count)
+   {
+      DirectoryIterator it(path, withStat);
+      DirectoryEntry entry;
+      while (it.next(entry)) {
+         count++;
+         if (!visit(entry) || entry.type != FileType::Directory) {
+            continue;
+         }
+         if (group) {
+            std::string sub = entry.path;
+            group->run([sub, &visit, withStat, group, &count]() {
+               walk_one(sub, visit, withStat, group, count);
+            });
+         } else {
+            walk_one(entry.path, visit, withStat, group, count);
+         }
+      }
+   }
+
+#ifndef _WIN32
+  /**
+   * \brief empties and removes directories with *at() calls relative to
+   *        their parents' descriptors
+   *
+   * Each directory is a Node that stays open until everything below it
+   * has gone, counted by pending: one for its own listing plus one for
+   * each subdirectory.  The last of those to finish removes the directory
+   * from its parent, which may in turn finish the parent.
+   **/
+   class TreeRemover {
+   public:
+      struct Node {
+         std::shared_ptr<Node> parent;                     //!<nullptr for the root
+         std::string           name;                       //!<Name in the parent, or the path of the root
+         int                   fd = -1;
+         std::atomic_int       pending{1};
+      };
+
+      TreeRemover(TaskGroup* group) : m_group(group), m_count(0) {}
+
+      uint64_t count() const { return m_count; }
+
+      void process(const std::shared_ptr<Node>& node)
+      {
+         int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+         node->fd = node->parent ? openat(node->parent->fd, node->name.c_str(), flags)
+                                 : open(node->name.c_str(), flags);
+
+         // The DIR stream gets its own descriptor so that node->fd outlives it
+         int listFd = node->fd >= 0 ? dup(node->fd) : -1;
+         DIR* dir = listFd >= 0 ? fdopendir(listFd) : nullptr;
+         if (!dir && listFd >= 0) {
+            close(listFd);
+         }
+         if (dir) {
+            struct dirent* ent;
+            while ((ent = readdir(dir)) != nullptr) {
+               if (is_dot(ent->d_name)) {
+                  continue;
+               }
+               FileType type = type_of_dirent(ent);
+               if (type == FileType::Unknown) {
+                  struct stat s;
+                  if (fstatat(node->fd, ent->d_name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                     type = type_of(s.st_mode);
+                  }
+               }
+
+               if (type == FileType::Directory) {
+                  std::shared_ptr<Node> child = std::make_shared<Node>();
+                  child->parent = node;
+                  child->name = ent->d_name;
+                  node->pending++;
+                  schedule(child);
+               } else if (unlinkat(node->fd, ent->d_name, 0) == 0) {
+                  m_count++;
+               }
+            }
+            closedir(dir);
+         }
+         finish(node);
+      }
+
+   private:
+      void schedule(const std::shared_ptr<Node>& node)
+      {
+         if (m_group) {
+            std::shared_ptr<Node> n = node;
+            m_group->run([this, n]() { process(n); });
+         } else {
+            process(node);
+         }
+      }
+
+      void finish(const std::shared_ptr<Node>& node)
+      {
+         if (--node->pending != 0) {
+            return;
+         }
+         if (node->fd >= 0) {
+            close(node->fd);
+            node->fd = -1;
+         }
+         int rc = node->parent ? unlinkat(node->parent->fd, node->name.c_str(), AT_REMOVEDIR)
+                               : rmdir(node->name.c_str());
+         if (rc == 0) {
+            m_count++;
+         }
+         if (node->parent) {
+            finish(node->parent);
+         }
+      }
+
+      TaskGroup*            m_group;
+      std::atomic<uint64_t> m_count;
+   };
+#else
+  /**
+   * \brief empties and removes a directory, depth first
+   **/
+   uint64_t remove_tree(const std::string& path)
+   {
+      uint64_t count = 0;
+      {
+         DirectoryIterator it(path);
+         DirectoryEntry entry;
+         while (it.next(entry)) {
+            if (entry.type == FileType::Directory) {
+               count += remove_tree(entry.path);
+               continue;
+            }
+            SetFileAttributesA(entry.path.c_str(), FILE_ATTRIBUTE_NORMAL);
+            // A symlink to a directory is removed as a directory
+            if (DeleteFileA(entry.path.c_str()) || RemoveDirectoryA(entry.path.c_str())) {
+               count++;
+            }
+         }
+      }
+      if (RemoveDirectoryA(path.c_str())) {
+         count++;
+      }
+      return count;
+   }
+#endif
+}
+
+   uint64_t walk_directory(std::string path, std::function<bool(const DirectoryEntry&)> visit,
+                           ThreadPool* pool, bool withStat)
+   {
+      std::atomic<uint64_t> count(0);
+      if (!pool) {
+         walk_one(path, visit, withStat, nullptr, count);
+         return count;
+      }
+      TaskGroup group(*pool);
+      walk_one(path, visit, withStat, &group, count);
+      group.wait();
+      return count;
+   }
+
+   uint64_t remove_all(std::string name, ThreadPool* pool)
+   {
+#ifdef _WIN32
+      (void)pool;
+      DWORD attributes = GetFileAttributesA(name.c_str());
+      if (attributes == INVALID_FILE_ATTRIBUTES) {
+         return 0;
+      }
+      if ((attributes & FILE_ATTRIBUTE_DIRECTORY) && !(attributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+         return remove_tree(name);
+      }
+      SetFileAttributesA(name.c_str(), FILE_ATTRIBUTE_NORMAL);
+      return (DeleteFileA(name.c_str()) || RemoveDirectoryA(name.c_str())) ? 1 : 0;
+#else
+      struct stat s;
+      if (lstat(name.c_str(), &s) != 0) {
+         return 0;
+      }
+      if (!S_ISDIR(s.st_mode)) {
+         return unlink(name.c_str()) == 0 ? 1 : 0;
+      }
+
+      std::shared_ptr<TreeRemover::Node> root = std::make_shared<TreeRemover::Node>();
+      root->name = name;
+      if (!pool) {
+         TreeRemover remover(nullptr);
+         remover.process(root);
+         return remover.count();
+      }
+      TaskGroup group(*pool);
+      TreeRemover remover(&group);
+      remover.process(root);
+      group.wait();
+      return remover.count();
+#endif
+   }
+}
+}
@@ -0,0 +1,99 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file Directory.h
+ **/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace acl
+{
+class ThreadPool;
+
+namespace filesystem
+{
+   enum class FileType { Unknown, File, Directory, Symlink, Other };
+
+   /**
+   *  \brief one entry of a directory listing
+   *
+   *  The type comes from the directory itself where the file system
+   *  records it, so listing does not cost a stat() per entry.  The size and
+   *  modification time are only filled in when asked for.
+   **/
+   struct DirectoryEntry {
+      std::string name;                                    //!<Name within its directory
+      std::string path;                                    //!<Directory path, a slash and the name
+      FileType    type = FileType::Unknown;                //!<Type of the entry itself; symlinks are not followed
+      bool        hasStat = false;                         //!<Whether size and modTime are filled in
+      uint64_t    size = 0;                                //!<Size in bytes
+      uint64_t    modTime = 0;                             //!<Modification time in usec, as getLastModTime()
+   };
+
+   /**
+   *  \brief reads a directory one entry at a time, skipping . and ..
+   *
+   *  Unlike getFileList(), entries are handed out as they are read, so a
+   *  directory with millions of files does not have to be held in memory.
+   **/
+   class DirectoryIterator {
+   public:
+      DirectoryIterator(std::string path, bool withStat = false);
+      ~DirectoryIterator();
+      DirectoryIterator(const DirectoryIterator&) = delete;
+      DirectoryIterator& operator=(const DirectoryIterator&) = delete;
+
+      bool is_open() const;
+      bool next(DirectoryEntry& entry);
+      int  error() const { return m_error; }
+
+   private:
+      struct State;                                        //!<The platform's open directory handle
+
+      std::string            m_path;
+      bool                   m_withStat;
+      int                    m_error = 0;                  //!<errno of the failure that ended the listing, or 0
+      std::unique_ptr<State> m_state;                      //!<nullptr if the directory could not be opened
+   };
+
+   /**
+   *  \brief visits every entry below a directory
+   *
+   *  With a pool, each subdirectory is listed as a separate pool job, so
+   *  the visitor is called from several threads at once and in no
+   *  particular order.  Symlinks to directories are reported but not
+   *  followed.
+   *
+   *  \param [in] path the directory to walk
+   *  \param [in] visit called for each entry; return false for a directory
+   *         to skip what is below it
+   *  \param [in] pool pool to spread the walk over, or nullptr to walk on
+   *         the calling thread
+   *  \param [in] withStat fill in the size and modification time of each entry
+   *  \return the number of entries visited
+   **/
+   uint64_t walk_directory(std::string path, std::function<bool(const DirectoryEntry&)> visit,
+                           ThreadPool* pool = nullptr, bool withStat = false);
+
+   /**
+   *  \brief removes a file, or a directory and everything below it
+   *
+   *  On POSIX systems entries are removed with unlinkat() relative to an
+   *  open descriptor of their directory, so no path is resolved again.
+   *  With a pool, subdirectories are emptied in parallel.
+   *
+   *  \param [in] name the file or directory to remove
+   *  \param [in] pool pool to spread the work over, or nullptr to work on
+   *         the calling thread
+   *  \return the number of files and directories removed
+   **/
+   uint64_t remove_all(std::string name, ThreadPool* pool);
+}
+}
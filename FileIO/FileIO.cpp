@@ -27,6 +27,7 @@
 #include <vector>
 #include <StringTools.h>
 
+#include "Directory.h"
 #include "FileIO.h"
 
 
@@ -177,43 +178,12 @@ bool _create_directory( std::string dirname )
    * \param [in] name name of the directory to delete
    * \return Number of items deleted. 0 indicates nothing deleted.
    *
-   * This function recursively removes all subdirectories
+   * This function recursively removes all subdirectories.  See the
+   * overload in Directory.h to spread the work over a ThreadPool.
    **/
    uint64_t remove_all( std::string name) 
    {
-     uint64_t count = 0;
-#ifdef _WIN32
-     std::cerr << "remove_all() not yet implemented on Windows" << std::endl;
-#else
-      DIR * dir;
-      struct dirent * ent = NULL;
-     
-      //Recursively call this function on all directories except the current
-      //and it's parent
-      if(( dir = opendir(name.c_str())) != NULL ) {
-         while((ent=readdir(dir)) != NULL ) {
-            std::string item= ent->d_name;
-            if((( item.compare("."))&&(item.compare(".."))))
-            {
-               std::string itemName = name;
-               itemName.append("/");
-               itemName.append(item);
-
-               if( is_directory( itemName.c_str())) {
-                  count += remove_all( itemName.c_str());
-               } 
-               else {  
-                  ::remove( itemName.c_str());
-               }
-            }
-         }
-      }
-
-      closedir( dir ) ;
-
-      count += remove( name );
-#endif
-      return count;
+      return remove_all( name, nullptr );
    }
 
   /**
@@ -306,29 +276,27 @@ bool _create_directory( std::string dirname )
    * \brief lists all files and directories in the given path
    * \param[in] path the target directory
    * \param[in] all if true, adds . and .. to the return list
+   *
+   * Use DirectoryIterator to read a large directory without holding
+   * every name at once.
    **/
    std::vector<std::string>getFileList(std::string path, bool all)
    {
-     std::vector<std::string> fileList;
-#ifdef _WIN32
-     std::cerr << "getFileList() not yet implemented on Windows" << std::endl;
-#else
-      DIR *dir = NULL;
-      struct dirent *ent;
-      dir = opendir( path.c_str());
-      if( dir != NULL ) {
-         while(( ent = readdir( dir)) != NULL ) {
-             std::string fname(ent->d_name);
-             if ( all || ((fname != ".") && (fname != "..")) ) {
-                fileList.push_back( ent->d_name );
-             }
-         }
-         closedir(dir);
-      }
-      else {
+      std::vector<std::string> fileList;
+      DirectoryIterator it( path );
+      if( !it.is_open() ) {
+         errno = it.error();
          perror("");
+         return fileList;
+      }
+      if( all ) {
+         fileList.push_back( "." );
+         fileList.push_back( ".." );
+      }
+      DirectoryEntry entry;
+      while( it.next( entry )) {
+         fileList.push_back( entry.name );
       }
-#endif
       return fileList;
    }
 
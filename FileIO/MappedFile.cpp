@@ -0,0 +1,405 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file MappedFile.cpp
+ **/
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <algorithm>
+
+#include "MappedFile.h"
+
+namespace acl
+{
+namespace filesystem
+{
+namespace
+{
+  /**
+   * \brief returns the alignment the file offset of a mapping must have
+   **/
+   uint64_t granularity()
+   {
+#ifdef _WIN32
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      return info.dwAllocationGranularity;
+#else
+      return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+   }
+}
+
+   MappedFile::MappedFile() {}
+
+  /**
+   * \brief opens and maps a file; check is_open() for success
+   **/
+   MappedFile::MappedFile(std::string name, Mode mode, uint64_t offset, uint64_t length)
+   {
+      open(name, mode, offset, length);
+   }
+
+   MappedFile::~MappedFile()
+   {
+      close();
+   }
+
+   MappedFile::MappedFile(MappedFile&& other)
+   {
+      *this = std::move(other);
+   }
+
+   MappedFile& MappedFile::operator=(MappedFile&& other)
+   {
+      std::swap(m_mode, other.m_mode);
+#ifdef _WIN32
+      std::swap(m_file, other.m_file);
+      std::swap(m_mapping, other.m_mapping);
+#else
+      std::swap(m_fd, other.m_fd);
+#endif
+      std::swap(m_base, other.m_base);
+      std::swap(m_mapLength, other.m_mapLength);
+      std::swap(m_data, other.m_data);
+      std::swap(m_size, other.m_size);
+      std::swap(m_offset, other.m_offset);
+      std::swap(m_length, other.m_length);
+      return *this;
+   }
+
+  /**
+   * \brief opens a file and maps a range of it, closing any file already open
+   *
+   * \param [in] name the file.  ReadWrite creates it if it does not exist;
+   *        use resize() to give a new file a size.
+   * \param [in] mode whether the mapping may be written
+   * \param [in] offset file offset of the first byte to map
+   * \param [in] length bytes to map, or TO_END.  Clamped to the end of the
+   *        file; a range past the end maps nothing until remap() or refresh()
+   *        after the file grows.
+   * \return true on success, false on failure
+   **/
+   bool MappedFile::open(std::string name, Mode mode, uint64_t offset, uint64_t length)
+   {
+      close();
+      m_mode = mode;
+#ifdef _WIN32
+      DWORD access = mode == Mode::ReadWrite ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+      DWORD creation = mode == Mode::ReadWrite ? OPEN_ALWAYS : OPEN_EXISTING;
+      HANDLE file = CreateFileA(name.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                nullptr, creation, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file == INVALID_HANDLE_VALUE) {
+         return false;
+      }
+      m_file = file;
+#else
+      int flags = mode == Mode::ReadWrite ? O_RDWR | O_CREAT : O_RDONLY;
+      m_fd = ::open(name.c_str(), flags | O_CLOEXEC, 0666);
+      if (m_fd < 0) {
+         return false;
+      }
+#endif
+      if (!map(offset, length)) {
+         close();
+         return false;
+      }
+      return true;
+   }
+
+  /**
+   * \brief unmaps and closes the file, and resets mode() to ReadOnly
+   **/
+   void MappedFile::close()
+   {
+      unmap();
+#ifdef _WIN32
+      if (m_file) {
+         CloseHandle(m_file);
+         m_file = nullptr;
+      }
+#else
+      if (m_fd >= 0) {
+         ::close(m_fd);
+         m_fd = -1;
+      }
+#endif
+      m_offset = 0;
+      m_length = TO_END;
+      m_mode = Mode::ReadOnly;
+   }
+
+  /**
+   * \brief returns true if a file is open, even if no bytes of it are mapped
+   **/
+   bool MappedFile::is_open() const
+   {
+#ifdef _WIN32
+      return m_file != nullptr;
+#else
+      return m_fd >= 0;
+#endif
+   }
+
+  /**
+   * \brief maps a different range of the open file
+   * \param [in] offset file offset of the first byte to map
+   * \param [in] length bytes to map, or TO_END; clamped to the end of the file
+   * \return true on success.  On failure nothing is mapped.
+   **/
+   bool MappedFile::remap(uint64_t offset, uint64_t length)
+   {
+      if (!is_open()) {
+         errno = EBADF;
+         return false;
+      }
+      return map(offset, length);
+   }
+
+  /**
+   * \brief maps the same range again to take in bytes the file has gained
+   *        since it was mapped
+   **/
+   bool MappedFile::refresh()
+   {
+      return remap(m_offset, m_length);
+   }
+
+  /**
+   * \brief sets the size of a ReadWrite file, then refreshes the mapping
+   * \return true on success, false on failure or for a ReadOnly file
+   **/
+   bool MappedFile::resize(uint64_t fileSize)
+   {
+      if (!is_open() || m_mode != Mode::ReadWrite) {
+         errno = EBADF;
+         return false;
+      }
+#ifdef _WIN32
+      // A file cannot be shrunk while a view of it is mapped
+      unmap();
+      LARGE_INTEGER size;
+      size.QuadPart = static_cast<LONGLONG>(fileSize);
+      if (!SetFilePointerEx(m_file, size, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file)) {
+         return false;
+      }
+#else
+      if (ftruncate(m_fd, static_cast<off_t>(fileSize)) != 0) {
+         return false;
+      }
+#endif
+      return map(m_offset, m_length);
+   }
+
+  /**
+   * \brief tells the system how part of the mapping will be used
+   * \param [in] advice the expected access pattern
+   * \param [in] offset start of the part, from data()
+   * \param [in] length bytes in the part; clamped to size()
+   * \return true if the hint was taken.  HugePages is refused by file
+   *         systems that do not support it.
+   **/
+   bool MappedFile::advise(Advice advice, size_t offset, size_t length)
+   {
+      if (!m_data || offset >= m_size) {
+         return m_data != nullptr;
+      }
+      length = std::min(length, m_size - offset);
+      char* start = m_data + offset;
+#ifdef _WIN32
+      if (advice == Advice::HugePages) {
+         return false;
+      }
+#if _WIN32_WINNT >= 0x0602
+      if (advice == Advice::WillNeed) {
+         WIN32_MEMORY_RANGE_ENTRY range;
+         range.VirtualAddress = start;
+         range.NumberOfBytes = length;
+         return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != 0;
+      }
+#endif
+      (void)start;
+      return true;
+#else
+      // madvise() wants a page-aligned start
+      uintptr_t page = static_cast<uintptr_t>(granularity());
+      char* aligned = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(start) & ~(page - 1));
+      length += static_cast<size_t>(start - aligned);
+
+      int flag;
+      switch (advice) {
+         case Advice::Normal:     flag = MADV_NORMAL; break;
+         case Advice::Sequential: flag = MADV_SEQUENTIAL; break;
+         case Advice::Random:     flag = MADV_RANDOM; break;
+         case Advice::WillNeed:   flag = MADV_WILLNEED; break;
+         case Advice::DontNeed:   flag = MADV_DONTNEED; break;
+         case Advice::HugePages:
+#ifdef MADV_HUGEPAGE
+            flag = MADV_HUGEPAGE;
+            break;
+#else
+            errno = ENOTSUP;
+            return false;
+#endif
+         default:
+            errno = EINVAL;
+            return false;
+      }
+      return madvise(aligned, length, flag) == 0;
+#endif
+   }
+
+  /**
+   * \brief starts reading part of the mapping in, so that touching it later
+   *        does not wait on the disk
+   **/
+   bool MappedFile::prefetch(size_t offset, size_t length)
+   {
+      return advise(Advice::WillNeed, offset, length);
+   }
+
+  /**
+   * \brief writes modified pages of a ReadWrite mapping back to the file
+   * \param [in] wait true to return once the data is on disk, false to only
+   *        start the write-back
+   * \return true on success
+   **/
+   bool MappedFile::flush(bool wait)
+   {
+      if (!m_base) {
+         return is_open();
+      }
+#ifdef _WIN32
+      if (!FlushViewOfFile(m_base, m_mapLength)) {
+         return false;
+      }
+      return !wait || FlushFileBuffers(m_file);
+#else
+      return msync(m_base, m_mapLength, wait ? MS_SYNC : MS_ASYNC) == 0;
+#endif
+   }
+
+  /**
+   * \brief gets the current size of the open file
+   * \return the file size in bytes, -1 on error
+   **/
+   int64_t MappedFile::file_size()
+   {
+#ifdef _WIN32
+      LARGE_INTEGER size;
+      if (!m_file || !GetFileSizeEx(m_file, &size)) {
+         return -1;
+      }
+      return size.QuadPart;
+#else
+      struct stat s;
+      if (m_fd < 0 || fstat(m_fd, &s) != 0) {
+         return -1;
+      }
+      return s.st_size;
+#endif
+   }
+
+  /**
+   * \brief maps [offset, offset + length) clamped to the file, replacing
+   *        the current mapping
+   **/
+   bool MappedFile::map(uint64_t offset, uint64_t length)
+   {
+      int64_t fileSize = file_size();
+      if (fileSize < 0) {
+         unmap();
+         return false;
+      }
+      uint64_t end = static_cast<uint64_t>(fileSize);
+      if (length != TO_END && offset <= end && length < end - offset) {
+         end = offset + length;
+      }
+
+      uint64_t base = offset - offset % granularity();
+      uint64_t oldBase = m_base ? m_offset - static_cast<uint64_t>(m_data - m_base) : 0;
+      m_offset = offset;
+      m_length = length;
+      if (offset >= end) {
+         unmap();
+         return true;
+      }
+      size_t mapLength = static_cast<size_t>(end - base);
+
+#ifdef _WIN32
+      unmap();
+      DWORD protect = m_mode == Mode::ReadWrite ? PAGE_READWRITE : PAGE_READONLY;
+      m_mapping = CreateFileMappingA(m_file, nullptr, protect, 0, 0, nullptr);
+      if (!m_mapping) {
+         return false;
+      }
+      DWORD access = m_mode == Mode::ReadWrite ? FILE_MAP_WRITE : FILE_MAP_READ;
+      void* p = MapViewOfFile(m_mapping, access, static_cast<DWORD>(base >> 32),
+                              static_cast<DWORD>(base & 0xffffffff), mapLength);
+      if (!p) {
+         CloseHandle(m_mapping);
+         m_mapping = nullptr;
+         return false;
+      }
+#else
+      void* p = MAP_FAILED;
+#ifdef __linux__
+      // Growing or shrinking in place keeps the pages already faulted in
+      if (m_base && oldBase == base) {
+         p = mremap(m_base, m_mapLength, mapLength, MREMAP_MAYMOVE);
+      }
+#endif
+      if (p == MAP_FAILED) {
+         unmap();
+         int prot = m_mode == Mode::ReadWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+         p = mmap(nullptr, mapLength, prot, MAP_SHARED, m_fd, static_cast<off_t>(base));
+         if (p == MAP_FAILED) {
+            return false;
+         }
+      }
+#endif
+      m_base = static_cast<char*>(p);
+      m_mapLength = mapLength;
+      m_data = m_base + (offset - base);
+      m_size = static_cast<size_t>(end - offset);
+      return true;
+   }
+
+  /**
+   * \brief removes the current mapping, if any
+   **/
+   void MappedFile::unmap()
+   {
+      if (m_base) {
+#ifdef _WIN32
+         UnmapViewOfFile(m_base);
+#else
+         munmap(m_base, m_mapLength);
+#endif
+      }
+#ifdef _WIN32
+      if (m_mapping) {
+         CloseHandle(m_mapping);
+         m_mapping = nullptr;
+      }
+#endif
+      m_base = nullptr;
+      m_mapLength = 0;
+      m_data = nullptr;
+      m_size = 0;
+   }
+}
+}
@@ -0,0 +1,145 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file MappedFile.h
+ **/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace acl
+{
+namespace filesystem
+{
+   /**
+   *  \brief a view of contiguous elements that it does not own
+   **/
+   template <typename T>
+   class Span {
+   public:
+      Span() {}
+      Span(T* data, size_t size) : m_data(data), m_size(size) {}
+
+      T*     data() const { return m_data; }
+      size_t size() const { return m_size; }
+      bool   empty() const { return m_size == 0; }
+      T*     begin() const { return m_data; }
+      T*     end() const { return m_data + m_size; }
+      T&     operator[](size_t i) const { return m_data[i]; }
+
+      /**
+      *  \brief returns the part from offset for up to count elements, clamped to this span
+      **/
+      Span<T> subspan(size_t offset, size_t count = static_cast<size_t>(-1)) const
+      {
+         if (offset > m_size) {
+            offset = m_size;
+         }
+         if (count > m_size - offset) {
+            count = m_size - offset;
+         }
+         return Span<T>(m_data + offset, count);
+      }
+
+   private:
+      T*     m_data = nullptr;
+      size_t m_size = 0;
+   };
+
+   /**
+   *  \brief maps a range of a file into memory for the life of the object
+   *
+   *  Reading through a mapping avoids copying the file into a buffer: pages
+   *  are read in as they are touched and shared with the page cache.  The
+   *  mapped range can be moved or extended with remap(), for example to
+   *  pick up data appended to a file that is still being written.
+   *
+   *  Like file_size(), functions report failure through their return value
+   *  (false or -1) rather than by printing, so that a missing file can be
+   *  probed cheaply.
+   **/
+   class MappedFile {
+   public:
+      enum class Mode {
+         ReadOnly,                                         //!<Pages are read only
+         ReadWrite                                         //!<Writes go to the file; see flush()
+      };
+      enum class Advice {
+         Normal,                                           //!<Default read-ahead
+         Sequential,                                       //!<Read ahead aggressively and drop pages behind
+         Random,                                           //!<Do not read ahead
+         WillNeed,                                         //!<Start reading the range in now
+         DontNeed,                                         //!<The range can be dropped from memory
+         HugePages                                         //!<Back the range with huge pages where the file system allows it
+      };
+
+      static const uint64_t TO_END = ~static_cast<uint64_t>(0); //!<Length that maps to the end of the file
+
+      MappedFile();
+      MappedFile(std::string name, Mode mode = Mode::ReadOnly, uint64_t offset = 0, uint64_t length = TO_END);
+      ~MappedFile();
+      MappedFile(MappedFile&& other);
+      MappedFile& operator=(MappedFile&& other);
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+
+      bool     open(std::string name, Mode mode = Mode::ReadOnly, uint64_t offset = 0, uint64_t length = TO_END);
+      void     close();
+      bool     is_open() const;
+      Mode     mode() const { return m_mode; }
+
+      const char* data() const { return m_data; }
+      char*    writable_data() { return m_mode == Mode::ReadWrite ? m_data : nullptr; }
+      size_t   size() const { return m_size; }
+      uint64_t offset() const { return m_offset; }
+      Span<const char> span() const { return Span<const char>(m_data, m_size); }
+      Span<char> writable_span() { return Span<char>(writable_data(), writable_data() ? m_size : 0); }
+
+      /**
+      *  \brief views the start of the mapping as an array of T
+      *
+      *  \return as many whole elements as fit, or an empty span if the
+      *          mapping is not suitably aligned for T
+      **/
+      template <typename T>
+      Span<const T> as() const
+      {
+         if (reinterpret_cast<uintptr_t>(m_data) % alignof(T) != 0) {
+            return Span<const T>();
+         }
+         return Span<const T>(reinterpret_cast<const T*>(m_data), m_size / sizeof(T));
+      }
+
+      bool     remap(uint64_t offset, uint64_t length = TO_END);
+      bool     refresh();
+      bool     resize(uint64_t fileSize);
+      bool     advise(Advice advice, size_t offset = 0, size_t length = static_cast<size_t>(-1));
+      bool     prefetch(size_t offset = 0, size_t length = static_cast<size_t>(-1));
+      bool     flush(bool wait = true);
+      int64_t  file_size();
+
+   private:
+      bool     map(uint64_t offset, uint64_t length);
+      void     unmap();
+
+      Mode     m_mode = Mode::ReadOnly;
+#ifdef _WIN32
+      void*    m_file = nullptr;                           //!<HANDLE from CreateFile
+      void*    m_mapping = nullptr;                        //!<HANDLE from CreateFileMapping
+#else
+      int      m_fd = -1;
+#endif
+      char*    m_base = nullptr;                           //!<Start of the mapping, aligned down to the allocation granularity
+      size_t   m_mapLength = 0;                            //!<Bytes mapped from m_base
+      char*    m_data = nullptr;                           //!<First byte of the requested range
+      size_t   m_size = 0;                                 //!<Bytes of the requested range that are mapped
+      uint64_t m_offset = 0;                               //!<File offset of m_data
+      uint64_t m_length = TO_END;                          //!<Length asked for, kept for refresh()
+   };
+}
+}
@@ -4,7 +4,7 @@
 **/
 
 #pragma once
-#include "acl/matrix.hpp"
+#include "matrix.hpp"
 #include <stdexcept>
 #include <math.h>
 #include <algorithm>
@@ -16,7 +16,7 @@ namespace mathalgo
 	class Givens
 	{
 	public:
-		Givens() : m_oJ(2,2), m_oQ(1,1), m_oR(1,1)
+		Givens() : m_oQ(1,1), m_oR(1,1), m_oJ(2,2)
 		{
 		}
 
@@ -68,7 +68,7 @@ namespace mathalgo
 				}
 			}
 
-			m_oQ = m_oQ.transpose();
+			m_oQ.transposeInPlace();
 		}
 		
 		/*
@@ -77,7 +77,7 @@ namespace mathalgo
 		*/
 		matrix<T> Solve( matrix<T>& oMatrix )
 		{
-			matrix<T> oQtM( m_oQ.transpose() * oMatrix );
+			matrix<T> oQtM( m_oQ.transposeMultiply( oMatrix ) );
 			int nCols = m_oR.cols();
 			matrix<T> oS( 1, nCols );
 			for (int i = nCols-1; i >= 0; i-- )
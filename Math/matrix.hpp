@@ -9,19 +9,254 @@
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifdef ACL_HAVE_CBLAS
+#include <cblas.h>
+#endif
 
 namespace mathalgo
 {
 	using namespace std;
 
+	namespace detail
+	{
+		/*
+			Tile sizes of the blocked product. A tile of B of GEMM_K_BLOCK rows
+			by GEMM_N_BLOCK columns of doubles is 256KB, so it stays in L2 while
+			every row of the A tile is run against it.
+		*/
+		const unsigned int GEMM_M_BLOCK = 64;
+		const unsigned int GEMM_K_BLOCK = 128;
+		const unsigned int GEMM_N_BLOCK = 256;
+		const unsigned int TRANSPOSE_BLOCK = 32;
+
+		/*
+			Products with fewer multiply-adds than this stay on the kernels below
+			even when a BLAS library is available, since its call overhead would
+			dominate.
+		*/
+		const double BLAS_MIN_WORK = 32.0 * 32.0 * 32.0;
+
+		/*
+			y[0..n) += a * x[0..n). This is the inner loop of every product, so
+			it has explicit AVX2 and NEON versions for float and double; other
+			types and targets rely on the compiler.
+		*/
+		template<typename T>
+		inline void axpy( T a, const T* x, T* y, unsigned int n )
+		{
+			for ( unsigned int i = 0; i < n; i++ )
+			{
+				y[i] += a * x[i];
+			}
+		}
+
+#if defined(__AVX2__)
+		inline void axpy( double a, const double* x, double* y, unsigned int n )
+		{
+			unsigned int i = 0;
+			__m256d va = _mm256_set1_pd( a );
+			for ( ; i + 4 <= n; i += 4 )
+			{
+#ifdef __FMA__
+				__m256d vy = _mm256_fmadd_pd( va, _mm256_loadu_pd( x + i ), _mm256_loadu_pd( y + i ) );
+#else
+				__m256d vy = _mm256_add_pd( _mm256_mul_pd( va, _mm256_loadu_pd( x + i ) ), _mm256_loadu_pd( y + i ) );
+#endif
+				_mm256_storeu_pd( y + i, vy );
+			}
+			for ( ; i < n; i++ )
+			{
+				y[i] += a * x[i];
+			}
+		}
+
+		inline void axpy( float a, const float* x, float* y, unsigned int n )
+		{
+			unsigned int i = 0;
+			__m256 va = _mm256_set1_ps( a );
+			for ( ; i + 8 <= n; i += 8 )
+			{
+#ifdef __FMA__
+				__m256 vy = _mm256_fmadd_ps( va, _mm256_loadu_ps( x + i ), _mm256_loadu_ps( y + i ) );
+#else
+				__m256 vy = _mm256_add_ps( _mm256_mul_ps( va, _mm256_loadu_ps( x + i ) ), _mm256_loadu_ps( y + i ) );
+#endif
+				_mm256_storeu_ps( y + i, vy );
+			}
+			for ( ; i < n; i++ )
+			{
+				y[i] += a * x[i];
+			}
+		}
+#elif defined(__ARM_NEON)
+		inline void axpy( float a, const float* x, float* y, unsigned int n )
+		{
+			unsigned int i = 0;
+			float32x4_t va = vdupq_n_f32( a );
+			for ( ; i + 4 <= n; i += 4 )
+			{
+				vst1q_f32( y + i, vmlaq_f32( vld1q_f32( y + i ), va, vld1q_f32( x + i ) ) );
+			}
+			for ( ; i < n; i++ )
+			{
+				y[i] += a * x[i];
+			}
+		}
+
+#if defined(__aarch64__)
+		inline void axpy( double a, const double* x, double* y, unsigned int n )
+		{
+			unsigned int i = 0;
+			float64x2_t va = vdupq_n_f64( a );
+			for ( ; i + 2 <= n; i += 2 )
+			{
+				vst1q_f64( y + i, vfmaq_f64( vld1q_f64( y + i ), va, vld1q_f64( x + i ) ) );
+			}
+			for ( ; i < n; i++ )
+			{
+				y[i] += a * x[i];
+			}
+		}
+#endif
+#endif
+
+		/*
+			C += op(A) * B on row-major storage, where op(A) is A (M x K, row
+			stride lda) or, with bTransA, the transpose of A stored as K x M.
+			Loops run row of C, then k, then along a row of B, so the inner loop
+			is a contiguous axpy whichever way A is stored.
+		*/
+		template<typename T>
+		void gemmBlocked( bool bTransA, unsigned int M, unsigned int N, unsigned int K,
+		                  const T* A, unsigned int lda, const T* B, unsigned int ldb, T* C, unsigned int ldc )
+		{
+			for ( unsigned int j0 = 0; j0 < N; j0 += GEMM_N_BLOCK )
+			{
+				unsigned int nb = std::min( GEMM_N_BLOCK, N - j0 );
+				for ( unsigned int k0 = 0; k0 < K; k0 += GEMM_K_BLOCK )
+				{
+					unsigned int kEnd = std::min( K, k0 + GEMM_K_BLOCK );
+					for ( unsigned int i0 = 0; i0 < M; i0 += GEMM_M_BLOCK )
+					{
+						unsigned int iEnd = std::min( M, i0 + GEMM_M_BLOCK );
+						for ( unsigned int i = i0; i < iEnd; i++ )
+						{
+							T* pC = C + static_cast<size_t>(i)*ldc + j0;
+							for ( unsigned int k = k0; k < kEnd; k++ )
+							{
+								T a = bTransA ? A[static_cast<size_t>(k)*lda + i] : A[static_cast<size_t>(i)*lda + k];
+								if ( a != T(0) )
+								{
+									axpy( a, B + static_cast<size_t>(k)*ldb + j0, pC, nb );
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+
+		/*
+			Upper triangle of C += A^T * A for A stored as K x N. Each row of C
+			only runs from the diagonal, so this is half the work of gemmBlocked.
+		*/
+		template<typename T>
+		void gramUpperBlocked( unsigned int N, unsigned int K, const T* A, unsigned int lda, T* C, unsigned int ldc )
+		{
+			for ( unsigned int k0 = 0; k0 < K; k0 += GEMM_K_BLOCK )
+			{
+				unsigned int kEnd = std::min( K, k0 + GEMM_K_BLOCK );
+				for ( unsigned int i = 0; i < N; i++ )
+				{
+					T* pC = C + static_cast<size_t>(i)*ldc + i;
+					for ( unsigned int k = k0; k < kEnd; k++ )
+					{
+						const T* pA = A + static_cast<size_t>(k)*lda;
+						if ( pA[i] != T(0) )
+						{
+							axpy( pA[i], pA + i, pC, N - i );
+						}
+					}
+				}
+			}
+		}
+
+		template<typename T>
+		inline void gemm( bool bTransA, unsigned int M, unsigned int N, unsigned int K,
+		                  const T* A, unsigned int lda, const T* B, unsigned int ldb, T* C, unsigned int ldc )
+		{
+			gemmBlocked( bTransA, M, N, K, A, lda, B, ldb, C, ldc );
+		}
+
+		template<typename T>
+		inline void gramUpper( unsigned int N, unsigned int K, const T* A, unsigned int lda, T* C, unsigned int ldc )
+		{
+			gramUpperBlocked( N, K, A, lda, C, ldc );
+		}
+
+#ifdef ACL_HAVE_CBLAS
+		inline void gemm( bool bTransA, unsigned int M, unsigned int N, unsigned int K,
+		                  const double* A, unsigned int lda, const double* B, unsigned int ldb, double* C, unsigned int ldc )
+		{
+			if ( static_cast<double>(M)*N*K < BLAS_MIN_WORK )
+			{
+				gemmBlocked( bTransA, M, N, K, A, lda, B, ldb, C, ldc );
+				return;
+			}
+			cblas_dgemm( CblasRowMajor, bTransA ? CblasTrans : CblasNoTrans, CblasNoTrans,
+			             M, N, K, 1.0, A, lda, B, ldb, 1.0, C, ldc );
+		}
+
+		inline void gemm( bool bTransA, unsigned int M, unsigned int N, unsigned int K,
+		                  const float* A, unsigned int lda, const float* B, unsigned int ldb, float* C, unsigned int ldc )
+		{
+			if ( static_cast<double>(M)*N*K < BLAS_MIN_WORK )
+			{
+				gemmBlocked( bTransA, M, N, K, A, lda, B, ldb, C, ldc );
+				return;
+			}
+			cblas_sgemm( CblasRowMajor, bTransA ? CblasTrans : CblasNoTrans, CblasNoTrans,
+			             M, N, K, 1.0f, A, lda, B, ldb, 1.0f, C, ldc );
+		}
+
+		inline void gramUpper( unsigned int N, unsigned int K, const double* A, unsigned int lda, double* C, unsigned int ldc )
+		{
+			if ( static_cast<double>(N)*N*K < 2*BLAS_MIN_WORK )
+			{
+				gramUpperBlocked( N, K, A, lda, C, ldc );
+				return;
+			}
+			cblas_dsyrk( CblasRowMajor, CblasUpper, CblasTrans, N, K, 1.0, A, lda, 1.0, C, ldc );
+		}
+
+		inline void gramUpper( unsigned int N, unsigned int K, const float* A, unsigned int lda, float* C, unsigned int ldc )
+		{
+			if ( static_cast<double>(N)*N*K < 2*BLAS_MIN_WORK )
+			{
+				gramUpperBlocked( N, K, A, lda, C, ldc );
+				return;
+			}
+			cblas_ssyrk( CblasRowMajor, CblasUpper, CblasTrans, N, K, 1.0f, A, lda, 1.0f, C, ldc );
+		}
+#endif
+	}
+
 	template<class T>
 	class matrix
 	{
 	public:
-		matrix(unsigned int nRows, unsigned int nCols) : 
-			m_nRows( nRows ), 
-			m_nCols( nCols ), 
-			m_oData( nRows*nCols, 0 )
+		matrix(unsigned int nRows, unsigned int nCols) :
+			m_oData( nRows*nCols, 0 ),
+			m_nRows( nRows ),
+			m_nCols( nCols )
 		{
 			if ( !nRows || !nCols )
 			{
@@ -34,7 +269,7 @@ namespace mathalgo
 			matrix oResult( nSize, nSize );
 
 			int nCount = 0;
-			std::generate( oResult.m_oData.begin(), oResult.m_oData.end(), 
+			std::generate( oResult.m_oData.begin(), oResult.m_oData.end(),
 				[&nCount, nSize]() { return !(nCount++%(nSize + 1)); } );
 
 			return oResult;
@@ -50,7 +285,45 @@ namespace mathalgo
 			return m_oData[nCol+m_nCols*nRow];
 		}
 
-		inline matrix operator*(matrix& other)
+		inline const T& operator()(unsigned int nRow, unsigned int nCol) const
+		{
+			if ( nRow >= m_nRows || nCol >= m_nCols )
+			{
+				throw out_of_range( "position out of range" );
+			}
+
+			return m_oData[nCol+m_nCols*nRow];
+		}
+
+		/*
+			Element access without the range check of operator(), for loops
+			whose bounds already come from rows() and cols().
+		*/
+		inline T& unchecked(unsigned int nRow, unsigned int nCol)
+		{
+			return m_oData[nCol+m_nCols*nRow];
+		}
+
+		inline const T& unchecked(unsigned int nRow, unsigned int nCol) const
+		{
+			return m_oData[nCol+m_nCols*nRow];
+		}
+
+		/*
+			Pointer to the cols() contiguous elements of a row. Rows follow
+			each other, so row(0) is the whole matrix in row-major order.
+		*/
+		inline T* row(unsigned int nRow)
+		{
+			return m_oData.data() + static_cast<size_t>(m_nCols)*nRow;
+		}
+
+		inline const T* row(unsigned int nRow) const
+		{
+			return m_oData.data() + static_cast<size_t>(m_nCols)*nRow;
+		}
+
+		inline matrix operator*(const matrix& other) const
 		{
 			if ( m_nCols != other.m_nRows )
 			{
@@ -58,49 +331,109 @@ namespace mathalgo
 			}
 
 			matrix oResult( m_nRows, other.m_nCols );
-			for ( unsigned int r = 0; r < m_nRows; ++r )
+			detail::gemm( false, m_nRows, other.m_nCols, m_nCols,
+			              m_oData.data(), m_nCols, other.m_oData.data(), other.m_nCols,
+			              oResult.m_oData.data(), oResult.m_nCols );
+
+			return oResult;
+		}
+
+		/*
+			Returns transpose() * other without building the transpose. For
+			other being this matrix the result is symmetric, so only half of it
+			is computed; this is how normal equations X^T X are formed.
+		*/
+		inline matrix transposeMultiply(const matrix& other) const
+		{
+			if ( m_nRows != other.m_nRows )
+			{
+				throw domain_error( "matrix dimensions are not multiplicable" );
+			}
+
+			matrix oResult( m_nCols, other.m_nCols );
+			if ( &other == this )
 			{
-				for ( unsigned int ocol = 0; ocol < other.m_nCols; ++ocol )
+				detail::gramUpper( m_nCols, m_nRows, m_oData.data(), m_nCols,
+				                   oResult.m_oData.data(), oResult.m_nCols );
+				for ( unsigned int r = 1; r < m_nCols; ++r )
 				{
-					for ( unsigned int c = 0; c < m_nCols; ++c )
+					for ( unsigned int c = 0; c < r; ++c )
 					{
-						oResult(r,ocol) += (*this)(r,c) * other(c,ocol);
+						oResult.unchecked(r,c) = oResult.unchecked(c,r);
 					}
 				}
 			}
+			else
+			{
+				detail::gemm( true, m_nCols, other.m_nCols, m_nRows,
+				              m_oData.data(), m_nCols, other.m_oData.data(), other.m_nCols,
+				              oResult.m_oData.data(), oResult.m_nCols );
+			}
 
 			return oResult;
 		}
 
-		inline matrix transpose()
+		inline matrix transpose() const
 		{
 			matrix oResult( m_nCols, m_nRows );
-			for ( unsigned int r = 0; r < m_nRows; ++r )
+			transposeInto( oResult );
+			return oResult;
+		}
+
+		/*
+			Replaces the matrix with its transpose. Square matrices and vectors
+			are transposed without allocating; other shapes go through one
+			temporary buffer.
+		*/
+		inline void transposeInPlace()
+		{
+			if ( m_nRows == m_nCols )
 			{
-				for ( unsigned int c = 0; c < m_nCols; ++c )
+				for ( unsigned int r = 0; r < m_nRows; ++r )
 				{
-					oResult(c,r) += (*this)(r,c);
+					for ( unsigned int c = r + 1; c < m_nCols; ++c )
+					{
+						std::swap( unchecked(r,c), unchecked(c,r) );
+					}
 				}
 			}
-			return oResult;
+			else if ( m_nRows == 1 || m_nCols == 1 )
+			{
+				std::swap( m_nRows, m_nCols );
+			}
+			else
+			{
+				matrix oResult( m_nCols, m_nRows );
+				transposeInto( oResult );
+				*this = std::move( oResult );
+			}
 		}
 
-		inline unsigned int rows() 
+		inline unsigned int rows() const
 		{
 			return m_nRows;
 		}
 
-		inline unsigned int cols() 
+		inline unsigned int cols() const
 		{
 			return m_nCols;
 		}
 
-		inline vector<T> data()
+		/*
+			Elements in row-major order. On a temporary, such as the result of
+			a product, the storage is moved out instead of copied.
+		*/
+		inline const vector<T>& data() const &
 		{
 			return m_oData;
 		}
 
-		void print()
+		inline vector<T> data() &&
+		{
+			return std::move( m_oData );
+		}
+
+		void print() const
 		{
 			for ( unsigned int r = 0; r < m_nRows; r++ )
 			{
@@ -113,6 +446,31 @@ namespace mathalgo
 		}
 
 	private:
+		/*
+			Writes the transpose into oResult, which is m_nCols x m_nRows, a
+			tile at a time so that neither side is walked with a large stride
+			for long.
+		*/
+		void transposeInto( matrix& oResult ) const
+		{
+			const unsigned int B = detail::TRANSPOSE_BLOCK;
+			for ( unsigned int r0 = 0; r0 < m_nRows; r0 += B )
+			{
+				unsigned int rEnd = std::min( m_nRows, r0 + B );
+				for ( unsigned int c0 = 0; c0 < m_nCols; c0 += B )
+				{
+					unsigned int cEnd = std::min( m_nCols, c0 + B );
+					for ( unsigned int r = r0; r < rEnd; ++r )
+					{
+						for ( unsigned int c = c0; c < cEnd; ++c )
+						{
+							oResult.unchecked(c,r) = unchecked(r,c);
+						}
+					}
+				}
+			}
+		}
+
 		std::vector<T> m_oData;
 
 		unsigned int m_nRows;
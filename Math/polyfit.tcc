@@ -4,9 +4,13 @@
 **/
 
 #pragma once
+#include <array>
+#include <cmath>
+#include <limits>
 #include <vector>
-#include "acl/matrix.hpp"
-#include "acl/givensQR.hpp"
+#include "matrix.hpp"
+#include "givensQR.hpp"
+#include "ParallelFor.tcc"
 
 namespace mathalgo
 {
@@ -40,34 +44,539 @@ namespace mathalgo
 		matrix<T> oYMatrix( nCount, 1 );
 	
 		// copy y matrix
-		for ( size_t i = 0; i < nCount; i++ )
-		{
-			oYMatrix(i, 0) = oY[i];
-		}
+		std::copy( oY.begin(), oY.end(), oYMatrix.row(0) );
 
 		// create the X matrix
 		for ( size_t nRow = 0; nRow < nCount; nRow++ )
 		{
+			T* pRow = oXMatrix.row( nRow );
 			T nVal = 1.0f;
 			for ( int nCol = 0; nCol < nDegree; nCol++ )
 			{
-				oXMatrix(nRow, nCol) = nVal;
+				pRow[nCol] = nVal;
 				nVal *= oX[nRow];
 			}
 		}
 
-		// transpose X matrix
-		matrix<T> oXtMatrix( oXMatrix.transpose() );
-		// multiply transposed X matrix with X matrix
-		matrix<T> oXtXMatrix( oXtMatrix * oXMatrix );
+		// multiply transposed X matrix with X matrix, without forming the transpose
+		matrix<T> oXtXMatrix( oXMatrix.transposeMultiply( oXMatrix ) );
 		// multiply transposed X matrix with Y matrix
-		matrix<T> oXtYMatrix( oXtMatrix * oYMatrix );
+		matrix<T> oXtYMatrix( oXMatrix.transposeMultiply( oYMatrix ) );
 
 		Givens<T> oGivens;
 		oGivens.Decompose( oXtXMatrix );
 		matrix<T> oCoeff = oGivens.Solve( oXtYMatrix );
 		// copy the result to coeff
-		return oCoeff.data();
+		return std::move( oCoeff ).data();
+	}
+
+	namespace detail
+	{
+		/*
+			The map u = (x - nCenter)*nScale that takes [min x, max x] to
+			[-1, 1]. The fixed-degree fits work in u: powers of raw x, such as
+			pixel indices or timestamps, span so many orders of magnitude that
+			the normal equations are singular to working precision.
+		*/
+		template<typename T>
+		void unitRange( const T* pX, size_t nCount, size_t nStride, T& nCenter, T& nScale )
+		{
+			T nMin = nCount ? pX[0] : T(0);
+			T nMax = nMin;
+			for ( size_t i = 1; i < nCount; i++ )
+			{
+				nMin = std::min( nMin, pX[i*nStride] );
+				nMax = std::max( nMax, pX[i*nStride] );
+			}
+			nCenter = (nMin + nMax) / 2;
+			nScale = nMax > nMin ? T(2) / (nMax - nMin) : T(1);
+		}
+
+		/*
+			Turns the coefficients of q(u), u = (x - nCenter)*nScale, into
+			those of p(x) = q(u), in place at a stride.
+		*/
+		template<int Degree, typename T>
+		void fromUnitRange( T* pCoeff, size_t nStride, T nCenter, T nScale )
+		{
+			T nPower = 1;
+			for ( int j = 0; j <= Degree; j++ )
+			{
+				pCoeff[j*nStride] *= nPower;
+				nPower *= nScale;
+			}
+			// Taylor shift: the polynomial in (x - nCenter) becomes one in x.
+			for ( int k = 0; k < Degree; k++ )
+			{
+				for ( int j = Degree - 1; j >= k; j-- )
+				{
+					pCoeff[j*nStride] -= nCenter * pCoeff[(j + 1)*nStride];
+				}
+			}
+		}
+
+		/*
+			Normal equations of a fit of compile-time degree, held on the stack.
+			Entry (i,j) of X^T X is the power sum S(i+j) = sum of x^(i+j), so the
+			2*Degree+1 sums are all that is needed to build it.
+		*/
+		template<int Degree, typename T>
+		class FixedNormalEquations
+		{
+		public:
+			static const int N = Degree + 1;
+
+			/*
+				LU-factors the matrix built from the power sums, with partial
+				pivoting. Returns false if it is singular to working precision,
+				such as when there are fewer distinct x values than coefficients.
+			*/
+			bool Factor( const T* pPowerSums )
+			{
+				T nScale = 0;
+				for ( int r = 0; r < N; r++ )
+				{
+					m_aPivot[r] = r;
+					for ( int c = 0; c < N; c++ )
+					{
+						m_aLU[r][c] = pPowerSums[r + c];
+						nScale = std::max( nScale, std::abs( m_aLU[r][c] ) );
+					}
+				}
+				// Pivots this small relative to the matrix are rounding error.
+				T nTolerance = nScale * N * N * std::numeric_limits<T>::epsilon();
+				for ( int k = 0; k < N; k++ )
+				{
+					int nBest = k;
+					for ( int r = k + 1; r < N; r++ )
+					{
+						if ( std::abs( m_aLU[r][k] ) > std::abs( m_aLU[nBest][k] ) )
+						{
+							nBest = r;
+						}
+					}
+					if ( !(std::abs( m_aLU[nBest][k] ) > nTolerance) )
+					{
+						return false;
+					}
+					if ( nBest != k )
+					{
+						std::swap( m_aLU[nBest], m_aLU[k] );
+						std::swap( m_aPivot[nBest], m_aPivot[k] );
+					}
+					for ( int r = k + 1; r < N; r++ )
+					{
+						T nFactor = m_aLU[r][k] / m_aLU[k][k];
+						m_aLU[r][k] = nFactor;
+						for ( int c = k + 1; c < N; c++ )
+						{
+							m_aLU[r][c] -= nFactor * m_aLU[k][c];
+						}
+					}
+				}
+				return true;
+			}
+
+			/*
+				Solves for the coefficients given the sums of y*x^i. pCoeff is
+				written at a stride so results can go straight to SoA output.
+			*/
+			void Solve( const T* pXtY, T* pCoeff, size_t nStride = 1 ) const
+			{
+				T aZ[N];
+				for ( int r = 0; r < N; r++ )
+				{
+					aZ[r] = pXtY[m_aPivot[r]];
+					for ( int c = 0; c < r; c++ )
+					{
+						aZ[r] -= m_aLU[r][c] * aZ[c];
+					}
+				}
+				for ( int r = N - 1; r >= 0; r-- )
+				{
+					for ( int c = r + 1; c < N; c++ )
+					{
+						aZ[r] -= m_aLU[r][c] * aZ[c];
+					}
+					aZ[r] /= m_aLU[r][r];
+				}
+				for ( int r = 0; r < N; r++ )
+				{
+					pCoeff[r*nStride] = aZ[r];
+				}
+			}
+
+		private:
+			T   m_aLU[N][N];
+			int m_aPivot[N];
+		};
+
+		/*
+			Series fitted per chunk of polyfitBatch(). The per-chunk sums are
+			kept on the stack, one row per power, so that accumulating them is
+			a contiguous loop over the series of the chunk.
+		*/
+		const size_t POLYFIT_BATCH_CHUNK = 64;
+
+		/*
+			Fits series [nFirst, nFirst+nSeriesInChunk) of a polyfitBatch() call.
+			With shared x, nCenter and nScale are its map to [-1, 1]; otherwise
+			each series gets its own.
+		*/
+		template<int Degree, typename T>
+		void polyfitBatchChunk( const T* pX, bool bSharedX, const T* pY, size_t nCount, size_t nSeries,
+		                        size_t nFirst, size_t nSeriesInChunk, T* pCoeff,
+		                        const FixedNormalEquations<Degree, T>* pShared, T nCenter, T nScale )
+		{
+			const int N = Degree + 1;
+			const size_t C = POLYFIT_BATCH_CHUNK;
+			T aXtY[N][C] = {};
+			T aPowerSums[2*Degree + 1][C] = {};
+			T aPower[C];
+			T aCenter[C];
+			T aScale[C];
+
+			if ( !bSharedX )
+			{
+				for ( size_t s = 0; s < nSeriesInChunk; s++ )
+				{
+					unitRange( pX + nFirst + s, nCount, nSeries, aCenter[s], aScale[s] );
+				}
+			}
+
+			for ( size_t k = 0; k < nCount; k++ )
+			{
+				const T* pYk = pY + k*nSeries + nFirst;
+				if ( bSharedX )
+				{
+					// Every series has the same x, so each power is one scalar.
+					T nU = (pX[k] - nCenter) * nScale;
+					T nPower = 1;
+					for ( int j = 0; j < N; j++ )
+					{
+						axpy( nPower, pYk, aXtY[j], static_cast<unsigned int>(nSeriesInChunk) );
+						nPower *= nU;
+					}
+					continue;
+				}
+
+				const T* pXk = pX + k*nSeries + nFirst;
+				for ( size_t s = 0; s < nSeriesInChunk; s++ )
+				{
+					aPower[s] = 1;
+				}
+				for ( int j = 0; j <= 2*Degree; j++ )
+				{
+					for ( size_t s = 0; s < nSeriesInChunk; s++ )
+					{
+						aPowerSums[j][s] += aPower[s];
+						if ( j < N )
+						{
+							aXtY[j][s] += aPower[s] * pYk[s];
+						}
+						aPower[s] *= (pXk[s] - aCenter[s]) * aScale[s];
+					}
+				}
+			}
+
+			for ( size_t s = 0; s < nSeriesInChunk; s++ )
+			{
+				T aB[N];
+				for ( int j = 0; j < N; j++ )
+				{
+					aB[j] = aXtY[j][s];
+				}
+
+				FixedNormalEquations<Degree, T> oLocal;
+				const FixedNormalEquations<Degree, T>* pEquations = pShared;
+				if ( !pEquations )
+				{
+					T aS[2*Degree + 1];
+					for ( int j = 0; j <= 2*Degree; j++ )
+					{
+						aS[j] = aPowerSums[j][s];
+					}
+					pEquations = oLocal.Factor( aS ) ? &oLocal : nullptr;
+				}
+
+				T* pOut = pCoeff + nFirst + s;
+				if ( pEquations )
+				{
+					pEquations->Solve( aB, pOut, nSeries );
+					if ( bSharedX )
+					{
+						fromUnitRange<Degree>( pOut, nSeries, nCenter, nScale );
+					}
+					else
+					{
+						fromUnitRange<Degree>( pOut, nSeries, aCenter[s], aScale[s] );
+					}
+				}
+				else
+				{
+					for ( int j = 0; j < N; j++ )
+					{
+						pOut[j*nSeries] = std::numeric_limits<T>::quiet_NaN();
+					}
+				}
+			}
+		}
+
+		/*
+			y[i] = p(x[i]) for i in [0, n) by Horner's rule. The vector versions
+			evaluate one register of x values per pass over the coefficients.
+		*/
+		template<typename T>
+		inline void horner( const T* pCoeff, size_t nCoeff, const T* pX, T* pY, size_t n )
+		{
+			for ( size_t i = 0; i < n; i++ )
+			{
+				T nY = pCoeff[nCoeff - 1];
+				for ( size_t j = nCoeff - 1; j-- > 0; )
+				{
+					nY = nY * pX[i] + pCoeff[j];
+				}
+				pY[i] = nY;
+			}
+		}
+
+#if defined(__AVX2__)
+		inline void horner( const double* pCoeff, size_t nCoeff, const double* pX, double* pY, size_t n )
+		{
+			size_t i = 0;
+			for ( ; i + 4 <= n; i += 4 )
+			{
+				__m256d vX = _mm256_loadu_pd( pX + i );
+				__m256d vY = _mm256_set1_pd( pCoeff[nCoeff - 1] );
+				for ( size_t j = nCoeff - 1; j-- > 0; )
+				{
+#ifdef __FMA__
+					vY = _mm256_fmadd_pd( vY, vX, _mm256_set1_pd( pCoeff[j] ) );
+#else
+					vY = _mm256_add_pd( _mm256_mul_pd( vY, vX ), _mm256_set1_pd( pCoeff[j] ) );
+#endif
+				}
+				_mm256_storeu_pd( pY + i, vY );
+			}
+			horner<double>( pCoeff, nCoeff, pX + i, pY + i, n - i );
+		}
+
+		inline void horner( const float* pCoeff, size_t nCoeff, const float* pX, float* pY, size_t n )
+		{
+			size_t i = 0;
+			for ( ; i + 8 <= n; i += 8 )
+			{
+				__m256 vX = _mm256_loadu_ps( pX + i );
+				__m256 vY = _mm256_set1_ps( pCoeff[nCoeff - 1] );
+				for ( size_t j = nCoeff - 1; j-- > 0; )
+				{
+#ifdef __FMA__
+					vY = _mm256_fmadd_ps( vY, vX, _mm256_set1_ps( pCoeff[j] ) );
+#else
+					vY = _mm256_add_ps( _mm256_mul_ps( vY, vX ), _mm256_set1_ps( pCoeff[j] ) );
+#endif
+				}
+				_mm256_storeu_ps( pY + i, vY );
+			}
+			horner<float>( pCoeff, nCoeff, pX + i, pY + i, n - i );
+		}
+#elif defined(__ARM_NEON)
+		inline void horner( const float* pCoeff, size_t nCoeff, const float* pX, float* pY, size_t n )
+		{
+			size_t i = 0;
+			for ( ; i + 4 <= n; i += 4 )
+			{
+				float32x4_t vX = vld1q_f32( pX + i );
+				float32x4_t vY = vdupq_n_f32( pCoeff[nCoeff - 1] );
+				for ( size_t j = nCoeff - 1; j-- > 0; )
+				{
+					vY = vmlaq_f32( vdupq_n_f32( pCoeff[j] ), vY, vX );
+				}
+				vst1q_f32( pY + i, vY );
+			}
+			horner<float>( pCoeff, nCoeff, pX + i, pY + i, n - i );
+		}
+
+#if defined(__aarch64__)
+		inline void horner( const double* pCoeff, size_t nCoeff, const double* pX, double* pY, size_t n )
+		{
+			size_t i = 0;
+			for ( ; i + 2 <= n; i += 2 )
+			{
+				float64x2_t vX = vld1q_f64( pX + i );
+				float64x2_t vY = vdupq_n_f64( pCoeff[nCoeff - 1] );
+				for ( size_t j = nCoeff - 1; j-- > 0; )
+				{
+					vY = vfmaq_f64( vdupq_n_f64( pCoeff[j] ), vY, vX );
+				}
+				vst1q_f64( pY + i, vY );
+			}
+			horner<double>( pCoeff, nCoeff, pX + i, pY + i, n - i );
+		}
+#endif
+#endif
+	}
+
+	/*
+		polyfit() for a degree known at compile time, called as
+		polyfit<3>( pX, pY, nCount ). The normal equations are accumulated
+		in one pass over the data and solved on the stack, so nothing is
+		allocated. This is the version to use for many small fits. x is
+		mapped to [-1, 1] before its powers are summed, so offset or wide
+		ranges such as pixel indices fit as well as small values do.
+
+		param:
+			pX				x axis values
+			pY				y axis values
+			nCount			number of points
+
+		return:
+			coefficients starting at the constant coefficient. Throws
+			domain_error if the points do not determine a polynomial of
+			this degree.
+	*/
+	template<int Degree, typename T>
+	std::array<T, Degree + 1> polyfit( const T* pX, const T* pY, size_t nCount )
+	{
+		static_assert( Degree >= 0, "polynomial degree must not be negative" );
+		const int N = Degree + 1;
+
+		T nCenter, nScale;
+		detail::unitRange( pX, nCount, 1, nCenter, nScale );
+
+		T aPowerSums[2*Degree + 1] = {};
+		T aXtY[N] = {};
+		for ( size_t i = 0; i < nCount; i++ )
+		{
+			T nU = (pX[i] - nCenter) * nScale;
+			T nPower = 1;
+			for ( int j = 0; j <= 2*Degree; j++ )
+			{
+				aPowerSums[j] += nPower;
+				if ( j < N )
+				{
+					aXtY[j] += nPower * pY[i];
+				}
+				nPower *= nU;
+			}
+		}
+
+		detail::FixedNormalEquations<Degree, T> oEquations;
+		if ( !oEquations.Factor( aPowerSums ) )
+		{
+			throw domain_error( "points do not determine a polynomial of this degree" );
+		}
+		std::array<T, Degree + 1> oCoeff;
+		oEquations.Solve( aXtY, oCoeff.data() );
+		detail::fromUnitRange<Degree>( oCoeff.data(), 1, nCenter, nScale );
+		return oCoeff;
+	}
+
+	template<int Degree, typename T>
+	std::array<T, Degree + 1> polyfit( const std::vector<T>& oX, const std::vector<T>& oY )
+	{
+		if ( oX.size() != oY.size() )
+			throw std::invalid_argument( "X and Y vector sizes do not match" );
+
+		return polyfit<Degree>( oX.data(), oY.data(), oX.size() );
+	}
+
+	/*
+		Fits a polynomial of compile-time degree to each of nSeries series of
+		nCount points, such as one curve per pixel across a stack of frames.
+
+		The data is structure-of-arrays: point k of series s is at
+		pY[k*nSeries + s], so each frame is one contiguous array. The x
+		values are laid out the same way, or with bSharedX are a single
+		array of nCount values used by every series; the normal equations
+		are then factored only once. Coefficient j of series s is written
+		to pCoeff[j*nSeries + s].
+
+		A series whose points do not determine a polynomial gets NaN
+		coefficients rather than stopping the batch.
+
+		param:
+			pX				x axis values
+			bSharedX		whether pX is one series shared by all
+			pY				y axis values
+			nCount			points per series
+			nSeries			number of series
+			pCoeff			(Degree+1)*nSeries coefficients out
+			pPool			pool to spread the series over, or nullptr
+	*/
+	template<int Degree, typename T>
+	void polyfitBatch( const T* pX, bool bSharedX, const T* pY, size_t nCount, size_t nSeries,
+	                   T* pCoeff, acl::ThreadPool* pPool = nullptr )
+	{
+		static_assert( Degree >= 0, "polynomial degree must not be negative" );
+
+		detail::FixedNormalEquations<Degree, T> oShared;
+		const detail::FixedNormalEquations<Degree, T>* pShared = nullptr;
+		T nCenter = 0;
+		T nScale = 1;
+		if ( bSharedX )
+		{
+			detail::unitRange( pX, nCount, 1, nCenter, nScale );
+			T aPowerSums[2*Degree + 1] = {};
+			for ( size_t k = 0; k < nCount; k++ )
+			{
+				T nU = (pX[k] - nCenter) * nScale;
+				T nPower = 1;
+				for ( int j = 0; j <= 2*Degree; j++ )
+				{
+					aPowerSums[j] += nPower;
+					nPower *= nU;
+				}
+			}
+			if ( !oShared.Factor( aPowerSums ) )
+			{
+				std::fill( pCoeff, pCoeff + (Degree + 1)*nSeries, std::numeric_limits<T>::quiet_NaN() );
+				return;
+			}
+			pShared = &oShared;
+		}
+
+		const size_t C = detail::POLYFIT_BATCH_CHUNK;
+		size_t nChunks = (nSeries + C - 1) / C;
+		auto fitChunk = [=]( size_t nChunk ) {
+			size_t nFirst = nChunk*C;
+			detail::polyfitBatchChunk<Degree>( pX, bSharedX, pY, nCount, nSeries,
+			                                   nFirst, std::min( C, nSeries - nFirst ), pCoeff, pShared,
+			                                   nCenter, nScale );
+		};
+
+		if ( pPool && nChunks > 1 )
+		{
+			acl::parallel_for( *pPool, size_t(0), nChunks, size_t(0), fitChunk );
+		}
+		else
+		{
+			for ( size_t nChunk = 0; nChunk < nChunks; nChunk++ )
+			{
+				fitChunk( nChunk );
+			}
+		}
+	}
+
+	/*
+		Evaluates a polynomial at nCount values into a caller's buffer,
+		pY[i] = p(pX[i]), by Horner's rule. For float and double on AVX2
+		and NEON targets several x values are evaluated per instruction.
+
+		param:
+			pCoeff			nCoeff coefficients starting at the constant one
+			pX				x axis values
+			pY				nCount fitted values out
+	*/
+	template<typename T>
+	void polyval( const T* pCoeff, size_t nCoeff, const T* pX, T* pY, size_t nCount )
+	{
+		if ( nCoeff == 0 )
+		{
+			std::fill( pY, pY + nCount, T(0) );
+			return;
+		}
+		detail::horner( pCoeff, nCoeff, pX, pY, nCount );
 	}
 
 	/*
@@ -86,26 +595,23 @@ namespace mathalgo
 	template<typename T>
 	std::vector<T> polyval( const std::vector<T>& oCoeff, const std::vector<T>& oX )
 	{
-		size_t nCount =  oX.size();
-		size_t nDegree = oCoeff.size();
-		std::vector<T>	oY( nCount );
+		std::vector<T>	oY( oX.size() );
+		polyval( oCoeff.data(), oCoeff.size(), oX.data(), oY.data(), oX.size() );
+		return oY;
+	}
 
-		for ( size_t i = 0; i < nCount; i++ )
+	/*
+		Evaluates a polynomial from polyfit<Degree>() at one point.
+	*/
+	template<size_t N, typename T>
+	inline T polyval( const std::array<T, N>& oCoeff, T nX )
+	{
+		T nY = oCoeff[N - 1];
+		for ( size_t j = N - 1; j-- > 0; )
 		{
-			T nY = 0;
-			T nXT = 1;
-			T nX = oX[i];
-			for ( size_t j = 0; j < nDegree; j++ )
-			{
-				// multiply current x by a coefficient
-				nY += oCoeff[j] * nXT;
-				// power up the X
-				nXT *= nX;
-			}
-			oY[i] = nY;
+			nY = nY * nX + oCoeff[j];
 		}
-
-		return oY;
+		return nY;
 	}
 
 };
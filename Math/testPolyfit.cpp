@@ -3,41 +3,173 @@
  *    \license This project is released under the MIT Public License.
 **/
 
-#include "acl/polyfit.tcc"
+#include "polyfit.tcc"
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#include "Benchmark.hpp"
+#include "ThreadPool.h"
 
-int main()
+using namespace acl::bench;
+
+/// @brief Points per fitted series, as for a pixel across a stack of frames.
+static const size_t POINTS = 64;
+
+/// @brief Series fitted per measured batch.
+static const size_t SERIES = 4096;
+
+/// @brief Runs fn repeatedly for the configured duration.
+/// @return Calls of fn per second.
+template <typename Fn>
+static double Rate(const Options& options, Fn fn)
+{
+  size_t calls = 0;
+  double start = Now();
+  double end = start + options.duration;
+  do {
+    fn();
+    calls++;
+  } while (Now() < end);
+  return calls / (Now() - start);
+}
+
+/// @brief polyval() as it was before Horner's rule, for comparison.
+static void PowerSumPolyval(const std::vector<double>& coeff, const std::vector<double>& x, std::vector<double>& y)
 {
-    std::vector<double> r_undistorted;
-    std::vector<double> r_distorted;
-    //create the undistorted array
-    for(double x = 0; x <= 1; x+=0.01){
-        r_undistorted.push_back(x);
+  for (size_t i = 0; i < x.size(); i++) {
+    double nY = 0;
+    double nXT = 1;
+    for (size_t j = 0; j < coeff.size(); j++) {
+      nY += coeff[j] * nXT;
+      nXT *= x[i];
     }
+    y[i] = nY;
+  }
+}
 
-    //Have the user enter A, B, C, D
-    std::string A, B, C, D;
-    std::cout << "A: ";
-    std::cin >> A;
-    std::cout << "B: ";
-    std::cin >> B;
-    std::cout << "C: ";
-    std::cin >> C;
-    std::cout << "D: ";
-    std::cin >> D;
-
-    //Create the distorted array 
-    for(double r : r_undistorted){
-        double newR = std::stod(A) * std::pow(r,4) + std::stod(B) * std::pow(r,3) + std::stod(C) * std::pow(r,2) + std::stod(D) * r;
-        r_distorted.push_back(newR);
+/// @brief Fits SERIES cubics of POINTS points each way and prints fits per second.
+static void RunFits(const Options& options, acl::ThreadPool& pool)
+{
+  // Structure-of-arrays: point k of series s is at [k * SERIES + s].
+  std::vector<double> sharedX(POINTS), x(POINTS * SERIES), y(POINTS * SERIES);
+  for (size_t k = 0; k < POINTS; k++) {
+    sharedX[k] = static_cast<double>(k) / POINTS;
+    for (size_t s = 0; s < SERIES; s++) {
+      double v = sharedX[k];
+      x[k * SERIES + s] = v;
+      y[k * SERIES + s] = 0.1 * s + v * (1.0 + v * (-0.5 + v * 0.25)) + 1e-3 * std::sin(k + s);
     }
+  }
+  std::vector<double> coeff(4 * SERIES);
 
-    //Polyfit the distorted to the undistorted
-    std::vector<double> coeffs = mathalgo::polyfit(r_distorted, r_undistorted,4);
-    
-    for(double coef : coeffs){
-        std::cout << coef << std::endl;
+  // The single-series fits take contiguous points, so gather each series first.
+  std::vector<double> seriesX(sharedX), seriesY(POINTS);
+  auto gather = [&](size_t s) {
+    for (size_t k = 0; k < POINTS; k++) {
+      seriesY[k] = y[k * SERIES + s];
     }
-    return 0;
+  };
+
+  double rate = Rate(options, [&]() {
+    for (size_t s = 0; s < SERIES; s++) {
+      gather(s);
+      std::vector<double> fit = mathalgo::polyfit(seriesX, seriesY, 3);
+      coeff[s] = fit[0];
+    }
+  });
+  JsonLine("polyfit").add("method", "general").add("points", POINTS).add("fits_per_s", rate * SERIES).print();
+
+  rate = Rate(options, [&]() {
+    for (size_t s = 0; s < SERIES; s++) {
+      gather(s);
+      coeff[s] = mathalgo::polyfit<3>(seriesX.data(), seriesY.data(), POINTS)[0];
+    }
+  });
+  JsonLine("polyfit").add("method", "fixed_degree").add("points", POINTS).add("fits_per_s", rate * SERIES).print();
+
+  rate = Rate(options, [&]() {
+    mathalgo::polyfitBatch<3>(x.data(), false, y.data(), POINTS, SERIES, coeff.data());
+  });
+  JsonLine("polyfit").add("method", "batch").add("points", POINTS).add("fits_per_s", rate * SERIES).print();
+
+  rate = Rate(options, [&]() {
+    mathalgo::polyfitBatch<3>(sharedX.data(), true, y.data(), POINTS, SERIES, coeff.data());
+  });
+  JsonLine("polyfit").add("method", "batch_shared_x").add("points", POINTS).add("fits_per_s", rate * SERIES).print();
+
+  rate = Rate(options, [&]() {
+    mathalgo::polyfitBatch<3>(x.data(), false, y.data(), POINTS, SERIES, coeff.data(), &pool);
+  });
+  JsonLine("polyfit").add("method", "batch_pool").add("points", POINTS)
+      .add("threads", static_cast<size_t>(pool.getNumThreads())).add("fits_per_s", rate * SERIES).print();
+}
+
+/// @brief Evaluates a quartic at a million points and prints values per second.
+static void RunPolyval(const Options& options)
+{
+  std::vector<double> coeff = { 0.5, -2.0, 3.0, 0.25, -0.125 };
+  std::vector<double> x(1000000), y(x.size());
+  for (size_t i = 0; i < x.size(); i++) {
+    x[i] = static_cast<double>(i) / x.size();
+  }
+
+  double rate = Rate(options, [&]() { PowerSumPolyval(coeff, x, y); });
+  JsonLine("polyval").add("method", "power_sum").add("values_per_s", rate * x.size()).print();
+
+  rate = Rate(options, [&]() { mathalgo::polyval(coeff.data(), coeff.size(), x.data(), y.data(), x.size()); });
+  JsonLine("polyval").add("method", "horner").add("values_per_s", rate * x.size()).print();
+}
+
+/// @brief Fits a quartic with coefficients read from standard input and prints the result.
+static int RunDemo()
+{
+  std::vector<double> r_undistorted;
+  std::vector<double> r_distorted;
+  //create the undistorted array
+  for (double x = 0; x <= 1; x += 0.01) {
+    r_undistorted.push_back(x);
+  }
+
+  //Have the user enter A, B, C, D
+  std::string A, B, C, D;
+  std::cout << "A: ";
+  std::cin >> A;
+  std::cout << "B: ";
+  std::cin >> B;
+  std::cout << "C: ";
+  std::cin >> C;
+  std::cout << "D: ";
+  std::cin >> D;
+
+  //Create the distorted array
+  for (double r : r_undistorted) {
+    double newR = std::stod(A) * std::pow(r, 4) + std::stod(B) * std::pow(r, 3) + std::stod(C) * std::pow(r, 2) + std::stod(D) * r;
+    r_distorted.push_back(newR);
+  }
+
+  //Polyfit the distorted to the undistorted
+  std::vector<double> coeffs = mathalgo::polyfit(r_distorted, r_undistorted, 4);
+
+  for (double coef : coeffs) {
+    std::cout << coef << std::endl;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  if (argc == 2 && strcmp(argv[1], "--demo") == 0) {
+    return RunDemo();
+  }
+  Options options = ParseArgs(argc, argv);
 
+  unsigned threads = std::thread::hardware_concurrency();
+  acl::ThreadPool pool(threads ? threads : 4, 1000);
+  pool.Start();
+  RunFits(options, pool);
+  RunPolyval(options);
+  pool.Stop();
+  pool.Join();
+  return 0;
 }
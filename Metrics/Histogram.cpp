@@ -0,0 +1,261 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file Histogram.cpp
+ **/
+
+#include "Histogram.hpp"
+
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace acl
+{
+
+namespace
+{
+std::atomic<unsigned> g_nextShard(0);                           //!< Hands shards out round robin
+thread_local unsigned t_shard = g_nextShard++;                  //!< Shard of the current thread
+
+/**
+ * \brief Returns the position of the highest set bit of a nonzero value
+ **/
+inline unsigned highest_bit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+}
+
+/**
+ * \brief Counts recorded by one group of threads
+ **/
+struct Histogram::Shard {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> counts[BUCKETS];
+
+    Shard() { clear(); }
+
+    void clear()
+    {
+        count = 0;
+        sum = 0;
+        min = UINT64_MAX;
+        max = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * \brief Constructor
+ **/
+HistogramSnapshot::HistogramSnapshot()
+    : m_counts(Histogram::BUCKETS, 0), m_min(UINT64_MAX)
+{
+}
+
+/**
+ * \brief Returns the smallest value recorded
+ *
+ * \return The value, or 0 if nothing was recorded
+ **/
+uint64_t HistogramSnapshot::min() const
+{
+    return m_count ? m_min : 0;
+}
+
+/**
+ * \brief Returns the average of the values recorded
+ *
+ * \return The mean, or 0 if nothing was recorded
+ **/
+double HistogramSnapshot::mean() const
+{
+    return m_count ? (double)m_sum / (double)m_count : 0;
+}
+
+/**
+ * \brief Returns the value that a given percentage of the recorded values
+ *        are at or below, to within the bucket resolution
+ *
+ * \param [in] percent Percentage from 0 to 100, such as 99.9
+ * \return The value, or 0 if nothing was recorded
+ **/
+uint64_t HistogramSnapshot::percentile(double percent) const
+{
+    if (!m_count) {
+        return 0;
+    }
+    double rank = std::ceil(percent / 100.0 * (double)m_count);
+    uint64_t target = rank < 1 ? 1 : (uint64_t)rank;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < m_counts.size(); i++) {
+        seen += m_counts[i];
+        if (seen >= target) {
+            uint64_t value = Histogram::bucket_value(i);
+            if (value < m_min) {
+                return m_min;
+            }
+            return value > m_max ? m_max : value;
+        }
+    }
+    return m_max;
+}
+
+/**
+ * \brief Adds the values of another snapshot into this one, for example to
+ *        combine histograms kept by several processes or objects
+ **/
+void HistogramSnapshot::merge(const HistogramSnapshot& other)
+{
+    for (size_t i = 0; i < m_counts.size(); i++) {
+        m_counts[i] += other.m_counts[i];
+    }
+    if (other.m_count) {
+        m_min = other.m_min < m_min ? other.m_min : m_min;
+        m_max = other.m_max > m_max ? other.m_max : m_max;
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+}
+
+/**
+ * \brief Constructor
+ **/
+Histogram::Histogram()
+{
+    for (size_t i = 0; i < SHARDS; i++) {
+        m_shards[i] = nullptr;
+    }
+}
+
+/**
+ * \brief Destructor.  No thread may be recording.
+ **/
+Histogram::~Histogram()
+{
+    for (size_t i = 0; i < SHARDS; i++) {
+        delete m_shards[i].load();
+    }
+}
+
+/**
+ * \brief Returns the shard for the calling thread, allocating it if needed
+ **/
+Histogram::Shard* Histogram::shard()
+{
+    std::atomic<Shard*>& slot = m_shards[t_shard % SHARDS];
+    Shard* s = slot.load(std::memory_order_acquire);
+    if (!s) {
+        Shard* created = new Shard;
+        if (slot.compare_exchange_strong(s, created, std::memory_order_acq_rel)) {
+            s = created;
+        } else {
+            delete created;
+        }
+    }
+    return s;
+}
+
+/**
+ * \brief Records a value
+ *
+ * \param [in] value The value, such as a duration in nanoseconds
+ * \param [in] count Number of times to record it
+ **/
+void Histogram::record(uint64_t value, uint64_t count)
+{
+    Shard* s = shard();
+    s->counts[bucket_index(value)].fetch_add(count, std::memory_order_relaxed);
+    s->count.fetch_add(count, std::memory_order_relaxed);
+    s->sum.fetch_add(value * count, std::memory_order_relaxed);
+
+    uint64_t seen = s->min.load(std::memory_order_relaxed);
+    while (value < seen && !s->min.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+    seen = s->max.load(std::memory_order_relaxed);
+    while (value > seen && !s->max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+/**
+ * \brief Copies the counts from every shard
+ **/
+HistogramSnapshot Histogram::snapshot() const
+{
+    HistogramSnapshot result;
+    for (size_t i = 0; i < SHARDS; i++) {
+        const Shard* s = m_shards[i].load(std::memory_order_acquire);
+        if (!s) {
+            continue;
+        }
+        for (size_t b = 0; b < BUCKETS; b++) {
+            result.m_counts[b] += s->counts[b].load(std::memory_order_relaxed);
+        }
+        result.m_count += s->count.load(std::memory_order_relaxed);
+        result.m_sum += s->sum.load(std::memory_order_relaxed);
+        uint64_t min = s->min.load(std::memory_order_relaxed);
+        uint64_t max = s->max.load(std::memory_order_relaxed);
+        result.m_min = min < result.m_min ? min : result.m_min;
+        result.m_max = max > result.m_max ? max : result.m_max;
+    }
+    return result;
+}
+
+/**
+ * \brief Forgets every value.  Values recorded while this runs may be
+ *        partly kept.
+ **/
+void Histogram::reset()
+{
+    for (size_t i = 0; i < SHARDS; i++) {
+        Shard* s = m_shards[i].load(std::memory_order_acquire);
+        if (s) {
+            s->clear();
+        }
+    }
+}
+
+/**
+ * \brief Returns the bucket that a value is counted in
+ **/
+size_t Histogram::bucket_index(uint64_t value)
+{
+    if (value < SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    unsigned shift = highest_bit(value) - SUB_BUCKET_BITS;
+    return (size_t)(shift + 1) * SUB_BUCKETS + (size_t)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+/**
+ * \brief Returns the middle of the range of values counted in a bucket
+ **/
+uint64_t Histogram::bucket_value(size_t index)
+{
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    unsigned shift = (unsigned)(index / SUB_BUCKETS) - 1;
+    uint64_t lowest = (uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t(1) << shift) >> 1);
+}
+
+}
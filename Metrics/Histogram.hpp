@@ -0,0 +1,89 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file Histogram.hpp
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+namespace acl
+{
+
+/**
+ * \brief A copy of a Histogram's counts at one moment, for reading
+ *        percentiles and merging with others.
+ **/
+class HistogramSnapshot
+{
+public:
+    HistogramSnapshot();
+
+    uint64_t    count() const { return m_count; }   //!< Number of values recorded
+    uint64_t    sum() const { return m_sum; }       //!< Total of the values recorded
+    uint64_t    min() const;                        //!< Smallest value, or 0 if empty
+    uint64_t    max() const { return m_max; }       //!< Largest value, or 0 if empty
+    double      mean() const;
+    uint64_t    percentile(double percent) const;
+    void        merge(const HistogramSnapshot& other);
+
+private:
+    friend class Histogram;
+
+    std::vector<uint64_t> m_counts;                 //!< Values recorded in each bucket
+    uint64_t    m_count = 0;
+    uint64_t    m_sum = 0;
+    uint64_t    m_min;
+    uint64_t    m_max = 0;
+};
+
+/**
+ * \brief Distribution of non-negative integer values, such as latencies
+ *        in nanoseconds, with a fixed relative error.
+ *
+ * Buckets are laid out as in HdrHistogram: values below 32 each have a
+ * bucket, and every power of two above that is split into 32 buckets, so
+ * that a percentile is within 1/32 (3%) of the true value over the whole
+ * 64-bit range.
+ *
+ * record() is lock-free.  Each thread records into one of a fixed number
+ * of shards, which are allocated the first time a thread uses them, so
+ * that threads rarely touch the same cache lines.  snapshot() adds the
+ * shards together; it may miss values recorded while it runs.
+ **/
+class Histogram
+{
+public:
+    static const unsigned SUB_BUCKET_BITS = 5;
+    static const size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    static const size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    Histogram();
+    ~Histogram();
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void        record(uint64_t value, uint64_t count = 1);
+    HistogramSnapshot snapshot() const;
+    void        reset();
+
+    static size_t   bucket_index(uint64_t value);
+    static uint64_t bucket_value(size_t index);
+
+private:
+    struct Shard;
+    static const size_t SHARDS = 16;
+
+    Shard*      shard();
+
+    std::atomic<Shard*> m_shards[SHARDS];           //!< Allocated on first use
+};
+
+}
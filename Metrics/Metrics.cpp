@@ -0,0 +1,118 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file Metrics.cpp
+ **/
+
+#include "Metrics.hpp"
+
+#include <sstream>
+
+namespace acl
+{
+
+/**
+ * \brief Returns the registry.  It is never destroyed, so that threads
+ *        still running during exit can record safely.
+ **/
+Metrics& Metrics::instance()
+{
+    static Metrics* metrics = new Metrics;
+    return *metrics;
+}
+
+/**
+ * \brief Returns the counter with a name, creating it if needed
+ **/
+Counter& Metrics::counter(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Counter>& c = m_counters[name];
+    if (!c) {
+        c.reset(new Counter);
+    }
+    return *c;
+}
+
+/**
+ * \brief Returns the histogram with a name, creating it if needed
+ **/
+Histogram& Metrics::histogram(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Histogram>& h = m_histograms[name];
+    if (!h) {
+        h.reset(new Histogram);
+    }
+    return *h;
+}
+
+/**
+ * \brief Copies the current value of every metric
+ **/
+MetricsSnapshot Metrics::snapshot()
+{
+    MetricsSnapshot result;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& c : m_counters) {
+        result.counters[c.first] = c.second->value();
+    }
+    for (auto& h : m_histograms) {
+        result.histograms[h.first] = h.second->snapshot();
+    }
+    return result;
+}
+
+/**
+ * \brief Sets every metric back to zero.  The metrics stay registered.
+ **/
+void Metrics::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& c : m_counters) {
+        c.second->reset();
+    }
+    for (auto& h : m_histograms) {
+        h.second->reset();
+    }
+}
+
+/**
+ * \brief Formats the snapshot as a JSON object with "counters" and
+ *        "histograms" members.  Each histogram is summarized by its count,
+ *        min, max, mean and 50th, 90th, 99th and 99.9th percentiles.
+ **/
+std::string MetricsSnapshot::to_json() const
+{
+    std::ostringstream out;
+    out.precision(10);
+    out << "{\"counters\":{";
+    const char* sep = "";
+    for (auto& c : counters) {
+        out << sep << "\"" << c.first << "\":" << c.second;
+        sep = ",";
+    }
+    out << "},\"histograms\":{";
+    sep = "";
+    for (auto& h : histograms) {
+        const HistogramSnapshot& s = h.second;
+        out << sep << "\"" << h.first << "\":{"
+            << "\"count\":" << s.count()
+            << ",\"min\":" << s.min()
+            << ",\"max\":" << s.max()
+            << ",\"mean\":" << s.mean()
+            << ",\"p50\":" << s.percentile(50)
+            << ",\"p90\":" << s.percentile(90)
+            << ",\"p99\":" << s.percentile(99)
+            << ",\"p999\":" << s.percentile(99.9)
+            << "}";
+        sep = ",";
+    }
+    out << "}}";
+    return out.str();
+}
+
+}
@@ -0,0 +1,143 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file Metrics.hpp
+ *
+ * Named counters and histograms, and the macros that the library uses to
+ * instrument its hot paths.  The macros compile to nothing unless
+ * ACL_ENABLE_METRICS is defined, which the USE_METRICS CMake option does
+ * for the library and everything that links to it.  The classes are always
+ * available for applications to use directly.
+ *
+ * With metrics compiled in, the library records:
+ *   TSQueue.depth             Queue length after each insert
+ *   TSQueue.wait_ns           Time dequeue() and dequeue_bulk() waited for data
+ *   ThreadPool.queue_ns       Time from push_job() until a worker starts the job
+ *   ThreadPool.run_ns         Time taken to run each job
+ *   ThreadPool.rejected       Jobs push_job() refused because the pool was full
+ *   LruCache.hits/misses/evictions/rejections, and the same for ShardedLruCache
+ *   CoreSocket.read_calls/bytes_read/write_calls/bytes_written
+ **/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Histogram.hpp"
+#include "Timer.h"
+
+namespace acl
+{
+
+/**
+ * \brief A count that any thread can add to without locking
+ **/
+class Counter
+{
+public:
+    void        add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t    value() const { return m_value.load(std::memory_order_relaxed); }
+    void        reset() { m_value = 0; }
+
+private:
+    std::atomic<uint64_t> m_value{0};
+};
+
+/**
+ * \brief Values of every counter and histogram at one moment
+ **/
+struct MetricsSnapshot {
+    std::map<std::string, uint64_t>          counters;
+    std::map<std::string, HistogramSnapshot> histograms;
+
+    std::string to_json() const;
+};
+
+/**
+ * \brief Process-wide registry of named counters and histograms
+ *
+ * Lookups take a lock, so callers on hot paths look a metric up once and
+ * keep the reference, which stays valid for the life of the process.  The
+ * ACL_METRIC_* macros do this with a function-local static.
+ **/
+class Metrics
+{
+public:
+    static Metrics& instance();
+
+    Counter&    counter(const std::string& name);
+    Histogram&  histogram(const std::string& name);
+    MetricsSnapshot snapshot();
+    void        reset();
+
+private:
+    Metrics() {}
+
+    std::mutex  m_mutex;                                           //!< Protects the maps
+    std::map<std::string, std::unique_ptr<Counter>>   m_counters;
+    std::map<std::string, std::unique_ptr<Histogram>> m_histograms;
+};
+
+/**
+ * \brief Records the nanoseconds from construction to destruction in a
+ *        histogram, using getFastNsec()
+ **/
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Histogram& histogram)
+        : m_histogram(histogram), m_start(getFastNsec()) {}
+    ~ScopedTimer() { m_histogram.record(getFastNsec() - m_start); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram&  m_histogram;
+    uint64_t    m_start;
+};
+
+}
+
+#define ACL_METRIC_CAT2(a, b) a##b
+#define ACL_METRIC_CAT(a, b) ACL_METRIC_CAT2(a, b)
+
+#ifdef ACL_ENABLE_METRICS
+
+/// Add n to the counter called name, which must be the same on every call
+#define ACL_METRIC_COUNT(name, n) do { \
+    static acl::Counter& acl_metric_ = acl::Metrics::instance().counter(name); \
+    acl_metric_.add(n); \
+} while (0)
+
+/// Record value in the histogram called name
+#define ACL_METRIC_RECORD(name, value) do { \
+    static acl::Histogram& acl_metric_ = acl::Metrics::instance().histogram(name); \
+    acl_metric_.record(value); \
+} while (0)
+
+/// Declare a variable holding the current getFastNsec() time
+#define ACL_METRIC_TIMESTAMP(var) uint64_t var = acl::getFastNsec()
+
+/// Record the nanoseconds since an ACL_METRIC_TIMESTAMP in a histogram
+#define ACL_METRIC_RECORD_SINCE(name, var) ACL_METRIC_RECORD(name, acl::getFastNsec() - (var))
+
+/// Record the nanoseconds until the end of the enclosing scope in a histogram
+#define ACL_METRIC_SCOPED_TIMER(name) \
+    static acl::Histogram& ACL_METRIC_CAT(acl_metric_histogram_, __LINE__) = \
+        acl::Metrics::instance().histogram(name); \
+    acl::ScopedTimer ACL_METRIC_CAT(acl_metric_timer_, __LINE__)(ACL_METRIC_CAT(acl_metric_histogram_, __LINE__))
+
+#else
+
+#define ACL_METRIC_COUNT(name, n) do {} while (0)
+#define ACL_METRIC_RECORD(name, value) do {} while (0)
+#define ACL_METRIC_TIMESTAMP(var)
+#define ACL_METRIC_RECORD_SINCE(name, var) do {} while (0)
+#define ACL_METRIC_SCOPED_TIMER(name)
+
+#endif
@@ -9,12 +9,18 @@
 
 #include "shared_mutex.h"
 
+#include <thread>
+
 #ifdef USE_HELGRIND
 #include "helgrind.h"
 #endif //USE_HELGRIND
 
 namespace acl
 {
+    namespace {
+        std::atomic_size_t s_nextSlot(0);   //!< Hands out distributed_shared_mutex slots
+        thread_local size_t t_slot = s_nextSlot++;
+    }
 
     shared_mutex::~shared_mutex()
     {
@@ -27,7 +33,7 @@ namespace acl
     /**
      * Constructor
      */
-    shared_mutex::shared_mutex(): readers(0)
+    shared_mutex::shared_mutex(): m_state(0), m_readersWaiting(0), m_writerWaiting(0)
     {
 #ifdef USE_HELGRIND
         // Due to virtual destructor, this should be a VTable pointer
@@ -35,12 +41,102 @@ namespace acl
 #endif //USE_HELGRIND
     }
 
+    /**
+     * Serializes writers.  Only one writer at a time waits for readers to drain.
+     */
+    void shared_mutex::writer_enter()
+    {
+        m_writer.lock();
+    }
+
+    /**
+     * Serializes writers without blocking
+     *
+     * @return Returns false if another writer holds or is waiting for the lock
+     */
+    bool shared_mutex::try_writer_enter()
+    {
+        return m_writer.try_lock();
+    }
+
+    /**
+     * Lets the next writer in
+     */
+    void shared_mutex::writer_exit()
+    {
+        m_writer.unlock();
+    }
+
+    /**
+     * Waits until drained() returns true, spinning briefly before sleeping.
+     * Readers that may make drained() true must call notify_writer().
+     */
+    void shared_mutex::wait_for_readers(const std::function<bool()>& drained)
+    {
+        for (int i = 0; i < SPIN_COUNT; i++) {
+            if (drained()) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        m_writerWaiting++;
+        {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_writerCv.wait(lock, drained);
+        }
+        m_writerWaiting--;
+    }
+
+    /**
+     * Wakes a writer sleeping in wait_for_readers()
+     */
+    void shared_mutex::notify_writer()
+    {
+        if (m_writerWaiting > 0) {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+            m_writerCv.notify_one();
+        }
+    }
+
+    /**
+     * Sleeps until done() returns true.  The writer must call notify_readers()
+     * after making done() true.
+     */
+    void shared_mutex::wait_for_writer(const std::function<bool()>& done)
+    {
+        m_readersWaiting++;
+        {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_readerCv.wait(lock, done);
+        }
+        m_readersWaiting--;
+    }
+
+    /**
+     * Wakes every reader sleeping in wait_for_writer()
+     */
+    void shared_mutex::notify_readers()
+    {
+        if (m_readersWaiting > 0) {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+            m_readerCv.notify_all();
+        }
+    }
+
     /**
      * Locks a thread
+     *
+     * Setting the WRITER bit stops new readers, then the writer waits for the
+     * readers already inside to leave.
      */
     void shared_mutex::lock()
     {
-        m_mutex.lock();
+        writer_enter();
+        uint32_t state = m_state.fetch_or(WRITER);
+        if (state != 0) {
+            wait_for_readers([this]() { return m_state.load() == WRITER; });
+        }
 #ifdef USE_HELGRIND
         ANNOTATE_RWLOCK_ACQUIRED(this, 1);
 #endif //USE_HELGRIND
@@ -48,12 +144,20 @@ namespace acl
 
     /**
      * Checks if a lock is in place
-     * 
+     *
      * @return Returns false if there is a lock
      */
     bool shared_mutex::try_lock()
     {
-        bool locked = m_mutex.try_lock();
+        if (!try_writer_enter()) {
+            return false;
+        }
+
+        uint32_t expected = 0;
+        bool locked = m_state.compare_exchange_strong(expected, WRITER);
+        if (!locked) {
+            writer_exit();
+        }
 #ifdef USE_HELGRIND
         if(locked) {
             ANNOTATE_RWLOCK_ACQUIRED(this, 1);
@@ -70,7 +174,23 @@ namespace acl
 #ifdef USE_HELGRIND
         ANNOTATE_RWLOCK_RELEASED(this, 1);
 #endif //USE_HELGRIND
-        m_mutex.unlock();
+        m_state.fetch_and(~WRITER);
+        notify_readers();
+        writer_exit();
+    }
+
+    /**
+     * Adds a reader unless a writer holds or is waiting for the lock
+     */
+    bool shared_mutex::try_add_reader()
+    {
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while (!(state & WRITER)) {
+            if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
     }
 
     /**
@@ -78,10 +198,14 @@ namespace acl
         */
     void shared_mutex::lock_shared()
     {
-        m_read.lock();
-        readers++;
-        if( readers == 1 ) m_mutex.lock();
-        m_read.unlock();
+        int spins = 0;
+        while (!try_add_reader()) {
+            if (++spins < SPIN_COUNT) {
+                std::this_thread::yield();
+            } else {
+                wait_for_writer([this]() { return !(m_state.load() & WRITER); });
+            }
+        }
 #ifdef USE_HELGRIND
         ANNOTATE_RWLOCK_ACQUIRED(this, 0);
 #endif //USE_HELGRIND
@@ -89,21 +213,12 @@ namespace acl
 
     /**
      * Checks if a lock is in place
-     * 
+     *
      * @return Returns false if there is a lock
      */
     bool shared_mutex::try_lock_shared()
     {
-        bool rc = true;
-        m_read.lock();
-        readers++;
-        if( readers == 1 ){
-            rc = m_mutex.try_lock();
-            if( !rc ){
-                readers--;
-            }
-        }
-        m_read.unlock();
+        bool rc = try_add_reader();
 #ifdef USE_HELGRIND
         if(rc) {
             ANNOTATE_RWLOCK_ACQUIRED(this, 0);
@@ -120,10 +235,189 @@ namespace acl
 #ifdef USE_HELGRIND
         ANNOTATE_RWLOCK_RELEASED(this, 0);
 #endif //USE_HELGRIND
-        m_read.lock();
-        readers--;
-        if( !readers ) m_mutex.unlock();
-        m_read.unlock();
+        uint32_t state = m_state.fetch_sub(1);
+        if (state == (WRITER | 1)) {
+            notify_writer();
+        }
+    }
+
+
+    /////////////////////////////////////////////
+    // distributed_shared_mutex implementation //
+    /////////////////////////////////////////////
+
+    /**
+     * Constructor
+     *
+     * @param slots Number of reader slots, rounded up to a power of two.  0 uses
+     *      one per hardware thread.
+     */
+    distributed_shared_mutex::distributed_shared_mutex(size_t slots): m_writerActive(false)
+    {
+        if (slots == 0) {
+            slots = std::thread::hardware_concurrency();
+        }
+
+        size_t count = 1;
+        while (count < slots) {
+            count <<= 1;
+        }
+
+        m_slots.reset(new Slot[count]);
+        for (size_t i = 0; i < count; i++) {
+            m_slots[i].readers = 0;
+        }
+        m_slotMask = count - 1;
+    }
+
+    /**
+     * Destructor
+     */
+    distributed_shared_mutex::~distributed_shared_mutex()
+    {
+    }
+
+    /**
+     * Returns the calling thread's slot
+     */
+    distributed_shared_mutex::Slot& distributed_shared_mutex::my_slot()
+    {
+        return m_slots[t_slot & m_slotMask];
+    }
+
+    /**
+     * Returns true if no reader holds the lock through any slot
+     */
+    bool distributed_shared_mutex::readers_drained()
+    {
+        for (size_t i = 0; i <= m_slotMask; i++) {
+            if (m_slots[i].readers.load() != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Returns the number of reader slots
+     */
+    size_t distributed_shared_mutex::get_num_slots() const
+    {
+        return m_slotMask + 1;
+    }
+
+    /**
+     * Locks a thread
+     *
+     * A reader bumps its slot before checking for a writer and a writer raises
+     * its flag before checking the slots, so one of them always sees the other.
+     */
+    void distributed_shared_mutex::lock()
+    {
+        writer_enter();
+        m_writerActive = true;
+        wait_for_readers([this]() { return readers_drained(); });
+#ifdef USE_HELGRIND
+        ANNOTATE_RWLOCK_ACQUIRED(this, 1);
+#endif //USE_HELGRIND
+    }
+
+    /**
+     * Checks if a lock is in place
+     *
+     * @return Returns false if there is a lock
+     */
+    bool distributed_shared_mutex::try_lock()
+    {
+        if (!try_writer_enter()) {
+            return false;
+        }
+
+        m_writerActive = true;
+        if (!readers_drained()) {
+            m_writerActive = false;
+            notify_readers();
+            writer_exit();
+            return false;
+        }
+#ifdef USE_HELGRIND
+        ANNOTATE_RWLOCK_ACQUIRED(this, 1);
+#endif //USE_HELGRIND
+        return true;
+    }
+
+    /**
+     * Unlocks a thread
+     */
+    void distributed_shared_mutex::unlock()
+    {
+#ifdef USE_HELGRIND
+        ANNOTATE_RWLOCK_RELEASED(this, 1);
+#endif //USE_HELGRIND
+        m_writerActive = false;
+        notify_readers();
+        writer_exit();
+    }
+
+    /**
+     * Checks if a lock is in place
+     */
+    void distributed_shared_mutex::lock_shared()
+    {
+        Slot& slot = my_slot();
+        int spins = 0;
+        while (true) {
+            slot.readers++;
+            if (!m_writerActive) {
+                break;
+            }
+
+            // Back out so the writer can finish
+            slot.readers--;
+            notify_writer();
+            if (++spins < SPIN_COUNT) {
+                std::this_thread::yield();
+            } else {
+                wait_for_writer([this]() { return !m_writerActive; });
+            }
+        }
+#ifdef USE_HELGRIND
+        ANNOTATE_RWLOCK_ACQUIRED(this, 0);
+#endif //USE_HELGRIND
+    }
+
+    /**
+     * Checks if a lock is in place
+     *
+     * @return Returns false if there is a lock
+     */
+    bool distributed_shared_mutex::try_lock_shared()
+    {
+        Slot& slot = my_slot();
+        slot.readers++;
+        if (m_writerActive) {
+            slot.readers--;
+            notify_writer();
+            return false;
+        }
+#ifdef USE_HELGRIND
+        ANNOTATE_RWLOCK_ACQUIRED(this, 0);
+#endif //USE_HELGRIND
+        return true;
+    }
+
+    /**
+     * Unlocks a shared thread
+     */
+    void distributed_shared_mutex::unlock_shared()
+    {
+#ifdef USE_HELGRIND
+        ANNOTATE_RWLOCK_RELEASED(this, 0);
+#endif //USE_HELGRIND
+        my_slot().readers--;
+        if (m_writerActive) {
+            notify_writer();
+        }
     }
 
 
@@ -190,7 +484,7 @@ namespace acl
 
     /**
      * Checks if a lock is in place
-     * 
+     *
      * @return Returns false if there is a lock
      */
     bool shared_lock::try_lock()
@@ -213,7 +507,7 @@ namespace acl
 
     /**
      * Checks if the caller owns the lock on a thread
-     * 
+     *
      * @return Returns a boolean on whether the lock is owned
      */
     bool shared_lock::owns_lock() const
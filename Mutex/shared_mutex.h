@@ -11,6 +11,14 @@
 
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#ifndef ACL_CACHE_LINE_SIZE
+#define ACL_CACHE_LINE_SIZE 64          //!< Assumed size of a cache line for padding
+#endif
 
 namespace acl
 {
@@ -18,31 +26,94 @@ namespace acl
      * @class shared_mutex
      *
      * @brief A class that allows threaded applications to lock threads and prevent deadlocks and race conditions
+     *
+     * The reader count and a writer flag share one atomic word, so an
+     * uncontended lock_shared()/unlock_shared() is a single compare-and-swap
+     * and an atomic decrement.  Writers are preferred: once a writer has
+     * announced itself new readers wait, so a steady stream of readers
+     * cannot starve it.  Threads that cannot get the lock spin briefly and
+     * then sleep on a condition variable.
      */
     class shared_mutex
     {
         private:
 #ifdef DEBUG_CACHE
-			AclMutex m_read;
-			AclMutex m_mutex;
+            AclMutex m_writer;
 #else
-            std::mutex m_read; //!< Brief readers
-            std::mutex m_mutex;  //!< Brief member fields for mutext
+            std::mutex m_writer; //!< Brief serializes writers
 #endif
-            std::atomic_int readers; //!< Brief the number of readers
+            std::atomic<uint32_t> m_state; //!< Brief reader count plus the WRITER bit
+            std::atomic_int m_readersWaiting; //!< Brief readers sleeping on m_readerCv
+            std::atomic_int m_writerWaiting; //!< Brief writers sleeping on m_writerCv
+            std::mutex m_waitMutex; //!< Brief mutex for the condition variables
+            std::condition_variable m_readerCv; //!< Brief signalled when a writer leaves
+            std::condition_variable m_writerCv; //!< Brief signalled when the last reader leaves
+
+            bool try_add_reader();
+
+        protected:
+            static const uint32_t WRITER = 0x80000000u; //!< Brief set while a writer holds or waits for the lock
+            static const int SPIN_COUNT = 64; //!< Brief attempts before sleeping
+
+            void writer_enter();
+            bool try_writer_enter();
+            void writer_exit();
+            void wait_for_readers(const std::function<bool()>& drained);
+            void notify_writer();
+            void wait_for_writer(const std::function<bool()>& done);
+            void notify_readers();
 
         public:
             shared_mutex();
             virtual ~shared_mutex();
             shared_mutex( const shared_mutex& other ) = delete;
             shared_mutex& operator=( const shared_mutex& ) = delete;
-            void lock(); 
-            bool try_lock();
-            void unlock();
-            void lock_shared();
-            bool try_lock_shared();
-            void unlock_shared();
+            virtual void lock();
+            virtual bool try_lock();
+            virtual void unlock();
+            virtual void lock_shared();
+            virtual bool try_lock_shared();
+            virtual void unlock_shared();
+
+    };
 
+    /**
+     * @class distributed_shared_mutex
+     *
+     * @brief A shared_mutex for read-mostly data that spreads readers over
+     *      per-thread slots ("big-reader" lock).
+     *
+     * Each reader only touches its own cache line, so readers on different
+     * cores never contend with each other.  A writer has to visit every slot,
+     * which makes lock() more expensive than it is for shared_mutex.  Threads
+     * are assigned a slot the first time they read, so more threads than
+     * slots share slots but are still correct.
+     */
+    class distributed_shared_mutex: public shared_mutex
+    {
+        private:
+            struct Slot {
+                std::atomic_int readers; //!< Brief readers holding the lock through this slot
+                char pad[ACL_CACHE_LINE_SIZE - sizeof(std::atomic_int)]; //!< Brief keeps slots on separate cache lines
+            };
+
+            std::unique_ptr<Slot[]> m_slots; //!< Brief one reader count per slot
+            size_t m_slotMask; //!< Brief number of slots - 1
+            std::atomic_bool m_writerActive; //!< Brief set while a writer holds or waits for the lock
+
+            Slot& my_slot();
+            bool readers_drained();
+
+        public:
+            distributed_shared_mutex(size_t slots = 0);
+            virtual ~distributed_shared_mutex();
+            virtual void lock();
+            virtual bool try_lock();
+            virtual void unlock();
+            virtual void lock_shared();
+            virtual bool try_lock_shared();
+            virtual void unlock_shared();
+            size_t get_num_slots() const;
     };
 
     /**
@@ -0,0 +1,463 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+#include <ConnectionPool.hpp>
+
+#ifdef ACL_USE_WINSOCK_SOCKETS
+#include <ws2tcpip.h> // for getaddrinfo, sockaddr_in6
+#define ACL_POLL WSAPoll
+typedef WSAPOLLFD acl_pollfd;
+typedef int acl_socklen_t;
+#else
+#include <errno.h>
+#include <netdb.h>      // for getaddrinfo
+#include <netinet/in.h> // for sockaddr_in6
+#include <sys/socket.h>
+#define ACL_POLL poll
+typedef struct pollfd acl_pollfd;
+typedef socklen_t acl_socklen_t;
+#endif
+
+namespace acl { namespace CoreSocket {
+
+/// @brief True if a non-blocking connect() is still in progress.
+static bool connect_in_progress()
+{
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+/// @brief Fill in the port of an IPv4 or IPv6 address.
+static void set_port(ResolvedAddress& a, int port)
+{
+  if (a.address.ss_family == AF_INET6) {
+    reinterpret_cast<struct sockaddr_in6*>(&a.address)->sin6_port = htons(static_cast<unsigned short>(port));
+  } else {
+    reinterpret_cast<struct sockaddr_in*>(&a.address)->sin_port = htons(static_cast<unsigned short>(port));
+  }
+}
+
+//=======================================================================
+// DNSCache
+
+DNSCache::DNSCache(double ttl, double negativeTtl)
+  : m_ttl(ttl)
+  , m_negativeTtl(negativeTtl)
+{
+}
+
+bool DNSCache::resolve(const std::string& host, int port, std::vector<ResolvedAddress>& addresses)
+{
+  addresses.clear();
+  bool cached = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(host);
+    if (it != m_entries.end() && Clock::now() < it->second.expires) {
+      addresses = it->second.addresses;
+      cached = true;
+    }
+  }
+  if (cached && addresses.empty()) {
+    return false;   // A remembered failure
+  }
+
+  // Look it up without holding the lock; two threads that miss at once
+  // both look it up, which is harmless.
+  if (!cached) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    struct addrinfo* result = nullptr;
+    int ret = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    if (ret == 0) {
+      for (struct addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+        if ((ai->ai_family != AF_INET && ai->ai_family != AF_INET6) ||
+            ai->ai_addrlen > sizeof(struct sockaddr_storage)) {
+          continue;
+        }
+        ResolvedAddress a;
+        memset(&a, 0, sizeof(a));
+        memcpy(&a.address, ai->ai_addr, ai->ai_addrlen);
+        a.length = static_cast<int>(ai->ai_addrlen);
+        addresses.push_back(a);
+      }
+      freeaddrinfo(result);
+    } else {
+      fprintf(stderr, "DNSCache::resolve(): Could not resolve %s: %s\n", host.c_str(),
+        gai_strerror(ret));
+    }
+
+    Entry entry;
+    entry.addresses = addresses;
+    entry.expires = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(addresses.empty() ? m_negativeTtl : m_ttl));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries[host] = entry;
+  }
+
+  for (auto& a : addresses) {
+    set_port(a, port);
+  }
+  return !addresses.empty();
+}
+
+void DNSCache::invalidate(const std::string& host)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.erase(host);
+}
+
+void DNSCache::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+}
+
+size_t DNSCache::size()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_entries.size();
+}
+
+//=======================================================================
+// Connecting
+
+bool connect_tcp_parallel(const std::vector<ResolvedAddress>& addresses, double timeout,
+  SOCKET* s, const TCPOptions* options, double stagger)
+{
+  if (s == nullptr) {
+    fprintf(stderr, "connect_tcp_parallel(): Null socket pointer\n");
+    return false;
+  }
+  *s = BAD_SOCKET;
+
+  // Alternate address families, starting with the resolver's first choice.
+  std::vector<const ResolvedAddress*> order;
+  {
+    std::vector<const ResolvedAddress*> first, second;
+    for (auto& a : addresses) {
+      (a.address.ss_family == addresses[0].address.ss_family ? first : second).push_back(&a);
+    }
+    for (size_t i = 0; i < std::max(first.size(), second.size()); i++) {
+      if (i < first.size()) {
+        order.push_back(first[i]);
+      }
+      if (i < second.size()) {
+        order.push_back(second[i]);
+      }
+    }
+  }
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point deadline = Clock::now() +
+    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(std::max(timeout, 0.0)));
+  Clock::time_point nextStart = Clock::now();
+  std::vector<SOCKET> pending;
+  size_t next = 0;
+  SOCKET winner = BAD_SOCKET;
+
+  while (winner == BAD_SOCKET) {
+    Clock::time_point now = Clock::now();
+    if (now >= deadline) {
+      break;
+    }
+
+    // Start the next attempt when it is due, or now if none is in flight.
+    if (next < order.size() && (now >= nextStart || pending.empty())) {
+      const ResolvedAddress& a = *order[next++];
+      nextStart = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(stagger));
+      SOCKET c = socket(a.address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+      if (c == BAD_SOCKET || !set_socket_nonblocking(c)) {
+        if (c != BAD_SOCKET) {
+          close_socket(c);
+        }
+        nextStart = now;
+        continue;
+      }
+      if (connect(c, reinterpret_cast<const struct sockaddr*>(&a.address), a.length) == 0) {
+        winner = c;
+      } else if (connect_in_progress()) {
+        pending.push_back(c);
+      } else {
+        close_socket(c);
+        nextStart = now;
+      }
+      continue;
+    }
+    if (pending.empty()) {
+      break;    // Every address failed
+    }
+
+    // Wait for an attempt to finish, the next to be due, or the deadline.
+    Clock::time_point until = deadline;
+    if (next < order.size()) {
+      until = std::min(until, nextStart);
+    }
+    std::vector<acl_pollfd> fds(pending.size());
+    for (size_t i = 0; i < pending.size(); i++) {
+      fds[i].fd = pending[i];
+      fds[i].events = POLLOUT;
+      fds[i].revents = 0;
+    }
+    double wait = std::chrono::duration<double>(until - Clock::now()).count();
+    int ret = ACL_POLL(fds.data(), static_cast<unsigned long>(fds.size()),
+      static_cast<int>(std::ceil(std::max(wait, 0.0) * 1000)));
+    if (ret < 0) {
+#ifndef ACL_USE_WINSOCK_SOCKETS
+      if (errno == EINTR) {
+        continue;
+      }
+#endif
+      perror("connect_tcp_parallel(): poll() failed");
+      break;
+    }
+    if (ret == 0) {
+      continue;   // Timeout; go around to check the clock
+    }
+
+    std::vector<SOCKET> still;
+    for (size_t i = 0; i < fds.size(); i++) {
+      if (fds[i].revents == 0) {
+        still.push_back(pending[i]);
+        continue;
+      }
+      int err = 0;
+      acl_socklen_t len = sizeof(err);
+      if (winner == BAD_SOCKET &&
+          getsockopt(pending[i], SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) == 0 &&
+          err == 0) {
+        winner = pending[i];
+      } else {
+        close_socket(pending[i]);
+        nextStart = Clock::now();   // A failure starts the next attempt right away
+      }
+    }
+    pending.swap(still);
+  }
+
+  for (SOCKET p : pending) {
+    close_socket(p);
+  }
+  if (winner == BAD_SOCKET) {
+    return false;
+  }
+  if (!set_socket_nonblocking(winner, false) ||
+      (options && !set_tcp_socket_options(winner, *options))) {
+    fprintf(stderr, "connect_tcp_parallel(): Could not configure the socket\n");
+    close_socket(winner);
+    return false;
+  }
+  *s = winner;
+  return true;
+}
+
+/// @brief Cache used when none is given.
+static DNSCache& shared_cache()
+{
+  static DNSCache cache;
+  return cache;
+}
+
+bool connect_tcp_cached(const std::string& host, int port, double timeout, SOCKET* s,
+  const TCPOptions* options, DNSCache* cache)
+{
+  if (cache == nullptr) {
+    cache = &shared_cache();
+  }
+  std::vector<ResolvedAddress> addresses;
+  if (!cache->resolve(host, port, addresses)) {
+    if (s) {
+      *s = BAD_SOCKET;
+    }
+    return false;
+  }
+  if (!connect_tcp_parallel(addresses, timeout, s, options)) {
+    // The host may have moved; look it up again next time.
+    cache->invalidate(host);
+    return false;
+  }
+  return true;
+}
+
+bool socket_is_idle_healthy(SOCKET s)
+{
+  if (s == BAD_SOCKET) {
+    return false;
+  }
+  int err = 0;
+  acl_socklen_t len = sizeof(err);
+  if (getsockopt(s, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) != 0 || err != 0) {
+    return false;
+  }
+  // Readable means end of file, a reset or unexpected data.
+  return check_ready_to_read_timeout(s, 0) == 0;
+}
+
+//=======================================================================
+// ConnectionPool
+
+ConnectionPool::ConnectionPool(const ConnectionPoolOptions& options, DNSCache* cache)
+  : m_options(options)
+  , m_cache(cache ? cache : &shared_cache())
+{
+}
+
+ConnectionPool::~ConnectionPool()
+{
+  clear();
+}
+
+std::string ConnectionPool::key(const std::string& host, int port)
+{
+  return host + ":" + std::to_string(port);
+}
+
+SOCKET ConnectionPool::acquire(const std::string& host, int port, bool* reused)
+{
+  if (reused) {
+    *reused = false;
+  }
+  std::string k = key(host, port);
+
+  // Take idle sockets, newest first, until a good one turns up.  Checks
+  // and closes happen outside the lock.
+  while (true) {
+    Idle idle;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_idle.find(k);
+      if (it == m_idle.end() || it->second.empty()) {
+        break;
+      }
+      idle = it->second.back();
+      it->second.pop_back();
+    }
+    bool fresh = Clock::now() - idle.since < std::chrono::duration<double>(m_options.maxIdleTime);
+    if (fresh && socket_is_idle_healthy(idle.s)) {
+      if (reused) {
+        *reused = true;
+      }
+      return idle.s;
+    }
+    close_socket(idle.s);
+  }
+
+  SOCKET s;
+  if (!connect_tcp_cached(host, port, m_options.connectTimeout, &s,
+        m_options.setTCPOptions ? &m_options.tcpOptions : nullptr, m_cache)) {
+    return BAD_SOCKET;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_connects++;
+  return s;
+}
+
+void ConnectionPool::release(const std::string& host, int port, SOCKET s)
+{
+  if (s == BAD_SOCKET) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::deque<Idle>& idle = m_idle[key(host, port)];
+    if (idle.size() < m_options.maxIdlePerHost) {
+      Idle i;
+      i.s = s;
+      i.since = Clock::now();
+      idle.push_back(i);
+      return;
+    }
+  }
+  close_socket(s);
+}
+
+size_t ConnectionPool::prune()
+{
+  // Take every idle socket so that the health checks, which are system
+  // calls, run outside the lock, as in acquire().
+  std::unordered_map<std::string, std::deque<Idle>> idle;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    idle.swap(m_idle);
+  }
+
+  std::vector<SOCKET> dead;
+  Clock::time_point now = Clock::now();
+  for (auto& host : idle) {
+    std::deque<Idle> keep;
+    for (auto& i : host.second) {
+      if (now - i.since >= std::chrono::duration<double>(m_options.maxIdleTime) ||
+          !socket_is_idle_healthy(i.s)) {
+        dead.push_back(i.s);
+      } else {
+        keep.push_back(i);
+      }
+    }
+    host.second.swap(keep);
+  }
+
+  // Put the survivors back.  Any released meanwhile are newer, so they stay
+  // at the back, and the oldest go if the host is now over its limit.
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& host : idle) {
+      if (host.second.empty()) {
+        continue;
+      }
+      std::deque<Idle>& current = m_idle[host.first];
+      current.insert(current.begin(), host.second.begin(), host.second.end());
+      while (current.size() > m_options.maxIdlePerHost) {
+        dead.push_back(current.front().s);
+        current.pop_front();
+      }
+    }
+  }
+  for (SOCKET s : dead) {
+    close_socket(s);
+  }
+  return dead.size();
+}
+
+void ConnectionPool::clear()
+{
+  std::unordered_map<std::string, std::deque<Idle>> idle;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    idle.swap(m_idle);
+  }
+  for (auto& host : idle) {
+    for (auto& i : host.second) {
+      close_socket(i.s);
+    }
+  }
+}
+
+size_t ConnectionPool::idle_count()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t count = 0;
+  for (auto& host : m_idle) {
+    count += host.second.size();
+  }
+  return count;
+}
+
+size_t ConnectionPool::connect_count()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_connects;
+}
+
+}  }	// End of namespace definitions.
@@ -0,0 +1,183 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#pragma once
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <CoreSocket.hpp>
+
+#ifndef ACL_USE_WINSOCK_SOCKETS
+#include <sys/socket.h> // for sockaddr_storage
+#endif
+
+namespace acl { namespace CoreSocket {
+
+/// @brief One IPv4 or IPv6 address and port to connect to.
+struct ResolvedAddress {
+  struct sockaddr_storage address;
+  int length;   ///< Bytes of address in use
+};
+
+/// @brief Caches host name lookups so that reconnecting does not wait on DNS.
+///
+/// getaddrinfo() does not report record lifetimes, so entries live for a
+/// fixed time.  Failed lookups are remembered for a shorter time so that a
+/// missing host does not cost a lookup on every attempt.  Thread safe; a
+/// lookup runs without holding the lock.
+class DNSCache {
+public:
+  /// @param [in] ttl Seconds to keep a successful lookup.
+  /// @param [in] negativeTtl Seconds to keep a failed lookup.
+  DNSCache(double ttl = 60, double negativeTtl = 5);
+
+  /// @brief Get the addresses for a host, looking it up if needed.
+  /// @param [in] host Name or numeric IPv4/IPv6 address.
+  /// @param [in] port Port to fill in to each address.
+  /// @param [out] addresses IPv4 and IPv6 addresses in resolver order.
+  /// @return False if the host could not be resolved.
+  bool resolve(const std::string& host, int port, std::vector<ResolvedAddress>& addresses);
+
+  /// @brief Forget a host, for example after connecting to it failed.
+  void invalidate(const std::string& host);
+
+  /// @brief Forget every host.
+  void clear();
+
+  /// @brief Number of hosts cached, including failed ones.
+  size_t size();
+
+private:
+  typedef std::chrono::steady_clock Clock;
+  struct Entry {
+    std::vector<ResolvedAddress> addresses;   ///< Empty if the lookup failed
+    Clock::time_point expires;
+  };
+
+  double m_ttl;
+  double m_negativeTtl;
+  std::mutex m_mutex;
+  std::unordered_map<std::string, Entry> m_entries;
+};
+
+/// @brief Connect to whichever of several addresses answers first.
+///
+/// Implements the connection racing of "Happy Eyeballs" (RFC 8305): the
+/// addresses are reordered to alternate between IPv6 and IPv4, and a new
+/// non-blocking attempt starts every stagger seconds, or as soon as the
+/// previous one fails, until one connects.  The others are then closed.
+/// A dead address costs at most stagger instead of a full connect timeout.
+/// @param [in] addresses Addresses to try, best first.
+/// @param [in] timeout Seconds to wait in total.
+/// @param [out] s Filled in with the connected socket, which is blocking.
+/// @param [in] options TCP options to set on the socket, or nullptr.
+/// @param [in] stagger Seconds to wait before starting the next attempt.
+/// @return True on success, false if no address could be reached in time.
+bool connect_tcp_parallel(const std::vector<ResolvedAddress>& addresses, double timeout,
+  SOCKET* s, const TCPOptions* options = nullptr, double stagger = 0.25);
+
+/// @brief Resolve a host through a cache and race connections to its addresses.
+///
+/// A faster replacement for connect_tcp_to() that supports IPv6 and has a
+/// timeout.  A failed connection drops the host from the cache so that the
+/// next attempt looks it up again.
+/// @param [in] host Name or numeric address of the host.
+/// @param [in] port Port to connect to.
+/// @param [in] timeout Seconds to wait for the connection.
+/// @param [out] s Filled in with the connected socket.
+/// @param [in] options TCP options to set on the socket, or nullptr.
+/// @param [in] cache Cache to use, or nullptr to use one shared by the process.
+/// @return True on success, false on failure.
+bool connect_tcp_cached(const std::string& host, int port, double timeout, SOCKET* s,
+  const TCPOptions* options = nullptr, DNSCache* cache = nullptr);
+
+/// @brief Options for a ConnectionPool.
+class ConnectionPoolOptions {
+public:
+  size_t maxIdlePerHost = 8;    ///< Idle sockets kept for each host:port; extras are closed
+  double maxIdleTime = 60;      ///< Seconds an idle socket is kept
+  double connectTimeout = 5;    ///< Seconds to wait for a new connection
+  bool setTCPOptions = true;    ///< Set tcpOptions on new connections
+  TCPOptions tcpOptions;
+};
+
+/// @brief Keeps idle connections to each host:port so that they can be
+/// reused instead of reconnecting.
+///
+/// acquire() hands out the most recently released idle socket for the key
+/// after checking that the peer has not closed it or sent data, or makes a
+/// new connection with connect_tcp_cached() if there is none.  Callers
+/// release() a socket that is still in a clean protocol state, or close it
+/// themselves if not.  Thread safe; connecting is done without holding the
+/// lock.
+class ConnectionPool {
+public:
+  /// @param [in] options Limits and connection settings.
+  /// @param [in] cache DNS cache to use, or nullptr to use one shared by the
+  ///         process.  Must outlive the pool.
+  ConnectionPool(const ConnectionPoolOptions& options = ConnectionPoolOptions(),
+    DNSCache* cache = nullptr);
+
+  /// @brief Destructor.  Closes the idle sockets; ones that are acquired
+  /// belong to their callers.
+  ~ConnectionPool();
+
+  ConnectionPool(const ConnectionPool&) = delete;
+  ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+  /// @brief Get a connected socket to host:port.
+  /// @param [out] reused Set to whether the socket came from the pool, if
+  ///         not nullptr.
+  /// @return The socket, or BAD_SOCKET if no connection could be made.
+  SOCKET acquire(const std::string& host, int port, bool* reused = nullptr);
+
+  /// @brief Give a socket from acquire() back to the pool, or close it if
+  /// the host already has maxIdlePerHost idle sockets.
+  void release(const std::string& host, int port, SOCKET s);
+
+  /// @brief Close idle sockets older than maxIdleTime or found to be dead.
+  /// The checks run without the lock, so acquire() does not wait for them,
+  /// but it does not see the sockets being checked and may connect anew.
+  /// @return Number of sockets closed, including any that release() added
+  ///         meanwhile beyond maxIdlePerHost.
+  size_t prune();
+
+  /// @brief Close every idle socket.
+  void clear();
+
+  /// @brief Total number of idle sockets.
+  size_t idle_count();
+
+  /// @brief Number of new connections made since construction.
+  size_t connect_count();
+
+private:
+  typedef std::chrono::steady_clock Clock;
+  struct Idle {
+    SOCKET s;
+    Clock::time_point since;
+  };
+
+  static std::string key(const std::string& host, int port);
+
+  ConnectionPoolOptions m_options;
+  DNSCache* m_cache;
+  std::mutex m_mutex;                                       ///< Protects the fields below
+  std::unordered_map<std::string, std::deque<Idle>> m_idle; ///< Most recently released last
+  size_t m_connects = 0;
+};
+
+/// @brief Check that an idle socket is still usable.
+///
+/// A connection that is idle between requests should have nothing to
+/// read; if it does, the peer has closed it, reset it or sent something
+/// unexpected, and it should not be reused.
+/// @return True if the socket is connected and has no pending data or error.
+bool socket_is_idle_healthy(SOCKET s);
+
+}  }	// End of namespace definitions.
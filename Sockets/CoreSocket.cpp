@@ -6,6 +6,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
 
+#include <algorithm>
 #include <string>
 #include <string.h>
 #include <system_error>
@@ -13,7 +14,9 @@
 #include <Timer.h>
 #include <climits>
 #include <iostream>
+#include <vector>
 #include <CoreSocket.hpp>
+#include <Metrics.hpp>
 #ifdef ACL_USE_WINSOCK_SOCKETS
 #include "Ws2ipdef.h"
 #endif
@@ -241,6 +244,7 @@ static std::string WSA_number_to_string(int err)
 #include <netinet/in.h> // for sockaddr_in, ntohl, in_addr, etc
 #include <sys/socket.h> // for getsockname, send, AF_INET, etc
 #include <unistd.h>     // for close, read, fork, etc
+#include <fcntl.h>      // for fcntl, O_NONBLOCK
 #ifdef _AIX
 #define _USE_IRS
 #endif
@@ -253,8 +257,29 @@ static std::string WSA_number_to_string(int err)
 #ifndef __CYGWIN__
 #include <netinet/tcp.h> // for TCP_NODELAY
 #endif                   /* __CYGWIN__ */
+#include <sys/uio.h>  // for writev, struct iovec
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <netinet/udp.h> // for UDP_GRO, UDP_SEGMENT
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/types.h> // for sendfile
+#endif
 #endif                   /* ACL_USE_WINSOCK_SOCKETS */
 
+#ifdef ACL_USE_WINSOCK_SOCKETS
+#include <io.h> // for _read, _lseeki64
+#endif
+
+// MSG_ZEROCOPY needs Linux 4.14 headers; older systems copy instead.
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define ACL_HAVE_ZEROCOPY
+#include <linux/errqueue.h> // for sock_extended_err
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 // cast fourth argument to setsockopt()
 #ifdef ACL_USE_WINSOCK_SOCKETS
 #define SOCK_CAST (char *)
@@ -472,6 +497,27 @@ int acl::CoreSocket::noint_select(int width, fd_set* readfds, fd_set* writefds,
 	return (ret);
 }
 
+//--------------------------------------------------------------
+// Count the system calls that move data and the bytes they move, for
+// acl::Metrics.  These compile to nothing unless ACL_ENABLE_METRICS is
+// defined.  The argument is the system call's return value.
+
+static inline void count_read(int64_t ret)
+{
+	ACL_METRIC_COUNT("CoreSocket.read_calls", 1);
+	if (ret > 0) {
+		ACL_METRIC_COUNT("CoreSocket.bytes_read", static_cast<uint64_t>(ret));
+	}
+}
+
+static inline void count_write(int64_t ret)
+{
+	ACL_METRIC_COUNT("CoreSocket.write_calls", 1);
+	if (ret > 0) {
+		ACL_METRIC_COUNT("CoreSocket.bytes_written", static_cast<uint64_t>(ret));
+	}
+}
+
 #ifndef ACL_USE_WINSOCK_SOCKETS
 
 int acl::CoreSocket::noint_block_write(int outfile, const char buffer[], size_t length)
@@ -482,6 +528,7 @@ int acl::CoreSocket::noint_block_write(int outfile, const char buffer[], size_t
 	do {
 		/* Try to write the remaining data */
 		ret = write(outfile, buffer + sofar, length - sofar);
+		count_write(ret);
 		sofar += ret;
 
 		/* Ignore interrupted system calls - retry */
@@ -514,6 +561,7 @@ int acl::CoreSocket::noint_block_read(int infile, char buffer[], size_t length)
 	do {
 		/* Try to read all remaining data */
 		ret = read(infile, buffer + sofar, length - sofar);
+		count_read(ret);
 		sofar += ret;
 
 		/* Ignore interrupted system calls - retry */
@@ -539,6 +587,7 @@ int acl::CoreSocket::noint_block_write(SOCKET outsock, const char* buffer, size_
 		/* Try to write the remaining data */
 		nwritten =
 			send(outsock, buffer + sofar, static_cast<int>(length - sofar), 0);
+		count_write(nwritten);
 
 		if (nwritten == SOCKET_ERROR) {
 			return -1;
@@ -567,6 +616,7 @@ int acl::CoreSocket::noint_block_read(SOCKET insock, char* buffer, size_t length
 		/* Try to read all remaining data */
 		nread =
 			recv(insock, buffer + sofar, static_cast<int>(length - sofar), 0);
+		count_read(nread);
 
 		if (nread == SOCKET_ERROR) {
 			return -1;
@@ -654,6 +704,7 @@ int acl::CoreSocket::noint_block_read_timeout(SOCKET infile, char* buffer, size_
 		{
 			int nread = recv(infile, buffer + sofar,
 				static_cast<int>(length - sofar), 0);
+			count_read(nread);
 			sofar += nread;
 			ret = nread;
 		}
@@ -674,9 +725,12 @@ int acl::CoreSocket::noint_block_read_timeout(SOCKET infile, char* buffer, size_
 	return static_cast<int>(sofar); /* All bytes read */
 }
 
-acl::CoreSocket::SOCKET acl::CoreSocket::open_socket(int type, unsigned short* portno,
-	const char* IPaddress, bool reuseAddr)
+/// @brief Implements open_socket(), optionally setting UDP options before bind().
+static acl::CoreSocket::SOCKET open_bound_socket(int type, unsigned short* portno,
+	const char* IPaddress, bool reuseAddr, const acl::CoreSocket::UDPOptions* udpOptions)
 {
+	using namespace acl::CoreSocket;
+
 	struct sockaddr_in name;
 	struct hostent* phe; /* pointer to host information entry   */
 	int namelen;
@@ -699,6 +753,12 @@ acl::CoreSocket::SOCKET acl::CoreSocket::open_socket(int type, unsigned short* p
 		}
 	}
 
+	// SO_REUSEPORT only counts if it is set before bind().
+	if (udpOptions && !set_udp_socket_options(sock, *udpOptions)) {
+		closeSocket(sock);
+		return BAD_SOCKET;
+	}
+
 	// Added by Eric Boren to address socket reconnectivity on the Android
 #ifdef __ANDROID__
 	int32_t optval = 1;
@@ -783,12 +843,72 @@ acl::CoreSocket::SOCKET acl::CoreSocket::open_socket(int type, unsigned short* p
 	return sock;
 }
 
+acl::CoreSocket::SOCKET acl::CoreSocket::open_socket(int type, unsigned short* portno,
+	const char* IPaddress, bool reuseAddr)
+{
+	return open_bound_socket(type, portno, IPaddress, reuseAddr, nullptr);
+}
+
 acl::CoreSocket::SOCKET acl::CoreSocket::open_udp_socket(unsigned short* portno, const char* IPaddress,
 	bool reuseAddr)
 {
 	return open_socket(SOCK_DGRAM, portno, IPaddress, reuseAddr);
 }
 
+acl::CoreSocket::SOCKET acl::CoreSocket::open_udp_socket(unsigned short* portno, const char* IPaddress,
+	const UDPOptions& options, bool reuseAddr)
+{
+	return open_bound_socket(SOCK_DGRAM, portno, IPaddress, reuseAddr, &options);
+}
+
+bool acl::CoreSocket::set_udp_socket_options(SOCKET s, const UDPOptions& options)
+{
+  if (s == BAD_SOCKET) {
+    fprintf(stderr, "set_udp_socket_options(): Bad socket\n");
+    return false;
+  }
+  bool ret = true;
+  if (options.receiveBufferSize >= 0) {
+    if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, SOCK_CAST & options.receiveBufferSize,
+          sizeof(options.receiveBufferSize)) < 0) {
+      perror("set_udp_socket_options(): setsockopt(SO_RCVBUF) failed");
+      ret = false;
+    }
+  }
+  if (options.sendBufferSize >= 0) {
+    if (setsockopt(s, SOL_SOCKET, SO_SNDBUF, SOCK_CAST & options.sendBufferSize,
+          sizeof(options.sendBufferSize)) < 0) {
+      perror("set_udp_socket_options(): setsockopt(SO_SNDBUF) failed");
+      ret = false;
+    }
+  }
+  if (options.reusePort) {
+#ifdef SO_REUSEPORT
+    int enable = 1;
+    if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, SOCK_CAST & enable, sizeof(enable)) < 0) {
+      perror("set_udp_socket_options(): setsockopt(SO_REUSEPORT) failed");
+      ret = false;
+    }
+#else
+    fprintf(stderr, "set_udp_socket_options(): SO_REUSEPORT not available on this architecture\n");
+    ret = false;
+#endif
+  }
+  if (options.gro) {
+#ifdef UDP_GRO
+    int enable = 1;
+    if (setsockopt(s, IPPROTO_UDP, UDP_GRO, &enable, sizeof(enable)) < 0) {
+      perror("set_udp_socket_options(): setsockopt(UDP_GRO) failed");
+      ret = false;
+    }
+#else
+    fprintf(stderr, "set_udp_socket_options(): UDP_GRO not available on this architecture\n");
+    ret = false;
+#endif
+  }
+  return ret;
+}
+
 bool acl::CoreSocket::set_tcp_socket_options(SOCKET s, TCPOptions options)
 {
 	bool ret = true;
@@ -836,7 +956,7 @@ bool acl::CoreSocket::set_tcp_socket_options(SOCKET s, TCPOptions options)
 			}
 		}
 
-		if (options.keepAlive) {
+		if (options.nodelay) {
 			struct protoent* p_entry;
 			int nonzero = 1;
 
@@ -950,6 +1070,247 @@ acl::CoreSocket::SOCKET acl::CoreSocket::connect_udp_port(const char* machineNam
 	return udp_socket;
 }
 
+acl::CoreSocket::UDPBatch::UDPBatch(size_t count, size_t bufferSize)
+  : m_bufferSize(bufferSize)
+  , m_storage(count * bufferSize)
+  , m_messages(count)
+{
+  reset();
+}
+
+void acl::CoreSocket::UDPBatch::reset()
+{
+  for (size_t i = 0; i < m_messages.size(); i++) {
+    m_messages[i].data = m_storage.data() + i * m_bufferSize;
+    m_messages[i].length = m_bufferSize;
+    memset(&m_messages[i].address, 0, sizeof(m_messages[i].address));
+    m_messages[i].segmentSize = 0;
+  }
+}
+
+#if defined(__linux__)
+/// @brief Total bytes moved by a recvmmsg() or sendmmsg() call that returned ret.
+static int64_t mmsg_bytes(const struct mmsghdr* hdrs, int ret)
+{
+  if (ret < 0) {
+    return ret;
+  }
+  int64_t bytes = 0;
+  for (int i = 0; i < ret; i++) {
+    bytes += hdrs[i].msg_len;
+  }
+  return bytes;
+}
+#endif
+
+/// @brief Send one UDPMessage with sendto(), splitting it into segmentSize
+/// datagrams if asked.
+static bool send_udp_message(acl::CoreSocket::SOCKET s, const acl::CoreSocket::UDPMessage& m)
+{
+  size_t step = m.length;
+  if (m.segmentSize > 0 && static_cast<size_t>(m.segmentSize) < m.length) {
+    step = static_cast<size_t>(m.segmentSize);
+  }
+  size_t sofar = 0;
+  do {
+    size_t n = std::min(step, m.length - sofar);
+    int ret;
+    if (m.address.sin_family != 0) {
+      ret = static_cast<int>(sendto(s, m.data + sofar, static_cast<int>(n), 0,
+        reinterpret_cast<const struct sockaddr*>(&m.address), sizeof(m.address)));
+    } else {
+      ret = static_cast<int>(send(s, m.data + sofar, static_cast<int>(n), 0));
+    }
+    count_write(ret);
+    if (ret < 0) {
+      // Ignore interrupted system calls - retry
+      if (socket_error == ACL_EINTR) {
+        continue;
+      }
+      return false;
+    }
+    sofar += n;
+  } while (sofar < m.length);
+  return true;
+}
+
+int acl::CoreSocket::recv_udp_batch(SOCKET s, UDPMessage* messages, size_t count, bool wait)
+{
+  if (s == BAD_SOCKET || (messages == nullptr && count > 0)) {
+    fprintf(stderr, "recv_udp_batch(): Bad socket or message list\n");
+    return -1;
+  }
+  size_t done = 0;
+
+#if defined(__linux__)
+  // The kernel's headers are built a chunk at a time on the stack so that
+  // a receive loop does not allocate.
+  const size_t CHUNK = 64;
+  struct mmsghdr hdrs[CHUNK];
+  struct iovec iov[CHUNK];
+  alignas(struct cmsghdr) char control[CHUNK][CMSG_SPACE(sizeof(int))];
+  while (done < count) {
+    unsigned n = static_cast<unsigned>(std::min(count - done, CHUNK));
+    memset(hdrs, 0, n * sizeof(hdrs[0]));
+    for (unsigned i = 0; i < n; i++) {
+      UDPMessage& m = messages[done + i];
+      iov[i].iov_base = m.data;
+      iov[i].iov_len = m.length;
+      hdrs[i].msg_hdr.msg_name = &m.address;
+      hdrs[i].msg_hdr.msg_namelen = sizeof(m.address);
+      hdrs[i].msg_hdr.msg_iov = &iov[i];
+      hdrs[i].msg_hdr.msg_iovlen = 1;
+      hdrs[i].msg_hdr.msg_control = control[i];
+      hdrs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    // Only the first call may block; later chunks take what is already queued.
+    int flags = (done == 0 && wait) ? MSG_WAITFORONE : MSG_DONTWAIT;
+    int ret = recvmmsg(s, hdrs, n, flags, nullptr);
+    count_read(mmsg_bytes(hdrs, ret));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK || done > 0) {
+        break;
+      }
+      perror("recv_udp_batch(): recvmmsg() failed");
+      return -1;
+    }
+    for (int i = 0; i < ret; i++) {
+      UDPMessage& m = messages[done + i];
+      m.length = hdrs[i].msg_len;
+      m.segmentSize = 0;
+#ifdef UDP_GRO
+      for (struct cmsghdr* cm = CMSG_FIRSTHDR(&hdrs[i].msg_hdr); cm != nullptr;
+           cm = CMSG_NXTHDR(&hdrs[i].msg_hdr, cm)) {
+        if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO) {
+          memcpy(&m.segmentSize, CMSG_DATA(cm), sizeof(m.segmentSize));
+        }
+      }
+#endif
+    }
+    done += ret;
+    if (static_cast<unsigned>(ret) < n) {
+      break;
+    }
+  }
+#else
+  while (done < count) {
+    if ((done > 0 || !wait) && check_ready_to_read_timeout(s, 0) != 1) {
+      break;
+    }
+    UDPMessage& m = messages[done];
+    int namelen = sizeof(m.address);
+    int ret = static_cast<int>(recvfrom(s, m.data, static_cast<int>(m.length), 0,
+      reinterpret_cast<struct sockaddr*>(&m.address), GSN_CAST & namelen));
+    count_read(ret);
+    if (ret < 0) {
+      if (socket_error == ACL_EINTR) {
+        continue;
+      }
+#ifdef ACL_USE_WINSOCK_SOCKETS
+      // Windows reports a truncated datagram as an error after filling the buffer.
+      if (socket_error == WSAEMSGSIZE) {
+        ret = static_cast<int>(m.length);
+      } else
+#endif
+      {
+        if (done > 0) {
+          break;
+        }
+        fprintf(stderr, "recv_udp_batch(): recvfrom() failed: %s\n",
+          socket_error_to_chars(socket_error));
+        return -1;
+      }
+    }
+    m.length = static_cast<size_t>(ret);
+    m.segmentSize = 0;
+    done++;
+  }
+#endif
+  return static_cast<int>(done);
+}
+
+int acl::CoreSocket::send_udp_batch(SOCKET s, const UDPMessage* messages, size_t count)
+{
+  if (s == BAD_SOCKET || (messages == nullptr && count > 0)) {
+    fprintf(stderr, "send_udp_batch(): Bad socket or message list\n");
+    return -1;
+  }
+  size_t done = 0;
+
+#if defined(__linux__)
+  const size_t CHUNK = 64;
+  struct mmsghdr hdrs[CHUNK];
+  struct iovec iov[CHUNK];
+  alignas(struct cmsghdr) char control[CHUNK][CMSG_SPACE(sizeof(uint16_t))];
+  while (done < count) {
+    unsigned n = static_cast<unsigned>(std::min(count - done, CHUNK));
+    memset(hdrs, 0, n * sizeof(hdrs[0]));
+    for (unsigned i = 0; i < n; i++) {
+      const UDPMessage& m = messages[done + i];
+      iov[i].iov_base = m.data;
+      iov[i].iov_len = m.length;
+      if (m.address.sin_family != 0) {
+        hdrs[i].msg_hdr.msg_name = const_cast<struct sockaddr_in*>(&m.address);
+        hdrs[i].msg_hdr.msg_namelen = sizeof(m.address);
+      }
+      hdrs[i].msg_hdr.msg_iov = &iov[i];
+      hdrs[i].msg_hdr.msg_iovlen = 1;
+#ifdef UDP_SEGMENT
+      if (m.segmentSize > 0 && static_cast<size_t>(m.segmentSize) < m.length) {
+        hdrs[i].msg_hdr.msg_control = control[i];
+        hdrs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&hdrs[i].msg_hdr);
+        cm->cmsg_level = IPPROTO_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segment = static_cast<uint16_t>(m.segmentSize);
+        memcpy(CMSG_DATA(cm), &segment, sizeof(segment));
+      }
+#endif
+    }
+
+    int ret = sendmmsg(s, hdrs, n, 0);
+    count_write(mmsg_bytes(hdrs, ret));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // The kernel may not do segmentation offload, or not this much of it;
+      // split the message here instead.
+      const UDPMessage& first = messages[done];
+      if (first.segmentSize > 0 && static_cast<size_t>(first.segmentSize) < first.length &&
+          send_udp_message(s, first)) {
+        done++;
+        continue;
+      }
+      if (done > 0) {
+        break;
+      }
+      perror("send_udp_batch(): sendmmsg() failed");
+      return -1;
+    }
+    done += ret;
+  }
+#else
+  while (done < count) {
+    if (!send_udp_message(s, messages[done])) {
+      if (done > 0) {
+        break;
+      }
+      fprintf(stderr, "send_udp_batch(): send failed: %s\n",
+        socket_error_to_chars(socket_error));
+      return -1;
+    }
+    done++;
+  }
+#endif
+  return static_cast<int>(done);
+}
+
 int acl::CoreSocket::get_local_socket_name(char* local_host, size_t max_length,
 	const char* remote_host)
 {
@@ -1283,6 +1644,341 @@ bool acl::CoreSocket::uncork_tcp_socket(SOCKET sock)
   return true;
 }
 
+bool acl::CoreSocket::set_socket_nonblocking(SOCKET sock, bool nonblocking)
+{
+  if (sock == BAD_SOCKET) {
+    fprintf(stderr, "set_socket_nonblocking(): Bad socket\n");
+    return false;
+  }
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  u_long mode = nonblocking ? 1 : 0;
+  if (ioctlsocket(sock, FIONBIO, &mode) != 0) {
+    fprintf(stderr, "set_socket_nonblocking(): ioctlsocket() failed\n");
+    return false;
+  }
+#else
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags < 0) {
+    perror("set_socket_nonblocking(): fcntl(F_GETFL) failed");
+    return false;
+  }
+  flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  if (fcntl(sock, F_SETFL, flags) < 0) {
+    perror("set_socket_nonblocking(): fcntl(F_SETFL) failed");
+    return false;
+  }
+#endif
+  return true;
+}
+
+int acl::CoreSocket::noint_block_writev(SOCKET outsock, const IOBuffer* buffers, size_t count)
+{
+  if (buffers == nullptr && count > 0) {
+    fprintf(stderr, "noint_block_writev(): NULL buffer list\n");
+    return -1;
+  }
+  size_t sofar = 0;
+
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  std::vector<WSABUF> bufs;
+  for (size_t i = 0; i < count; i++) {
+    if (buffers[i].length > 0) {
+      WSABUF b;
+      b.buf = const_cast<char*>(buffers[i].data);
+      b.len = static_cast<ULONG>(buffers[i].length);
+      bufs.push_back(b);
+    }
+  }
+  size_t first = 0;
+  while (first < bufs.size()) {
+    DWORD sent = 0;
+    if (WSASend(outsock, &bufs[first], static_cast<DWORD>(bufs.size() - first),
+          &sent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+      count_write(-1);
+      return -1;
+    }
+    count_write(sent);
+    if (sent == 0) {
+      break;
+    }
+    sofar += sent;
+
+    // Skip the buffers that went completely and trim the one that went partly.
+    while (sent > 0) {
+      if (sent >= bufs[first].len) {
+        sent -= bufs[first].len;
+        first++;
+      } else {
+        bufs[first].buf += sent;
+        bufs[first].len -= sent;
+        sent = 0;
+      }
+    }
+  }
+#else
+  std::vector<struct iovec> iov;
+  for (size_t i = 0; i < count; i++) {
+    if (buffers[i].length > 0) {
+      struct iovec v;
+      v.iov_base = const_cast<char*>(buffers[i].data);
+      v.iov_len = buffers[i].length;
+      iov.push_back(v);
+    }
+  }
+  size_t first = 0;
+  while (first < iov.size()) {
+    int n = static_cast<int>(std::min(iov.size() - first, static_cast<size_t>(IOV_MAX)));
+    ssize_t ret = writev(outsock, &iov[first], n);
+    count_write(ret);
+    if (ret < 0) {
+      // Ignore interrupted system calls - retry
+      if (socket_error == ACL_EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (ret == 0) {
+      break;    // EOF reached
+    }
+    sofar += ret;
+
+    // Skip the buffers that went completely and trim the one that went partly.
+    size_t sent = static_cast<size_t>(ret);
+    while (sent > 0) {
+      if (sent >= iov[first].iov_len) {
+        sent -= iov[first].iov_len;
+        first++;
+      } else {
+        iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + sent;
+        iov[first].iov_len -= sent;
+        sent = 0;
+      }
+    }
+  }
+#endif
+  return static_cast<int>(sofar);
+}
+
+int64_t acl::CoreSocket::noint_block_sendfile(SOCKET outsock, int fd, int64_t offset, size_t length)
+{
+  if (outsock == BAD_SOCKET || fd < 0 || offset < 0) {
+    fprintf(stderr, "noint_block_sendfile(): Bad socket, file or offset\n");
+    return -1;
+  }
+  size_t sofar = 0;
+
+  // Let the kernel move the data if it can.  A descriptor it cannot send
+  // from breaks out to the copying loop below, which picks up where this
+  // left off.
+#if defined(__linux__)
+  while (sofar < length) {
+    off_t off = static_cast<off_t>(offset + sofar);
+    // Linux sends at most 0x7ffff000 bytes per call.
+    size_t chunk = std::min(length - sofar, static_cast<size_t>(0x7ffff000));
+    ssize_t ret = sendfile(outsock, fd, &off, chunk);
+    count_write(ret);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EINVAL || errno == ENOSYS) {
+        break;
+      }
+      perror("noint_block_sendfile(): sendfile() failed");
+      return -1;
+    }
+    if (ret == 0) {
+      return static_cast<int64_t>(sofar);    // End of file
+    }
+    sofar += ret;
+  }
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+  while (sofar < length) {
+    off_t sent = 0;
+#if defined(__APPLE__)
+    sent = static_cast<off_t>(length - sofar);
+    int ret = sendfile(fd, outsock, static_cast<off_t>(offset + sofar), &sent, nullptr, 0);
+#else
+    int ret = sendfile(fd, outsock, static_cast<off_t>(offset + sofar), length - sofar,
+      nullptr, &sent, 0);
+#endif
+    // Both report the bytes sent even when interrupted.
+    count_write(sent);
+    sofar += static_cast<size_t>(sent);
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      if (errno == EINVAL || errno == ENOTSOCK || errno == EOPNOTSUPP) {
+        break;
+      }
+      perror("noint_block_sendfile(): sendfile() failed");
+      return -1;
+    }
+    if (sent == 0) {
+      return static_cast<int64_t>(sofar);    // End of file
+    }
+  }
+#endif
+
+  // Copy whatever is left through a buffer.
+  if (sofar < length) {
+    std::vector<char> buffer(std::min(length - sofar, static_cast<size_t>(1) << 16));
+    while (sofar < length) {
+      size_t want = std::min(buffer.size(), length - sofar);
+#ifdef ACL_USE_WINSOCK_SOCKETS
+      if (_lseeki64(fd, offset + sofar, SEEK_SET) < 0) {
+        perror("noint_block_sendfile(): _lseeki64() failed");
+        return -1;
+      }
+      int got = _read(fd, buffer.data(), static_cast<unsigned>(want));
+#else
+      ssize_t got = pread(fd, buffer.data(), want, static_cast<off_t>(offset + sofar));
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+#endif
+      if (got < 0) {
+        perror("noint_block_sendfile(): read failed");
+        return -1;
+      }
+      if (got == 0) {
+        break;    // End of file
+      }
+      if (noint_block_write(outsock, buffer.data(), static_cast<size_t>(got)) != got) {
+        return -1;
+      }
+      sofar += static_cast<size_t>(got);
+    }
+  }
+  return static_cast<int64_t>(sofar);
+}
+
+bool acl::CoreSocket::set_zerocopy(SOCKET sock)
+{
+  if (sock == BAD_SOCKET) {
+    fprintf(stderr, "set_zerocopy(): Bad socket\n");
+    return false;
+  }
+#ifdef ACL_HAVE_ZEROCOPY
+  int enable = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) < 0) {
+    // Kernels before 4.14 do not know the option; that is not an error.
+    if (errno != ENOPROTOOPT && errno != EOPNOTSUPP) {
+      perror("set_zerocopy(): setsockopt() failed");
+    }
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+int acl::CoreSocket::noint_block_write_zerocopy(SOCKET outsock, const char* buffer,
+  size_t length, uint32_t& nextId)
+{
+#ifdef ACL_HAVE_ZEROCOPY
+  // MSG_ZEROCOPY is silently ignored, and produces no notification, on a
+  // socket without SO_ZEROCOPY, so check before counting sends.
+  int enabled = 0;
+  socklen_t len = sizeof(enabled);
+  bool zerocopy = getsockopt(outsock, SOL_SOCKET, SO_ZEROCOPY, &enabled, &len) == 0 && enabled;
+  if (!zerocopy) {
+    return noint_block_write(outsock, buffer, length);
+  }
+
+  size_t sofar = 0;
+  while (sofar < length) {
+    ssize_t ret = send(outsock, buffer + sofar, length - sofar, zerocopy ? MSG_ZEROCOPY : 0);
+    count_write(ret);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Out of lockable memory for pinned pages; copy the rest.
+      if (errno == ENOBUFS && zerocopy) {
+        zerocopy = false;
+        continue;
+      }
+      return -1;
+    }
+    if (ret == 0) {
+      break;    // EOF reached
+    }
+    if (zerocopy) {
+      nextId++;
+    }
+    sofar += ret;
+  }
+  return static_cast<int>(sofar);
+#else
+  return noint_block_write(outsock, buffer, length);
+#endif
+}
+
+int acl::CoreSocket::read_zerocopy_completions(SOCKET sock, uint32_t& completed, double timeout)
+{
+  if (sock == BAD_SOCKET) {
+    fprintf(stderr, "read_zerocopy_completions(): Bad socket\n");
+    return -1;
+  }
+#ifdef ACL_HAVE_ZEROCOPY
+  // Notifications show up as POLLERR, which poll() reports without asking.
+  if (timeout > 0) {
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = 0;
+    pfd.revents = 0;
+    int ret;
+    do {
+      ret = poll(&pfd, 1, static_cast<int>(timeout * 1000));
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+      perror("read_zerocopy_completions(): poll() failed");
+      return -1;
+    }
+  }
+
+  int count = 0;
+  while (true) {
+    alignas(struct cmsghdr) char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;    // Queue drained
+      }
+      perror("read_zerocopy_completions(): recvmsg() failed");
+      return -1;
+    }
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+            (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+        continue;
+      }
+      const struct sock_extended_err* err =
+        reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      // Each notification covers the inclusive range of ids [ee_info, ee_data].
+      uint32_t n = err->ee_data - err->ee_info + 1;
+      completed += n;
+      count += static_cast<int>(n);
+    }
+  }
+  return count;
+#else
+  return 0;
+#endif
+}
+
 int acl::CoreSocket::check_ready_to_read_timeout(SOCKET s, double timeout)
 {
   if (s == acl::CoreSocket::BAD_SOCKET) {
@@ -6,6 +6,7 @@
 #pragma once
 #include <cstdint>
 #include <cstdlib>
+#include <vector>
 
 //=======================================================================
 // Figure out whether we're using Windows sockets or not.
@@ -116,6 +117,82 @@ int noint_block_write(SOCKET outsock, const char* buffer, size_t length);
 
 int noint_block_read(SOCKET insock, char* buffer, size_t length);
 
+/// @brief One piece of a scatter-gather write; see noint_block_writev().
+struct IOBuffer {
+  const char* data;
+  size_t length;
+};
+
+/// @brief Write several buffers as one block, retrying in case of interrupts.
+///
+/// Sends the buffers in order using writev() (WSASend() on Windows), so a
+/// header and a payload that live in different places go out in as few
+/// system calls as possible, without copying them together and without
+/// having to cork the socket around two writes.  Like noint_block_write(),
+/// it keeps sending until all of the data has gone or an error occurs.
+/// @param [in] outsock Socket to write to
+/// @param [in] buffers Buffers to send, in order.  Zero-length entries are allowed.
+/// @param [in] count Number of entries in buffers
+/// @return Total number of bytes written (which may be less than requested
+///         in case of EOF), or -1 in the case of an error.
+int noint_block_writev(SOCKET outsock, const IOBuffer* buffers, size_t count);
+
+/// @brief Send part of a file on a socket without copying it through user space.
+///
+/// Uses sendfile() on Linux, macOS and FreeBSD, so the kernel moves the data
+/// from the page cache straight to the socket.  On other systems, or if the
+/// kernel refuses (for example because the descriptor is not a regular
+/// file), it falls back to reading the file into a buffer and sending it.
+/// The file position of fd is not changed on the sendfile() path.
+/// @param [in] outsock Socket to write to
+/// @param [in] fd Open file descriptor to read from
+/// @param [in] offset Byte offset in the file to start at
+/// @param [in] length Number of bytes to send
+/// @return Number of bytes sent (less than length if the file ends first),
+///         or -1 in the case of an error.
+int64_t noint_block_sendfile(SOCKET outsock, int fd, int64_t offset, size_t length);
+
+/// @brief Turn on zero-copy sending for noint_block_write_zerocopy().
+///
+/// Sets SO_ZEROCOPY on Linux 4.14 and later.  Zero copy pins the caller's
+/// pages instead of copying them into the kernel, which only pays off for
+/// large writes (tens of kilobytes or more); a kernel may still copy, for
+/// example on loopback.
+/// @param [in] sock Socket to change
+/// @return True on success, false if zero copy is not supported.
+bool set_zerocopy(SOCKET sock);
+
+/// @brief Write a block using MSG_ZEROCOPY when it is enabled on the socket.
+///
+/// Behaves like noint_block_write(), but when set_zerocopy() succeeded the
+/// kernel reads the data in place after this returns, so the buffer must
+/// not be changed or freed until read_zerocopy_completions() reports that
+/// all of its sends are complete.  Each zero-copy send() consumes one
+/// notification; nextId is incremented once per notification so the caller
+/// knows how many to wait for.  When zero copy is not available the data
+/// is copied as usual and nextId is left alone.
+/// @param [in] outsock Socket to write to
+/// @param [in] buffer Data to send
+/// @param [in] length Number of bytes to send
+/// @param [in,out] nextId Number of zero-copy sends made on this socket.
+///         Start it at 0 for a new socket and pass it to every call.
+/// @return Number of bytes written, or -1 in the case of an error.
+int noint_block_write_zerocopy(SOCKET outsock, const char* buffer, size_t length,
+  uint32_t& nextId);
+
+/// @brief Collect completion notifications for noint_block_write_zerocopy().
+///
+/// Reads the socket's error queue and adds the number of zero-copy sends
+/// that the kernel has finished with to completed.  Once completed equals
+/// the nextId passed to the writes, every buffer handed to them may be
+/// reused.
+/// @param [in] sock Socket the writes were made on
+/// @param [in,out] completed Number of completed sends; start it at 0.
+/// @param [in] timeout Seconds to wait for a notification if none is
+///         queued yet; 0 does not wait.
+/// @return Number of sends newly reported complete (0 if none), or -1 on error.
+int read_zerocopy_completions(SOCKET sock, uint32_t& completed, double timeout = 0);
+
 /**
  *	This routine will perform like a normal select() call, but it will
  * restart if it quit because of an interrupt.  This makes it more robust
@@ -262,6 +339,39 @@ public:
 
 bool set_tcp_socket_options(SOCKET s, TCPOptions options = TCPOptions());
 
+/// @brief Options for UDP sockets, passed to set_udp_socket_options() and
+/// the open_udp_socket() overload that takes them.
+class UDPOptions {
+public:
+  /// SO_RCVBUF size in bytes, or -1 to leave the system default.  High-rate
+  /// receivers need a large buffer to ride out scheduling gaps; Linux caps
+  /// it at net.core.rmem_max.
+  int receiveBufferSize = -1;
+  /// SO_SNDBUF size in bytes, or -1 to leave the system default.
+  int sendBufferSize = -1;
+  /// Set SO_REUSEPORT so that several sockets, usually one per thread, can
+  /// bind the same port and have the kernel spread datagrams across them.
+  /// Only has an effect before the socket is bound.
+  bool reusePort = false;
+  /// Enable UDP_GRO (Linux 5.0 and later) so that recv_udp_batch() may
+  /// return several same-sized datagrams coalesced into one UDPMessage.
+  bool gro = false;
+};
+
+/// @brief Sets options on the specified UDP socket.
+/// @param [in] s Socket to set the options on.
+/// @param [in] options Options to set.
+/// @return False on failure to set any of the options, true on success.
+bool set_udp_socket_options(SOCKET s, const UDPOptions& options);
+
+/// @brief Opens a UDP socket and sets options on it before binding it.
+///
+/// Like open_udp_socket() above, but sets the options before bind() so that
+/// reusePort applies.
+/// @return BAD_SOCKET on failure and the socket identifier on success.
+SOCKET open_udp_socket(unsigned short* portno, const char* IPaddress,
+  const UDPOptions& options, bool reuseAddr = false);
+
 /**
  * Create a UDP socket and connect it to a specified port.
  */
@@ -269,6 +379,74 @@ bool set_tcp_socket_options(SOCKET s, TCPOptions options = TCPOptions());
 SOCKET connect_udp_port(const char* machineName, int remotePort,
 	const char* NIC_IP = NULL);
 
+/// @brief One datagram for recv_udp_batch() and send_udp_batch().
+struct UDPMessage {
+  char* data;                  ///< Buffer to receive into or send from
+  size_t length;               ///< Receive: buffer size in, bytes received out.  Send: bytes to send.
+  struct sockaddr_in address;  ///< Receive: the source.  Send: the destination, or
+                               ///< sin_family 0 to use the connected address.
+  int segmentSize;             ///< Segment size of coalesced (GRO) or to-be-split
+                               ///< (GSO) datagrams, 0 for one datagram.
+};
+
+/// @brief A set of UDPMessages with preallocated buffers, so a receive loop
+/// does not allocate.
+class UDPBatch {
+public:
+  /// @brief Constructor.
+  /// @param [in] count Number of messages.
+  /// @param [in] bufferSize Bytes in each message's buffer.  Use 65536 when
+  ///         UDPOptions::gro is set, since coalesced datagrams are large.
+  UDPBatch(size_t count, size_t bufferSize);
+
+  /// The messages point into m_storage, so a copy would point into the
+  /// original's buffers.  Moving keeps the storage, and with it the pointers.
+  UDPBatch(const UDPBatch&) = delete;
+  UDPBatch& operator=(const UDPBatch&) = delete;
+  UDPBatch(UDPBatch&&) = default;
+  UDPBatch& operator=(UDPBatch&&) = default;
+
+  /// @brief Point every message back at its buffer and reset its length to
+  /// the full buffer size and segmentSize to 0.  Call before each receive.
+  void reset();
+
+  UDPMessage* messages() { return m_messages.data(); }
+  UDPMessage& operator[](size_t i) { return m_messages[i]; }
+  size_t size() const { return m_messages.size(); }
+  size_t buffer_size() const { return m_bufferSize; }
+
+private:
+  size_t m_bufferSize;
+  std::vector<char> m_storage;
+  std::vector<UDPMessage> m_messages;
+};
+
+/// @brief Receive as many datagrams as are available, up to count, in as
+/// few system calls as possible.
+///
+/// Uses recvmmsg() on Linux and a loop over recvfrom() elsewhere.  Fills in
+/// the length, address and segmentSize of each message received; a datagram
+/// too big for its buffer is truncated.
+/// @param [in] s Socket to read from.
+/// @param [in,out] messages Messages to fill in; see UDPBatch.
+/// @param [in] count Number of messages.
+/// @param [in] wait True to block until at least one datagram arrives.
+/// @return Number of messages filled in, 0 if wait is false and nothing is
+///         ready, or -1 on error.
+int recv_udp_batch(SOCKET s, UDPMessage* messages, size_t count, bool wait = true);
+
+/// @brief Send several datagrams in as few system calls as possible.
+///
+/// Uses sendmmsg() on Linux and a loop over sendto() elsewhere.  A message
+/// whose segmentSize is smaller than its length is sent as several
+/// datagrams of that size, by the kernel (UDP_SEGMENT, Linux 4.18 and
+/// later) if it can and by splitting it here otherwise.
+/// @param [in] s Socket to write to.
+/// @param [in] messages Messages to send.
+/// @param [in] count Number of messages.
+/// @return Number of messages sent, or -1 if none could be.
+int send_udp_batch(SOCKET s, const UDPMessage* messages, size_t count);
+
 /**
  * Retrieves the IP address or hostname of the local interface used to connect
  * to the specified remote host.
@@ -396,6 +574,16 @@ bool cork_tcp_socket(SOCKET sock);
 /// On Windows, this has the side effect of enabling TCP_NODELAY on the socket.
 bool uncork_tcp_socket(SOCKET sock);
 
+/// @brief Put a socket into or out of non-blocking mode.
+///
+/// Reads, writes and accept() on a non-blocking socket return immediately
+/// with an EWOULDBLOCK/EAGAIN error instead of waiting.  Used by EventLoop.
+/// @param [in] sock Socket to change
+/// @param [in] nonblocking True to make the socket non-blocking, false to
+///         make it blocking again.
+/// @return True on success, false on failure.
+bool set_socket_nonblocking(SOCKET sock, bool nonblocking = true);
+
 /// @brief Helper function that determines whether the socket is ready to read.
 ///
 /// Note that for a socket that is in the listen state then ready to read
@@ -0,0 +1,772 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+#include <EventLoop.hpp>
+
+#if defined(__linux__)
+#define ACL_EVENTLOOP_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define ACL_EVENTLOOP_KQUEUE
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#else
+#define ACL_EVENTLOOP_POLL
+#endif
+
+#ifdef ACL_USE_WINSOCK_SOCKETS
+#define closeSocket closesocket
+#define ACL_POLL WSAPoll
+typedef WSAPOLLFD acl_pollfd;
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define closeSocket close
+#define ACL_POLL poll
+typedef struct pollfd acl_pollfd;
+#endif
+
+namespace acl { namespace CoreSocket {
+
+/// @brief Milliseconds for a poll-style timeout; negative means forever.
+static int timeout_ms(double timeout)
+{
+  if (timeout < 0) {
+    return -1;
+  }
+  return static_cast<int>(std::ceil(timeout * 1000));
+}
+
+EventLoop::EventLoop(ThreadPool* pool)
+  : m_pool(pool)
+  , m_stopRequested(false)
+  , m_valid(false)
+  , m_inFlight(0)
+{
+  m_valid = backend_open();
+  if (!m_valid) {
+    fprintf(stderr, "EventLoop::EventLoop(): Could not create the event queue\n");
+  }
+}
+
+EventLoop::~EventLoop()
+{
+  std::unique_lock<std::mutex> lock(m_inFlightMutex);
+  m_inFlightCv.wait(lock, [this]() { return m_inFlight == 0; });
+  lock.unlock();
+
+  backend_close();
+}
+
+bool EventLoop::valid() const
+{
+  return m_valid;
+}
+
+bool EventLoop::add(SOCKET s, int events, Handler handler)
+{
+  if (!m_valid || s == BAD_SOCKET || !handler) {
+    return false;
+  }
+
+  RegistrationPtr reg = std::make_shared<Registration>();
+  reg->s = s;
+  reg->events = events;
+  reg->handler = handler;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_registrations.count(s)) {
+      return false;
+    }
+    if (!backend_add(s, events)) {
+      return false;
+    }
+    m_registrations[s] = reg;
+  }
+#ifdef ACL_EVENTLOOP_POLL
+  wake();
+#endif
+  return true;
+}
+
+bool EventLoop::modify(SOCKET s, int events)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_registrations.find(s);
+    if (it == m_registrations.end()) {
+      return false;
+    }
+
+    // A busy socket is re-armed with the new events when its handler returns
+    it->second->events = events;
+    if (!it->second->busy && !backend_set(s, events)) {
+      return false;
+    }
+  }
+#ifdef ACL_EVENTLOOP_POLL
+  wake();
+#endif
+  return true;
+}
+
+bool EventLoop::remove(SOCKET s)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_registrations.find(s);
+    if (it == m_registrations.end()) {
+      return false;
+    }
+    it->second->removed = true;
+    m_registrations.erase(it);
+    backend_remove(s);
+  }
+#ifdef ACL_EVENTLOOP_POLL
+  wake();
+#endif
+  return true;
+}
+
+bool EventLoop::add_listener(SOCKET listener, AcceptHandler onAccept,
+  const TCPOptions* options)
+{
+  if (!onAccept || !set_socket_nonblocking(listener)) {
+    return false;
+  }
+
+  // Copy the options so the caller's need not outlive the loop
+  std::shared_ptr<TCPOptions> opts;
+  if (options) {
+    opts = std::make_shared<TCPOptions>(*options);
+  }
+
+  return add(listener, READ, [onAccept, opts](SOCKET s, int events) {
+    // Accept everything that is pending; the listener is non-blocking so
+    // accept() fails once the backlog is empty.
+    while (true) {
+      SOCKET accepted = accept(s, nullptr, nullptr);
+      if (accepted == BAD_SOCKET) {
+        break;
+      }
+      if (!set_socket_nonblocking(accepted) ||
+          (opts && !set_tcp_socket_options(accepted, *opts))) {
+        fprintf(stderr, "EventLoop::add_listener(): Could not configure accepted socket\n");
+        closeSocket(accepted);
+        continue;
+      }
+      onAccept(accepted);
+    }
+  });
+}
+
+int EventLoop::run_once(double timeout)
+{
+  if (!m_valid) {
+    return -1;
+  }
+
+  // Sleep no longer than it takes the first timer to come due
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_timers.empty()) {
+      double until = std::chrono::duration<double>(
+        m_timers.begin()->first.first - Clock::now()).count();
+      until = std::max(until, 0.0);
+      if (timeout < 0 || until < timeout) {
+        timeout = until;
+      }
+    }
+  }
+
+  std::vector<std::pair<SOCKET, int>> ready;
+  int ret = backend_wait(timeout, ready);
+  if (ret < 0) {
+    return ret;
+  }
+
+  int dispatched = 0;
+  for (auto& event : ready) {
+    RegistrationPtr reg;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_registrations.find(event.first);
+      if (it == m_registrations.end()) {
+        continue;   // Removed after the event was reported
+      }
+      reg = it->second;
+    }
+    dispatch(reg, event.second);
+    dispatched++;
+  }
+  return dispatched + run_timers();
+}
+
+uint64_t EventLoop::add_timer(double delay, TimerHandler handler)
+{
+  if (!m_valid || !handler) {
+    return 0;
+  }
+  Clock::time_point when = Clock::now() +
+    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(std::max(delay, 0.0)));
+  uint64_t id;
+  bool first;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    id = m_nextTimer++;
+    m_timers[TimerKey(when, id)] = handler;
+    m_timerDeadlines[id] = when;
+    first = m_timers.begin()->first.second == id;
+  }
+
+  // A blocked run_once() has to recompute how long to sleep
+  if (first) {
+    wake();
+  }
+  return id;
+}
+
+bool EventLoop::cancel_timer(uint64_t id)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_timerDeadlines.find(id);
+  if (it == m_timerDeadlines.end()) {
+    return false;
+  }
+  m_timers.erase(TimerKey(it->second, id));
+  m_timerDeadlines.erase(it);
+  return true;
+}
+
+int EventLoop::run_timers()
+{
+  // Take the due timers out before calling any of them, so a handler can
+  // add or cancel timers, and one that adds a zero-delay timer waits for
+  // the next pass.
+  std::vector<TimerHandler> due;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+    while (!m_timers.empty() && m_timers.begin()->first.first <= now) {
+      due.push_back(std::move(m_timers.begin()->second));
+      m_timerDeadlines.erase(m_timers.begin()->first.second);
+      m_timers.erase(m_timers.begin());
+    }
+  }
+  for (auto& handler : due) {
+    handler();
+  }
+  return static_cast<int>(due.size());
+}
+
+void EventLoop::run()
+{
+  // A stop() that comes before run() starts still counts; it is consumed on
+  // the way out so that the loop can be run again.
+  while (!m_stopRequested) {
+    if (run_once(-1) < 0) {
+      break;
+    }
+  }
+  m_stopRequested = false;
+}
+
+void EventLoop::stop()
+{
+  m_stopRequested = true;
+  wake();
+}
+
+size_t EventLoop::size()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_registrations.size();
+}
+
+void EventLoop::dispatch(const RegistrationPtr& reg, int events)
+{
+  if (!m_pool) {
+    reg->handler(reg->s, events);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (reg->busy || reg->removed) {
+      return;
+    }
+    reg->busy = true;
+    backend_disarm(reg->s);
+  }
+
+  m_inFlight++;
+  RegistrationPtr r = reg;
+  auto job = [this, r, events]() {
+    r->handler(r->s, events);
+    finish(r);
+  };
+  if (!m_pool->push_job(job)) {
+    job();
+  }
+}
+
+void EventLoop::finish(const RegistrationPtr& reg)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    reg->busy = false;
+    if (!reg->removed) {
+      backend_set(reg->s, reg->events);
+    }
+  }
+#ifdef ACL_EVENTLOOP_POLL
+  // poll() only sees the change when it rebuilds its descriptor list
+  wake();
+#endif
+
+  std::lock_guard<std::mutex> lock(m_inFlightMutex);
+  if (--m_inFlight == 0) {
+    m_inFlightCv.notify_all();
+  }
+}
+
+//=======================================================================
+// epoll (Linux)
+
+#if defined(ACL_EVENTLOOP_EPOLL)
+
+/// @brief epoll mask for a set of Events.  With a pool, sockets are one-shot
+/// so that the kernel disarms them as it reports them.
+static uint32_t epoll_mask(int events, bool oneShot)
+{
+  uint32_t mask = EPOLLRDHUP;
+  if (events & EventLoop::READ) {
+    mask |= EPOLLIN;
+  }
+  if (events & EventLoop::WRITE) {
+    mask |= EPOLLOUT;
+  }
+  if (oneShot) {
+    mask |= EPOLLONESHOT;
+  }
+  return mask;
+}
+
+bool EventLoop::backend_open()
+{
+  m_queue = epoll_create1(EPOLL_CLOEXEC);
+  if (m_queue < 0) {
+    perror("EventLoop: epoll_create1() failed");
+    return false;
+  }
+
+  m_wakeRead = m_wakeWrite = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeRead < 0) {
+    perror("EventLoop: eventfd() failed");
+    return false;
+  }
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = m_wakeRead;
+  return epoll_ctl(m_queue, EPOLL_CTL_ADD, m_wakeRead, &ev) == 0;
+}
+
+void EventLoop::backend_close()
+{
+  if (m_wakeRead >= 0) {
+    close(m_wakeRead);
+  }
+  if (m_queue >= 0) {
+    close(m_queue);
+  }
+}
+
+bool EventLoop::backend_add(SOCKET s, int events)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = epoll_mask(events, m_pool != nullptr);
+  ev.data.fd = s;
+  if (epoll_ctl(m_queue, EPOLL_CTL_ADD, s, &ev) != 0) {
+    perror("EventLoop::add(): epoll_ctl() failed");
+    return false;
+  }
+  return true;
+}
+
+bool EventLoop::backend_set(SOCKET s, int events)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = epoll_mask(events, m_pool != nullptr);
+  ev.data.fd = s;
+  return epoll_ctl(m_queue, EPOLL_CTL_MOD, s, &ev) == 0;
+}
+
+void EventLoop::backend_disarm(SOCKET s)
+{
+  // EPOLLONESHOT already disarmed it when the event was reported
+}
+
+void EventLoop::backend_remove(SOCKET s)
+{
+  // Fails harmlessly if the socket was closed before it was removed
+  struct epoll_event ev;
+  epoll_ctl(m_queue, EPOLL_CTL_DEL, s, &ev);
+}
+
+void EventLoop::wake()
+{
+  uint64_t one = 1;
+  if (write(m_wakeWrite, &one, sizeof(one)) < 0) {
+    // Already pending; the counter is full or the loop is shutting down
+  }
+}
+
+void EventLoop::drain_wake()
+{
+  uint64_t count;
+  while (read(m_wakeRead, &count, sizeof(count)) > 0) {
+  }
+}
+
+int EventLoop::backend_wait(double timeout, std::vector<std::pair<SOCKET, int>>& ready)
+{
+  struct epoll_event events[256];
+  int n = epoll_wait(m_queue, events, 256, timeout_ms(timeout));
+  if (n < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    perror("EventLoop::run_once(): epoll_wait() failed");
+    return -1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.fd == m_wakeRead) {
+      drain_wake();
+      continue;
+    }
+
+    int fired = 0;
+    if (events[i].events & EPOLLIN) {
+      fired |= READ;
+    }
+    if (events[i].events & EPOLLOUT) {
+      fired |= WRITE;
+    }
+    if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+      fired |= HANGUP;
+    }
+    ready.push_back(std::make_pair(static_cast<SOCKET>(events[i].data.fd), fired));
+  }
+  return static_cast<int>(ready.size());
+}
+
+//=======================================================================
+// kqueue (macOS and the BSDs)
+
+#elif defined(ACL_EVENTLOOP_KQUEUE)
+
+/// @brief Sets both filters for a socket, enabled according to events.
+static bool kqueue_set(int queue, SOCKET s, int events, bool add)
+{
+  struct kevent changes[2];
+  unsigned short base = add ? EV_ADD : 0;
+  EV_SET(&changes[0], s, EVFILT_READ,
+    base | ((events & EventLoop::READ) ? EV_ENABLE : EV_DISABLE), 0, 0, nullptr);
+  EV_SET(&changes[1], s, EVFILT_WRITE,
+    base | ((events & EventLoop::WRITE) ? EV_ENABLE : EV_DISABLE), 0, 0, nullptr);
+  return kevent(queue, changes, 2, nullptr, 0, nullptr) == 0;
+}
+
+bool EventLoop::backend_open()
+{
+  m_queue = kqueue();
+  if (m_queue < 0) {
+    perror("EventLoop: kqueue() failed");
+    return false;
+  }
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("EventLoop: pipe() failed");
+    return false;
+  }
+  m_wakeRead = fds[0];
+  m_wakeWrite = fds[1];
+  fcntl(m_wakeRead, F_SETFL, O_NONBLOCK);
+  fcntl(m_wakeWrite, F_SETFL, O_NONBLOCK);
+
+  struct kevent change;
+  EV_SET(&change, m_wakeRead, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, nullptr);
+  return kevent(m_queue, &change, 1, nullptr, 0, nullptr) == 0;
+}
+
+void EventLoop::backend_close()
+{
+  if (m_wakeRead >= 0) {
+    close(m_wakeRead);
+    close(m_wakeWrite);
+  }
+  if (m_queue >= 0) {
+    close(m_queue);
+  }
+}
+
+bool EventLoop::backend_add(SOCKET s, int events)
+{
+  if (!kqueue_set(m_queue, s, events, true)) {
+    perror("EventLoop::add(): kevent() failed");
+    return false;
+  }
+  return true;
+}
+
+bool EventLoop::backend_set(SOCKET s, int events)
+{
+  return kqueue_set(m_queue, s, events, true);
+}
+
+void EventLoop::backend_disarm(SOCKET s)
+{
+  kqueue_set(m_queue, s, 0, false);
+}
+
+void EventLoop::backend_remove(SOCKET s)
+{
+  // Fails harmlessly if the socket was closed before it was removed
+  struct kevent changes[2];
+  EV_SET(&changes[0], s, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+  EV_SET(&changes[1], s, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+  kevent(m_queue, changes, 2, nullptr, 0, nullptr);
+}
+
+void EventLoop::wake()
+{
+  char c = 0;
+  if (write(m_wakeWrite, &c, 1) < 0) {
+    // Pipe full: a wakeup is already pending
+  }
+}
+
+void EventLoop::drain_wake()
+{
+  char buf[64];
+  while (read(m_wakeRead, buf, sizeof(buf)) > 0) {
+  }
+}
+
+int EventLoop::backend_wait(double timeout, std::vector<std::pair<SOCKET, int>>& ready)
+{
+  struct timespec ts;
+  struct timespec* tsp = nullptr;
+  if (timeout >= 0) {
+    ts.tv_sec = static_cast<time_t>(timeout);
+    ts.tv_nsec = static_cast<long>((timeout - ts.tv_sec) * 1e9);
+    tsp = &ts;
+  }
+
+  struct kevent events[256];
+  int n = kevent(m_queue, nullptr, 0, events, 256, tsp);
+  if (n < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    perror("EventLoop::run_once(): kevent() failed");
+    return -1;
+  }
+
+  // Read and write readiness arrive as separate events; merge them per socket
+  for (int i = 0; i < n; i++) {
+    SOCKET s = static_cast<SOCKET>(events[i].ident);
+    if (s == m_wakeRead) {
+      drain_wake();
+      continue;
+    }
+
+    int fired = (events[i].filter == EVFILT_READ) ? READ : WRITE;
+    if (events[i].flags & (EV_EOF | EV_ERROR)) {
+      fired |= HANGUP;
+    }
+
+    bool merged = false;
+    for (auto& r : ready) {
+      if (r.first == s) {
+        r.second |= fired;
+        merged = true;
+        break;
+      }
+    }
+    if (!merged) {
+      ready.push_back(std::make_pair(s, fired));
+    }
+  }
+  return static_cast<int>(ready.size());
+}
+
+//=======================================================================
+// poll() and WSAPoll() everywhere else.  The descriptor list is rebuilt
+// from the registrations on every wait, so changes only need a wake().
+
+#else
+
+bool EventLoop::backend_open()
+{
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  // Windows has no pipes that WSAPoll() can watch, so use a UDP socket
+  // that is connected to itself.
+  unsigned short port = 0;
+  m_wakeRead = open_udp_socket(&port, "127.0.0.1");
+  if (m_wakeRead == BAD_SOCKET) {
+    return false;
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(m_wakeRead, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    return false;
+  }
+  m_wakeWrite = m_wakeRead;
+  return set_socket_nonblocking(m_wakeRead);
+#else
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("EventLoop: pipe() failed");
+    return false;
+  }
+  m_wakeRead = fds[0];
+  m_wakeWrite = fds[1];
+  fcntl(m_wakeRead, F_SETFL, O_NONBLOCK);
+  fcntl(m_wakeWrite, F_SETFL, O_NONBLOCK);
+  return true;
+#endif
+}
+
+void EventLoop::backend_close()
+{
+  if (m_wakeRead != BAD_SOCKET) {
+    closeSocket(m_wakeRead);
+  }
+  if (m_wakeWrite != BAD_SOCKET && m_wakeWrite != m_wakeRead) {
+    closeSocket(m_wakeWrite);
+  }
+}
+
+bool EventLoop::backend_add(SOCKET s, int events)
+{
+  return true;
+}
+
+bool EventLoop::backend_set(SOCKET s, int events)
+{
+  return true;
+}
+
+void EventLoop::backend_disarm(SOCKET s)
+{
+}
+
+void EventLoop::backend_remove(SOCKET s)
+{
+}
+
+void EventLoop::wake()
+{
+  char c = 0;
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  send(m_wakeWrite, &c, 1, 0);
+#else
+  if (write(m_wakeWrite, &c, 1) < 0) {
+    // Pipe full: a wakeup is already pending
+  }
+#endif
+}
+
+void EventLoop::drain_wake()
+{
+  char buf[64];
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  while (recv(m_wakeRead, buf, sizeof(buf), 0) > 0) {
+  }
+#else
+  while (read(m_wakeRead, buf, sizeof(buf)) > 0) {
+  }
+#endif
+}
+
+int EventLoop::backend_wait(double timeout, std::vector<std::pair<SOCKET, int>>& ready)
+{
+  std::vector<acl_pollfd> fds;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fds.reserve(m_registrations.size() + 1);
+    acl_pollfd wake;
+    memset(&wake, 0, sizeof(wake));
+    wake.fd = m_wakeRead;
+    wake.events = POLLIN;
+    fds.push_back(wake);
+
+    for (auto& item : m_registrations) {
+      const Registration& reg = *item.second;
+      if (reg.busy || !(reg.events & (READ | WRITE))) {
+        continue;
+      }
+      acl_pollfd p;
+      memset(&p, 0, sizeof(p));
+      p.fd = reg.s;
+      p.events = ((reg.events & READ) ? POLLIN : 0) | ((reg.events & WRITE) ? POLLOUT : 0);
+      fds.push_back(p);
+    }
+  }
+
+  int n = ACL_POLL(fds.data(), static_cast<unsigned long>(fds.size()), timeout_ms(timeout));
+  if (n < 0) {
+#ifndef ACL_USE_WINSOCK_SOCKETS
+    if (errno == EINTR) {
+      return 0;
+    }
+#endif
+    perror("EventLoop::run_once(): poll() failed");
+    return -1;
+  }
+
+  if (fds[0].revents) {
+    drain_wake();
+  }
+  for (size_t i = 1; i < fds.size(); i++) {
+    int fired = 0;
+    if (fds[i].revents & POLLIN) {
+      fired |= READ;
+    }
+    if (fds[i].revents & POLLOUT) {
+      fired |= WRITE;
+    }
+    if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+      fired |= HANGUP;
+    }
+    if (fired) {
+      ready.push_back(std::make_pair(static_cast<SOCKET>(fds[i].fd), fired));
+    }
+  }
+  return static_cast<int>(ready.size());
+}
+
+#endif
+
+}  }	// End of namespace definitions.
@@ -0,0 +1,185 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <CoreSocket.hpp>
+#include <ThreadPool.h>
+
+namespace acl { namespace CoreSocket {
+
+/// @brief Waits for activity on many sockets at once and calls a handler
+/// for each socket that is ready.
+///
+/// Uses epoll on Linux, kqueue on macOS and the BSDs, WSAPoll on Windows and
+/// poll() elsewhere, so one thread can serve thousands of connections.
+/// Sockets are level triggered: a handler is called again on the next
+/// run_once() for as long as the socket stays ready, so it need not drain
+/// the socket in one call.  Added sockets should be non-blocking (see
+/// set_socket_nonblocking()) so that a handler never stalls the loop.
+///
+/// If a ThreadPool is given, handlers run on the pool instead of on the
+/// thread calling run_once().  A socket is disarmed while its handler runs
+/// and re-armed when it returns, so each socket's handler is never called
+/// on two threads at once.  If the pool rejects a job the handler runs on
+/// the loop thread.
+///
+/// Timers added with add_timer() run on the thread calling run_once(),
+/// after the socket handlers it dispatched.
+///
+/// add(), modify(), remove(), add_timer(), cancel_timer() and stop() may be
+/// called from any thread, including from handlers.  run() and run_once() must be called from one
+/// thread at a time.
+class EventLoop {
+public:
+  /// @brief Bits passed to and from handlers.
+  enum Events {
+    READ = 1,   ///< Data (or a connection to accept) is ready
+    WRITE = 2,  ///< The socket can be written without blocking
+    HANGUP = 4  ///< The socket has an error or the peer hung up (reported, not requested)
+  };
+
+  /// @brief Called with the socket and the Events that fired.
+  typedef std::function<void(SOCKET s, int events)> Handler;
+
+  /// @brief Called with each newly accepted socket.
+  typedef std::function<void(SOCKET s)> AcceptHandler;
+
+  /// @brief Called when a timer comes due.
+  typedef std::function<void()> TimerHandler;
+
+  /// @brief Constructor.
+  /// @param [in] pool Thread pool to run handlers on, or nullptr to run
+  ///         them on the thread that calls run_once().  Must outlive the
+  ///         loop.
+  EventLoop(ThreadPool* pool = nullptr);
+
+  /// @brief Destructor.  Waits for handlers running on the pool.  Does not
+  /// close the registered sockets.
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  /// @brief Returns false if the operating-system event queue could not be
+  /// created.  Every other call fails when this is false.
+  bool valid() const;
+
+  /// @brief Start watching a socket.
+  /// @param [in] s Socket to watch; should be non-blocking.
+  /// @param [in] events READ and/or WRITE.
+  /// @param [in] handler Called when the socket is ready.
+  /// @return False if the socket is already registered or could not be added.
+  bool add(SOCKET s, int events, Handler handler);
+
+  /// @brief Change the events watched for a registered socket.
+  /// @return False if the socket is not registered.
+  bool modify(SOCKET s, int events);
+
+  /// @brief Stop watching a socket.  Does not close it.  A handler already
+  /// running for it is not interrupted.
+  /// @return False if the socket is not registered.
+  bool remove(SOCKET s);
+
+  /// @brief Accept connections on a listening socket.
+  ///
+  /// The listener is made non-blocking, then every connection that arrives
+  /// is accepted, made non-blocking, configured with options if given, and
+  /// passed to onAccept.  Accepted sockets are not added to the loop;
+  /// onAccept usually calls add() for them.
+  /// @param [in] listener Socket returned by get_a_TCP_socket().
+  /// @param [in] onAccept Called with each accepted socket.
+  /// @param [in] options TCP options to set on accepted sockets, or nullptr.
+  /// @return False if the listener could not be added.
+  bool add_listener(SOCKET listener, AcceptHandler onAccept,
+    const TCPOptions* options = nullptr);
+
+  /// @brief Call a handler once, after a delay.
+  ///
+  /// A zero delay runs the handler at the end of the next run_once(), which
+  /// lets work queued by several socket handlers be done together.
+  /// @param [in] delay Seconds to wait.
+  /// @param [in] handler Called on the thread running the loop.
+  /// @return Identifier to pass to cancel_timer(), never 0; 0 on failure.
+  uint64_t add_timer(double delay, TimerHandler handler);
+
+  /// @brief Keep a timer from running.
+  /// @return False if the timer has already run or been cancelled.
+  bool cancel_timer(uint64_t id);
+
+  /// @brief Wait for events and dispatch them once, then run due timers.
+  /// @param [in] timeout Seconds to wait; negative waits until an event
+  ///         arrives, a timer comes due or wake()/stop() is called.
+  /// @return Number of sockets and timers dispatched, 0 on timeout, -1 on error.
+  int run_once(double timeout = -1);
+
+  /// @brief Call run_once() until stop() is called.  Returns at once if
+  /// stop() was called since the last run() returned.
+  void run();
+
+  /// @brief Make run() return, or the next run() if none is running.  Safe
+  /// to call from any thread or handler.
+  void stop();
+
+  /// @brief Make a blocked run_once() return early.
+  void wake();
+
+  /// @brief Number of registered sockets, including listeners.
+  size_t size();
+
+private:
+  struct Registration {
+    SOCKET s;
+    int events;           ///< Events the caller asked for
+    Handler handler;
+    bool busy = false;    ///< Handler running on the pool; socket disarmed
+    bool removed = false; ///< remove() was called
+  };
+  typedef std::shared_ptr<Registration> RegistrationPtr;
+
+  // Operating-system specific parts, in EventLoop.cpp.  add, set, disarm
+  // and remove are called with m_mutex held.
+  bool backend_open();
+  void backend_close();
+  bool backend_add(SOCKET s, int events);
+  bool backend_set(SOCKET s, int events);
+  void backend_disarm(SOCKET s);
+  void backend_remove(SOCKET s);
+  int backend_wait(double timeout, std::vector<std::pair<SOCKET, int>>& ready);
+  void drain_wake();
+
+  void dispatch(const RegistrationPtr& reg, int events);
+  void finish(const RegistrationPtr& reg);
+  int run_timers();
+
+  typedef std::chrono::steady_clock Clock;
+  typedef std::pair<Clock::time_point, uint64_t> TimerKey;  ///< Deadline, then id to keep keys unique
+
+  ThreadPool* m_pool;
+  std::mutex m_mutex;                                       ///< Protects the registrations
+  std::unordered_map<SOCKET, RegistrationPtr> m_registrations;
+  std::map<TimerKey, TimerHandler> m_timers;               ///< Protected by m_mutex, soonest first
+  std::unordered_map<uint64_t, Clock::time_point> m_timerDeadlines;  ///< Finds a timer by id
+  uint64_t m_nextTimer = 1;
+  std::atomic_bool m_stopRequested;    ///< Set by stop(), cleared when run() returns
+  std::atomic_bool m_valid;
+  std::atomic_int m_inFlight;                               ///< Handlers queued or running on the pool
+  std::mutex m_inFlightMutex;
+  std::condition_variable m_inFlightCv;                     ///< Signalled when m_inFlight reaches 0
+
+  int m_queue = -1;                                         ///< epoll or kqueue descriptor
+  SOCKET m_wakeRead = BAD_SOCKET;                           ///< Becomes readable on wake()
+  SOCKET m_wakeWrite = BAD_SOCKET;                          ///< Written by wake()
+};
+
+}  }	// End of namespace definitions.
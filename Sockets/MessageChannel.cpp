@@ -0,0 +1,444 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <MessageChannel.hpp>
+
+#ifndef ACL_USE_WINSOCK_SOCKETS
+#include <errno.h>
+#include <sys/socket.h>
+#endif
+
+// Keep a send to a closed peer from raising SIGPIPE where we can.
+#ifdef MSG_NOSIGNAL
+#define ACL_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define ACL_SEND_FLAGS 0
+#endif
+
+namespace acl { namespace CoreSocket {
+
+/// @brief Smallest read worth making into the receive buffer.
+static const size_t MIN_READ = 4096;
+
+/// @brief True if the last socket call was interrupted by a signal.
+static bool interrupted()
+{
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  return WSAGetLastError() == WSAEINTR;
+#else
+  return errno == EINTR;
+#endif
+}
+
+/// @brief True if the last socket call failed only because it would block.
+static bool would_block()
+{
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/// @brief Append a length prefix and a message to a buffer.
+static void append_frame(std::vector<char>& out, const char* data, size_t length)
+{
+  uint32_t header = htonl(static_cast<uint32_t>(length));
+  const char* h = reinterpret_cast<const char*>(&header);
+  out.insert(out.end(), h, h + sizeof(header));
+  out.insert(out.end(), data, data + length);
+}
+
+//=======================================================================
+// FrameReader
+
+FrameReader::FrameReader(uint32_t maxMessageSize)
+  : m_maxMessageSize(maxMessageSize)
+  , m_buffer(16 * MIN_READ)
+{
+}
+
+char* FrameReader::space(size_t& available)
+{
+  if (m_start == m_end) {
+    m_start = m_end = 0;
+  }
+
+  // Make room for the rest of the current message, or at least for a
+  // useful read.  Shift the unread bytes down before growing the buffer.
+  size_t required = std::max(m_need, m_end - m_start + MIN_READ);
+  if (m_buffer.size() - m_start < required) {
+    memmove(m_buffer.data(), m_buffer.data() + m_start, m_end - m_start);
+    m_end -= m_start;
+    m_start = 0;
+    if (m_buffer.size() < required) {
+      m_buffer.resize(required);
+    }
+  }
+  available = m_buffer.size() - m_end;
+  return m_buffer.data() + m_end;
+}
+
+void FrameReader::commit(size_t n)
+{
+  m_end += std::min(n, m_buffer.size() - m_end);
+}
+
+int FrameReader::next(const char*& data, size_t& length)
+{
+  size_t have = m_end - m_start;
+  uint32_t header;
+  if (have < sizeof(header)) {
+    m_need = sizeof(header);
+    return 0;
+  }
+  memcpy(&header, m_buffer.data() + m_start, sizeof(header));
+  uint32_t size = ntohl(header);
+  if (size > m_maxMessageSize) {
+    return -1;
+  }
+  if (have < sizeof(header) + size) {
+    m_need = sizeof(header) + size;
+    return 0;
+  }
+  data = m_buffer.data() + m_start + sizeof(header);
+  length = size;
+  m_start += sizeof(header) + size;
+  m_need = 0;
+  return 1;
+}
+
+//=======================================================================
+// MessageChannel
+
+MessageChannel::MessageChannel(SOCKET s, const MessageChannelOptions& options)
+  : m_socket(s)
+  , m_options(options)
+  , m_reader(options.maxMessageSize)
+{
+}
+
+MessageChannel::~MessageChannel()
+{
+  flush();
+}
+
+bool MessageChannel::send(const char* data, size_t length, bool more)
+{
+  if (length > m_options.maxMessageSize) {
+    fprintf(stderr, "MessageChannel::send(): Message of %zu bytes is too large\n", length);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(m_sendMutex);
+
+  // Send a large message along with anything queued ahead of it, in one
+  // call and without copying it.
+  if (length >= m_options.coalesceBytes) {
+    uint32_t header = htonl(static_cast<uint32_t>(length));
+    IOBuffer bufs[3] = {
+      { m_out.data(), m_out.size() },
+      { reinterpret_cast<const char*>(&header), sizeof(header) },
+      { data, length }
+    };
+    size_t total = m_out.size() + sizeof(header) + length;
+    int ret = noint_block_writev(m_socket, bufs, 3);
+    m_out.clear();
+    return ret >= 0 && static_cast<size_t>(ret) == total;
+  }
+
+  if (m_out.empty()) {
+    m_oldest = std::chrono::steady_clock::now();
+  }
+  append_frame(m_out, data, length);
+  bool due = m_options.flushDelay > 0 &&
+    std::chrono::steady_clock::now() - m_oldest >= std::chrono::duration<double>(m_options.flushDelay);
+  if (!more || due || m_out.size() >= m_options.coalesceBytes) {
+    return flush_locked();
+  }
+  return true;
+}
+
+bool MessageChannel::flush()
+{
+  std::lock_guard<std::mutex> lock(m_sendMutex);
+  return flush_locked();
+}
+
+bool MessageChannel::flush_if_due()
+{
+  std::lock_guard<std::mutex> lock(m_sendMutex);
+  if (m_out.empty() || std::chrono::steady_clock::now() - m_oldest <
+      std::chrono::duration<double>(m_options.flushDelay)) {
+    return true;
+  }
+  return flush_locked();
+}
+
+bool MessageChannel::flush_locked()
+{
+  if (m_out.empty()) {
+    return true;
+  }
+  int ret = noint_block_write(m_socket, m_out.data(), m_out.size());
+  bool ok = ret >= 0 && static_cast<size_t>(ret) == m_out.size();
+  m_out.clear();    // Keeps its capacity for the next batch
+  return ok;
+}
+
+int MessageChannel::receive(const char*& data, size_t& length, double timeout)
+{
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(std::max(timeout, 0.0)));
+  while (true) {
+    int ret = m_reader.next(data, length);
+    if (ret < 0) {
+      fprintf(stderr, "MessageChannel::receive(): Corrupt message stream\n");
+      return -1;
+    }
+    if (ret > 0) {
+      return 1;
+    }
+
+    if (timeout >= 0) {
+      double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+      int ready = check_ready_to_read_timeout(m_socket, std::max(remaining, 0.0));
+      if (ready <= 0) {
+        return ready;
+      }
+    }
+
+    // Take everything that has arrived, which may be many messages.
+    size_t available;
+    char* buffer = m_reader.space(available);
+    int n = static_cast<int>(recv(m_socket, buffer, static_cast<int>(available), 0));
+    if (n < 0 && interrupted()) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    m_reader.commit(static_cast<size_t>(n));
+  }
+}
+
+//=======================================================================
+// AsyncMessageChannel
+
+/// @brief Shared with the loop's handler and timers, so it outlives a
+/// handler that is running when the channel is destroyed.
+struct AsyncMessageChannel::State {
+  State(EventLoop& l, SOCKET sock, MessageHandler m, CloseHandler c,
+        const MessageChannelOptions& o)
+    : loop(l), s(sock), onMessage(m), onClose(c), options(o), reader(o.maxMessageSize) {}
+
+  void handle(int events);
+  bool flush_locked();
+  void close();
+
+  EventLoop& loop;
+  SOCKET s;
+  MessageHandler onMessage;
+  CloseHandler onClose;
+  MessageChannelOptions options;
+  bool registered = false;
+  FrameReader reader;           ///< Only used by handle(), which the loop never runs twice at once
+
+  std::mutex mutex;             ///< Protects the fields below
+  std::vector<char> out;        ///< Queued framed messages
+  size_t outStart = 0;          ///< First byte of out not yet sent
+  bool writeArmed = false;      ///< Waiting for the socket to become writable
+  uint64_t timer = 0;           ///< Pending flush timer, or 0
+  bool closed = false;
+};
+
+void AsyncMessageChannel::State::handle(int events)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+      return;
+    }
+    if (events & EventLoop::WRITE) {
+      flush_locked();
+    }
+  }
+  if (!(events & (EventLoop::READ | EventLoop::HANGUP))) {
+    return;
+  }
+
+  while (true) {
+    size_t available;
+    char* buffer = reader.space(available);
+    int n = static_cast<int>(recv(s, buffer, static_cast<int>(available), 0));
+    if (n > 0) {
+      reader.commit(static_cast<size_t>(n));
+      const char* data;
+      size_t length;
+      int ret;
+      while ((ret = reader.next(data, length)) == 1) {
+        onMessage(data, length);
+      }
+      if (ret < 0) {
+        fprintf(stderr, "AsyncMessageChannel: Corrupt message stream\n");
+        close();
+        return;
+      }
+      // A short read means the socket is drained; the loop calls again
+      // when more arrives.
+      if (static_cast<size_t>(n) < available) {
+        return;
+      }
+      continue;
+    }
+    if (n < 0 && interrupted()) {
+      continue;
+    }
+    if (n < 0 && would_block()) {
+      return;
+    }
+    close();
+    return;
+  }
+}
+
+bool AsyncMessageChannel::State::flush_locked()
+{
+  while (outStart < out.size()) {
+    int n = static_cast<int>(::send(s, out.data() + outStart,
+      static_cast<int>(out.size() - outStart), ACL_SEND_FLAGS));
+    if (n > 0) {
+      outStart += static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && interrupted()) {
+      continue;
+    }
+    if (n < 0 && would_block()) {
+      // Finish when the socket can take more
+      if (!writeArmed) {
+        writeArmed = true;
+        loop.modify(s, EventLoop::READ | EventLoop::WRITE);
+      }
+      return true;
+    }
+    return false;   // The read side sees the failure and closes
+  }
+  out.clear();      // Keeps its capacity for the next batch
+  outStart = 0;
+  if (writeArmed) {
+    writeArmed = false;
+    loop.modify(s, EventLoop::READ);
+  }
+  return true;
+}
+
+void AsyncMessageChannel::State::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+      return;
+    }
+    closed = true;
+    if (timer) {
+      loop.cancel_timer(timer);
+      timer = 0;
+    }
+  }
+  loop.remove(s);
+  if (onClose) {
+    onClose();
+  }
+}
+
+AsyncMessageChannel::AsyncMessageChannel(EventLoop& loop, SOCKET s, MessageHandler onMessage,
+  CloseHandler onClose, const MessageChannelOptions& options)
+  : m_state(std::make_shared<State>(loop, s, onMessage, onClose, options))
+{
+  if (!onMessage || !set_socket_nonblocking(s)) {
+    fprintf(stderr, "AsyncMessageChannel::AsyncMessageChannel(): Bad handler or socket\n");
+    return;
+  }
+  std::shared_ptr<State> state = m_state;
+  m_state->registered = loop.add(s, EventLoop::READ,
+    [state](SOCKET sock, int events) { state->handle(events); });
+}
+
+AsyncMessageChannel::~AsyncMessageChannel()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->closed = true;
+    if (m_state->timer) {
+      m_state->loop.cancel_timer(m_state->timer);
+      m_state->timer = 0;
+    }
+  }
+  if (m_state->registered) {
+    m_state->loop.remove(m_state->s);
+  }
+}
+
+bool AsyncMessageChannel::valid() const
+{
+  return m_state->registered;
+}
+
+bool AsyncMessageChannel::send(const char* data, size_t length)
+{
+  State& st = *m_state;
+  if (length > st.options.maxMessageSize) {
+    fprintf(stderr, "AsyncMessageChannel::send(): Message of %zu bytes is too large\n", length);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(st.mutex);
+  if (st.closed || !st.registered) {
+    return false;
+  }
+  append_frame(st.out, data, length);
+  if (st.out.size() - st.outStart >= st.options.coalesceBytes) {
+    return st.flush_locked();
+  }
+
+  // Queued data already waiting for the socket goes out when it is
+  // writable; otherwise a timer sends the batch.
+  if (st.timer == 0 && !st.writeArmed) {
+    std::shared_ptr<State> state = m_state;
+    st.timer = st.loop.add_timer(st.options.flushDelay, [state]() {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->timer = 0;
+      if (!state->closed) {
+        state->flush_locked();
+      }
+    });
+  }
+  return true;
+}
+
+bool AsyncMessageChannel::flush()
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  if (m_state->closed || !m_state->registered) {
+    return false;
+  }
+  return m_state->flush_locked();
+}
+
+size_t AsyncMessageChannel::pending()
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  return m_state->out.size() - m_state->outStart;
+}
+
+SOCKET AsyncMessageChannel::socket() const
+{
+  return m_state->s;
+}
+
+}  }	// End of namespace definitions.
@@ -0,0 +1,185 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <CoreSocket.hpp>
+#include <EventLoop.hpp>
+
+namespace acl { namespace CoreSocket {
+
+/// @brief Options for MessageChannel and AsyncMessageChannel.
+class MessageChannelOptions {
+public:
+  /// Queued small messages are sent once they add up to this many bytes.
+  /// MessageChannel sends a message at least this big straight from the
+  /// caller's buffer instead of copying it.
+  size_t coalesceBytes = 16384;
+  /// Longest time, in seconds, that a queued message waits to be sent.
+  /// With the default of 0, AsyncMessageChannel sends everything queued
+  /// during one pass of the event loop together at the end of the pass,
+  /// and MessageChannel holds messages sent with more until one is sent
+  /// without it.
+  double flushDelay = 0;
+  /// A length prefix bigger than this means the stream is corrupt.
+  uint32_t maxMessageSize = 64 * 1024 * 1024;
+};
+
+/// @brief Splits a byte stream into length-prefixed messages.
+///
+/// Each message on the wire is a 4-byte length in network byte order
+/// followed by that many bytes.  Data is read into one buffer that is
+/// reused, and only grows to fit the largest message seen, so receiving
+/// does not allocate per message.  One read may bring in many messages.
+class FrameReader {
+public:
+  /// @param [in] maxMessageSize Largest message to accept.
+  FrameReader(uint32_t maxMessageSize = MessageChannelOptions().maxMessageSize);
+
+  /// @brief Get space to read into.  Invalidates data returned by next().
+  /// @param [out] available Number of bytes that may be written.
+  /// @return Where to write them; call commit() with the number written.
+  char* space(size_t& available);
+
+  /// @brief Record that bytes were written to the space from space().
+  void commit(size_t n);
+
+  /// @brief Get the next complete message.
+  /// @param [out] data Start of the message, valid until space() is called.
+  /// @param [out] length Size of the message.
+  /// @return 1 if a message was returned, 0 if more data is needed, -1 if
+  ///         the length prefix is larger than the maximum.
+  int next(const char*& data, size_t& length);
+
+private:
+  uint32_t m_maxMessageSize;
+  std::vector<char> m_buffer;
+  size_t m_start = 0;   ///< First byte not yet returned
+  size_t m_end = 0;     ///< One past the last byte read
+  size_t m_need = 0;    ///< Bytes to hold the incomplete message at m_start
+};
+
+/// @brief Sends and receives length-prefixed messages on a blocking socket.
+///
+/// Sending with more set queues a small message in a reused buffer so that
+/// a burst of messages goes out in one system call; the queue is sent when
+/// a message is sent without more, when it reaches coalesceBytes, or by
+/// flush().  flush_if_due() sends a queue that has waited flushDelay.
+/// Large messages go out with their header in a single writev() without
+/// being copied.
+///
+/// Sends may be called from any thread.  Only one thread at a time may
+/// call receive(), but it may do so while others send.
+class MessageChannel {
+public:
+  /// @param [in] s Connected, blocking socket.  Not closed by the channel.
+  /// @param [in] options Batching and size limits.
+  MessageChannel(SOCKET s, const MessageChannelOptions& options = MessageChannelOptions());
+
+  /// @brief Destructor.  Sends any queued messages.
+  ~MessageChannel();
+
+  MessageChannel(const MessageChannel&) = delete;
+  MessageChannel& operator=(const MessageChannel&) = delete;
+
+  /// @brief Send a message.
+  /// @param [in] data Message contents.
+  /// @param [in] length Size of the message.
+  /// @param [in] more True if another message follows soon, so this one
+  ///         may be held to be sent with it.
+  /// @return False if the socket failed.
+  bool send(const char* data, size_t length, bool more = false);
+
+  /// @brief Send all queued messages now.
+  /// @return False if the socket failed.
+  bool flush();
+
+  /// @brief Send the queued messages if the oldest has waited flushDelay.
+  /// @return False if the socket failed.
+  bool flush_if_due();
+
+  /// @brief Receive a message.
+  /// @param [out] data Start of the message, valid until the next receive().
+  /// @param [out] length Size of the message.
+  /// @param [in] timeout Seconds to wait; negative waits forever.
+  /// @return 1 if a message was received, 0 on timeout, -1 if the socket
+  ///         failed or closed or the stream is corrupt.
+  int receive(const char*& data, size_t& length, double timeout = -1);
+
+  SOCKET socket() const { return m_socket; }
+
+private:
+  bool flush_locked();
+
+  SOCKET m_socket;
+  MessageChannelOptions m_options;
+  std::mutex m_sendMutex;                               ///< Protects the fields below
+  std::vector<char> m_out;                              ///< Queued framed messages
+  std::chrono::steady_clock::time_point m_oldest;       ///< When the first queued message was added
+  FrameReader m_reader;
+};
+
+/// @brief Sends and receives length-prefixed messages on an EventLoop.
+///
+/// The socket is made non-blocking and added to the loop, which calls
+/// onMessage for every message received, on the loop thread or its pool.
+/// send() never blocks: it queues the message, and the queue is sent when
+/// it reaches coalesceBytes or flushDelay after the first queued message,
+/// by a loop timer.  Whatever the socket will not take right away is sent
+/// when it becomes writable.
+///
+/// When the peer closes the socket or it fails, the socket is removed from
+/// the loop and onClose is called; the socket is not closed.  send() may
+/// be called from any thread, including from onMessage.
+class AsyncMessageChannel {
+public:
+  /// @brief Called with each message; data is valid only during the call.
+  typedef std::function<void(const char* data, size_t length)> MessageHandler;
+  /// @brief Called once when the connection ends.
+  typedef std::function<void()> CloseHandler;
+
+  /// @param [in] loop Loop to run on; must outlive the channel.
+  /// @param [in] s Connected socket.  Not closed by the channel.
+  /// @param [in] onMessage Called with each message received.
+  /// @param [in] onClose Called when the connection ends, or nullptr.
+  /// @param [in] options Batching and size limits.
+  AsyncMessageChannel(EventLoop& loop, SOCKET s, MessageHandler onMessage,
+    CloseHandler onClose = nullptr, const MessageChannelOptions& options = MessageChannelOptions());
+
+  /// @brief Destructor.  Removes the socket from the loop without sending
+  /// queued messages; call flush() first to try to send them.  A handler
+  /// already running is not interrupted.
+  ~AsyncMessageChannel();
+
+  AsyncMessageChannel(const AsyncMessageChannel&) = delete;
+  AsyncMessageChannel& operator=(const AsyncMessageChannel&) = delete;
+
+  /// @brief False if the socket could not be added to the loop.
+  bool valid() const;
+
+  /// @brief Queue a message to be sent.
+  /// @return False if the connection has ended.
+  bool send(const char* data, size_t length);
+
+  /// @brief Send as much of the queue as the socket will take now.
+  /// @return False if the connection has ended.
+  bool flush();
+
+  /// @brief Bytes queued but not yet sent.
+  size_t pending();
+
+  SOCKET socket() const;
+
+private:
+  struct State;
+  std::shared_ptr<State> m_state;
+};
+
+}  }	// End of namespace definitions.
@@ -7,6 +7,9 @@ set(cmake_common_args
     -DCMAKE_CXX_COMPILER:PATH=${CMAKE_CXX_COMPILER}
     -DCMAKE_CXX_FLAGS:STRING=${CMAKE_CXX_FLAGS}
     -DBUILD_TESTS:BOOL=${BUILD_TESTS}
+    -DBUILD_BENCHMARKS:BOOL=${BUILD_BENCHMARKS}
+    -DUSE_METRICS:BOOL=${USE_METRICS}
+    -DUSE_BLAS:BOOL=${USE_BLAS}
     -DUSE_DOXYGEN:BOOL=${USE_DOXYGEN}
     -DBUILD_STATIC_LIB:BOOL=${BUILD_STATIC_LIB}
     -DBUILD_DEB_PACKAGE:BOOL=${BUILD_DEB_PACKAGE}
@@ -47,10 +47,23 @@ bool MultiThread::Start()
         return false;
     }
 
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_notified = false;
+    }
+
+    m_placement = plan_thread_placement(m_threadOptions, m_numThreads);
+
     std::promise<void> p;
     auto f = std::make_shared<std::shared_future<void>>(p.get_future().share());
     for(unsigned i = 0; i < m_numThreads; i++) {
-        m_threads.emplace_back([this, f] {f->get(); Execute();});
+        ThreadOptions options = m_threadOptions;
+        ThreadPlacement placement = m_placement[i];
+        m_threads.emplace_back([this, f, i, options, placement] {
+            f->get();
+            apply_thread_options(options, placement, i);
+            Execute();
+        });
         m_idMap.emplace(m_threads.crbegin()->get_id(), i);
     }
     p.set_value();
@@ -149,6 +162,33 @@ bool MultiThread::setNumThreads(unsigned numThreads)
     return true;
 }
 
+/**
+ * @brief Sets the CPUs, NUMA placement, priority and names of the threads
+ * started by the next Start call.  Running threads are not changed.
+ *
+ * @param options the options
+ */
+void MultiThread::setThreadOptions(const ThreadOptions& options)
+{
+    m_threadOptions = options;
+}
+
+/**
+ * @brief Returns the options set by setThreadOptions
+ */
+ThreadOptions MultiThread::getThreadOptions()
+{
+    return m_threadOptions;
+}
+
+/**
+ * @brief Returns the number of threads started by the next (or current) Start call
+ */
+unsigned MultiThread::getNumThreads()
+{
+    return m_numThreads;
+}
+
 /**
  * @brief Returns a thread ID for this thread.  Will be an int between 0 and n-1,
  * where n is the number of threads
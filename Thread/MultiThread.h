@@ -10,6 +10,7 @@
 #pragma once
 
 #include "Thread.h"
+#include "ThreadOptions.h"
 #include <vector>
 #include <map>
 
@@ -22,9 +23,12 @@ public:
     MultiThread(int numThreads=2): m_numThreads(numThreads) {}
     virtual ~MultiThread();
     virtual bool setNumThreads(unsigned);
+    virtual unsigned getNumThreads();
     virtual bool Start();
     virtual bool Join();
     virtual bool Detach();
+    virtual void setThreadOptions(const ThreadOptions& options);
+    virtual ThreadOptions getThreadOptions();
 
 protected:
     virtual int getMyId();
@@ -33,5 +37,7 @@ protected:
     std::vector<std::thread>    m_threads;      //<! Running threads
     std::map<std::thread::id,int>  m_idMap;     //<! map of Ids
     std::mutex                  m_threadMutex;  //<! mutex for joining threads
+    ThreadOptions               m_threadOptions; //<! Placement, priority and names for the next Start
+    std::vector<ThreadPlacement> m_placement;   //<! Placement of each running thread
 };
 }
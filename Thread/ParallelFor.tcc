@@ -0,0 +1,150 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file ParallelFor.tcc
+ **/
+
+#pragma once
+
+#include <iterator>
+#include <memory>
+#include <vector>
+#include "TaskGroup.h"
+#include "ThreadPool.h"
+
+#define PARALLEL_CHUNKS_PER_THREAD 4    //!< Chunks per thread when the grain is automatic
+
+namespace acl
+{
+
+/**
+ * @brief Returns the grain size to use for n iterations.  A grain of 0 splits
+ *      the range into a few chunks per pool thread.
+ */
+template<typename Index> Index parallel_grain(ThreadPool& pool, Index n, Index grain)
+{
+    if (grain > 0) {
+        return grain;
+    }
+
+    unsigned threads = pool.getNumThreads() ? pool.getNumThreads() : 1;
+    Index chunks = static_cast<Index>(threads * PARALLEL_CHUNKS_PER_THREAD);
+    grain = n / chunks;
+    return grain > 0 ? grain : 1;
+}
+
+/**
+ * @brief Calls fn(i) for every i in [begin, end), split into chunks of grain
+ *      iterations that run on the pool.  Returns when every call has finished;
+ *      the calling thread runs chunks too.
+ *
+ * Each call waits only for its own chunks, so unrelated loops can share one
+ * pool.  The first exception thrown by fn is rethrown once all chunks finish.
+ *
+ * @param pool The pool to run on
+ * @param begin First index
+ * @param end One past the last index
+ * @param grain Iterations per chunk, or 0 to choose automatically
+ * @param fn Called with each index
+ */
+template<typename Index, typename Fn>
+void parallel_for(ThreadPool& pool, Index begin, Index end, Index grain, Fn fn)
+{
+    if (end <= begin) {
+        return;
+    }
+
+    Index n = end - begin;
+    grain = parallel_grain(pool, n, grain);
+
+    TaskGroup group(pool);
+    for (Index chunk = begin; chunk < end; ) {
+        Index chunkEnd = (end - chunk > grain) ? chunk + grain : end;
+        group.run([chunk, chunkEnd, &fn]() {
+            for (Index i = chunk; i < chunkEnd; ++i) {
+                fn(i);
+            }
+        });
+        chunk = chunkEnd;
+    }
+    group.wait();
+}
+
+/**
+ * @brief Maps every index in [begin, end) to a value and combines the values.
+ *
+ * Each chunk folds its values, starting from identity, with reduce; the chunk
+ * results are then folded in index order, so the result is deterministic for
+ * a given grain even if reduce is not commutative.
+ *
+ * @param pool The pool to run on
+ * @param begin First index
+ * @param end One past the last index
+ * @param grain Iterations per chunk, or 0 to choose automatically
+ * @param identity The identity value of reduce
+ * @param map Called with each index, returns a T
+ * @param reduce Combines two T values
+ * @return The combined value, or identity for an empty range
+ */
+template<typename Index, typename T, typename Map, typename Reduce>
+T parallel_reduce(ThreadPool& pool, Index begin, Index end, Index grain, T identity, Map map, Reduce reduce)
+{
+    if (end <= begin) {
+        return identity;
+    }
+
+    Index n = end - begin;
+    grain = parallel_grain(pool, n, grain);
+    size_t chunks = static_cast<size_t>((n + grain - 1) / grain);
+    std::vector<T> partials(chunks, identity);
+
+    TaskGroup group(pool);
+    size_t c = 0;
+    for (Index chunk = begin; chunk < end; ++c) {
+        Index chunkEnd = (end - chunk > grain) ? chunk + grain : end;
+        T* partial = &partials[c];
+        group.run([chunk, chunkEnd, partial, &map, &reduce]() {
+            T value = *partial;
+            for (Index i = chunk; i < chunkEnd; ++i) {
+                value = reduce(value, map(i));
+            }
+            *partial = value;
+        });
+        chunk = chunkEnd;
+    }
+    group.wait();
+
+    T result = identity;
+    for (auto& partial : partials) {
+        result = reduce(result, partial);
+    }
+    return result;
+}
+
+/**
+ * @brief Writes fn(*(first + i)) to *(out + i) for every element of [first, last).
+ *
+ * @param pool The pool to run on
+ * @param first Start of the input (random access)
+ * @param last End of the input
+ * @param out Start of the output (random access, at least as long as the input)
+ * @param grain Elements per chunk, or 0 to choose automatically
+ * @param fn Called with each input element, returns the output element
+ * @return An iterator one past the last element written
+ */
+template<typename InputIt, typename OutputIt, typename Fn>
+OutputIt parallel_transform(ThreadPool& pool, InputIt first, InputIt last, OutputIt out,
+        typename std::iterator_traits<InputIt>::difference_type grain, Fn fn)
+{
+    typedef typename std::iterator_traits<InputIt>::difference_type Index;
+
+    Index n = last - first;
+    parallel_for(pool, Index(0), n, grain, [first, out, &fn](Index i) {
+        *(out + i) = fn(*(first + i));
+    });
+    return out + n;
+}
+}
@@ -0,0 +1,101 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file TaskGroup.cpp
+ **/
+
+#include "TaskGroup.h"
+
+namespace acl
+{
+
+/**
+ * \brief Constructor
+ *
+ * \param [in] pool the pool to run jobs on.  Must outlive the group.
+ **/
+TaskGroup::TaskGroup(ThreadPool& pool): m_pool(pool), m_pending(0) {}
+
+/**
+ * \brief Destructor.  Waits for outstanding jobs, which reference the group.
+ **/
+TaskGroup::~TaskGroup()
+{
+    try {
+        wait();
+    } catch (...) {
+        // Errors are only reported by an explicit wait()
+    }
+}
+
+/**
+ * \brief Queues a job on the pool as part of this group.  If the pool will
+ *        not take the job, it runs on the calling thread.
+ *
+ * \param [in] f the job
+ **/
+void TaskGroup::run(std::function<void()> f)
+{
+    m_pending++;
+
+    auto job = [this, f]() {
+        try {
+            f();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_error) {
+                m_error = std::current_exception();
+            }
+        }
+        finish();
+    };
+
+    if (!m_pool.push_job(job)) {
+        job();
+    }
+}
+
+/**
+ * \brief Marks one job finished, waking waiters on the last one
+ **/
+void TaskGroup::finish()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_pending == 0) {
+        m_doneCv.notify_all();
+    }
+}
+
+/**
+ * \brief Waits for every job run so far, helping with queued pool jobs
+ *        meanwhile.  Rethrows the first exception thrown by a job.
+ **/
+void TaskGroup::wait()
+{
+    while (m_pending > 0) {
+        if (!m_pool.try_run_job()) {
+            // Nothing is queued, so this group's remaining jobs are running
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_doneCv.wait(lock, [this] {return m_pending == 0;});
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_error) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * \brief Returns the number of jobs not yet finished
+ **/
+size_t TaskGroup::pending()
+{
+    return m_pending;
+}
+}
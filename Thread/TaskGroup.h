@@ -0,0 +1,52 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file TaskGroup.h
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include "ThreadPool.h"
+
+namespace acl
+{
+
+/**
+ * @class TaskGroup
+ *
+ * @brief Tracks the completion of a batch of jobs run on a ThreadPool.
+ *
+ * Unlike ThreadPool::wait_until_empty(), wait() returns as soon as this
+ * group's jobs are done, regardless of other work sharing the pool.  While
+ * waiting, the caller runs queued pool jobs itself, so waiting from inside a
+ * pool job does not tie up a worker.  A helped job may belong to another
+ * batch, so wait() can take as long as the longest job it picks up.
+ */
+class TaskGroup
+{
+public:
+    TaskGroup(ThreadPool& pool);
+    virtual ~TaskGroup();
+
+    virtual void run(std::function<void()> f);
+    virtual void wait();
+    virtual size_t pending();
+
+protected:
+    void finish();
+
+    ThreadPool&             m_pool;         //!< Pool the jobs run on
+    std::atomic_size_t      m_pending;      //!< Jobs not yet finished
+    std::mutex              m_mutex;        //!< Mutex for m_doneCv and m_error
+    std::condition_variable m_doneCv;       //!< Signalled when m_pending reaches 0
+    std::exception_ptr      m_error;        //!< First exception thrown by a job
+};
+}
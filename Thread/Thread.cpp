@@ -22,7 +22,7 @@ std::ofstream threadTest;
 namespace acl
 {
 
-Thread::Thread() : m_running(false) {}
+Thread::Thread() : m_running(false), m_notified(false) {}
 
 /**
  * \brief  Destructor
@@ -55,6 +55,10 @@ bool Thread::Start()
     if(m_threadObj.joinable()) {
         Join();
     }
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_notified = false;
+    }
     m_threadObj = std::thread([this] {Execute();});
     return true;
 }
@@ -76,13 +80,13 @@ void Thread::Execute()
  * \brief Main execution loop for the thread
  *
  * This function is the main processing loop. It needs to be overwritten for
- * each class instantiation. In the base class, it sleep for 1000uSecs
+ * each class instantiation. In the base class, it sleeps until Stop() or notify()
  **/
 void Thread::mainLoop(void)
 {
     threadTest << std::this_thread::get_id() <<": Thread mainLoop"<<std::endl;
     std::cerr << "WARNING: thread mainLoop method not overridden" << std::endl;
-	std::this_thread::sleep_for(std::chrono::seconds(1));
+    sleep();
 }
 
 /**
@@ -139,11 +143,53 @@ bool Thread::Join()
 }
 
 /**
- * \brief forces the thread to stop running
+ * \brief forces the thread to stop running.  Threads blocked in sleep() wake
+ *        up immediately.
  **/
 void Thread::Stop()
 {
-    m_running = false;
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_running = false;
+    }
+    m_stopCv.notify_all();
+}
+
+/**
+ * \brief Sleeps until Stop() or notify() is called, or the timeout expires.
+ *
+ * Use this instead of std::this_thread::sleep_for in mainLoop so that
+ * stopping the thread takes effect immediately.
+ *
+ * \param [in] seconds the longest time to sleep.  Negative sleeps until woken.
+ * \return true if the thread is still running
+ **/
+bool Thread::sleep(double seconds)
+{
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+    auto woken = [this] {return !m_running || m_notified;};
+
+    if (seconds < 0) {
+        m_stopCv.wait(lock, woken);
+    } else {
+        m_stopCv.wait_for(lock, std::chrono::duration<double>(seconds), woken);
+    }
+
+    m_notified = false;
+    return m_running;
+}
+
+/**
+ * \brief Wakes a thread blocked in sleep() without stopping it.  If no thread
+ *        is sleeping, the next call to sleep() returns immediately.
+ **/
+void Thread::notify()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_notified = true;
+    }
+    m_stopCv.notify_all();
 }
 
 /**
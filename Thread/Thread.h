@@ -11,6 +11,7 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
 
 namespace acl
 {
@@ -25,6 +26,9 @@ class Thread
 protected:
     std::thread         m_threadObj;    //!< Thread variable
     std::atomic_bool    m_running;      //!< Flag to stop running by a shared pointer
+    std::mutex          m_stopMutex;    //!< Mutex for m_stopCv
+    std::condition_variable m_stopCv;   //!< Signalled by Stop() and notify()
+    bool                m_notified;     //!< Set by notify(), cleared by sleep()
 
     virtual void  Execute(void);
     virtual void  mainLoop(void);
@@ -38,5 +42,7 @@ public:
     virtual bool  Join(void);
     virtual bool  Detach(void);
     virtual bool  isRunning(void);
+    virtual bool  sleep(double seconds = -1);
+    virtual void  notify(void);
 };
 }
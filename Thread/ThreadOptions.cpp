@@ -0,0 +1,427 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file ThreadOptions.cpp
+ **/
+
+#include "ThreadOptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
+
+namespace acl
+{
+
+namespace
+{
+#ifdef __linux__
+/**
+ * \brief Parses a kernel CPU list such as "0-3,8-11"
+ **/
+std::vector<int> parse_cpu_list(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        int first, last;
+        int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (n == 1) {
+            last = first;
+        } else if (n != 2) {
+            continue;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * \brief Reads the first line of a file
+ *
+ * \return false if the file could not be read
+ **/
+bool read_line(const std::string& path, std::string& line)
+{
+    std::ifstream in(path);
+    return in && std::getline(in, line);
+}
+
+/**
+ * \brief Returns the CPU bandwidth limit of the process's cgroup in CPUs,
+ *        or 0 if there is none.  Looks at the cgroup mounted at
+ *        /sys/fs/cgroup, which inside a container is the container's own.
+ **/
+double cgroup_cpu_limit()
+{
+    std::string line;
+    // cgroup v2: "<quota> <period>" or "max <period>"
+    if (read_line("/sys/fs/cgroup/cpu.max", line)) {
+        double quota, period;
+        if (sscanf(line.c_str(), "%lf %lf", &quota, &period) == 2 && quota > 0 && period > 0) {
+            return quota / period;
+        }
+        return 0;
+    }
+    // cgroup v1: quota is -1 when unlimited
+    const char* dirs[] = { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct" };
+    for (const char* dir : dirs) {
+        std::string quota, period;
+        if (read_line(std::string(dir) + "/cpu.cfs_quota_us", quota) &&
+                read_line(std::string(dir) + "/cpu.cfs_period_us", period)) {
+            double q = atof(quota.c_str());
+            double p = atof(period.c_str());
+            return (q > 0 && p > 0) ? q / p : 0;
+        }
+    }
+    return 0;
+}
+#endif
+
+/**
+ * \brief Returns the CPUs this process is allowed to run on
+ **/
+std::vector<int> allowed_cpus()
+{
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        unsigned count = std::thread::hardware_concurrency();
+        for (unsigned cpu = 0; cpu < (count ? count : 1); cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+}
+
+/**
+ * \brief Returns how many threads can usefully run at once
+ *
+ * The smallest of std::thread::hardware_concurrency(), the number of CPUs
+ * in the process's affinity mask and, on Linux, the cgroup CPU quota
+ * rounded up, so that a container limited to two CPUs on a 64-core host
+ * gets two threads rather than 64.
+ *
+ * \return The count, at least 1
+ **/
+unsigned available_concurrency()
+{
+    unsigned count = std::thread::hardware_concurrency();
+#ifdef __linux__
+    unsigned allowed = static_cast<unsigned>(allowed_cpus().size());
+    if (allowed && (!count || allowed < count)) {
+        count = allowed;
+    }
+    double limit = cgroup_cpu_limit();
+    if (limit > 0) {
+        unsigned quota = static_cast<unsigned>(std::ceil(limit));
+        if (!count || quota < count) {
+            count = quota;
+        }
+    }
+#endif
+    return count ? count : 1;
+}
+
+/**
+ * \brief Returns the CPUs of each NUMA node that this process may use
+ *
+ * Nodes without usable CPUs are left out.  Where the topology is not known
+ * (Linux without /sys/devices/system/node, and other systems) this is one
+ * node holding every CPU.
+ *
+ * \return One list of CPUs per node
+ **/
+std::vector<std::vector<int>> numa_nodes()
+{
+    std::vector<int> allowed = allowed_cpus();
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    std::vector<int> ids;
+    if (DIR* dir = opendir("/sys/devices/system/node")) {
+        while (struct dirent* entry = readdir(dir)) {
+            int id;
+            char extra;
+            if (sscanf(entry->d_name, "node%d%c", &id, &extra) == 1) {
+                ids.push_back(id);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (int id : ids) {
+        std::string list;
+        if (!read_line("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist", list)) {
+            continue;
+        }
+        std::vector<int> cpus;
+        for (int cpu : parse_cpu_list(list)) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            nodes.push_back(cpus);
+        }
+    }
+#endif
+    if (nodes.empty()) {
+        nodes.push_back(allowed);
+    }
+    return nodes;
+}
+
+/**
+ * \brief Returns the CPU the calling thread is running on
+ *
+ * \return The CPU number, or -1 if it cannot be determined
+ **/
+int current_cpu()
+{
+#if defined(__linux__)
+    return sched_getcpu();
+#elif defined(_WIN32)
+    return static_cast<int>(GetCurrentProcessorNumber());
+#else
+    return -1;
+#endif
+}
+
+/**
+ * \brief Works out the CPUs and node for each of a set of threads
+ *
+ * \param [in] options The placement options
+ * \param [in] count The number of threads
+ * \return One placement per thread
+ **/
+std::vector<ThreadPlacement> plan_thread_placement(const ThreadOptions& options, unsigned count)
+{
+    // Each group is a node index (or -1) and the CPUs its threads share
+    std::vector<ThreadPlacement> groups;
+    if (options.spreadNuma) {
+        std::vector<std::vector<int>> nodes = numa_nodes();
+        for (size_t n = 0; n < nodes.size(); n++) {
+            ThreadPlacement group;
+            group.node = static_cast<int>(n);
+            for (int cpu : nodes[n]) {
+                if (options.cpus.empty() ||
+                        std::find(options.cpus.begin(), options.cpus.end(), cpu) != options.cpus.end()) {
+                    group.cpus.push_back(cpu);
+                }
+            }
+            if (!group.cpus.empty()) {
+                groups.push_back(group);
+            }
+        }
+    }
+    if (groups.empty()) {
+        ThreadPlacement group;
+        group.cpus = (options.pinEach && options.cpus.empty()) ? allowed_cpus() : options.cpus;
+        groups.push_back(group);
+    }
+
+    std::vector<ThreadPlacement> plan(count);
+    std::vector<size_t> used(groups.size(), 0);
+    for (unsigned i = 0; i < count; i++) {
+        size_t g = i % groups.size();
+        plan[i].node = groups[g].node;
+        if (options.pinEach && !groups[g].cpus.empty()) {
+            plan[i].cpus.push_back(groups[g].cpus[used[g]++ % groups[g].cpus.size()]);
+        } else {
+            plan[i].cpus = groups[g].cpus;
+        }
+    }
+    return plan;
+}
+
+/**
+ * \brief Sets the calling thread's name, CPUs and priority
+ *
+ * \param [in] options The options to apply
+ * \param [in] placement This thread's entry from plan_thread_placement()
+ * \param [in] index This thread's number, appended to the name
+ * \return true if everything asked for was applied
+ **/
+bool apply_thread_options(const ThreadOptions& options, const ThreadPlacement& placement,
+        unsigned index)
+{
+    bool rc = true;
+    if (!options.name.empty()) {
+        rc = set_current_thread_name(options.name + "-" + std::to_string(index)) && rc;
+    }
+    if (!placement.cpus.empty()) {
+        rc = set_current_thread_affinity(placement.cpus) && rc;
+    }
+    if (options.priority != ThreadPriority::Normal) {
+        rc = set_current_thread_priority(options.priority) && rc;
+    }
+    return rc;
+}
+
+/**
+ * \brief Confines the calling thread to a set of CPUs
+ *
+ * Not supported on macOS, which has no hard affinity.
+ *
+ * \param [in] cpus The CPU numbers
+ * \return true on success
+ **/
+bool set_current_thread_affinity(const std::vector<int>& cpus)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        std::cerr << "WARNING: set_current_thread_affinity: pthread_setaffinity_np failed with error "
+                  << err << std::endl;
+        return false;
+    }
+    return true;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < static_cast<int>(sizeof(mask) * 8)) {
+            mask |= DWORD_PTR(1) << cpu;
+        }
+    }
+    if (!mask || !SetThreadAffinityMask(GetCurrentThread(), mask)) {
+        std::cerr << "WARNING: set_current_thread_affinity: SetThreadAffinityMask failed" << std::endl;
+        return false;
+    }
+    return true;
+#else
+    std::cerr << "WARNING: set_current_thread_affinity: not supported on this system" << std::endl;
+    return false;
+#endif
+}
+
+/**
+ * \brief Raises or lowers the calling thread's scheduling priority
+ *
+ * On Linux this sets the thread's nice value to 10 for Low or -10 for
+ * High; raising it needs CAP_SYS_NICE.
+ *
+ * \param [in] priority The priority
+ * \return true on success
+ **/
+bool set_current_thread_priority(ThreadPriority priority)
+{
+#if defined(__linux__)
+    int nice = priority == ThreadPriority::Low ? 10 : priority == ThreadPriority::High ? -10 : 0;
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) != 0) {
+        perror("WARNING: set_current_thread_priority: setpriority failed");
+        return false;
+    }
+    return true;
+#elif defined(_WIN32)
+    int level = priority == ThreadPriority::Low ? THREAD_PRIORITY_BELOW_NORMAL :
+                priority == ThreadPriority::High ? THREAD_PRIORITY_ABOVE_NORMAL : THREAD_PRIORITY_NORMAL;
+    if (!SetThreadPriority(GetCurrentThread(), level)) {
+        std::cerr << "WARNING: set_current_thread_priority: SetThreadPriority failed" << std::endl;
+        return false;
+    }
+    return true;
+#else
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+        int low = sched_get_priority_min(policy);
+        int high = sched_get_priority_max(policy);
+        param.sched_priority = priority == ThreadPriority::Low ? low :
+                               priority == ThreadPriority::High ? high : (low + high) / 2;
+        if (pthread_setschedparam(pthread_self(), policy, &param) == 0) {
+            return true;
+        }
+    }
+    std::cerr << "WARNING: set_current_thread_priority: pthread_setschedparam failed" << std::endl;
+    return false;
+#endif
+}
+
+/**
+ * \brief Names the calling thread for debuggers and profilers
+ *
+ * Linux keeps only the first 15 characters.
+ *
+ * \param [in] name The name
+ * \return true on success
+ **/
+bool set_current_thread_name(const std::string& name)
+{
+#if defined(__linux__)
+    return pthread_setname_np(pthread_self(), name.substr(0, 15).c_str()) == 0;
+#elif defined(__APPLE__)
+    return pthread_setname_np(name.c_str()) == 0;
+#elif defined(_WIN32)
+    // SetThreadDescription() is only in Windows 10 1607 and later
+    typedef HRESULT (WINAPI *SetThreadDescriptionFn)(HANDLE, PCWSTR);
+    SetThreadDescriptionFn fn = reinterpret_cast<SetThreadDescriptionFn>(
+        GetProcAddress(GetModuleHandleA("kernel32.dll"), "SetThreadDescription"));
+    if (!fn) {
+        return false;
+    }
+    std::wstring wide(name.begin(), name.end());
+    return SUCCEEDED(fn(GetCurrentThread(), wide.c_str()));
+#else
+    return false;
+#endif
+}
+
+/**
+ * \brief Returns the calling thread's name, or an empty string if it has
+ *        none or it cannot be read
+ **/
+std::string get_current_thread_name()
+{
+#if defined(__linux__) || defined(__APPLE__)
+    char name[64] = "";
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0) {
+        return name;
+    }
+#endif
+    return "";
+}
+
+}
@@ -0,0 +1,65 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file ThreadOptions.h
+ **/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace acl
+{
+
+/**
+ * \brief Scheduling priority for a thread, relative to normal threads
+ **/
+enum class ThreadPriority {
+    Normal,                         //!< Leave the priority alone
+    Low,                            //!< Background work
+    High                            //!< Latency-sensitive work; may need privileges
+};
+
+/**
+ * \brief Where and how the threads of a MultiThread run
+ *
+ * Applied by each thread to itself as it starts, so they take effect at
+ * the next Start().  Failing to apply one prints a warning and the thread
+ * runs anyway.
+ **/
+class ThreadOptions
+{
+public:
+    std::vector<int> cpus;          //!< CPUs the threads may run on; empty for any
+    bool pinEach = false;           //!< Pin each thread to a single one of its CPUs, round robin
+    bool spreadNuma = false;        //!< Deal threads round robin to NUMA nodes and keep each on its node's CPUs
+    ThreadPriority priority = ThreadPriority::Normal;
+    std::string name;               //!< Thread i is named "name-i" for debuggers and profilers; empty for no name
+};
+
+/**
+ * \brief The CPUs and NUMA node that one thread is assigned
+ **/
+struct ThreadPlacement {
+    int node = -1;                  //!< Index into numa_nodes(), or -1 if not placed by node
+    std::vector<int> cpus;          //!< CPUs to confine the thread to; empty for any
+};
+
+unsigned    available_concurrency();
+std::vector<std::vector<int>> numa_nodes();
+int         current_cpu();
+
+std::vector<ThreadPlacement> plan_thread_placement(const ThreadOptions& options, unsigned count);
+bool        apply_thread_options(const ThreadOptions& options, const ThreadPlacement& placement,
+                unsigned index);
+
+bool        set_current_thread_affinity(const std::vector<int>& cpus);
+bool        set_current_thread_priority(ThreadPriority priority);
+bool        set_current_thread_name(const std::string& name);
+std::string get_current_thread_name();
+
+}
@@ -9,51 +9,652 @@
 
 #include "ThreadPool.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "Metrics.hpp"
+
 namespace acl
 {
 
+namespace
+{
+thread_local ThreadPool* t_pool = nullptr;  //!< Pool the current thread works for
+thread_local int t_index = -1;              //!< Worker index within t_pool
+
+#ifdef ACL_ENABLE_METRICS
+/**
+* \brief wraps a job to record how long it waited in the pool and how long it ran
+**/
+struct MeasuredJob {
+    std::function<void()> f;
+    uint64_t queued;
+
+    void operator()()
+    {
+        ACL_METRIC_RECORD_SINCE("ThreadPool.queue_ns", queued);
+        ACL_METRIC_SCOPED_TIMER("ThreadPool.run_ns");
+        f();
+    }
+};
+#endif
+}
+
 /**
 * \brief initializes the thread pool
 *
-* \param [in] numThreads the number of threads
+* \param [in] numThreads the number of threads, or 0 for available_concurrency()
 * \param [in] maxJobLength the maximum number of jobs that can be submitted
-* \param [in] timeout the time a thread should process before moving on
+* \param [in] timeout unused; see setTimeout()
 **/
-ThreadPool::ThreadPool(int numThreads, int maxJobLength, double timeout): MultiThread(numThreads), TSQueue<std::function<void()>>()
+ThreadPool::ThreadPool(int numThreads, int maxJobLength, double timeout):
+    MultiThread(numThreads > 0 ? numThreads : static_cast<int>(available_concurrency())),
+    m_queued(0), m_dropped(0), m_dropExpired(false), m_maxSize(maxJobLength), m_nextWorker(0),
+    m_idle(0), m_blocked(0), m_emptyWaiters(0), m_blocking(false)
 {
-    set_max_size(maxJobLength);
+    for (auto& queued : m_queuedByPriority) {
+        queued = 0;
+    }
+    m_aging = 1.0;
     m_timeout = timeout;
+    resize_workers(m_numThreads);
+}
+
+/**
+* \brief stops the workers and waits for them before the queues are destroyed
+**/
+ThreadPool::~ThreadPool()
+{
+    Stop();
+    Join();
+}
+
+/**
+* \brief starts the worker threads, first giving each its own deque.  A
+*        thread count of 0 from setNumThreads() means available_concurrency().
+*
+* \return true if the threads were started
+**/
+bool ThreadPool::Start()
+{
+    if (!isRunning()) {
+        if (!m_numThreads) {
+            m_numThreads = available_concurrency();
+        }
+        resize_workers(m_numThreads);
+        place_workers();
+    }
+    return MultiThread::Start();
+}
+
+/**
+* \brief stops the workers and wakes any thread sleeping on the pool
+**/
+void ThreadPool::Stop()
+{
+    MultiThread::Stop();
+
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    m_workCv.notify_all();
+    m_spaceCv.notify_all();
 }
 
 /**
-* \brief adds jobs to the pool
+* \brief changes the number of deques, redistributing queued jobs.  Only
+*        called while the workers are stopped.
+*
+* \param [in] count the number of deques
+**/
+void ThreadPool::resize_workers(size_t count)
+{
+    if (count == m_workers.size()) {
+        return;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < count; i++) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+
+    for (int p = 0; p < NUM_PRIORITIES; p++) {
+        std::deque<Job> pending;
+        for (auto& worker : m_workers) {
+            std::lock_guard<std::mutex> lock(worker->m);
+            for (auto& job : worker->jobs[p]) {
+                job.local = false;
+                pending.push_back(std::move(job));
+            }
+        }
+        for (size_t i = 0; i < pending.size(); i++) {
+            workers[i % count]->jobs[p].push_back(std::move(pending[i]));
+        }
+    }
+    m_workers.swap(workers);
+}
+
+/**
+* \brief records which NUMA node each worker will run on, if the thread
+*        options spread them.  Only called while the workers are stopped.
+**/
+void ThreadPool::place_workers()
+{
+    m_workerNode.clear();
+    m_nodeWorkers.clear();
+    m_cpuNode.clear();
+    if (!m_threadOptions.spreadNuma) {
+        return;
+    }
+
+    std::vector<ThreadPlacement> plan = plan_thread_placement(m_threadOptions,
+            static_cast<unsigned>(m_workers.size()));
+    std::vector<std::vector<int>> nodes = numa_nodes();
+    if (plan.empty() || plan[0].node < 0) {
+        return;
+    }
+
+    m_nodeWorkers.resize(nodes.size());
+    for (size_t i = 0; i < plan.size(); i++) {
+        m_workerNode.push_back(plan[i].node);
+        m_nodeWorkers[plan[i].node].push_back(i);
+    }
+    for (size_t n = 0; n < nodes.size(); n++) {
+        for (int cpu : nodes[n]) {
+            if (cpu >= static_cast<int>(m_cpuNode.size())) {
+                m_cpuNode.resize(cpu + 1, -1);
+            }
+            m_cpuNode[cpu] = static_cast<int>(n);
+        }
+    }
+}
+
+/**
+* \brief returns the NUMA node of a worker, or for -1 of the CPU the calling
+*        thread is on.  Returns -1 if workers are not spread across nodes.
+**/
+int ThreadPool::caller_node(int index)
+{
+    if (m_workerNode.empty()) {
+        return -1;
+    }
+    if (index >= 0) {
+        return m_workerNode[index];
+    }
+    int cpu = current_cpu();
+    return (cpu >= 0 && cpu < static_cast<int>(m_cpuNode.size())) ? m_cpuNode[cpu] : -1;
+}
+
+/**
+* \brief picks the deque for a job pushed from outside the pool: round
+*        robin over the workers on the caller's node, or over all of them
+**/
+size_t ThreadPool::external_worker()
+{
+    int node = caller_node(-1);
+    if (node >= 0 && !m_nodeWorkers[node].empty()) {
+        const std::vector<size_t>& local = m_nodeWorkers[node];
+        return local[m_nextWorker++ % local.size()];
+    }
+    return m_nextWorker++ % m_workers.size();
+}
+
+/**
+* \brief returns this thread's worker index, or -1 if it is not one of this pool's workers
+**/
+int ThreadPool::my_index()
+{
+    return t_pool == this ? t_index : -1;
+}
+
+/**
+* \brief claims room for one job if the pool is not full
+*
+* \return true if room was claimed
+**/
+bool ThreadPool::reserve_slot()
+{
+    size_t queued = m_queued.load();
+    while (queued < m_maxSize.load()) {
+        if (m_queued.compare_exchange_weak(queued, queued + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* \brief gives back the room of a job that has been taken from a deque
+**/
+void ThreadPool::release_slot()
+{
+    size_t left = --m_queued;
+
+    if (m_blocked > 0) {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_spaceCv.notify_one();
+    }
+    if (!left && m_emptyWaiters > 0) {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_emptyCv.notify_all();
+    }
+}
+
+/**
+* \brief adds a job to the pool at Normal priority
 *
 * \param [in] f the job to be added
-* \return true if the job has been successfully enqueued
+* \return true if the job has been successfully enqueued (or, for a worker
+*         of a full blocking pool, run)
 **/
 bool ThreadPool::push_job(std::function<void()> f)
 {
-    return enqueue(f);
+    return push_job(std::move(f), Priority::Normal, Clock::time_point::max());
 }
 
 /**
-* \brief main function to loop through the queue and run jobs
+* \brief adds a job to the pool with a priority and no deadline
+*
+* \param [in] f the job to be added
+* \param [in] priority the class to queue the job in
+* \return true if the job has been successfully enqueued (or, for a worker
+*         of a full blocking pool, run)
 **/
-void ThreadPool::mainLoop()
+bool ThreadPool::push_job(std::function<void()> f, Priority priority)
+{
+    return push_job(std::move(f), priority, Clock::time_point::max());
+}
+
+/**
+* \brief adds a job to the pool with a priority and a deadline
+*
+* \param [in] f the job to be added
+* \param [in] priority the class to queue the job in
+* \param [in] deadline the time after which the job is no longer worth
+*        running.  It is only acted on with setDropExpired(true); jobs are
+*        not reordered by deadline within their class.
+* \return true if the job has been successfully enqueued (or, for a worker
+*         of a full blocking pool, run)
+**/
+bool ThreadPool::push_job(std::function<void()> f, Priority priority, Clock::time_point deadline)
+{
+    if (!f) {
+        return true;
+    }
+
+    int index = my_index();
+    if (!reserve_slot()) {
+        if (!m_blocking) {
+            ACL_METRIC_COUNT("ThreadPool.rejected", 1);
+            return false;
+        }
+
+        // Waiting on our own pool could deadlock it
+        if (index >= 0) {
+            f();
+            return true;
+        }
+
+        bool reserved = false;
+        std::unique_lock<std::mutex> lock(m_poolMutex);
+        m_blocked++;
+        m_spaceCv.wait(lock, [this, &reserved] {
+            return (reserved = reserve_slot()) || !isRunning();
+        });
+        m_blocked--;
+        if (!reserved) {
+            ACL_METRIC_COUNT("ThreadPool.rejected", 1);
+            return false;
+        }
+    }
+
+#ifdef ACL_ENABLE_METRICS
+    MeasuredJob measured = { std::move(f), getFastNsec() };
+    f = std::move(measured);
+#endif
+
+    int p = static_cast<int>(priority);
+    Job job = { std::move(f), Clock::now(), deadline, index >= 0 };
+    Worker& worker = index >= 0 ? *m_workers[index] : *m_workers[external_worker()];
+    {
+        std::lock_guard<std::mutex> lock(worker.m);
+        worker.jobs[p].push_back(std::move(job));
+        m_queuedByPriority[p]++;
+    }
+
+    if (m_idle > 0) {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_workCv.notify_one();
+    }
+    return true;
+}
+
+/**
+* \brief returns the most urgent class with a job queued anywhere in the
+*        pool, or the least urgent class if nothing is queued
+**/
+int ThreadPool::top_priority()
+{
+    for (int p = 0; p < NUM_PRIORITIES - 1; p++) {
+        if (m_queuedByPriority[p] > 0) {
+            return p;
+        }
+    }
+    return NUM_PRIORITIES - 1;
+}
+
+/**
+* \brief takes the most urgent job from a worker's deques, discarding
+*        expired ones on the way if setDropExpired(true) was called
+*
+* A class's urgency is its priority raised by one for each aging interval
+* its oldest job has waited; ties go to the class whose oldest job has
+* waited longest.  A class that won by aging gives up its oldest job so
+* that the waiting job is the one served.
+*
+* \param [in] worker the worker whose deques to take from
+* \param [in] maxPriority the least urgent class to take from
+* \param [in] newest true to take the newest job of the class if the worker
+*        pushed it itself, false the oldest
+* \param [out] f the job
+* \return true if a job was taken
+**/
+bool ThreadPool::take(Worker& worker, int maxPriority, bool newest, std::function<void()>& f)
+{
+    std::vector<Job> expired;
+    bool found = false;
+    double aging = m_aging;
+    bool dropExpired = m_dropExpired;
+    Clock::time_point now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(worker.m);
+        while (!found) {
+            int best = -1;
+            int bestUrgency = NUM_PRIORITIES;
+            for (int p = 0; p < NUM_PRIORITIES; p++) {
+                if (worker.jobs[p].empty()) {
+                    continue;
+                }
+                const Job& oldest = worker.jobs[p].front();
+                int urgency = p;
+                if (aging > 0) {
+                    double waited = std::chrono::duration<double>(now - oldest.queued).count();
+                    urgency = std::max(0, p - static_cast<int>(std::floor(waited / aging)));
+                }
+                if (urgency > maxPriority) {
+                    continue;
+                }
+                if (urgency < bestUrgency ||
+                        (urgency == bestUrgency && oldest.queued < worker.jobs[best].front().queued)) {
+                    best = p;
+                    bestUrgency = urgency;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+
+            // Only jobs the owner pushed itself are run newest first; jobs
+            // from outside the pool keep the order they were submitted in.
+            std::deque<Job>& jobs = worker.jobs[best];
+            bool back = newest && bestUrgency == best && jobs.back().local;
+            Job job = std::move(back ? jobs.back() : jobs.front());
+            if (back) {
+                jobs.pop_back();
+            } else {
+                jobs.pop_front();
+            }
+            m_queuedByPriority[best]--;
+
+            if (dropExpired && job.deadline < now) {
+                expired.push_back(std::move(job));
+            } else {
+                f = std::move(job.f);
+                found = true;
+            }
+        }
+    }
+
+    // Expired jobs are destroyed outside the lock in case their captures are costly
+    m_dropped += expired.size();
+    for (size_t i = 0; i < expired.size(); i++) {
+        release_slot();
+    }
+    if (found) {
+        release_slot();
+    }
+    return found;
+}
+
+/**
+* \brief takes a job from a worker's own deques: the newest it pushed itself,
+*        otherwise the oldest within a class
+**/
+bool ThreadPool::pop_local(size_t index, int maxPriority, std::function<void()>& f)
+{
+    return take(*m_workers[index], maxPriority, true, f);
+}
+
+/**
+* \brief takes a job from another worker's deques, oldest first within a
+*        class, trying workers on the thief's NUMA node first
+*
+* \param [in] index the stealing worker, or -1 for a thread outside the pool
+**/
+bool ThreadPool::steal(size_t index, int maxPriority, std::function<void()>& f)
+{
+    size_t count = m_workers.size();
+    size_t start = index < count ? index + 1 : 0;
+    int node = caller_node(index < count ? static_cast<int>(index) : -1);
+
+    for (size_t i = 0; i < (node >= 0 ? 2 * count : count); i++) {
+        size_t victim = (start + i) % count;
+        if (victim == index) {
+            continue;
+        }
+        // With a node, the first round is that node's workers and the second the rest
+        if (node >= 0 && (m_workerNode[victim] == node) != (i < count)) {
+            continue;
+        }
+        if (take(*m_workers[victim], maxPriority, false, f)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* \brief runs one queued job on the calling thread, if there is one.  Lets a
+*        thread waiting on pool work help instead of sleeping.
+*
+* \return true if a job was run
+**/
+bool ThreadPool::try_run_job()
 {
+    int index = my_index();
     std::function<void()> f;
-    if (dequeue(f, m_timeout) && f) {
-        f();
+
+    // First look only for the most urgent class queued anywhere, so that a
+    // worker with Low jobs of its own still picks up a High job elsewhere
+    int top = top_priority();
+    for (int maxPriority = top; ; maxPriority = NUM_PRIORITIES - 1) {
+        if ((index >= 0 && pop_local(index, maxPriority, f)) || steal(index, maxPriority, f)) {
+            f();
+            return true;
+        }
+        if (maxPriority == NUM_PRIORITIES - 1) {
+            break;
+        }
+    }
+    return false;
+}
+
+/**
+* \brief sleeps until a job is queued or the pool stops
+**/
+void ThreadPool::wait_for_work()
+{
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+    m_idle++;
+    m_workCv.wait(lock, [this] {return m_queued > 0 || !isRunning();});
+    m_idle--;
+}
+
+/**
+* \brief records the worker index of this thread, then runs the main loop
+**/
+void ThreadPool::Execute()
+{
+    t_pool = this;
+    t_index = getMyId();
+    MultiThread::Execute();
+    t_pool = nullptr;
+    t_index = -1;
+}
+
+/**
+* \brief main function to run a job from this worker's deque or another one's
+**/
+void ThreadPool::mainLoop()
+{
+    if (!try_run_job()) {
+        wait_for_work();
     }
 }
 
 /**
 * \brief sets the timeout value
 *
-* \param [in] timeout the timeout value to be set
+* \deprecated Idle workers now sleep until a job is queued or the pool is
+*        stopped, so the timeout has no effect.
+*
+* \param [in] timeout ignored
 **/
 void ThreadPool::setTimeout(double timeout)
 {
     m_timeout = timeout;
 }
+
+/**
+* \brief sets whether push_job waits for room when the pool is full
+*
+* \param [in] block true to wait, false to reject the job
+**/
+void ThreadPool::setBlocking(bool block)
+{
+    m_blocking = block;
+    if (!block) {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_spaceCv.notify_all();
+    }
+}
+
+/**
+* \brief sets how long a job waits before it counts as one class more urgent
+*
+* \param [in] seconds the aging interval, or 0 to serve classes strictly in order
+**/
+void ThreadPool::setAgingInterval(double seconds)
+{
+    m_aging = seconds;
+}
+
+/**
+* \brief sets whether jobs whose deadline has passed are discarded instead of run
+*
+* \param [in] drop true to discard expired jobs when a worker reaches them
+**/
+void ThreadPool::setDropExpired(bool drop)
+{
+    m_dropExpired = drop;
+}
+
+/**
+* \brief returns the number of queued jobs
+**/
+size_t ThreadPool::size()
+{
+    return m_queued;
+}
+
+/**
+* \brief returns the number of jobs queued in one priority class
+**/
+size_t ThreadPool::size(Priority priority)
+{
+    return m_queuedByPriority[static_cast<int>(priority)];
+}
+
+/**
+* \brief returns the number of expired jobs discarded since construction
+**/
+size_t ThreadPool::dropped_count()
+{
+    return m_dropped;
+}
+
+/**
+* \brief removes all queued jobs without running them
+**/
+void ThreadPool::delete_all()
+{
+    for (auto& worker : m_workers) {
+        for (int p = 0; p < NUM_PRIORITIES; p++) {
+            std::deque<Job> jobs;
+            {
+                std::lock_guard<std::mutex> lock(worker->m);
+                jobs.swap(worker->jobs[p]);
+                m_queuedByPriority[p] -= jobs.size();
+            }
+            m_queued -= jobs.size();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    m_spaceCv.notify_all();
+    m_emptyCv.notify_all();
+}
+
+/**
+* \brief sets the maximum number of queued jobs
+**/
+void ThreadPool::set_max_size(size_t size)
+{
+    m_maxSize = size;
+
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    m_spaceCv.notify_all();
+}
+
+/**
+* \brief returns the maximum number of queued jobs
+**/
+size_t ThreadPool::get_max_size()
+{
+    return m_maxSize;
+}
+
+/**
+ * \brief Waits until no jobs are queued.  Jobs already taken by a worker
+ *        may still be running.
+ *
+ * \param [in] timeout the maximum number of milliseconds to wait.
+ *        A timeout of 0 will wait indefinitely.
+ *
+ * \return true if the queue got to 0, false if timeout occured
+ */
+bool ThreadPool::wait_until_empty(uint16_t timeout)
+{
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+    m_emptyWaiters++;
+
+    bool rc = true;
+    if (!timeout) {
+        m_emptyCv.wait(lock, [this] {return m_queued == 0;});
+    } else {
+        rc = m_emptyCv.wait_for(lock, std::chrono::milliseconds(timeout),
+                [this] {return m_queued == 0;});
+    }
+
+    m_emptyWaiters--;
+    return rc;
+}
 }
@@ -11,12 +11,18 @@
 #define THREADPOOL_H_
 
 #include "MultiThread.h"
-#include "TSQueue.tcc"
 
 #include <functional>
 #include <atomic>
-#include "ThreadPool.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <type_traits>
+#include <vector>
 #include "Timer.h"
 
 #pragma once
@@ -26,25 +32,139 @@ namespace acl
 
     /**
     * \brief class to run thread pool
+    *
+    * Each worker thread owns a job deque.  Jobs pushed from a worker go on
+    * that worker's own deque and are run newest first; jobs pushed from other
+    * threads are spread round robin and run in the order they were pushed.  A
+    * worker whose deque is empty steals the oldest job from another worker
+    * before going to sleep, so workers only contend when they are short of
+    * work.
+    *
+    * The pool holds at most get_max_size() queued jobs.  By default a push to
+    * a full pool is rejected; with setBlocking(true) the caller waits for
+    * space instead, except on the pool's own workers, which run the job
+    * themselves rather than wait on the pool they belong to.
+    *
+    * With ThreadOptions::spreadNuma set, workers are dealt out to NUMA nodes
+    * and the deques of each node's workers act as that node's queue: jobs
+    * pushed from outside go to a worker on the caller's node, and a worker
+    * steals from workers on its own node before going to another node.
+    *
+    * Jobs have a priority class.  Workers run the most urgent class that is
+    * queued anywhere in the pool, so a burst of Low jobs does not hold up
+    * High ones.  To keep lower classes from starving, a queued job counts
+    * as one class more urgent for every aging interval it has waited.  A
+    * job may also carry a deadline; with setDropExpired(true), a job whose
+    * deadline has passed when a worker reaches it is discarded unrun.
     **/
-    class ThreadPool: public MultiThread, private TSQueue<std::function<void()>>
+    class ThreadPool: public MultiThread
     {
     public:
+        /**
+        * \brief priority classes for push_job, most urgent first
+        **/
+        enum class Priority { High, Normal, Low };
+        static const int NUM_PRIORITIES = 3;
+        typedef std::chrono::steady_clock Clock;
+
         ThreadPool(int numThreads = 1, int maxJobLength = 50, double timeout = 1);
+        virtual ~ThreadPool();
 
         bool push_job(std::function<void()> f);
+        bool push_job(std::function<void()> f, Priority priority);
+        bool push_job(std::function<void()> f, Priority priority, Clock::time_point deadline);
+        template<typename F, typename... Args>
+        std::future<typename std::result_of<F(Args...)>::type> submit(F&& f, Args&&... args);
+        bool try_run_job();
         void setTimeout(double timeout);
+        void setBlocking(bool block);
+        void setAgingInterval(double seconds);
+        void setDropExpired(bool drop);
+
+        size_t size();
+        size_t size(Priority priority);
+        size_t dropped_count();
+        void delete_all();
+        void set_max_size(size_t size);
+        size_t get_max_size();
+        bool wait_until_empty(uint16_t timeout = 0);
 
-        using TSQueue<std::function<void()>>::size;
-        using TSQueue<std::function<void()>>::delete_all;
-        using TSQueue<std::function<void()>>::set_max_size;
-        using TSQueue<std::function<void()>>::get_max_size;
-        using TSQueue<std::function<void()>>::wait_until_empty;
+        virtual bool Start();
+        virtual void Stop();
 
     private:
-        std::atomic<double> m_timeout;                  //!< Timeout value of the thread pool
+        struct Job {
+            std::function<void()>   f;
+            Clock::time_point       queued;             //!< When push_job was called
+            Clock::time_point       deadline;           //!< Clock::time_point::max() for none
+            bool                    local;              //!< Pushed by the worker that owns the deque
+        };
+        struct Worker {
+            std::mutex              m;                  //!< Protects jobs
+            std::deque<Job>         jobs[NUM_PRIORITIES]; //!< One per priority; back is newest
+        };
+
+        bool reserve_slot();
+        int  top_priority();
+        bool take(Worker& worker, int maxPriority, bool newest, std::function<void()>& f);
+        void place_workers();
+        int  caller_node(int index);
+        size_t external_worker();
+        void release_slot();
+        bool pop_local(size_t index, int maxPriority, std::function<void()>& f);
+        bool steal(size_t index, int maxPriority, std::function<void()>& f);
+        void wait_for_work();
+        void resize_workers(size_t count);
+        int  my_index();
+
+        virtual void Execute();
         virtual void mainLoop();
+
+        std::vector<std::unique_ptr<Worker>> m_workers;  //!< One deque per worker thread
+        std::vector<int>        m_workerNode;           //!< NUMA node of each worker; empty if not spread
+        std::vector<std::vector<size_t>> m_nodeWorkers; //!< Workers on each NUMA node
+        std::vector<int>        m_cpuNode;              //!< NUMA node of each CPU
+        std::atomic_size_t      m_queued;               //!< Jobs waiting in any deque
+        std::atomic_size_t      m_queuedByPriority[NUM_PRIORITIES]; //!< Jobs waiting in each class
+        std::atomic_size_t      m_dropped;              //!< Expired jobs discarded
+        std::atomic<double>     m_aging;                //!< Seconds of waiting per class of promotion
+        std::atomic_bool        m_dropExpired;          //!< Discard jobs past their deadline
+        std::atomic_size_t      m_maxSize;              //!< Maximum queued jobs
+        std::atomic_size_t      m_nextWorker;           //!< Round robin for external pushes
+        std::atomic_int         m_idle;                 //!< Workers sleeping on m_workCv
+        std::atomic_int         m_blocked;              //!< Producers sleeping on m_spaceCv
+        std::atomic_int         m_emptyWaiters;         //!< Threads in wait_until_empty
+        std::atomic_bool        m_blocking;             //!< Wait for space instead of rejecting
+        std::mutex              m_poolMutex;            //!< Mutex for the condition variables
+        std::condition_variable m_workCv;               //!< Signalled when a job is queued
+        std::condition_variable m_spaceCv;              //!< Signalled when a queued job is taken
+        std::condition_variable m_emptyCv;              //!< Signalled when the queue drains
+        std::atomic<double> m_timeout;                  //!< Unused; kept for setTimeout()
     };
+
+    /**
+    * \brief submits a callable and returns a future for its result
+    *
+    * \param [in] f the callable
+    * \param [in] args arguments bound to the callable
+    * \return a future for the result, or a default-constructed (invalid)
+    *         future if the job was rejected.  Exceptions thrown by the
+    *         callable are delivered through the future.
+    **/
+    template<typename F, typename... Args>
+    std::future<typename std::result_of<F(Args...)>::type> ThreadPool::submit(F&& f, Args&&... args)
+    {
+        typedef typename std::result_of<F(Args...)>::type R;
+
+        auto task = std::make_shared<std::packaged_task<R()>>(
+                std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<R> future = task->get_future();
+
+        if (!push_job([task]() { (*task)(); })) {
+            return std::future<R>();
+        }
+        return future;
+    }
 }
 
 #endif /* THREADPOOL_H_ */
@@ -30,15 +30,27 @@ ThreadWorker::~ThreadWorker()
 
 void ThreadWorker::setMainLoopFunction(std::function<void()> f)
 {
-    std::lock_guard<std::mutex> l(m_mainLoopMutex);
-    m_mainLoopFunction = f;
+    notify();   // Interrupt a running function that is sleeping
+    {
+        std::lock_guard<std::mutex> l(m_mainLoopMutex);
+        m_mainLoopFunction = f;
+    }
+    notify();
 }
 
+/**
+ * Runs the main loop function.  Without one, sleeps until a function is set
+ * or the worker is stopped instead of spinning.  Functions that wait for work
+ * should call sleep() so that Stop() can interrupt them.
+ */
 void ThreadWorker::mainLoop()
 {
-    std::lock_guard<std::mutex> l(m_mainLoopMutex);
+    std::unique_lock<std::mutex> l(m_mainLoopMutex);
     if (m_mainLoopFunction) {
         m_mainLoopFunction();
+    } else {
+        l.unlock();
+        sleep();
     }
 }
 
@@ -31,6 +31,8 @@ class ThreadWorker : private Thread
         using Thread::Stop;
         using Thread::Join;
         using Thread::isRunning;
+        using Thread::sleep;
+        using Thread::notify;
 
     private:
         void mainLoop();
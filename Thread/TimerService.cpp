@@ -0,0 +1,393 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file TimerService.cpp
+ **/
+
+#include "TimerService.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include "Timer.h"
+
+namespace acl
+{
+
+namespace
+{
+const uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+}
+
+/**
+* \brief creates a stopped timer service
+*
+* \param [in] pool the pool to run callbacks on, or nullptr to run them on
+*        the timer thread.  Must outlive the service.
+* \param [in] tick the resolution of the wheel in seconds
+**/
+TimerService::TimerService(ThreadPool* pool, double tick):
+    m_pool(pool), m_tick(tick > 0 ? tick : 0.001), m_current(0), m_wake(NEVER), m_free(-1),
+    m_count(0), m_worker([this] { run(); })
+{
+    m_tickNsec = std::max<uint64_t>(1, static_cast<uint64_t>(m_tick * 1e9 + 0.5));
+    m_startNsec = getMonotonicNsec();
+    std::fill(m_slots, m_slots + LEVELS * SLOTS, -1);
+}
+
+/**
+* \brief stops the timer thread.  Pending timers are discarded unrun.
+**/
+TimerService::~TimerService()
+{
+    Stop();
+}
+
+/**
+* \brief starts the timer thread.  Timers that fell due while it was
+*        stopped run straight away.
+*
+* \return true if the thread was started
+**/
+bool TimerService::Start()
+{
+    return m_worker.Start();
+}
+
+/**
+* \brief stops the timer thread and waits for it.  Pending timers are kept.
+**/
+void TimerService::Stop()
+{
+    m_worker.Stop();
+    m_worker.Join();
+}
+
+/**
+* \brief returns true if the timer thread is running
+**/
+bool TimerService::isRunning()
+{
+    return m_worker.isRunning();
+}
+
+/**
+* \brief runs a callback once after a delay
+*
+* \param [in] delay seconds from now; the callback never runs sooner
+* \param [in] f the callback
+* \return an id for cancel(), or 0 if f is empty
+**/
+TimerService::TimerId TimerService::schedule_after(double delay, std::function<void()> f)
+{
+    uint64_t delayNsec = delay > 0 ? static_cast<uint64_t>(delay * 1e9) : 0;
+    return add(delayNsec, 0, std::move(f));
+}
+
+/**
+* \brief runs a callback repeatedly until it is cancelled
+*
+* Runs are spaced from the first due time rather than from when each run
+* happened, so they do not drift.  Runs missed while the service was
+* stopped or behind are skipped rather than made up.
+*
+* \param [in] interval seconds between runs, rounded to whole ticks
+* \param [in] f the callback
+* \param [in] firstDelay seconds before the first run; negative for interval
+* \return an id for cancel(), or 0 if f is empty or interval is not positive
+**/
+TimerService::TimerId TimerService::schedule_every(double interval, std::function<void()> f, double firstDelay)
+{
+    if (interval <= 0) {
+        std::cerr << "TimerService::schedule_every: interval must be positive" << std::endl;
+        return 0;
+    }
+    uint64_t intervalTicks = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(interval / m_tick)));
+    double first = firstDelay < 0 ? interval : firstDelay;
+    return add(static_cast<uint64_t>(first * 1e9), intervalTicks, std::move(f));
+}
+
+/**
+* \brief cancels a timer
+*
+* A callback that has already been handed to the pool still runs.
+*
+* \param [in] id the id from schedule_after() or schedule_every()
+* \return true if the timer was pending and will not run again
+**/
+bool TimerService::cancel(TimerId id)
+{
+    int32_t index = static_cast<int32_t>(id & 0xffffffff);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+
+    std::function<void()> f;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (index < 0 || index >= static_cast<int32_t>(m_nodes.size())) {
+            return false;
+        }
+        Node& node = m_nodes[index];
+        if (node.generation != generation || node.slot < 0) {
+            return false;
+        }
+        unlink(index);
+        f.swap(node.f);     // Destroyed outside the lock
+        release(index);
+    }
+    return true;
+}
+
+/**
+* \brief returns the number of pending timers
+**/
+size_t TimerService::size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+/**
+* \brief returns the resolution of the wheel in seconds
+**/
+double TimerService::getTick()
+{
+    return m_tick;
+}
+
+/**
+* \brief adds a timer and wakes the worker if it is due before the worker would wake
+*
+* \param [in] delayNsec nanoseconds from now to the first run
+* \param [in] intervalTicks ticks between runs, or 0 for a single run
+* \param [in] f the callback
+* \return the new timer's id, or 0 if f is empty
+**/
+TimerService::TimerId TimerService::add(uint64_t delayNsec, uint64_t intervalTicks, std::function<void()> f)
+{
+    if (!f) {
+        return 0;
+    }
+
+    TimerId id;
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t due = getMonotonicNsec() - m_startNsec + delayNsec;
+
+        int32_t index;
+        if (m_free >= 0) {
+            index = m_free;
+            m_free = m_nodes[index].next;
+        } else {
+            index = static_cast<int32_t>(m_nodes.size());
+            m_nodes.push_back(Node());
+            m_nodes[index].generation = 1;
+        }
+
+        Node& node = m_nodes[index];
+        node.f = std::move(f);
+        node.expires = std::max((due + m_tickNsec - 1) / m_tickNsec, m_current + 1);
+        node.interval = intervalTicks;
+        link(index);
+        m_count++;
+        id = (static_cast<TimerId>(node.generation) << 32) | static_cast<uint32_t>(index);
+
+        if (node.expires < m_wake) {
+            m_wake = node.expires;
+            wake = true;
+        }
+    }
+    if (wake) {
+        m_worker.notify();
+    }
+    return id;
+}
+
+/**
+* \brief returns the number of whole ticks since construction
+**/
+uint64_t TimerService::now_tick()
+{
+    return (getMonotonicNsec() - m_startNsec) / m_tickNsec;
+}
+
+/**
+* \brief puts a node in the slot for its due time: the first wheel whose
+*        span covers the time left, or the last wheel for anything later
+**/
+void TimerService::link(int32_t index)
+{
+    Node& node = m_nodes[index];
+    uint64_t expires = std::max(node.expires, m_current);
+    uint64_t left = expires - m_current;
+
+    int level = 0;
+    while (level < LEVELS - 1 && left >= (static_cast<uint64_t>(1) << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    // Beyond the last wheel, park in its furthest slot and be placed again on the way down
+    if (level == LEVELS - 1 && left >= (static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS))) {
+        expires = m_current + (static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS)) - 1;
+    }
+
+    int32_t slot = level * SLOTS + static_cast<int32_t>((expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+    node.slot = slot;
+    node.prev = -1;
+    node.next = m_slots[slot];
+    if (node.next >= 0) {
+        m_nodes[node.next].prev = index;
+    }
+    m_slots[slot] = index;
+}
+
+/**
+* \brief takes a node out of its slot
+**/
+void TimerService::unlink(int32_t index)
+{
+    Node& node = m_nodes[index];
+    if (node.prev >= 0) {
+        m_nodes[node.prev].next = node.next;
+    } else {
+        m_slots[node.slot] = node.next;
+    }
+    if (node.next >= 0) {
+        m_nodes[node.next].prev = node.prev;
+    }
+    node.slot = -1;
+}
+
+/**
+* \brief returns an unlinked node to the free list, invalidating its id
+**/
+void TimerService::release(int32_t index)
+{
+    Node& node = m_nodes[index];
+    node.f = nullptr;
+    if (++node.generation == 0) {
+        node.generation = 1;
+    }
+    node.slot = -1;
+    node.next = m_free;
+    m_free = index;
+    m_count--;
+}
+
+/**
+* \brief moves the timers of the current slot of a wheel down to the
+*        wheels below, now that those have turned over
+**/
+void TimerService::cascade(int level)
+{
+    int32_t slot = level * SLOTS + static_cast<int32_t>((m_current >> (SLOT_BITS * level)) & (SLOTS - 1));
+    int32_t index = m_slots[slot];
+    m_slots[slot] = -1;
+    while (index >= 0) {
+        int32_t next = m_nodes[index].next;
+        link(index);
+        index = next;
+    }
+}
+
+/**
+* \brief moves the wheel on one tick, collecting the callbacks that fall
+*        due and putting periodic timers back for their next run
+*
+* \param [out] due collected callbacks
+**/
+void TimerService::advance(std::vector<std::function<void()>>& due)
+{
+    m_current++;
+    for (int level = LEVELS - 1; level > 0; level--) {
+        if ((m_current & ((static_cast<uint64_t>(1) << (SLOT_BITS * level)) - 1)) == 0) {
+            cascade(level);
+        }
+    }
+
+    int32_t slot = static_cast<int32_t>(m_current & (SLOTS - 1));
+    int32_t index = m_slots[slot];
+    m_slots[slot] = -1;
+    while (index >= 0) {
+        Node& node = m_nodes[index];
+        int32_t next = node.next;
+        node.slot = -1;
+
+        if (node.expires > m_current) {
+            link(index);
+        } else if (node.interval) {
+            due.push_back(node.f);
+            node.expires += node.interval;
+            if (node.expires <= m_current) {
+                node.expires += (m_current - node.expires) / node.interval * node.interval + node.interval;
+            }
+            link(index);
+        } else {
+            due.push_back(std::move(node.f));
+            release(index);
+        }
+        index = next;
+    }
+}
+
+/**
+* \brief returns the tick of the next timer in the current turn of the
+*        first wheel, or of the next turn if there is none, or NEVER if no
+*        timers are pending
+**/
+uint64_t TimerService::next_wake()
+{
+    if (!m_count) {
+        return NEVER;
+    }
+    uint64_t turn = (m_current | (SLOTS - 1)) + 1;
+    for (uint64_t t = m_current + 1; t < turn; t++) {
+        if (m_slots[t & (SLOTS - 1)] >= 0) {
+            return t;
+        }
+    }
+    return turn;
+}
+
+/**
+* \brief main loop of the timer thread: catches the wheel up with the
+*        clock, dispatches what fell due and sleeps until the next timer
+**/
+void TimerService::run()
+{
+    std::vector<std::function<void()>> due;
+    uint64_t wake;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t target = now_tick();
+        while (m_current < target) {
+            if (!m_count) {
+                m_current = target;     // Nothing to cascade, so skip ahead
+                break;
+            }
+            advance(due);
+        }
+        m_wake = wake = next_wake();
+    }
+
+    for (auto& f : due) {
+        if (!m_pool || !m_pool->push_job(f)) {
+            f();
+        }
+    }
+    due.clear();
+
+    if (wake == NEVER) {
+        m_worker.sleep();
+    } else {
+        uint64_t now = getMonotonicNsec() - m_startNsec;
+        uint64_t at = wake * m_tickNsec;
+        if (at > now) {
+            m_worker.sleep(static_cast<double>(at - now) * 1e-9);
+        }
+    }
+}
+}
@@ -0,0 +1,100 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+/**
+ * \file TimerService.h
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "ThreadPool.h"
+#include "ThreadWorker.h"
+
+namespace acl
+{
+
+/**
+ * @class TimerService
+ *
+ * @brief Runs delayed and periodic callbacks for many timers on one thread.
+ *
+ * Timers are kept in a hierarchical timing wheel: LEVELS wheels of SLOTS
+ * slots each, where a slot of the first wheel is one tick and a slot of
+ * each further wheel spans a whole turn of the wheel below.  Each slot is
+ * an intrusive list, so scheduling and cancelling are O(1) whatever the
+ * number of pending timers.  As the first wheel turns over, the next slot
+ * of the wheel above is redistributed into it.
+ *
+ * A single ThreadWorker advances the wheel and hands expired callbacks to
+ * a ThreadPool, or runs them itself if there is no pool or the pool is
+ * full.  Callbacks never run early, and run at most one tick late plus the
+ * time the pool takes to get to them.  A periodic callback may overlap its
+ * previous run if that run takes longer than the interval.  The worker
+ * sleeps while no timer is due in the current turn of the first wheel.
+ */
+class TimerService
+{
+public:
+    typedef uint64_t TimerId;                   //!< 0 is never a valid timer
+    static const int LEVELS = 4;                //!< Number of wheels
+    static const int SLOT_BITS = 8;
+    static const int SLOTS = 1 << SLOT_BITS;    //!< Slots in each wheel
+
+    TimerService(ThreadPool* pool = nullptr, double tick = 0.001);
+    ~TimerService();
+
+    TimerService(const TimerService&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+
+    bool Start();
+    void Stop();
+    bool isRunning();
+
+    TimerId schedule_after(double delay, std::function<void()> f);
+    TimerId schedule_every(double interval, std::function<void()> f, double firstDelay = -1);
+    bool cancel(TimerId id);
+
+    size_t size();
+    double getTick();
+
+private:
+    struct Node {
+        std::function<void()>   f;
+        uint64_t                expires;        //!< Tick the timer is due
+        uint64_t                interval;       //!< Ticks between runs; 0 for one shot
+        uint32_t                generation;     //!< Bumped on reuse so stale ids miss
+        int32_t                 slot;           //!< Index into m_slots, or -1 if free
+        int32_t                 prev;           //!< Previous node in the slot, or -1
+        int32_t                 next;           //!< Next node in the slot or free list, or -1
+    };
+
+    TimerId add(uint64_t delayNsec, uint64_t intervalTicks, std::function<void()> f);
+    uint64_t now_tick();
+    void link(int32_t index);
+    void unlink(int32_t index);
+    void release(int32_t index);
+    void cascade(int level);
+    void advance(std::vector<std::function<void()>>& due);
+    uint64_t next_wake();
+    void run();
+
+    ThreadPool*             m_pool;             //!< Where callbacks run, or nullptr
+    double                  m_tick;             //!< Seconds per tick
+    uint64_t                m_tickNsec;         //!< Nanoseconds per tick
+    uint64_t                m_startNsec;        //!< getMonotonicNsec() at tick 0
+    std::mutex              m_mutex;            //!< Protects everything below
+    uint64_t                m_current;          //!< Last tick processed
+    uint64_t                m_wake;             //!< Tick the worker will wake at
+    std::vector<Node>       m_nodes;            //!< Timer storage, indexed by the low half of a TimerId
+    int32_t                 m_free;             //!< Head of the free list of m_nodes, or -1
+    int32_t                 m_slots[LEVELS * SLOTS]; //!< Head node of each slot, or -1
+    size_t                  m_count;            //!< Pending timers
+    ThreadWorker            m_worker;           //!< Advances the wheel
+};
+}
@@ -28,6 +28,16 @@
 #include <winsock2.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define ACL_HAVE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
 using namespace std;
 
 namespace acl
@@ -35,8 +45,11 @@ namespace acl
 {
 /**
  * Constructor
+ *
+ * @param clock The clock that start/stop/elapsed measure with
  */
-Timer::Timer()
+Timer::Timer(ClockSource clock)
+    : m_clock(clock)
 {
 
     //Initialize random number generator
@@ -51,6 +64,45 @@ Timer::~Timer()
 {
 }
 
+/**
+ * Function to change the clock the timer measures with.  Restarts the timer,
+ * since times from different clocks cannot be compared.
+ *
+ * @param clock The clock to use
+ */
+void Timer::setClockSource(ClockSource clock)
+{
+    m_clock = clock;
+    start();
+}
+
+/**
+ * Function to get the clock the timer measures with
+ *
+ * @return The clock in use
+ */
+ClockSource Timer::getClockSource() const
+{
+    return m_clock;
+}
+
+/**
+ * \brief Reads the timer's clock
+ *
+ * @return Seconds since the clock's reference point
+ */
+double Timer::now() const
+{
+    switch (m_clock) {
+    case ClockSource::Wall:
+        return getTime();
+    case ClockSource::Fast:
+        return (double)getFastNsec() / 1e9;
+    default:
+        return getMonotonicTime();
+    }
+}
+
 /**
  * Function to set the FPS of the timer
  *
@@ -121,7 +173,7 @@ int64_t Timer::getTimeCodeOffset()
  */
 void Timer::start()
 {
-    m_startTime = getTime();
+    m_startTime = now();
     if( m_stopTime != 0 ) {
        m_stopTime = 0;
     }
@@ -133,7 +185,7 @@ void Timer::start()
  **/
 void Timer::stop()
 {
-   m_stopTime = getTime();
+   m_stopTime = now();
 }
 
 /**
@@ -153,7 +205,7 @@ void Timer::reset()
 double Timer::elapsed()
 {
     if( m_stopTime == 0 ) {
-       return  getTime() - m_startTime;
+       return  now() - m_startTime;
     } 
     else  {
        return  m_stopTime - m_startTime;
@@ -329,6 +381,9 @@ int64_t convertDoubleToTimeCode(double dTime, double fps)
 /**
  * Gets the current time as a double
  *
+ * This is wall-clock time, which can jump when the system clock is set; use
+ * getMonotonicTime() to measure intervals.
+ *
  * @return The double time in seconds since the epoch
  */
 double getTime()
@@ -351,6 +406,137 @@ uint64_t getUsecTime()
     return useconds.count();
 }
 
+/**
+ * Gets the time from a clock that never goes backwards
+ *
+ * The reference point is arbitrary (usually system boot), so the value is
+ * only useful for measuring intervals within one process.
+ *
+ * @return 64-bit nanosecond time
+ */
+uint64_t getMonotonicNsec()
+{
+    auto now = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+}
+
+/**
+ * Gets the monotonic time as a double
+ *
+ * @return Seconds since the getMonotonicNsec() reference point
+ */
+double getMonotonicTime()
+{
+    return (double)getMonotonicNsec() / 1e9;
+}
+
+#ifdef ACL_HAVE_TSC
+/**
+ * \brief Conversion from time-stamp counter ticks to getMonotonicNsec() time
+ *
+ * The counter is only used if the processor reports an invariant TSC, one
+ * that ticks at a constant rate in every power state and is synchronized
+ * between cores.  The rate is measured against the steady clock once, on
+ * first use, over a few milliseconds.
+ **/
+struct TSCCalibration {
+    bool     valid = false;
+    uint64_t baseTicks = 0;                  //!< Counter value at baseNsec
+    uint64_t baseNsec = 0;                   //!< getMonotonicNsec() at calibration
+    double   nsecPerTick = 0;
+
+    static uint64_t read()
+    {
+        unsigned aux;
+        return __rdtscp(&aux);
+    }
+
+    static bool invariant()
+    {
+        unsigned regs[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0x80000000);
+        if ((unsigned)info[0] < 0x80000007) {
+            return false;
+        }
+        __cpuid(info, 0x80000007);
+        regs[3] = (unsigned)info[3];
+#else
+        if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007 ||
+            !__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3])) {
+            return false;
+        }
+#endif
+        return (regs[3] & (1u << 8)) != 0;
+    }
+
+    TSCCalibration()
+    {
+        if (!invariant()) {
+            return;
+        }
+        uint64_t startNsec = getMonotonicNsec();
+        uint64_t startTicks = read();
+        uint64_t endNsec;
+        do {
+            endNsec = getMonotonicNsec();
+        } while (endNsec - startNsec < 10000000);
+        uint64_t endTicks = read();
+        if (endTicks <= startTicks) {
+            return;
+        }
+        nsecPerTick = (double)(endNsec - startNsec) / (double)(endTicks - startTicks);
+        baseTicks = endTicks;
+        baseNsec = endNsec;
+        valid = true;
+    }
+};
+
+static const TSCCalibration& tscCalibration()
+{
+    static TSCCalibration calibration;
+    return calibration;
+}
+#endif
+
+/**
+ * Gets the monotonic time as cheaply as possible
+ *
+ * On x86 processors with an invariant time-stamp counter this reads the
+ * counter with rdtscp and scales it, which avoids a system call or vDSO
+ * call; elsewhere it is getMonotonicNsec().  The two share a reference
+ * point, but the TSC rate is measured, so they drift apart by up to a few
+ * parts per million.  The first call takes about 10 ms to calibrate.
+ *
+ * @return 64-bit nanosecond time
+ */
+uint64_t getFastNsec()
+{
+#ifdef ACL_HAVE_TSC
+    const TSCCalibration& tsc = tscCalibration();
+    if (tsc.valid) {
+        int64_t ticks = (int64_t)(TSCCalibration::read() - tsc.baseTicks);
+        return tsc.baseNsec + (int64_t)((double)ticks * tsc.nsecPerTick);
+    }
+#endif
+    return getMonotonicNsec();
+}
+
+/**
+ * Reports whether getFastNsec() reads the time-stamp counter
+ *
+ * @return True if it does, false if it falls back to getMonotonicNsec()
+ */
+bool fastClockUsesTSC()
+{
+#ifdef ACL_HAVE_TSC
+    return tscCalibration().valid;
+#else
+    return false;
+#endif
+}
+
 /**
  * Returns the current time as utc with 2^16 sub second steps
  *
@@ -72,9 +72,20 @@ typedef struct {
     uint8_t frame;                           //!< Frame(0-99)
 } SMPTETime;
 
+/**
+ * \brief Clock that a Timer measures intervals with
+ **/
+enum class ClockSource {
+    Wall,                                    //!< getTime(); jumps when the system clock is set
+    Monotonic,                               //!< getMonotonicNsec(); never goes backwards
+    Fast                                     //!< getFastNsec(); monotonic and cheapest to read
+};
+
 /**
  * \brief Timer class for system metrics and measuring time
  *
+ * Intervals are measured on a monotonic clock by default so that NTP
+ * adjustments do not show up in them.  The time code is always wall time.
  **/
 class Timer
 {
@@ -83,10 +94,15 @@ private:
     double  m_stopTime = 0;                  //!< preallocated current time
     int64_t m_timeCodeOffset = 0;            //!< offset from system time to global timecode
     double  m_fps=30;                        //!< Number of frames per second a
+    ClockSource m_clock;                     //!< Clock used by start/stop/elapsed
+
+    double      now() const;
 
 public:
-    Timer();
+    Timer(ClockSource clock = ClockSource::Monotonic);
     ~Timer();
+    void        setClockSource(ClockSource clock);
+    ClockSource getClockSource() const;
     SMPTETime   getTimeCode();
     void        updateTimeCodeOffset(int64_t refTimeCode);
     int64_t     getTimeCodeOffset();
@@ -102,6 +118,10 @@ public:
 //Support functions
 double      getTime();
 uint64_t    getUsecTime();
+uint64_t    getMonotonicNsec();
+double      getMonotonicTime();
+uint64_t    getFastNsec();
+bool        fastClockUsesTSC();
 uint64_t    getTimestamp();
 timeval     convertUsecTimeToTimeval(uint64_t t);
 uint64_t    convertTimevalToUsecTime(timeval tv);
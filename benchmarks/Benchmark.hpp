@@ -0,0 +1,102 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// @brief Helpers shared by the benchmark programs.
+///
+/// Every benchmark prints one JSON object per line on standard output, one
+/// line per measurement, so that results can be collected and compared
+/// between versions by a script.  Progress and errors go to standard error.
+namespace acl { namespace bench {
+
+/// @brief Command-line settings common to all benchmarks.
+struct Options {
+  double duration = 1.0;    ///< Seconds to run each measurement
+};
+
+/// @brief Parse the common command-line arguments.
+///
+/// Accepts --duration SECONDS and --quick, which is --duration 0.1 for
+/// smoke-testing the programs.  Prints usage and exits on anything else.
+inline Options ParseArgs(int argc, const char* argv[])
+{
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+      options.duration = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--quick") == 0) {
+      options.duration = 0.1;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--duration SECONDS] [--quick]" << std::endl;
+      exit(1);
+    }
+  }
+  return options;
+}
+
+/// @brief Seconds since an arbitrary fixed point, from a monotonic clock.
+inline double Now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// @brief Value at fraction p (0 to 1) of a sorted list, nearest rank.
+inline double Percentile(const std::vector<double>& sorted, double p)
+{
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t i = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+/// @brief Builds and prints one JSON result line.
+///
+/// Usage: JsonLine("tcp_throughput").add("size", 1024).add("mb_per_s", rate).print();
+class JsonLine {
+public:
+  explicit JsonLine(const std::string& benchmark) {
+    m_out.precision(10);
+    m_out << "{\"benchmark\":\"" << benchmark << "\"";
+  }
+  JsonLine& add(const std::string& key, const std::string& value) {
+    m_out << ",\"" << key << "\":\"" << value << "\"";
+    return *this;
+  }
+  JsonLine& add(const std::string& key, const char* value) {
+    return add(key, std::string(value));
+  }
+  JsonLine& add(const std::string& key, bool value) {
+    m_out << ",\"" << key << "\":" << (value ? "true" : "false");
+    return *this;
+  }
+  JsonLine& add(const std::string& key, double value) {
+    m_out << ",\"" << key << "\":" << value;
+    return *this;
+  }
+  JsonLine& add(const std::string& key, int value) {
+    return add(key, static_cast<double>(value));
+  }
+  JsonLine& add(const std::string& key, size_t value) {
+    return add(key, static_cast<double>(value));
+  }
+  void print() {
+    std::cout << m_out.str() << "}" << std::endl;
+  }
+
+private:
+  std::ostringstream m_out;
+};
+
+}  }	// End of namespace definitions.
@@ -0,0 +1,59 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#pragma once
+#include <iostream>
+#include <CoreSocket.hpp>
+#include "Benchmark.hpp"
+
+#ifndef ACL_USE_WINSOCK_SOCKETS
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+namespace acl { namespace bench {
+
+/// @brief Turn Nagle's algorithm off (nodelay true) or on for a socket.
+///
+/// set_tcp_socket_options() only ever sets TCP_NODELAY and poll_for_accept()
+/// always sets it, so the benchmarks need to be able to clear it.
+inline bool SetNoDelay(CoreSocket::SOCKET s, bool nodelay)
+{
+  int flag = nodelay ? 1 : 0;
+  if (setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&flag), sizeof(flag))) {
+    perror("SetNoDelay: setsockopt(TCP_NODELAY) failed");
+    return false;
+  }
+  return true;
+}
+
+/// @brief Connect two TCP sockets to each other over loopback.
+/// @param [out] client The connecting end.
+/// @param [out] server The accepted end.
+/// @param [in] nodelay Whether to set TCP_NODELAY on both ends.
+/// @return True on success.
+inline bool MakeTCPPair(CoreSocket::SOCKET& client, CoreSocket::SOCKET& server, bool nodelay)
+{
+  using namespace acl::CoreSocket;
+  int port = 0;
+  SOCKET listener = get_a_TCP_socket(&port, "127.0.0.1");
+  if (listener == BAD_SOCKET) {
+    std::cerr << "MakeTCPPair: Could not open listening socket" << std::endl;
+    return false;
+  }
+  TCPOptions options;
+  options.UseSystemDefaults();
+  options.ignoreSIGPIPE = true;
+  bool ok = connect_tcp_to("127.0.0.1", port, nullptr, &client, &options) &&
+    poll_for_accept(listener, &server, 10.0) == 1;
+  close_socket(listener);
+  if (!ok) {
+    std::cerr << "MakeTCPPair: Could not connect" << std::endl;
+    return false;
+  }
+  return SetNoDelay(client, nodelay) && SetNoDelay(server, nodelay);
+}
+
+}  }	// End of namespace definitions.
@@ -0,0 +1,86 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "SocketBenchmark.hpp"
+
+using namespace acl::CoreSocket;
+using namespace acl::bench;
+
+/// @brief Connects and closes as fast as possible against a server that
+/// accepts with poll_for_accept(), and reports connections per second.
+///
+/// Each closed connection leaves a client port in TIME_WAIT, so very long
+/// durations can run out of ephemeral ports.
+/// @param [in] clients Number of threads connecting at once.
+/// @return True on success.
+static bool RunAccept(const Options& options, int clients)
+{
+  int port = 0;
+  SOCKET listener = get_a_TCP_socket(&port, "127.0.0.1");
+  if (listener == BAD_SOCKET) {
+    std::cerr << "RunAccept: Could not open listening socket" << std::endl;
+    return false;
+  }
+
+  std::atomic_bool running(true);
+  std::atomic_bool ok(true);
+  std::vector<std::thread> threads;
+  double start = Now();
+  for (int c = 0; c < clients; c++) {
+    threads.emplace_back([&]() {
+      double end = start + options.duration;
+      while (ok && Now() < end) {
+        SOCKET s;
+        if (!connect_tcp_to("127.0.0.1", port, nullptr, &s)) {
+          std::cerr << "RunAccept: connect failed" << std::endl;
+          ok = false;
+          break;
+        }
+        close_socket(s);
+      }
+    });
+  }
+  std::thread stopper([&]() {
+    for (auto& t : threads) {
+      t.join();
+    }
+    running = false;
+  });
+
+  size_t accepted = 0;
+  while (running) {
+    SOCKET s;
+    if (poll_for_accept(listener, &s, 0.01) == 1) {
+      close_socket(s);
+      accepted++;
+    }
+  }
+  double elapsed = Now() - start;
+  stopper.join();
+  close_socket(listener);
+  if (!ok) {
+    return false;
+  }
+
+  JsonLine("tcp_accept_rate")
+    .add("clients", clients)
+    .add("seconds", elapsed)
+    .add("accepted", accepted)
+    .add("accepts_per_s", static_cast<double>(accepted) / elapsed)
+    .print();
+  return true;
+}
+
+int main(int argc, const char* argv[])
+{
+  Options options = ParseArgs(argc, argv);
+  if (!RunAccept(options, 1) || !RunAccept(options, 4)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "SocketBenchmark.hpp"
+
+using namespace acl::CoreSocket;
+using namespace acl::bench;
+
+/// @brief Sends a request and waits for it to be echoed back, over and over,
+/// and reports the distribution of round-trip times.
+/// @param [in] size Bytes in each request and response.
+/// @param [in] nodelay Whether TCP_NODELAY is set.
+/// @return True on success.
+static bool RunLatency(const Options& options, size_t size, bool nodelay)
+{
+  SOCKET client, server;
+  if (!MakeTCPPair(client, server, nodelay)) {
+    return false;
+  }
+
+  std::thread echo([&]() {
+    std::vector<char> buffer(size);
+    while (noint_block_read(server, buffer.data(), size) == static_cast<int>(size)) {
+      if (noint_block_write(server, buffer.data(), size) != static_cast<int>(size)) {
+        break;
+      }
+    }
+  });
+
+  bool ok = true;
+  std::vector<char> request(size, 'x'), response(size);
+  std::vector<double> samples;
+  double end = Now() + options.duration;
+  while (Now() < end) {
+    double start = Now();
+    if (noint_block_write(client, request.data(), size) != static_cast<int>(size) ||
+        noint_block_read(client, response.data(), size) != static_cast<int>(size)) {
+      std::cerr << "RunLatency: round trip failed" << std::endl;
+      ok = false;
+      break;
+    }
+    samples.push_back((Now() - start) * 1e6);
+  }
+  close_socket(client);
+  echo.join();
+  close_socket(server);
+  if (!ok || samples.empty()) {
+    return false;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (double s : samples) {
+    sum += s;
+  }
+  JsonLine("tcp_latency")
+    .add("message_size", size)
+    .add("nodelay", nodelay)
+    .add("samples", samples.size())
+    .add("mean_us", sum / static_cast<double>(samples.size()))
+    .add("p50_us", Percentile(samples, 0.50))
+    .add("p90_us", Percentile(samples, 0.90))
+    .add("p99_us", Percentile(samples, 0.99))
+    .add("p999_us", Percentile(samples, 0.999))
+    .add("max_us", samples.back())
+    .print();
+  return true;
+}
+
+int main(int argc, const char* argv[])
+{
+  Options options = ParseArgs(argc, argv);
+  const size_t sizes[] = { 16, 1024, 65536 };
+  for (size_t size : sizes) {
+    if (!RunLatency(options, size, true) || !RunLatency(options, size, false)) {
+      return 1;
+    }
+  }
+  return 0;
+}
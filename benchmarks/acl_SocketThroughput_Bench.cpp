@@ -0,0 +1,91 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <thread>
+#include <vector>
+#include "SocketBenchmark.hpp"
+
+using namespace acl::CoreSocket;
+using namespace acl::bench;
+
+/// @brief Streams fixed-size messages over a loopback TCP connection for a
+/// while and reports the rate at which the receiver got them.
+/// @param [in] size Bytes per write.
+/// @param [in] nodelay Whether TCP_NODELAY is set.
+/// @param [in] batch Messages written between cork_tcp_socket() and
+///         uncork_tcp_socket(), or 0 to leave the socket uncorked.
+/// @return True on success.
+static bool RunThroughput(const Options& options, size_t size, bool nodelay, size_t batch)
+{
+  SOCKET sender, receiver;
+  if (!MakeTCPPair(sender, receiver, nodelay)) {
+    return false;
+  }
+
+  bool ok = true;
+  size_t sent = 0;
+  std::thread writer([&]() {
+    std::vector<char> buffer(size, 'x');
+    double end = Now() + options.duration;
+    while (ok && Now() < end) {
+      if (batch > 0) {
+        cork_tcp_socket(sender);
+      }
+      for (size_t i = 0; i < (batch > 0 ? batch : 1); i++) {
+        if (noint_block_write(sender, buffer.data(), size) != static_cast<int>(size)) {
+          std::cerr << "RunThroughput: write failed" << std::endl;
+          ok = false;
+          break;
+        }
+        sent++;
+      }
+      if (batch > 0) {
+        uncork_tcp_socket(sender);
+      }
+    }
+    close_socket(sender);
+  });
+
+  // The writer only ever sends whole messages, so the end of the stream
+  // comes between reads.
+  std::vector<char> buffer(size);
+  size_t received = 0;
+  double start = Now();
+  while (noint_block_read(receiver, buffer.data(), size) == static_cast<int>(size)) {
+    received++;
+  }
+  double elapsed = Now() - start;
+  writer.join();
+  close_socket(receiver);
+  if (!ok || received != sent) {
+    std::cerr << "RunThroughput: sent " << sent << " messages but received " << received << std::endl;
+    return false;
+  }
+
+  double bytes = static_cast<double>(received) * static_cast<double>(size);
+  JsonLine("tcp_throughput")
+    .add("message_size", size)
+    .add("nodelay", nodelay)
+    .add("cork_batch", batch)
+    .add("seconds", elapsed)
+    .add("messages_per_s", static_cast<double>(received) / elapsed)
+    .add("mb_per_s", bytes / elapsed / 1e6)
+    .print();
+  return true;
+}
+
+int main(int argc, const char* argv[])
+{
+  Options options = ParseArgs(argc, argv);
+  const size_t sizes[] = { 64, 512, 4096, 65536, 1 << 20 };
+  for (size_t size : sizes) {
+    if (!RunThroughput(options, size, true, 0) ||
+        !RunThroughput(options, size, false, 0) ||
+        !RunThroughput(options, size, true, 16)) {
+      return 1;
+    }
+  }
+  return 0;
+}
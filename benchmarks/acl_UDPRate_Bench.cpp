@@ -0,0 +1,122 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "SocketBenchmark.hpp"
+
+using namespace acl::CoreSocket;
+using namespace acl::bench;
+
+/// @brief Datagrams handed to each send_udp_batch() call.
+static const size_t BATCH = 64;
+
+/// @brief Sends datagrams to a loopback receiver as fast as possible and
+/// reports how many were sent and received per second.
+/// @param [in] size Bytes per datagram.
+/// @param [in] batched True to send with send_udp_batch(), false to call
+///         sendto() once per datagram.
+/// @return True on success.
+static bool RunRate(const Options& options, size_t size, bool batched)
+{
+  UDPOptions udpOptions;
+  udpOptions.receiveBufferSize = 8 * 1024 * 1024;
+  unsigned short port = 0;
+  SOCKET receiver = open_udp_socket(&port, "127.0.0.1", udpOptions);
+  SOCKET sender = open_udp_socket(nullptr, "127.0.0.1");
+  if (receiver == BAD_SOCKET || sender == BAD_SOCKET) {
+    std::cerr << "RunRate: Could not open sockets" << std::endl;
+    close_socket(receiver);
+    close_socket(sender);
+    return false;
+  }
+
+  struct sockaddr_in to;
+  memset(&to, 0, sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_port = htons(port);
+  to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  std::atomic_bool sending(true);
+  size_t sent = 0;
+  double sendSeconds = 0;
+  std::thread writer([&]() {
+    std::vector<char> buffer(size * BATCH, 'x');
+    std::vector<UDPMessage> messages(BATCH);
+    for (size_t i = 0; i < BATCH; i++) {
+      messages[i].data = &buffer[i * size];
+      messages[i].length = size;
+      messages[i].address = to;
+      messages[i].segmentSize = 0;
+    }
+    double start = Now();
+    double end = start + options.duration;
+    while (Now() < end) {
+      if (batched) {
+        int ret = send_udp_batch(sender, messages.data(), BATCH);
+        if (ret > 0) {
+          sent += static_cast<size_t>(ret);
+        }
+      } else {
+        for (size_t i = 0; i < BATCH; i++) {
+          if (sendto(sender, buffer.data(), static_cast<int>(size), 0,
+              reinterpret_cast<struct sockaddr*>(&to), sizeof(to)) == static_cast<int>(size)) {
+            sent++;
+          }
+        }
+      }
+    }
+    sendSeconds = Now() - start;
+    sending = false;
+  });
+
+  // Loopback drops what the receive buffer cannot hold, so stop once the
+  // sender is done and nothing more has arrived for a while.
+  UDPBatch batch(BATCH, size);
+  size_t received = 0;
+  while (sending || check_ready_to_read_timeout(receiver, 0.05) == 1) {
+    if (check_ready_to_read_timeout(receiver, 0.01) != 1) {
+      continue;
+    }
+    batch.reset();
+    int ret = recv_udp_batch(receiver, batch.messages(), batch.size(), false);
+    if (ret < 0) {
+      std::cerr << "RunRate: receive failed" << std::endl;
+      break;
+    }
+    received += static_cast<size_t>(ret);
+  }
+  writer.join();
+  close_socket(sender);
+  close_socket(receiver);
+  if (sent == 0) {
+    std::cerr << "RunRate: nothing was sent" << std::endl;
+    return false;
+  }
+
+  JsonLine("udp_rate")
+    .add("datagram_size", size)
+    .add("batched", batched)
+    .add("seconds", sendSeconds)
+    .add("sent_per_s", static_cast<double>(sent) / sendSeconds)
+    .add("received_per_s", static_cast<double>(received) / sendSeconds)
+    .add("loss", 1.0 - static_cast<double>(received) / static_cast<double>(sent))
+    .print();
+  return true;
+}
+
+int main(int argc, const char* argv[])
+{
+  Options options = ParseArgs(argc, argv);
+  const size_t sizes[] = { 64, 512, 1400 };
+  for (size_t size : sizes) {
+    if (!RunRate(options, size, false) || !RunRate(options, size, true)) {
+      return 1;
+    }
+  }
+  return 0;
+}
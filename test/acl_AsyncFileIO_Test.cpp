@@ -0,0 +1,265 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <errno.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <AsyncFileIO.h>
+#include <FileIO.h>
+
+using namespace acl::filesystem;
+
+static const char* g_fileName = "acl_AsyncFileIO_Test.dat";
+
+/// @brief Fills a block whose contents depend on its index.
+static void FillBlock(char* data, size_t size, int index)
+{
+  for (size_t i = 0; i < size; i++) {
+    data[i] = static_cast<char>((i * 7 + index) % 251);
+  }
+}
+
+/// @brief Tests positional and vectored reads and writes on a File.
+int TestFile()
+{
+  File file(g_fileName, File::READ | File::WRITE | File::CREATE | File::TRUNCATE);
+  if (!file.is_open() || file.size() != 0) {
+    return 1;
+  }
+
+  char block[1000];
+  FillBlock(block, sizeof(block), 1);
+  if (file.pwrite(block, sizeof(block), 500) != 1000 || file.size() != 1500) {
+    return 2;
+  }
+  char back[1000];
+  if (file.pread(back, sizeof(back), 500) != 1000 || memcmp(block, back, sizeof(back)) != 0) {
+    return 3;
+  }
+  // Reads stop short only at end of file.
+  if (file.pread(back, sizeof(back), 1000) != 500 || file.pread(back, 10, 5000) != 0) {
+    return 4;
+  }
+
+  // Vectored transfers fill buffers in order, including empty ones.
+  char a[300], b[700];
+  IOVec in[3];
+  in[0].data = a;
+  in[0].length = sizeof(a);
+  in[1].data = nullptr;
+  in[1].length = 0;
+  in[2].data = b;
+  in[2].length = sizeof(b);
+  if (file.preadv(in, 3, 500) != 1000 || memcmp(a, block, 300) != 0 || memcmp(b, block + 300, 700) != 0) {
+    return 5;
+  }
+  IOVec out[2];
+  out[0].data = b;
+  out[0].length = sizeof(b);
+  out[1].data = a;
+  out[1].length = sizeof(a);
+  if (file.pwritev(out, 2, 0) != 1000 || file.pread(back, 1000, 0) != 1000 ||
+      memcmp(back, block + 300, 700) != 0 || memcmp(back + 700, block, 300) != 0) {
+    return 6;
+  }
+
+  if (!file.truncate(100) || file.size() != 100 || !file.allocate(0, 8192) || file.size() != 8192) {
+    return 7;
+  }
+  if (!file.sync() || !file.sync(false)) {
+    return 8;
+  }
+
+  File moved(std::move(file));
+  if (file.is_open() || !moved.is_open() || moved.size() != 8192) {
+    return 9;
+  }
+  moved.close();
+  if (moved.is_open() || moved.pread(back, 1, 0) != -1) {
+    return 10;
+  }
+  return 0;
+}
+
+/// @brief Tests aligned buffers and, where the file system allows it, O_DIRECT.
+int TestDirect()
+{
+  AlignedBuffer buffer(10000);
+  if (!buffer.data() || reinterpret_cast<uintptr_t>(buffer.data()) % DIRECT_IO_ALIGNMENT != 0 ||
+      buffer.size() != 12288 || align_up(4097) != 8192 || align_up(4096) != 4096) {
+    return 1;
+  }
+  AlignedBuffer moved(std::move(buffer));
+  if (buffer.data() || moved.size() != 12288) {
+    return 2;
+  }
+
+  File file;
+  if (!file.open(g_fileName, File::READ | File::WRITE | File::CREATE | File::TRUNCATE | File::DIRECT)) {
+    std::cout << "  O_DIRECT not supported here; skipping direct transfers" << std::endl;
+    return 0;
+  }
+  FillBlock(moved.data(), moved.size(), 2);
+  AlignedBuffer back(moved.size());
+  if (file.pwrite(moved.data(), moved.size(), 4096) != static_cast<int64_t>(moved.size()) ||
+      file.pread(back.data(), back.size(), 4096) != static_cast<int64_t>(back.size()) ||
+      memcmp(moved.data(), back.data(), back.size()) != 0) {
+    return 3;
+  }
+  return 0;
+}
+
+/// @brief Tests batches, chained submissions and errors on one backend.
+int TestAsync(AsyncFileIO::Backend backend)
+{
+  const int blocks = 64;
+  const size_t blockSize = 65536;
+  File file(g_fileName, File::READ | File::WRITE | File::CREATE | File::TRUNCATE);
+  if (!file.is_open()) {
+    return 1;
+  }
+
+  AsyncFileIO io(16, backend);
+  if (backend != AsyncFileIO::Backend::Auto && io.backend() != backend) {
+    return 2;
+  }
+
+  // A batch larger than the depth waits for room as it goes.
+  std::vector<std::vector<char>> data(blocks, std::vector<char>(blockSize));
+  std::atomic_int written(0);
+  std::atomic_int errors(0);
+  std::vector<IORequest> batch;
+  for (int i = 0; i < blocks; i++) {
+    FillBlock(data[i].data(), blockSize, i);
+    batch.push_back(IORequest::write(file, data[i].data(), blockSize, i * blockSize,
+      [&written, &errors, blockSize](int64_t result) {
+        if (result != static_cast<int64_t>(blockSize)) {
+          errors++;
+        }
+        written++;
+      }));
+  }
+  if (!io.submit(batch) || !io.wait_all(10) || written != blocks || errors != 0 || io.pending() != 0) {
+    return 3;
+  }
+  if (file.size() != static_cast<int64_t>(blocks * blockSize)) {
+    return 4;
+  }
+
+  std::atomic_int synced(0);
+  if (!io.submit(IORequest::sync(file, [&synced](int64_t result) { synced = result == 0 ? 1 : -1; })) ||
+      !io.wait_all(10) || synced != 1) {
+    return 5;
+  }
+
+  // Read back with vectored requests that split each block in two.
+  std::vector<std::vector<char>> back(blocks, std::vector<char>(blockSize));
+  std::atomic_int read(0);
+  batch.clear();
+  for (int i = 0; i < blocks; i++) {
+    IORequest r = IORequest::read(file, back[i].data(), 1000, i * blockSize, nullptr);
+    IOVec rest;
+    rest.data = back[i].data() + 1000;
+    rest.length = blockSize - 1000;
+    r.vecs.push_back(rest);
+    r.callback = [&read, &errors, blockSize](int64_t result) {
+      if (result != static_cast<int64_t>(blockSize)) {
+        errors++;
+      }
+      read++;
+    };
+    batch.push_back(std::move(r));
+  }
+  if (!io.submit(batch) || !io.wait_all(10) || read != blocks || errors != 0) {
+    return 6;
+  }
+  for (int i = 0; i < blocks; i++) {
+    if (back[i] != data[i]) {
+      return 7;
+    }
+  }
+
+  // Callbacks may submit more, even with the queue full.
+  std::atomic_int chained(0);
+  std::function<void(int64_t)> next;
+  next = [&](int64_t result) {
+    if (result != 4096) {
+      errors++;
+    }
+    if (++chained < 200) {
+      io.submit(IORequest::read(file, back[chained % blocks].data(), 4096, 0, next));
+    }
+  };
+  batch.clear();
+  for (int i = 0; i < 16; i++) {
+    batch.push_back(IORequest::read(file, back[i].data(), 4096, 0, next));
+  }
+  if (!io.submit(batch)) {
+    return 8;
+  }
+  for (int i = 0; i < 1000 && chained < 200; i++) {
+    io.wait_all(0.01);
+  }
+  if (!io.wait_all(10) || chained < 200 || errors != 0) {
+    return 9;
+  }
+
+  // End of file and errors come back through the callback.
+  std::atomic<int64_t> eof(-1);
+  if (!io.submit(IORequest::read(file, back[0].data(), 100, blocks * blockSize + 10,
+      [&eof](int64_t result) { eof = result; })) || !io.wait_all(10) || eof != 0) {
+    return 10;
+  }
+  File readOnly(g_fileName, File::READ);
+  std::atomic<int64_t> failed(0);
+  if (!io.submit(IORequest::write(readOnly, data[0].data(), 100, 0,
+      [&failed](int64_t result) { failed = result; })) || !io.wait_all(10) || failed != -EBADF) {
+    return 11;
+  }
+
+  File closed;
+  if (io.submit(IORequest::read(closed, back[0].data(), 1, 0, nullptr))) {
+    return 12;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing File..." << std::endl;
+  if ((ret = TestFile()) != 0) {
+    std::cerr << "File test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "Testing aligned and direct I/O..." << std::endl;
+  if ((ret = TestDirect()) != 0) {
+    std::cerr << "Direct I/O test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "Testing AsyncFileIO with threads..." << std::endl;
+  if ((ret = TestAsync(AsyncFileIO::Backend::Threads)) != 0) {
+    std::cerr << "Threaded AsyncFileIO test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  {
+    AsyncFileIO probe(1);
+    std::cout << "Testing AsyncFileIO with the "
+              << (probe.backend() == AsyncFileIO::Backend::IOUring ? "io_uring" : "thread")
+              << " backend..." << std::endl;
+  }
+  if ((ret = TestAsync(AsyncFileIO::Backend::Auto)) != 0) {
+    std::cerr << "Default AsyncFileIO test failed with code " << ret << std::endl;
+    return 400 + ret;
+  }
+
+  remove(g_fileName);
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,253 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <ConnectionPool.hpp>
+#include <CoreSocket.hpp>
+
+using namespace acl::CoreSocket;
+
+/// @brief Accepts connections on a loopback port until stopped.
+class Server {
+public:
+  Server() {
+    m_listener = get_a_TCP_socket(&m_port, "127.0.0.1");
+    m_thread = std::thread([this]() {
+      while (!m_done) {
+        SOCKET s;
+        if (poll_for_accept(m_listener, &s, 0.01) == 1) {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_accepted.push_back(s);
+        }
+      }
+    });
+  }
+  ~Server() {
+    m_done = true;
+    m_thread.join();
+    close_all();
+    close_socket(m_listener);
+  }
+  /// @brief Close the server end of every connection so far.
+  void close_all() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto s : m_accepted) {
+      close_socket(s);
+    }
+    m_accepted.clear();
+  }
+  size_t accepted() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_accepted.size();
+  }
+  int port() const { return m_port; }
+  bool ok() const { return m_listener != BAD_SOCKET; }
+
+private:
+  SOCKET m_listener;
+  int m_port = 0;
+  std::atomic_bool m_done{false};
+  std::mutex m_mutex;
+  std::vector<SOCKET> m_accepted;
+  std::thread m_thread;
+};
+
+/// @brief Waits for the server to have accepted a number of connections.
+static bool WaitForAccepts(Server& server, size_t count)
+{
+  auto start = std::chrono::steady_clock::now();
+  while (server.accepted() < count) {
+    if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5)) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+/// @brief Tests lookups, caching and invalidation.
+int TestDNSCache()
+{
+  DNSCache cache;
+  std::vector<ResolvedAddress> addresses;
+  if (!cache.resolve("127.0.0.1", 1234, addresses) || addresses.size() != 1 || cache.size() != 1) {
+    return 1;
+  }
+  const struct sockaddr_in* in = reinterpret_cast<const struct sockaddr_in*>(&addresses[0].address);
+  if (in->sin_family != AF_INET || ntohs(in->sin_port) != 1234 ||
+      in->sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+    return 2;
+  }
+
+  // A cached entry hands back the new port.
+  if (!cache.resolve("127.0.0.1", 4321, addresses) || cache.size() != 1 ||
+      ntohs(reinterpret_cast<const struct sockaddr_in*>(&addresses[0].address)->sin_port) != 4321) {
+    return 3;
+  }
+  if (!cache.resolve("::1", 80, addresses) || addresses[0].address.ss_family != AF_INET6 ||
+      cache.size() != 2) {
+    return 4;
+  }
+  cache.invalidate("::1");
+  if (cache.size() != 1) {
+    return 5;
+  }
+  cache.clear();
+  if (cache.size() != 0) {
+    return 6;
+  }
+  return 0;
+}
+
+/// @brief Tests that a dead address does not hold up a live one.
+int TestParallelConnect()
+{
+  Server server;
+  if (!server.ok()) {
+    return 1;
+  }
+
+  // A port that nobody is listening on refuses at once.
+  int closedPort = 0;
+  SOCKET closed = get_a_TCP_socket(&closedPort, "127.0.0.1");
+  close_socket(closed);
+
+  DNSCache cache;
+  std::vector<ResolvedAddress> dead, live;
+  if (!cache.resolve("127.0.0.1", closedPort, dead) || !cache.resolve("127.0.0.1", server.port(), live)) {
+    return 2;
+  }
+  std::vector<ResolvedAddress> addresses;
+  addresses.push_back(dead[0]);
+  addresses.push_back(live[0]);
+
+  auto start = std::chrono::steady_clock::now();
+  SOCKET s;
+  if (!connect_tcp_parallel(addresses, 5.0, &s, nullptr, 1.0)) {
+    return 3;
+  }
+  // The refusal starts the next attempt without waiting out the stagger.
+  if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(900)) {
+    close_socket(s);
+    return 4;
+  }
+  close_socket(s);
+
+  // Nothing reachable fails rather than hanging.
+  addresses.pop_back();
+  if (connect_tcp_parallel(addresses, 1.0, &s) || s != BAD_SOCKET) {
+    return 5;
+  }
+
+  if (!connect_tcp_cached("127.0.0.1", server.port(), 5.0, &s, nullptr, &cache)) {
+    return 6;
+  }
+  close_socket(s);
+  return 0;
+}
+
+/// @brief Tests reuse, health checks and idle limits.
+int TestPool()
+{
+  Server server;
+  if (!server.ok()) {
+    return 1;
+  }
+  ConnectionPoolOptions options;
+  options.maxIdlePerHost = 2;
+  ConnectionPool pool(options);
+
+  bool reused = true;
+  SOCKET a = pool.acquire("127.0.0.1", server.port(), &reused);
+  if (a == BAD_SOCKET || reused || pool.connect_count() != 1) {
+    return 2;
+  }
+  pool.release("127.0.0.1", server.port(), a);
+  SOCKET b = pool.acquire("127.0.0.1", server.port(), &reused);
+  if (b != a || !reused || pool.connect_count() != 1 || pool.idle_count() != 0) {
+    return 3;
+  }
+
+  // Only maxIdlePerHost sockets are kept.
+  SOCKET c = pool.acquire("127.0.0.1", server.port());
+  SOCKET d = pool.acquire("127.0.0.1", server.port());
+  pool.release("127.0.0.1", server.port(), b);
+  pool.release("127.0.0.1", server.port(), c);
+  pool.release("127.0.0.1", server.port(), d);
+  if (pool.idle_count() != 2 || pool.connect_count() != 3) {
+    return 4;
+  }
+
+  // Connections the server closed are not handed out.
+  if (!WaitForAccepts(server, 3)) {
+    return 5;
+  }
+  server.close_all();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  SOCKET e = pool.acquire("127.0.0.1", server.port(), &reused);
+  if (e == BAD_SOCKET || reused || pool.idle_count() != 0 || pool.connect_count() != 4) {
+    return 6;
+  }
+  if (!socket_is_idle_healthy(e)) {
+    return 7;
+  }
+  pool.release("127.0.0.1", server.port(), e);
+
+  // Old idle sockets are pruned.
+  ConnectionPoolOptions shortOptions;
+  shortOptions.maxIdleTime = 0.02;
+  ConnectionPool shortPool(shortOptions);
+  shortPool.release("127.0.0.1", server.port(), shortPool.acquire("127.0.0.1", server.port()));
+  if (shortPool.idle_count() != 1) {
+    return 8;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(40));
+  if (shortPool.prune() != 1 || shortPool.idle_count() != 0) {
+    return 9;
+  }
+
+  // Healthy sockets go back to the pool and are reused.
+  if (pool.prune() != 0 || pool.idle_count() != 1 ||
+      pool.acquire("127.0.0.1", server.port(), &reused) != e || !reused) {
+    return 10;
+  }
+  pool.release("127.0.0.1", server.port(), e);
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing DNS cache..." << std::endl;
+  if ((ret = TestDNSCache()) != 0) {
+    std::cerr << "DNS cache test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing parallel connect..." << std::endl;
+  if ((ret = TestParallelConnect()) != 0) {
+    std::cerr << "Parallel connect test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing connection pool..." << std::endl;
+  if ((ret = TestPool()) != 0) {
+    std::cerr << "Connection pool test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
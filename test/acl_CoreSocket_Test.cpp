@@ -3,7 +3,10 @@
  *    \license This project is released under the MIT Public License.
 **/
 
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <thread>
 #include <vector>
 #include <CoreSocket.hpp>
@@ -457,6 +460,229 @@ void Usage(std::string name)
   exit(1);
 }
 
+/// @brief Tests the scatter-gather, sendfile and zero-copy write paths.
+///
+/// Each is sent over a loopback TCP connection and checked on the far side.
+/// @return 0 on success, unique error code on failure.
+int TestSendPaths()
+{
+  int port = 0;
+  SOCKET lSock = get_a_TCP_socket(&port, "127.0.0.1");
+  if (lSock == BAD_SOCKET) {
+    return 1;
+  }
+  SOCKET rSock;
+  if (!connect_tcp_to("127.0.0.1", port, nullptr, &rSock)) {
+    close_socket(lSock);
+    return 2;
+  }
+  SOCKET wSock;
+  if (1 != poll_for_accept(lSock, &wSock, 10.0)) {
+    close_socket(rSock);
+    close_socket(lSock);
+    return 3;
+  }
+  int ret = 0;
+
+  // A header, an empty piece and a payload go out as one block.
+  std::vector<char> payload(100000);
+  for (size_t i = 0; i < payload.size(); i++) {
+    payload[i] = static_cast<char>(i % 128);
+  }
+  const char header[] = "HDR:";
+  IOBuffer bufs[3] = { { header, 4 }, { header, 0 }, { payload.data(), payload.size() } };
+  int total = static_cast<int>(4 + payload.size());
+  std::vector<char> in(total);
+  std::thread reader([&]() {
+    if (noint_block_read(rSock, in.data(), in.size()) != total) {
+      ret = 4;
+    }
+  });
+  if (noint_block_writev(wSock, bufs, 3) != total) {
+    ret = 5;
+  }
+  reader.join();
+  if (ret == 0 && (std::string(in.data(), 4) != "HDR:" || in[4 + 200] != payload[200] ||
+      in.back() != payload.back())) {
+    ret = 6;
+  }
+
+  // Send the middle of a file, then ask for more than is left in it.
+  FILE* f = tmpfile();
+  if (ret == 0 && (f == nullptr || fwrite(payload.data(), 1, payload.size(), f) != payload.size() ||
+      fflush(f) != 0)) {
+    ret = 7;
+  }
+  if (ret == 0) {
+#ifdef ACL_USE_WINSOCK_SOCKETS
+    int fd = _fileno(f);
+#else
+    int fd = fileno(f);
+#endif
+    std::vector<char> part(50000);
+    std::thread fileReader([&]() {
+      if (noint_block_read(rSock, part.data(), part.size()) != static_cast<int>(part.size())) {
+        ret = 8;
+      }
+    });
+    if (noint_block_sendfile(wSock, fd, 1000, 30000) != 30000 ||
+        noint_block_sendfile(wSock, fd, static_cast<int64_t>(payload.size()) - 20000, 30000) != 20000) {
+      ret = 9;
+    }
+    fileReader.join();
+    if (ret == 0 && (part[0] != payload[1000] || part[29999] != payload[30999] ||
+        part[30000] != payload[payload.size() - 20000] || part.back() != payload.back())) {
+      ret = 10;
+    }
+  }
+  if (f) {
+    fclose(f);
+  }
+
+  // Zero copy is optional, but the counters must agree whether or not it is there.
+  if (ret == 0) {
+    bool zerocopy = set_zerocopy(wSock);
+    uint32_t nextId = 0, completed = 0;
+    std::thread zcReader([&]() {
+      if (noint_block_read(rSock, in.data(), payload.size()) != static_cast<int>(payload.size())) {
+        ret = 11;
+      }
+    });
+    if (noint_block_write_zerocopy(wSock, payload.data(), payload.size(), nextId) !=
+        static_cast<int>(payload.size())) {
+      ret = 12;
+    }
+    zcReader.join();
+    if (zerocopy != (nextId > 0) || in[12345] != payload[12345]) {
+      ret = 13;
+    }
+    for (int i = 0; i < 100 && ret == 0 && completed < nextId; i++) {
+      if (read_zerocopy_completions(wSock, completed, 0.1) < 0) {
+        ret = 14;
+      }
+    }
+    if (ret == 0 && completed != nextId) {
+      ret = 15;
+    }
+  }
+
+  close_socket(wSock);
+  close_socket(rSock);
+  close_socket(lSock);
+  return ret;
+}
+
+/// @brief Tests batched UDP sends and receives, including split datagrams.
+/// @return 0 on success, unique error code on failure.
+int TestUDPBatch()
+{
+  UDPOptions options;
+  options.receiveBufferSize = 1 << 20;
+  options.reusePort = true;
+  unsigned short port = 0;
+  SOCKET rSock = open_udp_socket(&port, "127.0.0.1", options);
+  if (rSock == BAD_SOCKET) {
+    return 1;
+  }
+#ifdef __linux__
+  // A second socket may share the port, so threads can split the load.
+  SOCKET twin = open_udp_socket(&port, "127.0.0.1", options);
+  if (twin == BAD_SOCKET) {
+    close_socket(rSock);
+    return 2;
+  }
+  close_socket(twin);
+#endif
+  SOCKET sSock = open_udp_socket(nullptr, "127.0.0.1");
+  if (sSock == BAD_SOCKET) {
+    close_socket(rSock);
+    return 3;
+  }
+
+  // Send more messages than fit in one system call.
+  const size_t count = 100;
+  UDPBatch out(count, 64);
+  for (size_t i = 0; i < count; i++) {
+    out[i].address.sin_family = AF_INET;
+    out[i].address.sin_port = htons(port);
+    out[i].address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    out[i].length = 1 + i % 64;
+    memset(out[i].data, static_cast<char>(i), out[i].length);
+  }
+  int ret = 0;
+  if (send_udp_batch(sSock, out.messages(), count) != static_cast<int>(count)) {
+    ret = 4;
+  }
+
+  // Loopback does not drop, so every message should arrive in order.
+  UDPBatch in(32, 64);
+  size_t received = 0;
+  while (ret == 0 && received < count) {
+    in.reset();
+    if (check_ready_to_read_timeout(rSock, 5.0) != 1) {
+      ret = 5;
+      break;
+    }
+    int n = recv_udp_batch(rSock, in.messages(), in.size());
+    if (n <= 0) {
+      ret = 6;
+      break;
+    }
+    for (int i = 0; i < n; i++, received++) {
+      if (in[i].length != 1 + received % 64 || in[i].data[0] != static_cast<char>(received) ||
+          in[i].address.sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+        ret = 7;
+      }
+    }
+  }
+  in.reset();
+  if (ret == 0 && recv_udp_batch(rSock, in.messages(), in.size(), false) != 0) {
+    ret = 8;
+  }
+
+  // A message with a segment size goes out as several datagrams.
+  if (ret == 0) {
+    std::vector<char> big(3000, 'g');
+    UDPMessage m;
+    m.data = big.data();
+    m.length = big.size();
+    m.address = out[0].address;
+    m.segmentSize = 1000;
+    if (send_udp_batch(sSock, &m, 1) != 1) {
+      ret = 9;
+    }
+    size_t bytes = 0;
+    while (ret == 0 && bytes < big.size()) {
+      in.reset();
+      if (check_ready_to_read_timeout(rSock, 5.0) != 1) {
+        ret = 10;
+        break;
+      }
+      int n = recv_udp_batch(rSock, in.messages(), in.size());
+      for (int i = 0; i < n; i++) {
+        if (in[i].length != 64 || in[i].data[0] != 'g') {
+          // Only the first 64 bytes of each 1000-byte datagram fit.
+          ret = 11;
+        }
+        bytes += 1000;
+      }
+    }
+  }
+
+  // A moved batch keeps its storage, so its messages still point into it.
+  if (ret == 0) {
+    char* data = in[1].data;
+    UDPBatch moved(std::move(in));
+    if (moved.size() != 32 || moved[1].data != data) {
+      ret = 12;
+    }
+  }
+
+  close_socket(sSock);
+  close_socket(rSock);
+  return ret;
+}
+
 int main(int argc, const char* argv[])
 {
   size_t realParams = 0;
@@ -750,6 +976,28 @@ int main(int argc, const char* argv[])
     }
   }
 
+  // Test the scatter-gather, file and zero-copy send paths.
+  {
+    std::cout << "Testing writev, sendfile and zero copy..." << std::endl;
+    int ret = TestSendPaths();
+    if (ret != 0) {
+      std::cerr << "Error in send path test: " << ret << std::endl;
+      return 600 + ret;
+    }
+    std::cout << "... Completed" << std::endl;
+  }
+
+  // Test batched UDP.
+  {
+    std::cout << "Testing batched UDP..." << std::endl;
+    int ret = TestUDPBatch();
+    if (ret != 0) {
+      std::cerr << "Error in batched UDP test: " << ret << std::endl;
+      return 700 + ret;
+    }
+    std::cout << "... Completed" << std::endl;
+  }
+
   // Test running separate server and client tests that talk to each other over the
   // network.  The default is to run both threads from this same process, but it can
   // also be specified on the command line to run them as separate processes on the
@@ -0,0 +1,217 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include <Directory.h>
+#include <FileIO.h>
+#include <ThreadPool.h>
+
+using namespace acl::filesystem;
+
+static const std::string g_root = "acl_Directory_Test.tree";
+static const std::string g_outside = "acl_Directory_Test.outside";
+
+/// @brief Builds a tree of directories and files below g_root.
+/// @return The number of entries below g_root, or 0 on failure.
+static uint64_t MakeTree(int dirs, int files)
+{
+  uint64_t entries = 0;
+  if (!create_directory(g_root)) {
+    return 0;
+  }
+  for (int d = 0; d < dirs; d++) {
+    std::string dir = g_root + "/dir" + std::to_string(d);
+    std::string nested = dir + "/nested";
+    if (!create_directory(dir) || !create_directory(nested)) {
+      return 0;
+    }
+    entries += 2;
+    for (int f = 0; f < files; f++) {
+      std::ofstream(dir + "/file" + std::to_string(f)) << std::string(f, 'x');
+      std::ofstream(nested + "/file" + std::to_string(f)) << "y";
+      entries += 2;
+    }
+  }
+  std::ofstream(g_root + "/top") << "top";
+  entries++;
+
+#ifndef _WIN32
+  // A link out of the tree is listed but not followed or emptied.
+  create_directory(g_outside);
+  std::ofstream(g_outside + "/keep") << "keep";
+  if (symlink(("../" + g_outside).c_str(), (g_root + "/link").c_str()) != 0) {
+    return 0;
+  }
+  entries++;
+#endif
+  return entries;
+}
+
+/// @brief Tests listing one directory.
+int TestIterator()
+{
+  DirectoryIterator missing(g_root + "/missing");
+  DirectoryEntry entry;
+  if (missing.is_open() || missing.next(entry) || missing.error() == 0) {
+    return 1;
+  }
+
+  std::set<std::string> names;
+  DirectoryIterator it(g_root + "/dir0", true);
+  while (it.next(entry)) {
+    names.insert(entry.name);
+    if (entry.path != g_root + "/dir0/" + entry.name || !entry.hasStat) {
+      return 2;
+    }
+    if (entry.name == "nested" && entry.type != FileType::Directory) {
+      return 3;
+    }
+    if (entry.name == "file7" && (entry.type != FileType::File || entry.size != 7 || entry.modTime == 0)) {
+      return 4;
+    }
+  }
+  if (it.error() != 0 || names.size() != 11 || !names.count("nested") || names.count(".")) {
+    return 5;
+  }
+
+#ifndef _WIN32
+  DirectoryIterator top(g_root);
+  bool sawLink = false;
+  while (top.next(entry)) {
+    if (entry.name == "link") {
+      sawLink = entry.type == FileType::Symlink;
+    }
+  }
+  if (!sawLink) {
+    return 6;
+  }
+#endif
+
+  std::vector<std::string> list = getFileList(g_root + "/dir0", true);
+  if (list.size() != 13 || std::find(list.begin(), list.end(), "..") == list.end()) {
+    return 7;
+  }
+  return 0;
+}
+
+/// @brief Tests recursive walks with and without a pool.
+int TestWalk(uint64_t entries)
+{
+  std::atomic<uint64_t> files(0);
+  auto countFiles = [&files](const DirectoryEntry& e) {
+    if (e.type == FileType::File) {
+      files++;
+    }
+    return true;
+  };
+  if (walk_directory(g_root, countFiles) != entries) {
+    return 1;
+  }
+  uint64_t sequentialFiles = files;
+
+  acl::ThreadPool pool(4, 10000);
+  pool.Start();
+  files = 0;
+  if (walk_directory(g_root, countFiles, &pool, true) != entries || files != sequentialFiles) {
+    return 2;
+  }
+
+  // Refusing a directory skips what is below it.
+  std::mutex mutex;
+  std::set<std::string> seen;
+  uint64_t visited = walk_directory(g_root, [&](const DirectoryEntry& e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    seen.insert(e.path);
+    return e.name != "nested";
+  }, &pool);
+  if (visited != seen.size() || seen.count(g_root + "/dir0/nested") != 1 ||
+      seen.count(g_root + "/dir0/nested/file0") != 0 || seen.count(g_root + "/dir0/file0") != 1) {
+    return 3;
+  }
+  pool.Stop();
+  pool.Join();
+  return 0;
+}
+
+/// @brief Tests removing trees, single files and missing paths.
+int TestRemoveAll(uint64_t entries, acl::ThreadPool* pool)
+{
+  uint64_t removed = pool ? remove_all(g_root, pool) : remove_all(g_root);
+  if (removed != entries + 1 || exists(g_root)) {
+    return 1;
+  }
+#ifndef _WIN32
+  if (!exists(g_outside + "/keep")) {
+    return 2;
+  }
+#endif
+  if (remove_all(g_root, pool) != 0) {
+    return 3;
+  }
+  std::ofstream(g_root) << "file";
+  if (remove_all(g_root, pool) != 1 || exists(g_root)) {
+    return 4;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+  remove_all(g_root);
+  remove_all(g_outside);
+
+  uint64_t entries = MakeTree(20, 10);
+  if (entries == 0) {
+    std::cerr << "Unable to build the test tree" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Testing DirectoryIterator..." << std::endl;
+  if ((ret = TestIterator()) != 0) {
+    std::cerr << "DirectoryIterator test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "Testing walk_directory..." << std::endl;
+  if ((ret = TestWalk(entries)) != 0) {
+    std::cerr << "walk_directory test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "Testing remove_all..." << std::endl;
+  if ((ret = TestRemoveAll(entries, nullptr)) != 0) {
+    std::cerr << "remove_all test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  std::cout << "Testing parallel remove_all..." << std::endl;
+  {
+    remove_all(g_outside);
+    MakeTree(50, 40);
+    uint64_t bigEntries = 0;
+    walk_directory(g_root, [&bigEntries](const DirectoryEntry&) { bigEntries++; return true; });
+    acl::ThreadPool pool(4, 10000);
+    pool.Start();
+    ret = TestRemoveAll(bigEntries, &pool);
+    pool.Stop();
+    pool.Join();
+    if (ret != 0) {
+      std::cerr << "Parallel remove_all test failed with code " << ret << std::endl;
+      return 400 + ret;
+    }
+  }
+
+  remove_all(g_outside);
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,278 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <CoreSocket.hpp>
+#include <EventLoop.hpp>
+#include <ThreadPool.h>
+
+#ifndef ACL_USE_WINSOCK_SOCKETS
+#include <errno.h>
+#include <sys/socket.h>
+#endif
+
+using namespace acl::CoreSocket;
+
+static size_t g_numClients = 50;
+static int g_packetSize = 100;
+
+/// @brief True if the last socket call failed only because it would block.
+static bool WouldBlock()
+{
+#ifdef ACL_USE_WINSOCK_SOCKETS
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/// @brief Echoes everything that arrives on a socket, closing it on EOF.
+static void Echo(EventLoop& loop, SOCKET s)
+{
+  char buf[4096];
+  while (true) {
+    int n = static_cast<int>(recv(s, buf, sizeof(buf), 0));
+    if (n > 0) {
+      if (noint_block_write(s, buf, n) != n) {
+        std::cerr << "Echo: write failed" << std::endl;
+      }
+    } else if (n < 0 && WouldBlock()) {
+      return;
+    } else {
+      loop.remove(s);
+      close_socket(s);
+      return;
+    }
+  }
+}
+
+/// @brief Runs an echo server on an event loop and checks many clients at once.
+/// @param [in] pool Pool to dispatch handlers to, or nullptr for the loop thread.
+/// @return 0 on success, unique error code on failure.
+int TestEcho(acl::ThreadPool* pool)
+{
+  EventLoop loop(pool);
+  if (!loop.valid()) {
+    return 1;
+  }
+
+  int port = 0;
+  SOCKET listener = get_a_TCP_socket(&port, "127.0.0.1");
+  if (listener == BAD_SOCKET) {
+    return 2;
+  }
+  TCPOptions options;
+  std::atomic_int accepted(0);
+  if (!loop.add_listener(listener, [&loop, &accepted](SOCKET s) {
+        accepted++;
+        loop.add(s, EventLoop::READ, [&loop](SOCKET c, int events) { Echo(loop, c); });
+      }, &options)) {
+    return 3;
+  }
+
+  std::thread server([&loop]() { loop.run(); });
+
+  // Connect every client before any of them talks, so the loop has to
+  // serve them all at once.
+  std::vector<SOCKET> clients;
+  for (size_t i = 0; i < g_numClients; i++) {
+    SOCKET s;
+    if (!connect_tcp_to("127.0.0.1", port, nullptr, &s)) {
+      loop.stop();
+      server.join();
+      return 4;
+    }
+    clients.push_back(s);
+  }
+
+  int ret = 0;
+  std::vector<char> out(g_packetSize);
+  std::vector<char> in(g_packetSize);
+  for (size_t i = 0; i < clients.size(); i++) {
+    for (int b = 0; b < g_packetSize; b++) {
+      out[b] = static_cast<char>((b + i) % 128);
+    }
+    if (noint_block_write(clients[i], out.data(), out.size()) != g_packetSize) {
+      ret = 5;
+      break;
+    }
+  }
+  for (size_t i = 0; ret == 0 && i < clients.size(); i++) {
+    if (noint_block_read(clients[i], in.data(), in.size()) != g_packetSize) {
+      ret = 6;
+      break;
+    }
+    for (int b = 0; b < g_packetSize; b++) {
+      if (in[b] != static_cast<char>((b + i) % 128)) {
+        ret = 7;
+      }
+    }
+  }
+
+  // Closing the clients makes the server remove their sockets.
+  for (auto s : clients) {
+    close_socket(s);
+  }
+  auto start = std::chrono::steady_clock::now();
+  while (loop.size() > 1 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (ret == 0 && (loop.size() != 1 || accepted != static_cast<int>(g_numClients))) {
+    ret = 8;
+  }
+
+  loop.stop();
+  server.join();
+  loop.remove(listener);
+  close_socket(listener);
+  return ret;
+}
+
+/// @brief Tests timeouts and wakeups on an empty loop.
+int TestWake()
+{
+  EventLoop loop;
+  auto start = std::chrono::steady_clock::now();
+  if (loop.run_once(0.05) != 0) {
+    return 1;
+  }
+  if (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(40)) {
+    return 2;
+  }
+
+  // stop() from another thread ends a blocked run().
+  std::thread stopper([&loop]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    loop.stop();
+  });
+  start = std::chrono::steady_clock::now();
+  loop.run();
+  stopper.join();
+  if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5)) {
+    return 3;
+  }
+
+  if (loop.add(BAD_SOCKET, EventLoop::READ, [](SOCKET s, int events) {}) || loop.remove(BAD_SOCKET)) {
+    return 4;
+  }
+
+  // A stop() before run() starts is not lost.  The loop is leaked if run()
+  // hangs, so that the failure is reported.
+  EventLoop* early = new EventLoop;
+  early->stop();
+  std::atomic_bool done(false);
+  std::thread runner([early, &done]() {
+    early->run();
+    done = true;
+  });
+  for (int i = 0; i < 500 && !done; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (!done) {
+    runner.detach();
+    return 5;
+  }
+  runner.join();
+
+  // The request is consumed, so the next run() waits for its own stop().
+  bool fired = false;
+  early->add_timer(0.02, [early, &fired]() { fired = true; early->stop(); });
+  early->run();
+  delete early;
+  if (!fired) {
+    return 6;
+  }
+  return 0;
+}
+
+/// @brief Tests timer ordering, cancellation and wakeups.
+int TestTimers()
+{
+  EventLoop loop;
+  std::vector<int> order;
+  loop.add_timer(0.03, [&order]() { order.push_back(3); });
+  uint64_t cancelled = loop.add_timer(0.02, [&order]() { order.push_back(-1); });
+  loop.add_timer(0.01, [&order]() { order.push_back(1); });
+  loop.add_timer(0, [&order, &loop]() {
+    order.push_back(0);
+    // Added from a timer, so it runs on a later pass.
+    loop.add_timer(0, [&order]() { order.push_back(2); });
+  });
+  if (cancelled == 0 || !loop.cancel_timer(cancelled) || loop.cancel_timer(cancelled)) {
+    return 1;
+  }
+
+  // run_once() with no timeout still returns when a timer comes due.
+  auto start = std::chrono::steady_clock::now();
+  while (order.size() < 4 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    loop.run_once(-1);
+  }
+  if (order.size() != 4 || order[0] != 0 || order[3] != 3) {
+    return 2;
+  }
+  if (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(25)) {
+    return 3;
+  }
+
+  // A timer added from another thread wakes a blocked loop.
+  std::atomic_bool fired(false);
+  std::thread adder([&loop, &fired]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    loop.add_timer(0, [&loop, &fired]() { fired = true; loop.stop(); });
+  });
+  loop.run();
+  adder.join();
+  if (!fired) {
+    return 4;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing wakeups..." << std::endl;
+  if ((ret = TestWake()) != 0) {
+    std::cerr << "Wake test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing timers..." << std::endl;
+  if ((ret = TestTimers()) != 0) {
+    std::cerr << "Timer test failed with code " << ret << std::endl;
+    return 400 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing echo on the loop thread..." << std::endl;
+  if ((ret = TestEcho(nullptr)) != 0) {
+    std::cerr << "Inline echo test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing echo on a thread pool..." << std::endl;
+  {
+    acl::ThreadPool pool(4, 1000);
+    pool.Start();
+    ret = TestEcho(&pool);
+    pool.Stop();
+    pool.Join();
+    if (ret != 0) {
+      std::cerr << "Pool echo test failed with code " << ret << std::endl;
+      return 300 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,514 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <LruCache.tcc>
+#include <ShardedLruCache.tcc>
+#include <LoadingCache.tcc>
+#include <stdexcept>
+#include <ThreadPool.h>
+
+/// @brief Runs the cache tests shared by the ordered and sharded caches.
+/// @param maxSize Capacity the cache is configured with by the caller
+/// @return 0 on success, unique error code on failure.
+template <class C>
+int TestCacheInterface(C& c, int maxSize)
+{
+  std::string value;
+
+  if (c.get_value(1, value) || c.size() != 0) {
+    return 1;
+  }
+
+  // Insert, look up, and reject duplicates.
+  if (!c.add_to_cache(1, "one") || !c.get_value(1, value) || value != "one") {
+    return 2;
+  }
+  if (c.add_to_cache(1, "uno") || !c.get_value(1, value) || value != "one") {
+    return 3;
+  }
+  c.empty_cache();
+  if (c.size() != 0 || c.get_value(1, value)) {
+    return 4;
+  }
+
+  // Filling past capacity evicts, keeping the size bounded; a key that is
+  // read constantly must survive.
+  for (int i = 0; i < maxSize * 4; i++) {
+    c.add_to_cache(i, std::to_string(i));
+    if (!c.get_value(0, value) || value != "0") {
+      return 5;
+    }
+  }
+  if (c.size() > static_cast<size_t>(maxSize) || c.size() == 0) {
+    return 6;
+  }
+
+  // A cleanup handler that refuses keeps the entry in the cache.
+  c.empty_cache();
+  int booted = 0;
+  c.setCleanupHandler([&booted](int key, std::string val) {
+    booted++;
+    return key != 0;
+  });
+  for (int i = 0; i < maxSize * 4; i++) {
+    c.add_to_cache(i, std::to_string(i));
+  }
+  c.setCleanupHandler();
+  if (booted == 0 || !c.get_value(0, value)) {
+    return 7;
+  }
+  c.empty_cache();
+
+  // Concurrent readers and writers.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&c, t, maxSize]() {
+      std::string v;
+      for (int i = 0; i < 5000; i++) {
+        int key = (i * 7 + t) % (maxSize * 2);
+        if (!c.get_value(key, v)) {
+          c.add_to_cache(key, std::to_string(key));
+        } else if (v != std::to_string(key)) {
+          std::cerr << "Wrong value for key " << key << std::endl;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  if (c.size() > static_cast<size_t>(maxSize)) {
+    return 8;
+  }
+
+  return 0;
+}
+
+/// @brief Tests that the sharded cache evicts in least-recently-used order.
+int TestShardedOrder()
+{
+  acl::ShardedLruCache<int, int> c(1);
+  c.set_max_size(3);
+  if (c.get_num_shards() != 1 || c.get_max_size() != 3) {
+    return 1;
+  }
+
+  int value;
+  c.add_to_cache(1, 1);
+  c.add_to_cache(2, 2);
+  c.add_to_cache(3, 3);
+  c.get_value(1, value);      // 2 is now the least recently used
+  c.add_to_cache(4, 4);
+  if (c.get_value(2, value) || !c.get_value(1, value) || !c.get_value(3, value) ||
+      !c.get_value(4, value) || c.size() != 3) {
+    return 2;
+  }
+
+  acl::ShardedLruCache<int, int> rounded(5);
+  if (rounded.get_num_shards() != 8) {
+    return 3;
+  }
+
+  // The shard limits add up to the maximum size, even when it does not divide
+  // evenly or is smaller than the number of shards.
+  for (size_t maxSize : { size_t(10), size_t(3) }) {
+    rounded.empty_cache();
+    rounded.set_max_size(maxSize);
+    for (int i = 0; i < 1000; i++) {
+      rounded.add_to_cache(i, i);
+    }
+    if (rounded.size() != maxSize || rounded.get_max_size() != maxSize) {
+      return 4;
+    }
+  }
+  return 0;
+}
+
+/// @brief Tests cost-budgeted eviction and cleanup on a thread pool.
+int TestCostAndCleanup()
+{
+  acl::LruCache<int, std::string> c;
+  c.setCostFunction([](const int& key, const std::string& val) {
+    return val.size();
+  });
+  c.set_max_cost(100);
+
+  // Insert 10 entries of 10 bytes, then one of 35; the 4 oldest must go.
+  for (int i = 0; i < 10; i++) {
+    c.add_to_cache(i, std::string(10, 'a'));
+  }
+  if (c.get_total_cost() != 100 || c.size() != 10) {
+    return 1;
+  }
+  std::vector<int> booted;
+  c.setCleanupHandler([&booted](int key, std::string val) {
+    booted.push_back(key);
+    return true;
+  });
+  if (!c.add_to_cache(100, std::string(35, 'b'))) {
+    return 2;
+  }
+  std::string value;
+  if (booted.size() != 4 || booted[0] != 0 || booted[3] != 3 || c.get_value(3, value) ||
+      !c.get_value(4, value) || c.get_total_cost() != 95) {
+    return 3;
+  }
+
+  // An entry bigger than the whole budget is rejected without evicting.
+  if (c.add_to_cache(200, std::string(101, 'c')) || c.size() != 7) {
+    return 4;
+  }
+
+  // Cleanup handlers run on the pool; refused entries come back.
+  acl::ThreadPool pool(2, 50);
+  pool.Start();
+  std::atomic_int calls(0);
+  std::thread::id inserter = std::this_thread::get_id();
+  bool onInserter = false;
+  c.setCleanupPool(&pool);
+  c.setCleanupHandler([&](int key, std::string val) {
+    calls++;
+    if (std::this_thread::get_id() == inserter) {
+      onInserter = true;
+    }
+    return key != 4;
+  });
+  for (int i = 0; i < 20; i++) {
+    c.add_to_cache(1000 + i, std::string(10, 'd'));
+  }
+  c.wait_for_cleanup();
+  c.setCleanupPool();
+  pool.Stop();
+  pool.Join();
+
+  if (calls == 0 || onInserter || !c.get_value(4, value)) {
+    return 5;
+  }
+
+  // A full blocking pool must not deadlock the inserter against cleanup
+  // jobs that need the cache lock.  Both are leaked if it does, so that a
+  // failure is reported instead of hanging in their destructors.
+  acl::ThreadPool* blockingPool = new acl::ThreadPool(1, 1);
+  blockingPool->setBlocking(true);
+  blockingPool->Start();
+  acl::LruCache<int, std::string>* small = new acl::LruCache<int, std::string>;
+  small->set_max_size(2);
+  small->setCleanupPool(blockingPool);
+  small->setCleanupHandler([](int key, std::string val) {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    return key % 2 == 0;
+  });
+  std::atomic_bool done(false);
+  std::thread writer([small, &done]() {
+    for (int i = 0; i < 200; i++) {
+      small->add_to_cache(i, "x");
+    }
+    small->wait_for_cleanup();
+    done = true;
+  });
+  for (int i = 0; i < 1000 && !done; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (!done) {
+    writer.detach();
+    return 6;
+  }
+  writer.join();
+  small->setCleanupPool();
+  blockingPool->Stop();
+  blockingPool->Join();
+  delete small;
+  delete blockingPool;
+  return 0;
+}
+
+/// @brief Tests evictions that empty the cache before the new entry goes in.
+int TestEvictAll()
+{
+  std::string value;
+  acl::LruCache<int, std::string> one;
+  one.set_max_size(1);
+  for (int i = 0; i < 3; i++) {
+    if (!one.add_to_cache(i, std::to_string(i)) || !one.get_value(i, value) || value != std::to_string(i) ||
+        one.size() != 1) {
+      return 1;
+    }
+  }
+
+  // Each entry takes more than half the budget, so each insertion evicts all.
+  acl::LruCache<int, std::string> costly;
+  costly.setCostFunction([](const int& key, const std::string& val) {
+    return val.size();
+  });
+  costly.set_max_cost(100);
+  for (int i = 0; i < 3; i++) {
+    if (!costly.add_to_cache(i, std::string(60, 'a')) || !costly.get_value(i, value) ||
+        costly.size() != 1 || costly.get_total_cost() != 60) {
+      return 2;
+    }
+  }
+
+  // A refused victim goes back behind the new entry rather than onto itself.
+  acl::LruCache<int, std::string> refusing;
+  refusing.set_max_size(1);
+  refusing.setCleanupHandler([](int key, std::string val) {
+    return false;
+  });
+  refusing.add_to_cache(1, "one");
+  if (!refusing.add_to_cache(2, "two") || refusing.size() != 2 ||
+      !refusing.get_value(1, value) || value != "one" || !refusing.get_value(2, value) || value != "two") {
+    return 3;
+  }
+  refusing.setCleanupHandler();
+  if (!refusing.add_to_cache(3, "three") || refusing.size() != 1 || !refusing.get_value(3, value) ||
+      refusing.get_value(1, value) || refusing.get_value(2, value)) {
+    return 4;
+  }
+  return 0;
+}
+
+/// @brief Runs a hot working set interleaved with a one-off sequential sweep.
+/// @return The hit rate of the hot set during the sweep
+template <class C>
+double RunSweep(C& c)
+{
+  const int HOT = 32;
+  std::string value;
+
+  for (int round = 0; round < 5; round++) {
+    for (int i = 0; i < HOT; i++) {
+      if (!c.get_value(i, value)) {
+        c.add_to_cache(i, std::to_string(i));
+      }
+    }
+  }
+
+  int hotHits = 0;
+  int hotLookups = 0;
+  for (int i = 1000; i < 4000; i++) {
+    if (!c.get_value(i, value)) {
+      c.add_to_cache(i, std::to_string(i));
+    }
+    if (i % 60 == 0) {
+      for (int h = 0; h < HOT; h++) {
+        hotLookups++;
+        if (c.get_value(h, value)) {
+          hotHits++;
+        } else {
+          c.add_to_cache(h, std::to_string(h));
+        }
+      }
+    }
+  }
+  return static_cast<double>(hotHits) / hotLookups;
+}
+
+/// @brief Tests that TinyLFU admission keeps a hot set through a one-off
+/// sweep that plain LRU does not.
+template <class C>
+int TestScanResistance()
+{
+  C lru;
+  lru.set_max_size(64);
+  double lruRate = RunSweep(lru);
+
+  C tinyLfu;
+  tinyLfu.set_max_size(64);
+  tinyLfu.setAdmissionPolicy(std::make_shared<acl::TinyLfuAdmission<int>>(64));
+  double tinyLfuRate = RunSweep(tinyLfu);
+
+  std::cout << "Hot set hit rate during sweep: LRU " << lruRate << ", TinyLFU " << tinyLfuRate << std::endl;
+  if (lruRate > 0.5 || tinyLfuRate < 0.75) {
+    return 1;
+  }
+
+  acl::CacheStats stats = tinyLfu.get_stats();
+  if (stats.rejections == 0 || stats.evictions == 0 || stats.hits == 0 || stats.misses == 0) {
+    return 2;
+  }
+  tinyLfu.reset_stats();
+  stats = tinyLfu.get_stats();
+  if (stats.hits || stats.misses || stats.evictions || stats.rejections || stats.hit_rate() != 0) {
+    return 3;
+  }
+  return 0;
+}
+
+/// @brief Tests that concurrent misses share one load.
+int TestLoadingCache()
+{
+  acl::ThreadPool pool(2, 50);
+  pool.Start();
+  acl::LoadingCache<int, std::string> c(&pool);
+  c.set_max_size(64);
+
+  std::atomic_int loads(0);
+  auto loader = [&loads](const int& key) {
+    loads++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return std::to_string(key);
+  };
+
+  // Many threads miss on the same key at once; only one load may run.
+  std::vector<std::thread> threads;
+  std::atomic_int wrong(0);
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&c, &loader, &wrong]() {
+      if (c.get_or_load(7, loader) != "7") {
+        wrong++;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  if (loads != 1 || wrong != 0 || c.loads_in_flight() != 0) {
+    return 1;
+  }
+
+  // Cached values do not load again.
+  if (c.get_or_load(7, loader) != "7" || loads != 1) {
+    return 2;
+  }
+
+  // Asynchronous loads run on the pool and are shared as well.
+  std::shared_future<std::string> f1 = c.get_or_load_async(8, loader);
+  std::shared_future<std::string> f2 = c.get_or_load_async(8, loader);
+  if (f1.get() != "8" || f2.get() != "8" || loads != 2) {
+    return 3;
+  }
+  std::shared_future<std::string> hit = c.get_or_load_async(8, loader);
+  if (hit.wait_for(std::chrono::seconds(0)) != std::future_status::ready || hit.get() != "8" || loads != 2) {
+    return 5;
+  }
+
+  // Loader exceptions reach every waiter and nothing is cached.
+  auto failing = [](const int& key) -> std::string {
+    throw std::runtime_error("load failed");
+  };
+  bool threw = false;
+  try {
+    c.get_or_load(9, failing);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  std::string value;
+  if (!threw || c.get_value(9, value) || c.get_or_load(9, loader) != "9") {
+    return 4;
+  }
+
+  // Loads evict through a full blocking cleanup pool whose handler uses the
+  // cache.  Both are leaked on a deadlock so that the failure is reported.
+  acl::ThreadPool* blockingPool = new acl::ThreadPool(1, 1);
+  blockingPool->setBlocking(true);
+  blockingPool->Start();
+  acl::LoadingCache<int, std::string>* small = new acl::LoadingCache<int, std::string>;
+  small->set_max_size(2);
+  small->setCleanupPool(blockingPool);
+  small->setCleanupHandler([small](int key, std::string val) {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    return small->loads_in_flight() < 1000;
+  });
+  std::atomic_bool done(false);
+  std::thread writer([small, &done]() {
+    for (int i = 0; i < 200; i++) {
+      small->get_or_load(i, [](const int& key) { return std::to_string(key); });
+    }
+    small->wait_for_cleanup();
+    done = true;
+  });
+  for (int i = 0; i < 1000 && !done; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (!done) {
+    writer.detach();
+    return 6;
+  }
+  writer.join();
+  small->setCleanupPool();
+  blockingPool->Stop();
+  blockingPool->Join();
+  delete small;
+  delete blockingPool;
+
+  pool.Stop();
+  pool.Join();
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+  const int MAX_SIZE = 64;
+
+  std::cout << "Testing LruCache..." << std::endl;
+  {
+    acl::LruCache<int, std::string> c;
+    c.set_max_size(MAX_SIZE);
+    if ((ret = TestCacheInterface(c, MAX_SIZE)) != 0) {
+      std::cerr << "LruCache test failed with code " << ret << std::endl;
+      return 100 + ret;
+    }
+
+    std::string value;
+    c.add_to_cache(1010, "ten");
+    c.add_to_cache(1020, "twenty");
+    if (!c.get_lower_bound(1015, value) || value != "twenty") {
+      std::cerr << "LruCache lower bound test failed" << std::endl;
+      return 200;
+    }
+  }
+  if ((ret = TestCostAndCleanup()) != 0) {
+    std::cerr << "LruCache cost test failed with code " << ret << std::endl;
+    return 500 + ret;
+  }
+  if ((ret = TestEvictAll()) != 0) {
+    std::cerr << "LruCache evict-all test failed with code " << ret << std::endl;
+    return 900 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing ShardedLruCache..." << std::endl;
+  {
+    acl::ShardedLruCache<int, std::string> c(4);
+    c.set_max_size(MAX_SIZE);
+    if ((ret = TestCacheInterface(c, MAX_SIZE)) != 0) {
+      std::cerr << "ShardedLruCache test failed with code " << ret << std::endl;
+      return 300 + ret;
+    }
+    if ((ret = TestShardedOrder()) != 0) {
+      std::cerr << "ShardedLruCache order test failed with code " << ret << std::endl;
+      return 400 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing TinyLFU admission..." << std::endl;
+  if ((ret = TestScanResistance<acl::LruCache<int, std::string>>()) != 0) {
+    std::cerr << "LruCache admission test failed with code " << ret << std::endl;
+    return 600 + ret;
+  }
+  if ((ret = TestScanResistance<acl::ShardedLruCache<int, std::string>>()) != 0) {
+    std::cerr << "ShardedLruCache admission test failed with code " << ret << std::endl;
+    return 700 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing LoadingCache..." << std::endl;
+  if ((ret = TestLoadingCache()) != 0) {
+    std::cerr << "LoadingCache test failed with code " << ret << std::endl;
+    return 800 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <AsyncFileIO.h>
+#include <FileIO.h>
+#include <MappedFile.h>
+
+using namespace acl::filesystem;
+
+static const char* g_fileName = "acl_MappedFile_Test.dat";
+
+/// @brief Writes a file of count uint32_t values 0, 1, 2, ...
+static bool WriteCounting(const char* name, uint32_t first, uint32_t count, bool truncate)
+{
+  std::vector<uint32_t> values(count);
+  for (uint32_t i = 0; i < count; i++) {
+    values[i] = first + i;
+  }
+  File file(name, File::WRITE | File::CREATE | (truncate ? File::TRUNCATE : 0));
+  size_t bytes = values.size() * sizeof(uint32_t);
+  return file.is_open() && file.pwrite(values.data(), bytes, first * sizeof(uint32_t)) == static_cast<int64_t>(bytes);
+}
+
+/// @brief Tests read-only mappings of whole files and of ranges.
+int TestReadOnly()
+{
+  MappedFile missing("acl_MappedFile_Test.missing");
+  if (missing.is_open() || missing.data() || missing.size() != 0) {
+    return 1;
+  }
+
+  const uint32_t count = 10000;
+  if (!WriteCounting(g_fileName, 0, count, true)) {
+    return 2;
+  }
+  MappedFile map(g_fileName);
+  if (!map.is_open() || map.size() != count * sizeof(uint32_t) || map.writable_data() ||
+      map.file_size() != file_size(g_fileName)) {
+    return 3;
+  }
+  Span<const uint32_t> values = map.as<uint32_t>();
+  if (values.size() != count) {
+    return 4;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    if (values[i] != i) {
+      return 5;
+    }
+  }
+  Span<const uint32_t> tail = values.subspan(count - 3, 100);
+  if (tail.size() != 3 || tail[0] != count - 3 || values.subspan(count + 1).size() != 0) {
+    return 6;
+  }
+  if (!map.advise(MappedFile::Advice::Sequential) || !map.prefetch(100, 1000) ||
+      !map.advise(MappedFile::Advice::Random, 5000) || !map.advise(MappedFile::Advice::Normal)) {
+    return 7;
+  }
+  map.advise(MappedFile::Advice::HugePages);    // Allowed to be refused
+
+  // A range that does not start on a page boundary, and one clamped to the end.
+  uint64_t offset = 1001 * sizeof(uint32_t);
+  if (!map.remap(offset, 40) || map.size() != 40 || map.offset() != offset) {
+    return 8;
+  }
+  uint32_t value;
+  memcpy(&value, map.data(), sizeof(value));
+  if (value != 1001) {
+    return 9;
+  }
+  if (!map.remap(count * sizeof(uint32_t) - 8, 1000) || map.size() != 8) {
+    return 10;
+  }
+
+  // A range past the end maps nothing until the file grows into it.
+  MappedFile growing(g_fileName, MappedFile::Mode::ReadOnly, count * sizeof(uint32_t));
+  if (!growing.is_open() || growing.size() != 0 || growing.data()) {
+    return 11;
+  }
+  if (!WriteCounting(g_fileName, count, count, false) || !growing.refresh() ||
+      growing.size() != count * sizeof(uint32_t)) {
+    return 12;
+  }
+  memcpy(&value, growing.data(), sizeof(value));
+  if (value != count) {
+    return 13;
+  }
+
+  MappedFile moved(std::move(growing));
+  if (growing.is_open() || !moved.is_open() || moved.size() != count * sizeof(uint32_t)) {
+    return 14;
+  }
+  return 0;
+}
+
+/// @brief Tests writing through a mapping and growing the file.
+int TestReadWrite()
+{
+  acl::filesystem::remove(g_fileName);
+  MappedFile map(g_fileName, MappedFile::Mode::ReadWrite);
+  if (!map.is_open() || map.size() != 0 || !map.resize(8192) || map.size() != 8192) {
+    return 1;
+  }
+  Span<char> bytes = map.writable_span();
+  if (bytes.size() != 8192) {
+    return 2;
+  }
+  for (size_t i = 0; i < bytes.size(); i++) {
+    bytes[i] = static_cast<char>(i % 199);
+  }
+  if (!map.resize(1 << 20) || map.size() != (1 << 20) || map.data()[8191] != static_cast<char>(8191 % 199)) {
+    return 3;
+  }
+  map.writable_data()[(1 << 20) - 1] = 'x';
+  if (!map.flush() || !map.flush(false)) {
+    return 4;
+  }
+
+  File file(g_fileName, File::READ);
+  char check[8192];
+  char last;
+  if (file.pread(check, sizeof(check), 0) != 8192 || file.pread(&last, 1, (1 << 20) - 1) != 1 || last != 'x') {
+    return 5;
+  }
+  for (size_t i = 0; i < sizeof(check); i++) {
+    if (check[i] != static_cast<char>(i % 199)) {
+      return 6;
+    }
+  }
+
+  MappedFile readOnly(g_fileName);
+  if (readOnly.resize(10) || readOnly.writable_span().size() != 0) {
+    return 7;
+  }
+  map.close();
+  if (map.is_open() || map.data() || map.refresh() || map.mode() != MappedFile::Mode::ReadOnly) {
+    return 8;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing read-only mappings..." << std::endl;
+  if ((ret = TestReadOnly()) != 0) {
+    std::cerr << "Read-only mapping test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "Testing read-write mappings..." << std::endl;
+  if ((ret = TestReadWrite()) != 0) {
+    std::cerr << "Read-write mapping test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+
+  acl::filesystem::remove(g_fileName);
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
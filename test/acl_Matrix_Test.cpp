@@ -0,0 +1,210 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <matrix.hpp>
+#include <polyfit.tcc>
+
+using mathalgo::matrix;
+
+/// @brief Fills a matrix with values in [-1, 1) from a fixed seed.
+template <typename T>
+static matrix<T> Random(unsigned int rows, unsigned int cols, unsigned int seed)
+{
+  matrix<T> m(rows, cols);
+  srand(seed);
+  for (unsigned int r = 0; r < rows; r++) {
+    for (unsigned int c = 0; c < cols; c++) {
+      m(r, c) = static_cast<T>(rand() % 2000 - 1000) / 1000;
+    }
+  }
+  return m;
+}
+
+/// @brief The textbook triple loop the kernels are checked against.
+template <typename T>
+static matrix<T> NaiveProduct(const matrix<T>& a, const matrix<T>& b)
+{
+  matrix<T> result(a.rows(), b.cols());
+  for (unsigned int r = 0; r < a.rows(); r++) {
+    for (unsigned int c = 0; c < b.cols(); c++) {
+      double sum = 0;
+      for (unsigned int k = 0; k < a.cols(); k++) {
+        sum += static_cast<double>(a(r, k)) * b(k, c);
+      }
+      result(r, c) = static_cast<T>(sum);
+    }
+  }
+  return result;
+}
+
+template <typename T>
+static bool Near(const matrix<T>& a, const matrix<T>& b, double tolerance)
+{
+  if (a.rows() != b.rows() || a.cols() != b.cols()) {
+    return false;
+  }
+  for (unsigned int r = 0; r < a.rows(); r++) {
+    for (unsigned int c = 0; c < a.cols(); c++) {
+      if (std::fabs(static_cast<double>(a(r, c)) - b(r, c)) > tolerance) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// @brief Tests products against the naive loop, across block edges.
+template <typename T>
+int TestProducts(double tolerance)
+{
+  const unsigned int shapes[][3] = { {1, 1, 1}, {3, 5, 2}, {65, 129, 257}, {200, 300, 70}, {1, 400, 1} };
+  for (const auto& shape : shapes) {
+    matrix<T> a = Random<T>(shape[0], shape[1], shape[0] + 1);
+    matrix<T> b = Random<T>(shape[1], shape[2], shape[2] + 2);
+    if (!Near(a * b, NaiveProduct(a, b), tolerance)) {
+      return 1;
+    }
+
+    // A^T B and A^T A without forming A^T.
+    matrix<T> c = Random<T>(shape[0], shape[2], shape[1] + 3);
+    if (!Near(a.transposeMultiply(c), NaiveProduct(a.transpose(), c), tolerance)) {
+      return 2;
+    }
+    matrix<T> gram = a.transposeMultiply(a);
+    if (!Near(gram, NaiveProduct(a.transpose(), a), tolerance)) {
+      return 3;
+    }
+    for (unsigned int r = 0; r < gram.rows(); r++) {
+      for (unsigned int col = 0; col < r; col++) {
+        if (gram(r, col) != gram(col, r)) {
+          return 4;
+        }
+      }
+    }
+  }
+
+  matrix<T> a(2, 3), b(2, 3);
+  try {
+    a * b;
+    return 5;
+  } catch (const std::domain_error&) {
+  }
+  try {
+    matrix<T>(3, 2).transposeMultiply(b);
+    return 6;
+  } catch (const std::domain_error&) {
+  }
+  return 0;
+}
+
+/// @brief Tests transposes, accessors and moving the data out.
+int TestLayout()
+{
+  matrix<double> a = Random<double>(70, 45, 7);
+  matrix<double> t = a.transpose();
+  if (t.rows() != 45 || t.cols() != 70) {
+    return 1;
+  }
+  for (unsigned int r = 0; r < a.rows(); r++) {
+    for (unsigned int c = 0; c < a.cols(); c++) {
+      if (t.unchecked(c, r) != a(r, c) || a.row(r)[c] != a(r, c)) {
+        return 2;
+      }
+    }
+  }
+
+  matrix<double> inPlace = a;
+  inPlace.transposeInPlace();
+  if (!Near(inPlace, t, 0)) {
+    return 3;
+  }
+  matrix<double> square = Random<double>(33, 33, 8);
+  matrix<double> squareT = square.transpose();
+  square.transposeInPlace();
+  if (!Near(square, squareT, 0)) {
+    return 4;
+  }
+  matrix<double> column = Random<double>(10, 1, 9);
+  std::vector<double> values = column.data();
+  column.transposeInPlace();
+  if (column.rows() != 1 || column.cols() != 10 || column.data() != values) {
+    return 5;
+  }
+
+  const double* storage = column.row(0);
+  std::vector<double> moved = std::move(column).data();
+  if (moved.data() != storage || moved != values) {
+    return 6;
+  }
+
+  try {
+    a(70, 0);
+    return 7;
+  } catch (const std::out_of_range&) {
+  }
+  return 0;
+}
+
+/// @brief Tests that polyfit built on the fused products still recovers a polynomial.
+int TestPolyfit()
+{
+  const double coeffs[] = { 0.5, -2.0, 3.0, 0.25 };
+  std::vector<double> x, y;
+  for (int i = 0; i < 2000; i++) {
+    double v = -1.0 + i / 1000.0;
+    x.push_back(v);
+    y.push_back(coeffs[0] + v * (coeffs[1] + v * (coeffs[2] + v * coeffs[3])));
+  }
+  std::vector<double> fit = mathalgo::polyfit(x, y, 3);
+  if (fit.size() != 4) {
+    return 1;
+  }
+  for (size_t i = 0; i < fit.size(); i++) {
+    if (std::fabs(fit[i] - coeffs[i]) > 1e-8) {
+      return 2;
+    }
+  }
+  std::vector<double> fitted = mathalgo::polyval(fit, x);
+  for (size_t i = 0; i < x.size(); i++) {
+    if (std::fabs(fitted[i] - y[i]) > 1e-8) {
+      return 3;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing double products..." << std::endl;
+  if ((ret = TestProducts<double>(1e-9)) != 0) {
+    std::cerr << "Double product test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "Testing float products..." << std::endl;
+  if ((ret = TestProducts<float>(1e-2)) != 0) {
+    std::cerr << "Float product test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "Testing layout..." << std::endl;
+  if ((ret = TestLayout()) != 0) {
+    std::cerr << "Layout test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  std::cout << "Testing polyfit..." << std::endl;
+  if ((ret = TestPolyfit()) != 0) {
+    std::cerr << "Polyfit test failed with code " << ret << std::endl;
+    return 400 + ret;
+  }
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,300 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <CoreSocket.hpp>
+#include <EventLoop.hpp>
+#include <MessageChannel.hpp>
+#include <ThreadPool.h>
+
+using namespace acl::CoreSocket;
+
+static int g_numMessages = 1000;
+
+/// @brief Fills a message whose contents depend on its index and size.
+static std::vector<char> MakeMessage(int i, size_t size)
+{
+  std::vector<char> msg(size);
+  for (size_t b = 0; b < size; b++) {
+    msg[b] = static_cast<char>((b + i) % 128);
+  }
+  return msg;
+}
+
+/// @brief Size of message i; every 100th one is larger than coalesceBytes.
+static size_t MessageSize(int i)
+{
+  return (i % 100 == 99) ? 100000 : static_cast<size_t>(i % 50);
+}
+
+/// @brief Connects a pair of TCP sockets over loopback.
+static bool MakePair(SOCKET& a, SOCKET& b)
+{
+  int port = 0;
+  SOCKET lSock = get_a_TCP_socket(&port, "127.0.0.1");
+  if (lSock == BAD_SOCKET) {
+    return false;
+  }
+  bool ok = connect_tcp_to("127.0.0.1", port, nullptr, &a) && poll_for_accept(lSock, &b, 10.0) == 1;
+  close_socket(lSock);
+  return ok;
+}
+
+/// @brief Tests splitting a stream that arrives a byte at a time.
+int TestFrameReader()
+{
+  std::vector<char> stream;
+  for (int i = 0; i < 3; i++) {
+    std::string body(static_cast<size_t>(i * 10000), static_cast<char>('a' + i));
+    uint32_t header = htonl(static_cast<uint32_t>(body.size()));
+    stream.insert(stream.end(), reinterpret_cast<char*>(&header), reinterpret_cast<char*>(&header) + 4);
+    stream.insert(stream.end(), body.begin(), body.end());
+  }
+
+  FrameReader reader;
+  int found = 0;
+  for (char c : stream) {
+    size_t available;
+    char* space = reader.space(available);
+    if (available == 0) {
+      return 1;
+    }
+    *space = c;
+    reader.commit(1);
+    const char* data;
+    size_t length;
+    int ret;
+    while ((ret = reader.next(data, length)) == 1) {
+      if (length != static_cast<size_t>(found * 10000) || (length > 0 && data[length - 1] != 'a' + found)) {
+        return 2;
+      }
+      found++;
+    }
+    if (ret < 0) {
+      return 3;
+    }
+  }
+  if (found != 3) {
+    return 4;
+  }
+
+  // A prefix beyond the limit marks the stream corrupt.
+  FrameReader small(100);
+  size_t available;
+  char* space = small.space(available);
+  uint32_t header = htonl(101);
+  memcpy(space, &header, 4);
+  small.commit(4);
+  const char* data;
+  size_t length;
+  if (small.next(data, length) != -1) {
+    return 5;
+  }
+  return 0;
+}
+
+/// @brief Tests batched and direct sends between two blocking channels.
+int TestBlocking()
+{
+  SOCKET a, b;
+  if (!MakePair(a, b)) {
+    return 1;
+  }
+  int ret = 0;
+  {
+    MessageChannel sender(a);
+    MessageChannel receiver(b);
+
+    const char* data;
+    size_t length;
+    if (receiver.receive(data, length, 0.05) != 0) {
+      ret = 2;
+    }
+
+    std::thread t([&sender, &ret]() {
+      for (int i = 0; i < g_numMessages; i++) {
+        std::vector<char> msg = MakeMessage(i, MessageSize(i));
+        if (!sender.send(msg.data(), msg.size(), i % 10 != 9)) {
+          ret = 3;
+          break;
+        }
+      }
+      sender.flush();
+    });
+    for (int i = 0; ret == 0 && i < g_numMessages; i++) {
+      if (receiver.receive(data, length, 10.0) != 1) {
+        ret = 4;
+        break;
+      }
+      std::vector<char> expected = MakeMessage(i, MessageSize(i));
+      if (length != expected.size() || memcmp(data, expected.data(), length) != 0) {
+        ret = 5;
+      }
+    }
+    t.join();
+
+    // Held messages go out once they have waited flushDelay.
+    MessageChannelOptions options;
+    options.flushDelay = 0.01;
+    MessageChannel delayed(a, options);
+    delayed.send("x", 1, true);
+    if (ret == 0 && receiver.receive(data, length, 0.05) != 0) {
+      ret = 6;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    delayed.flush_if_due();
+    if (ret == 0 && (receiver.receive(data, length, 5.0) != 1 || length != 1 || data[0] != 'x')) {
+      ret = 7;
+    }
+  }
+  close_socket(a);
+  close_socket(b);
+  return ret;
+}
+
+/// @brief Runs an echo server of AsyncMessageChannels and checks it with
+/// blocking clients.
+/// @param [in] pool Pool to dispatch handlers to, or nullptr for the loop thread.
+int TestAsync(acl::ThreadPool* pool)
+{
+  EventLoop loop(pool);
+  int port = 0;
+  SOCKET listener = get_a_TCP_socket(&port, "127.0.0.1");
+  if (!loop.valid() || listener == BAD_SOCKET) {
+    return 1;
+  }
+
+  std::mutex channelMutex;
+  std::vector<std::unique_ptr<AsyncMessageChannel>> channels;
+  std::vector<SOCKET> accepted;
+  std::atomic_int closed(0);
+  loop.add_listener(listener, [&](SOCKET s) {
+    // Messages may arrive on a pool thread before the constructor returns.
+    auto self = std::make_shared<std::atomic<AsyncMessageChannel*>>(nullptr);
+    AsyncMessageChannel* c = new AsyncMessageChannel(loop, s,
+      [self](const char* data, size_t length) {
+        while (!*self) {
+          std::this_thread::yield();
+        }
+        self->load()->send(data, length);
+      },
+      [&closed]() { closed++; });
+    *self = c;
+    std::lock_guard<std::mutex> lock(channelMutex);
+    channels.emplace_back(c);
+    accepted.push_back(s);
+  });
+  std::thread server([&loop]() { loop.run(); });
+
+  const int numClients = 4;
+  std::vector<std::thread> clients;
+  std::atomic_int ret(0);
+  for (int c = 0; c < numClients; c++) {
+    clients.emplace_back([port, &ret]() {
+      SOCKET s;
+      if (!connect_tcp_to("127.0.0.1", port, nullptr, &s)) {
+        ret = 2;
+        return;
+      }
+      {
+        MessageChannel channel(s);
+        std::thread writer([&channel]() {
+          for (int i = 0; i < g_numMessages; i++) {
+            std::vector<char> msg = MakeMessage(i, MessageSize(i));
+            channel.send(msg.data(), msg.size(), true);
+          }
+          channel.flush();
+        });
+        for (int i = 0; i < g_numMessages; i++) {
+          const char* data;
+          size_t length;
+          if (channel.receive(data, length, 10.0) != 1) {
+            ret = 3;
+            break;
+          }
+          std::vector<char> expected = MakeMessage(i, MessageSize(i));
+          if (length != expected.size() || memcmp(data, expected.data(), length) != 0) {
+            ret = 4;
+          }
+        }
+        writer.join();
+      }
+      close_socket(s);
+    });
+  }
+  for (auto& t : clients) {
+    t.join();
+  }
+
+  // Every server channel sees its client go away.
+  auto start = std::chrono::steady_clock::now();
+  while (closed < numClients && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (ret == 0 && closed != numClients) {
+    ret = 5;
+  }
+
+  loop.stop();
+  server.join();
+  loop.remove(listener);
+  close_socket(listener);
+  channels.clear();
+  for (auto s : accepted) {
+    close_socket(s);
+  }
+  return ret;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing frame reader..." << std::endl;
+  if ((ret = TestFrameReader()) != 0) {
+    std::cerr << "Frame reader test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing blocking channel..." << std::endl;
+  if ((ret = TestBlocking()) != 0) {
+    std::cerr << "Blocking channel test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing async channel on the loop thread..." << std::endl;
+  if ((ret = TestAsync(nullptr)) != 0) {
+    std::cerr << "Inline async channel test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing async channel on a thread pool..." << std::endl;
+  {
+    acl::ThreadPool pool(4, 1000);
+    pool.Start();
+    ret = TestAsync(&pool);
+    pool.Stop();
+    pool.Join();
+    if (ret != 0) {
+      std::cerr << "Pool async channel test failed with code " << ret << std::endl;
+      return 400 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
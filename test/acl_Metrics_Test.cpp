@@ -0,0 +1,182 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+// Exercise the macros even when the library itself is built without them.
+#ifndef ACL_ENABLE_METRICS
+#define ACL_ENABLE_METRICS
+#endif
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Histogram.hpp>
+#include <Metrics.hpp>
+#include <TSQueue.tcc>
+
+/// @brief Tests bucket boundaries and percentile accuracy.
+int TestHistogram()
+{
+  // Every value maps to a bucket whose middle is within the stated error.
+  for (uint64_t v = 1; v < (uint64_t(1) << 62); v = v * 3 / 2 + 1) {
+    size_t index = acl::Histogram::bucket_index(v);
+    if (index >= acl::Histogram::BUCKETS) {
+      return 1;
+    }
+    double error = std::fabs(static_cast<double>(acl::Histogram::bucket_value(index)) - v) / v;
+    if (error > 1.0 / acl::Histogram::SUB_BUCKETS) {
+      return 2;
+    }
+  }
+  if (acl::Histogram::bucket_index(UINT64_MAX) != acl::Histogram::BUCKETS - 1) {
+    return 3;
+  }
+
+  acl::Histogram h;
+  if (h.snapshot().count() != 0 || h.snapshot().percentile(50) != 0) {
+    return 4;
+  }
+  for (uint64_t v = 1; v <= 10000; v++) {
+    h.record(v);
+  }
+  acl::HistogramSnapshot s = h.snapshot();
+  if (s.count() != 10000 || s.min() != 1 || s.max() != 10000 || s.mean() != 5000.5) {
+    return 5;
+  }
+  const double percents[] = { 50, 90, 99, 99.9 };
+  for (double p : percents) {
+    double expected = p * 100;
+    if (std::fabs(static_cast<double>(s.percentile(p)) - expected) / expected > 0.04) {
+      return 6;
+    }
+  }
+  if (s.percentile(0) != 1 || s.percentile(100) != 10000) {
+    return 7;
+  }
+
+  // Merged snapshots add up.
+  acl::Histogram other;
+  other.record(1000000, 5);
+  acl::HistogramSnapshot merged = s;
+  merged.merge(other.snapshot());
+  if (merged.count() != 10005 || merged.max() != 1000000 || merged.min() != 1) {
+    return 8;
+  }
+
+  h.reset();
+  if (h.snapshot().count() != 0) {
+    return 9;
+  }
+  return 0;
+}
+
+/// @brief Tests that no values are lost when many threads record at once.
+int TestConcurrentRecording()
+{
+  acl::Histogram h;
+  const int numThreads = 8;
+  const int perThread = 100000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; t++) {
+    threads.emplace_back([&h, t]() {
+      for (int i = 0; i < perThread; i++) {
+        h.record(static_cast<uint64_t>(t * perThread + i));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  acl::HistogramSnapshot s = h.snapshot();
+  if (s.count() != static_cast<uint64_t>(numThreads) * perThread) {
+    return 1;
+  }
+  if (s.min() != 0 || s.max() != static_cast<uint64_t>(numThreads * perThread - 1)) {
+    return 2;
+  }
+  return 0;
+}
+
+/// @brief Tests the registry, the macros and the JSON export.
+int TestRegistry()
+{
+  acl::Metrics& metrics = acl::Metrics::instance();
+  if (&metrics.counter("test.count") != &metrics.counter("test.count")) {
+    return 1;
+  }
+
+  for (int i = 0; i < 10; i++) {
+    ACL_METRIC_COUNT("test.count", 2);
+    ACL_METRIC_RECORD("test.values", i);
+    ACL_METRIC_SCOPED_TIMER("test.scope_ns");
+  }
+  ACL_METRIC_TIMESTAMP(start);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  ACL_METRIC_RECORD_SINCE("test.since_ns", start);
+
+  acl::MetricsSnapshot s = metrics.snapshot();
+  if (s.counters["test.count"] != 20 || s.histograms["test.values"].count() != 10 ||
+      s.histograms["test.scope_ns"].count() != 10) {
+    return 2;
+  }
+  if (s.histograms["test.since_ns"].min() < 1500000) {
+    return 3;
+  }
+
+  // The queue reports its depth and how long dequeues waited.
+  acl::TSQueue<int> queue;
+  queue.enqueue(1);
+  queue.enqueue(2);
+  int value;
+  queue.dequeue(value, 10);
+  s = metrics.snapshot();
+  if (s.histograms["TSQueue.depth"].max() != 2 || s.histograms["TSQueue.wait_ns"].count() != 1) {
+    return 4;
+  }
+
+  std::string json = s.to_json();
+  if (json.find("\"test.count\":20") == std::string::npos ||
+      json.find("\"test.values\":{\"count\":10,\"min\":0,\"max\":9") == std::string::npos) {
+    std::cerr << json << std::endl;
+    return 5;
+  }
+
+  metrics.reset();
+  s = metrics.snapshot();
+  if (s.counters["test.count"] != 0 || s.histograms["test.values"].count() != 0) {
+    return 6;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing histogram..." << std::endl;
+  if ((ret = TestHistogram()) != 0) {
+    std::cerr << "Histogram test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing concurrent recording..." << std::endl;
+  if ((ret = TestConcurrentRecording()) != 0) {
+    std::cerr << "Concurrent recording test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing metrics registry..." << std::endl;
+  if ((ret = TestRegistry()) != 0) {
+    std::cerr << "Metrics registry test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,271 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <polyfit.tcc>
+#include <ThreadPool.h>
+
+/// @brief Coefficients of the cubic that the fits should recover.
+static const double g_coeffs[] = { 0.5, -2.0, 3.0, 0.25 };
+
+static double Cubic(double x, double scale)
+{
+  return scale * (g_coeffs[0] + x * (g_coeffs[1] + x * (g_coeffs[2] + x * g_coeffs[3])));
+}
+
+/// @brief Tests the compile-time degree fit against the general one.
+int TestFixed()
+{
+  std::vector<double> x, y;
+  for (int i = 0; i < 500; i++) {
+    x.push_back(-1.0 + i / 250.0);
+    y.push_back(Cubic(x.back(), 1));
+  }
+  std::array<double, 4> fit = mathalgo::polyfit<3>(x, y);
+  std::vector<double> general = mathalgo::polyfit(x, y, 3);
+  for (size_t i = 0; i < fit.size(); i++) {
+    if (std::fabs(fit[i] - g_coeffs[i]) > 1e-9 || std::fabs(fit[i] - general[i]) > 1e-9) {
+      return 1;
+    }
+  }
+  if (std::fabs(mathalgo::polyval(fit, 0.3) - Cubic(0.3, 1)) > 1e-9) {
+    return 2;
+  }
+
+  // A constant and a line through two points are both exact.
+  std::array<double, 1> mean = mathalgo::polyfit<0>(x.data(), y.data(), 1);
+  std::array<double, 2> line = mathalgo::polyfit<1>(x.data(), y.data(), 2);
+  if (std::fabs(mean[0] - y[0]) > 1e-12 || std::fabs(line[0] + line[1] * x[1] - y[1]) > 1e-9) {
+    return 3;
+  }
+
+  // Points at only two distinct x values cannot determine a cubic.
+  std::vector<double> twoX, twoY;
+  for (int i = 0; i < 12; i++) {
+    twoX.push_back(i % 2 ? 0.75 : 0.25);
+    twoY.push_back(Cubic(twoX.back(), 1));
+  }
+  try {
+    mathalgo::polyfit<3>(twoX, twoY);
+    return 4;
+  } catch (const std::domain_error&) {
+  }
+  try {
+    mathalgo::polyfit<3>(x, std::vector<double>(3));
+    return 5;
+  } catch (const std::invalid_argument&) {
+  }
+  return 0;
+}
+
+/// @brief Tests fits on x far from [-1, 1], such as sample indices and
+/// offset timestamps, which the general fit handles.
+template <typename T>
+int TestRange(T offset, T step, double tolerance)
+{
+  const T coeffs[] = { T(1), T(2), T(0.5), T(0.01) };
+  const size_t count = 64;
+  const size_t series = 100;
+  std::vector<T> x(count), y(count);
+  for (size_t i = 0; i < count; i++) {
+    // Fit around the offset so that the coefficients stay representable.
+    T u = static_cast<T>(i) * step;
+    x[i] = offset + u;
+    y[i] = coeffs[0] + u * (coeffs[1] + u * (coeffs[2] + u * coeffs[3]));
+  }
+  // Errors are relative to the largest value, since the small ones cancel.
+  double yMax = std::fabs(y.back());
+  std::array<T, 4> fit = mathalgo::polyfit<3>(x, y);
+  std::vector<T> fitted(count);
+  mathalgo::polyval(fit.data(), fit.size(), x.data(), fitted.data(), count);
+  for (size_t i = 0; i < count; i++) {
+    if (!(std::fabs(fitted[i] - y[i]) <= tolerance * yMax)) {
+      return 1;
+    }
+  }
+  std::vector<T> general = mathalgo::polyfit(x, y, 3);
+  if (offset == 0) {
+    for (size_t j = 0; j < 4; j++) {
+      if (!(std::fabs(fit[j] - coeffs[j]) <= 100 * tolerance + std::fabs(general[j] - coeffs[j]))) {
+        return 2;
+      }
+    }
+  }
+
+  // The same curve for every series, with shared and with per-series x.
+  std::vector<T> sx(count * series), sy(count * series), coeff(4 * series);
+  for (size_t k = 0; k < count; k++) {
+    for (size_t s = 0; s < series; s++) {
+      sx[k * series + s] = x[k];
+      sy[k * series + s] = y[k];
+    }
+  }
+  for (bool shared : { true, false }) {
+    mathalgo::polyfitBatch<3>(shared ? x.data() : sx.data(), shared, sy.data(), count, series, coeff.data());
+    for (size_t s = 0; s < series; s++) {
+      T single[4];
+      for (size_t j = 0; j < 4; j++) {
+        single[j] = coeff[j * series + s];
+      }
+      mathalgo::polyval(single, 4, x.data(), fitted.data(), count);
+      for (size_t i = 0; i < count; i++) {
+        if (!(std::fabs(fitted[i] - y[i]) <= tolerance * yMax)) {
+          return shared ? 3 : 4;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/// @brief Tests Horner evaluation against summing powers, including lengths
+/// that do not fill a vector register.
+template <typename T>
+int TestPolyval(double tolerance)
+{
+  std::vector<T> coeff = { T(0.5), T(-2), T(3), T(0.25), T(-0.125) };
+  for (size_t n : { size_t(0), size_t(1), size_t(7), size_t(9), size_t(1003) }) {
+    std::vector<T> x(n);
+    for (size_t i = 0; i < n; i++) {
+      x[i] = static_cast<T>(-2.0 + 4.0 * i / (n + 1));
+    }
+    std::vector<T> y = mathalgo::polyval(coeff, x);
+    if (y.size() != n) {
+      return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+      double expected = 0;
+      double power = 1;
+      for (T c : coeff) {
+        expected += c * power;
+        power *= x[i];
+      }
+      if (std::fabs(y[i] - expected) > tolerance) {
+        return 2;
+      }
+    }
+  }
+
+  T x = 2;
+  T y = 1;
+  mathalgo::polyval(static_cast<const T*>(nullptr), 0, &x, &y, 1);
+  if (y != 0) {
+    return 3;
+  }
+  return 0;
+}
+
+/// @brief Tests batched fits with shared and per-series x values.
+int TestBatch(acl::ThreadPool* pool)
+{
+  const size_t count = 40;
+  const size_t series = 1000;
+  std::vector<double> sharedX(count), x(count * series), y(count * series), ySharedX(count * series);
+  for (size_t k = 0; k < count; k++) {
+    sharedX[k] = -1.0 + 2.0 * k / count;
+    for (size_t s = 0; s < series; s++) {
+      // Each series is the cubic scaled by its own factor.
+      double scale = 1.0 + s / 100.0;
+      double xs = sharedX[k] + s / 1000.0;
+      x[k * series + s] = xs;
+      y[k * series + s] = Cubic(xs, scale);
+      ySharedX[k * series + s] = Cubic(sharedX[k], scale);
+    }
+  }
+  // A series with a single repeated x cannot be fitted.
+  for (size_t k = 0; k < count; k++) {
+    x[k * series + 17] = 0.5;
+  }
+
+  std::vector<double> coeff(4 * series);
+  mathalgo::polyfitBatch<3>(sharedX.data(), true, ySharedX.data(), count, series, coeff.data(), pool);
+  for (size_t s = 0; s < series; s++) {
+    for (size_t j = 0; j < 4; j++) {
+      if (std::fabs(coeff[j * series + s] - g_coeffs[j] * (1.0 + s / 100.0)) > 1e-8) {
+        return 1;
+      }
+    }
+  }
+
+  mathalgo::polyfitBatch<3>(x.data(), false, y.data(), count, series, coeff.data(), pool);
+  for (size_t s = 0; s < series; s++) {
+    for (size_t j = 0; j < 4; j++) {
+      double value = coeff[j * series + s];
+      if (s == 17) {
+        if (!std::isnan(value)) {
+          return 2;
+        }
+      } else if (std::fabs(value - g_coeffs[j] * (1.0 + s / 100.0)) > 1e-7) {
+        return 3;
+      }
+    }
+  }
+
+  std::vector<double> flatX(count, 1.0);
+  mathalgo::polyfitBatch<3>(flatX.data(), true, y.data(), count, series, coeff.data(), pool);
+  if (!std::isnan(coeff[0]) || !std::isnan(coeff.back())) {
+    return 4;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing fixed-degree polyfit..." << std::endl;
+  if ((ret = TestFixed()) != 0) {
+    std::cerr << "Fixed-degree polyfit test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "Testing fixed-degree polyfit on wide and offset x..." << std::endl;
+  if ((ret = TestRange<float>(0, 1, 1e-3)) != 0) {
+    std::cerr << "Float index polyfit test failed with code " << ret << std::endl;
+    return 600 + ret;
+  }
+  if ((ret = TestRange<double>(0, 1, 1e-9)) != 0) {
+    std::cerr << "Double index polyfit test failed with code " << ret << std::endl;
+    return 700 + ret;
+  }
+  if ((ret = TestRange<double>(1000, 1, 1e-7)) != 0) {
+    std::cerr << "Double offset polyfit test failed with code " << ret << std::endl;
+    return 800 + ret;
+  }
+  if ((ret = TestRange<float>(0, 10, 1e-3)) != 0) {
+    std::cerr << "Float wide-range polyfit test failed with code " << ret << std::endl;
+    return 900 + ret;
+  }
+  std::cout << "Testing polyval..." << std::endl;
+  if ((ret = TestPolyval<double>(1e-10)) != 0) {
+    std::cerr << "Double polyval test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  if ((ret = TestPolyval<float>(1e-3)) != 0) {
+    std::cerr << "Float polyval test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  std::cout << "Testing polyfitBatch..." << std::endl;
+  if ((ret = TestBatch(nullptr)) != 0) {
+    std::cerr << "polyfitBatch test failed with code " << ret << std::endl;
+    return 400 + ret;
+  }
+  std::cout << "Testing polyfitBatch on a pool..." << std::endl;
+  acl::ThreadPool pool(4, 1000);
+  pool.Start();
+  ret = TestBatch(&pool);
+  pool.Stop();
+  pool.Join();
+  if (ret != 0) {
+    std::cerr << "Pooled polyfitBatch test failed with code " << ret << std::endl;
+    return 500 + ret;
+  }
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <shared_mutex.h>
+
+/// @brief Tests exclusive and shared ownership rules through the public API.
+/// @return 0 on success, unique error code on failure.
+int TestOwnership(acl::shared_mutex& m)
+{
+  // Readers share, writers exclude readers.
+  {
+    acl::shared_lock r1(m);
+    acl::shared_lock r2(m, std::try_to_lock);
+    if (!r1.owns_lock() || !r2.owns_lock()) {
+      return 1;
+    }
+    if (m.try_lock()) {
+      return 2;
+    }
+  }
+
+  // Writers exclude everyone.
+  if (!m.try_lock()) {
+    return 3;
+  }
+  {
+    acl::shared_lock r(m, std::try_to_lock);
+    if (r.owns_lock()) {
+      return 4;
+    }
+  }
+  bool otherGotIt = true;
+  std::thread other([&m, &otherGotIt]() {
+    otherGotIt = m.try_lock();
+  });
+  other.join();
+  if (otherGotIt) {
+    return 5;
+  }
+  m.unlock();
+
+  // Deferred and adopted locks.
+  {
+    acl::shared_lock r(m, std::defer_lock);
+    if (r.owns_lock() || !r.try_lock() || !r.owns_lock()) {
+      return 6;
+    }
+    r.unlock();
+    m.lock_shared();
+    acl::shared_lock adopted(m, std::adopt_lock);
+    if (!adopted.owns_lock()) {
+      return 7;
+    }
+  }
+  if (!m.try_lock()) {
+    return 8;
+  }
+  m.unlock();
+  return 0;
+}
+
+/// @brief Readers must never see a half-finished write.
+int TestConsistency(acl::shared_mutex& m)
+{
+  int a = 0;
+  int b = 0;
+  std::atomic_int torn(0);
+  std::atomic_bool done(false);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      while (!done) {
+        acl::shared_lock lock(m);
+        if (a != b) {
+          torn++;
+        }
+      }
+    });
+  }
+  for (int t = 0; t < 2; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 2000; i++) {
+        std::lock_guard<acl::shared_mutex> lock(m);
+        a++;
+        b++;
+      }
+    });
+  }
+  threads[4].join();
+  threads[5].join();
+  done = true;
+  for (int t = 0; t < 4; t++) {
+    threads[t].join();
+  }
+
+  if (torn != 0 || a != 4000 || b != 4000) {
+    return 1;
+  }
+  return 0;
+}
+
+/// @brief A writer must get in while readers hold the lock continuously.
+int TestWriterPreference(acl::shared_mutex& m)
+{
+  std::atomic_bool done(false);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&m, &done]() {
+      while (!done) {
+        acl::shared_lock lock(m);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  int writes = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (writes < 20 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+    std::lock_guard<acl::shared_mutex> lock(m);
+    writes++;
+  }
+  done = true;
+  for (auto& t : readers) {
+    t.join();
+  }
+
+  if (writes < 20) {
+    return 1;
+  }
+  return 0;
+}
+
+template <class M>
+int TestMutex(int base)
+{
+  int ret;
+  M m;
+  if ((ret = TestOwnership(m)) != 0) {
+    std::cerr << "ownership test failed with code " << ret << std::endl;
+    return base + ret;
+  }
+  if ((ret = TestConsistency(m)) != 0) {
+    std::cerr << "consistency test failed with code " << ret << std::endl;
+    return base + 10 + ret;
+  }
+  if ((ret = TestWriterPreference(m)) != 0) {
+    std::cerr << "writer preference test failed with code " << ret << std::endl;
+    return base + 20 + ret;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing shared_mutex..." << std::endl;
+  if ((ret = TestMutex<acl::shared_mutex>(100)) != 0) {
+    return ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing distributed_shared_mutex..." << std::endl;
+  if ((ret = TestMutex<acl::distributed_shared_mutex>(200)) != 0) {
+    return ret;
+  }
+  {
+    acl::distributed_shared_mutex m(3);
+    if (m.get_num_slots() != 4) {
+      std::cerr << "distributed_shared_mutex slot count is wrong" << std::endl;
+      return 300;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
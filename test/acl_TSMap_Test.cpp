@@ -0,0 +1,324 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <TSMap.tcc>
+#include <TSUnorderedMap.tcc>
+#include <TSSnapshotMap.tcc>
+
+/// @brief Runs the tests shared by the ordered and hashed maps.
+/// @return 0 on success, unique error code on failure.
+template <class M>
+int TestMapInterface(M& m)
+{
+  std::string value;
+
+  if (!m.empty() || m.size() != 0 || m.find(1).second || m.find(1, value)) {
+    return 1;
+  }
+
+  // emplace only overwrites when forced.
+  if (!m.emplace(1, "one") || m.emplace(1, "uno") || m.find(1).first != "one") {
+    return 2;
+  }
+  if (!m.emplace(1, "uno", true) || !m.find(1, value) || value != "uno" || m.size() != 1) {
+    return 3;
+  }
+
+  // replace returns the old value.
+  auto old = m.replace(1, "one");
+  if (old.second || old.first != "uno" || m.find(1).first != "one") {
+    return 4;
+  }
+  auto fresh = m.replace(2, "two");
+  if (!fresh.second || fresh.first != "two" || m.size() != 2) {
+    return 5;
+  }
+  if (!m.createInPlace(3, 5, 'x') || m.find(3).first != "xxxxx" || m.createInPlace(3, 1, 'y')) {
+    return 6;
+  }
+
+  // perform and perform_ro.
+  if (!m.perform(2, [](const int& k, std::string& v) { v += "!"; return true; }) ||
+      m.find(2).first != "two!") {
+    return 7;
+  }
+  size_t length = 0;
+  if (!m.perform_ro(2, [&length](const int& k, const std::string& v) { length = v.size(); return true; }) ||
+      length != 4 || m.perform_ro(9, [](const int& k, const std::string& v) { return true; })) {
+    return 8;
+  }
+
+  // erase honors its predicate; remove hands back the value.
+  if (m.erase(2, [](const int& k, std::string& v) { return false; }) || !m.erase(2) || m.find(2).second) {
+    return 9;
+  }
+  auto removed = m.remove(3);
+  if (!removed.second || removed.first != "xxxxx" || m.remove(3).second || m.size() != 1) {
+    return 10;
+  }
+
+  // Iteration.
+  for (int i = 10; i < 20; i++) {
+    m.emplace(i, std::to_string(i));
+  }
+  std::vector<int> keys = m.getKeyList();
+  if (keys.size() != 11 || m.for_each_ro([](const int& k, const std::string& v) { return k >= 10; }) != 10) {
+    return 11;
+  }
+  m.for_each([](const int& k, std::string& v) { v = "x"; return true; });
+  if (m.find(15).first != "x") {
+    return 12;
+  }
+  if (m.delete_if([](const int& k, std::string& v) { return k % 2 == 0; }) != 5 || m.size() != 6) {
+    return 13;
+  }
+  m.clear();
+  if (!m.empty() || m.size() != 0) {
+    return 14;
+  }
+
+  // Concurrent writers on disjoint keys and readers on all of them.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&m, t]() {
+      for (int i = 0; i < 1000; i++) {
+        m.emplace(t * 1000 + i, std::to_string(i));
+        m.find((i * 7) % 4000);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  if (m.size() != 4000 || m.getKeyList().size() != 4000) {
+    return 15;
+  }
+  return 0;
+}
+
+/// @brief Tests the ordered lookups with a statically typed comparator.
+int TestOrdered()
+{
+  acl::TSMap<int, std::string, std::greater<int>> m;
+  m.emplace(10, "ten");
+  m.emplace(20, "twenty");
+  m.emplace(30, "thirty");
+
+  std::vector<int> keys = m.getKeyList();
+  if (keys.size() != 3 || keys[0] != 30 || keys[2] != 10) {
+    return 1;
+  }
+
+  // With std::greater, lower_bound finds the first key not greater than k.
+  auto lb = m.lower_bound_key(25);
+  if (!lb.second || lb.first.first != 20) {
+    return 2;
+  }
+  acl::TSMap<int, std::string> ascending;
+  ascending.emplace(10, "ten");
+  ascending.emplace(20, "twenty");
+  auto inf = ascending.findInfimum_key(15);
+  if (!inf.second || inf.first.first != 10 || ascending.findInfimum(5).second ||
+      ascending.lower_bound(15).first != "twenty") {
+    return 3;
+  }
+  return 0;
+}
+
+/// @brief A transparent string comparator that also works in C++11, which
+/// has no std::less<>.
+struct TransparentLess {
+  typedef void is_transparent;
+  bool operator()(const std::string& a, const std::string& b) const { return a < b; }
+  bool operator()(const std::string& a, const char* b) const { return a.compare(b) < 0; }
+  bool operator()(const char* a, const std::string& b) const { return b.compare(a) > 0; }
+};
+
+/// @brief Tests the bulk operations and transactions.
+int TestBatch()
+{
+  acl::TSMap<std::string, int> m;
+  std::vector<std::pair<std::string, int>> items;
+  for (int i = 0; i < 10; i++) {
+    items.emplace_back(std::to_string(i), i);
+  }
+  if (m.emplace_many(items) != 10 || m.emplace_many(items) != 0 || m.emplace_many(items, true) != 10) {
+    return 1;
+  }
+
+  auto found = m.find_many({"3", "missing", "7"});
+  if (found.size() != 3 || !found[0].second || found[0].first != 3 || found[1].second ||
+      !found[2].second || found[2].first != 7) {
+    return 2;
+  }
+  if (m.erase_many({"0", "1", "missing"}) != 2 || m.size() != 8) {
+    return 3;
+  }
+
+  // Move a value between keys atomically.
+  bool moved = m.transaction([](acl::TSMap<std::string, int>::Map& map) {
+    auto it = map.find("5");
+    if (it == map.end()) {
+      return false;
+    }
+    map["50"] = it->second * 10;
+    map.erase(it);
+    return true;
+  });
+  int sum = 0;
+  m.transaction_ro([&sum](const acl::TSMap<std::string, int>::Map& map) {
+    for (auto& item : map) {
+      sum += item.second;
+    }
+    return true;
+  });
+  if (!moved || m.find("5").second || m.find("50").first != 50 || sum != 2 + 3 + 4 + 50 + 6 + 7 + 8 + 9) {
+    return 4;
+  }
+
+  // A transparent comparator takes C strings as keys.
+  acl::TSMap<std::string, int, TransparentLess> transparent;
+  transparent.emplace("abc", 1);
+  int value = 0;
+  if (!transparent.find("abc").second || !transparent.find("abc", value) || value != 1 ||
+      transparent.find("abd").second) {
+    return 5;
+  }
+  return 0;
+}
+
+/// @brief Tests snapshot isolation of the copy-on-write map.
+int TestSnapshot()
+{
+  acl::TSSnapshotMap<int, std::string> m;
+  std::string value;
+
+  if (!m.empty() || m.get_version() != 0 || !m.emplace(1, "one") || m.emplace(1, "uno") ||
+      !m.find(1, value) || value != "one" || m.get_version() != 1) {
+    return 1;
+  }
+
+  // A snapshot does not see later writes.
+  auto before = m.snapshot();
+  m.emplace(2, "two");
+  m.perform(1, [](const int& k, std::string& v) { v = "uno"; return true; });
+  if (before->map.size() != 1 || before->map.at(1) != "one" || m.find(1).first != "uno" ||
+      m.size() != 2 || m.get_version() != 3) {
+    return 2;
+  }
+
+  // A rejected change does not publish a version.
+  if (m.emplace(2, "dos") || m.erase(9) || m.get_version() != 3) {
+    return 3;
+  }
+
+  // Batched updates publish once.
+  m.update([](acl::TSSnapshotMap<int, std::string>::Map& map) {
+    for (int i = 10; i < 20; i++) {
+      map.emplace(i, std::to_string(i));
+    }
+    return true;
+  });
+  if (m.size() != 12 || m.get_version() != 4 || m.lower_bound(15).first != "15") {
+    return 4;
+  }
+  if (m.delete_if([](const int& k, const std::string& v) { return k >= 10; }) != 10 ||
+      m.getKeyList().size() != 2) {
+    return 5;
+  }
+  auto removed = m.remove(2);
+  if (!removed.second || removed.first != "two" || !m.erase(1) || !m.empty()) {
+    return 6;
+  }
+
+  // A scan in progress does not block writers.
+  for (int i = 0; i < 100; i++) {
+    m.emplace(i, std::to_string(i));
+  }
+  std::atomic_bool scanning(false);
+  std::atomic_bool release(false);
+  size_t seen = 0;
+  std::thread reader([&]() {
+    seen = m.for_each_ro([&](const int& k, const std::string& v) {
+      scanning = true;
+      while (!release) {
+        std::this_thread::yield();
+      }
+      return true;
+    });
+  });
+  while (!scanning) {
+    std::this_thread::yield();
+  }
+  m.clear();
+  for (int i = 0; i < 10; i++) {
+    m.emplace(i, "new");
+  }
+  release = true;
+  reader.join();
+  if (seen != 100 || m.size() != 10) {
+    return 7;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing TSMap..." << std::endl;
+  {
+    acl::TSMap<int, std::string> m;
+    if ((ret = TestMapInterface(m)) != 0) {
+      std::cerr << "TSMap interface test failed with code " << ret << std::endl;
+      return 100 + ret;
+    }
+    if ((ret = TestOrdered()) != 0) {
+      std::cerr << "TSMap ordered test failed with code " << ret << std::endl;
+      return 200 + ret;
+    }
+#if __cplusplus >= 201402L
+    std::cout << "Transparent find compares keys directly" << std::endl;
+#else
+    std::cout << "Transparent find converts keys (no heterogeneous std::map lookup before C++14)" << std::endl;
+#endif
+    if ((ret = TestBatch()) != 0) {
+      std::cerr << "TSMap batch test failed with code " << ret << std::endl;
+      return 600 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing TSUnorderedMap..." << std::endl;
+  {
+    acl::TSUnorderedMap<int, std::string> m(5);
+    if (m.get_num_shards() != 8) {
+      std::cerr << "TSUnorderedMap shard count is wrong" << std::endl;
+      return 300;
+    }
+    if ((ret = TestMapInterface(m)) != 0) {
+      std::cerr << "TSUnorderedMap interface test failed with code " << ret << std::endl;
+      return 400 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing TSSnapshotMap..." << std::endl;
+  if ((ret = TestSnapshot()) != 0) {
+    std::cerr << "TSSnapshotMap test failed with code " << ret << std::endl;
+    return 500 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
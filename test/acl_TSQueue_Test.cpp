@@ -0,0 +1,395 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <TSQueue.tcc>
+#include <TSRingQueue.tcc>
+#include <LockFreeQueue.tcc>
+
+/// @brief Runs the queue-interface tests against any queue type that has the
+/// TSQueue interface.
+/// @return 0 on success, unique error code on failure.
+template <class Q>
+int TestQueueInterface(Q& q)
+{
+  int value = -1;
+
+  // Dequeue on an empty queue with no timeout must fail immediately.
+  if (q.dequeue(value)) {
+    return 1;
+  }
+  if (q.size() != 0) {
+    return 2;
+  }
+
+  // FIFO ordering, enough elements to force the storage to grow and wrap.
+  for (int i = 0; i < 100; i++) {
+    if (!q.enqueue(i)) {
+      return 3;
+    }
+  }
+  for (int i = 0; i < 50; i++) {
+    if (!q.dequeue(value) || value != i) {
+      return 4;
+    }
+  }
+  for (int i = 100; i < 150; i++) {
+    q.enqueue(i);
+  }
+  for (int i = 50; i < 150; i++) {
+    if (!q.dequeue(value) || value != i) {
+      return 5;
+    }
+  }
+
+  // Stack ordering with push and pop, and peek at the head.
+  q.enqueue(1);
+  q.push(2);
+  if (!q.peek(value) || value != 2 || q.size() != 2) {
+    return 6;
+  }
+  if (!q.pop(value) || value != 2 || !q.pop(value) || value != 1) {
+    return 7;
+  }
+
+  // Maximum size handling
+  q.set_max_size(2);
+  if (q.get_max_size() != 2) {
+    return 8;
+  }
+  if (!q.enqueue(1) || !q.enqueue(2) || q.enqueue(3) || q.push(3)) {
+    return 9;
+  }
+  if (!q.enqueue(3, true) || q.size() != 3) {
+    return 10;
+  }
+  q.delete_all();
+  if (q.size() != 0 || !q.wait_until_empty(10)) {
+    return 11;
+  }
+  q.set_max_size(DEFAULT_MAX_SIZE);
+
+  // Timed dequeue wakes up when a producer adds an element.
+  std::thread producer([&q]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    q.enqueue(42);
+  });
+  bool got = q.dequeue(value, 2000);
+  producer.join();
+  if (!got || value != 42) {
+    return 12;
+  }
+
+  // Multiple producers and consumers; every element must arrive exactly once.
+  const int NUM_THREADS = 4;
+  const int PER_THREAD = 10000;
+  std::vector<std::thread> threads;
+  std::vector<long long> sums(NUM_THREADS, 0);
+  for (int t = 0; t < NUM_THREADS; t++) {
+    threads.emplace_back([&q, t, PER_THREAD]() {
+      for (int i = 0; i < PER_THREAD; i++) {
+        q.enqueue(t * PER_THREAD + i);
+      }
+    });
+    threads.emplace_back([&q, &sums, t, PER_THREAD]() {
+      int v;
+      for (int i = 0; i < PER_THREAD; i++) {
+        while (!q.dequeue(v, 100)) {}
+        sums[t] += v;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  long long total = 0;
+  for (auto s : sums) {
+    total += s;
+  }
+  long long n = NUM_THREADS * PER_THREAD;
+  if (total != n * (n - 1) / 2 || q.size() != 0) {
+    return 13;
+  }
+
+  return 0;
+}
+
+/// @brief Tests move-only elements and the batch interface.
+/// @return 0 on success, unique error code on failure.
+template <template <typename> class Q>
+int TestMoveAndBulk()
+{
+  // Move-only elements
+  Q<std::unique_ptr<int>> mq;
+  std::unique_ptr<int> p(new int(1));
+  if (!mq.enqueue(std::move(p)) || p) {
+    return 1;
+  }
+  if (!mq.emplace(new int(2)) || !mq.push(std::unique_ptr<int>(new int(0)))) {
+    return 2;
+  }
+  // Copying with enqueue(const T&) or peek() does not compile for these.
+  if (mq.size() != 3) {
+    return 3;
+  }
+  for (int i = 0; i < 3; i++) {
+    std::unique_ptr<int> out;
+    if (!mq.dequeue(out) || !out || *out != i) {
+      return 4;
+    }
+  }
+
+  // Batch enqueue respects max_size and reports what was added.
+  Q<int> q;
+  std::vector<int> in;
+  for (int i = 0; i < 300; i++) {
+    in.push_back(i);
+  }
+  q.set_max_size(200);
+  if (q.enqueue_bulk(in.begin(), in.end()) != 200 || q.size() != 200) {
+    return 5;
+  }
+  if (q.enqueue_bulk(in.begin() + 200, in.end(), true) != 100 || q.size() != 300) {
+    return 6;
+  }
+
+  // Batch dequeue drains in order, up to max per call.
+  std::vector<int> out;
+  if (q.dequeue_bulk(std::back_inserter(out), 128) != 128) {
+    return 7;
+  }
+  while (q.dequeue_bulk(std::back_inserter(out), 128)) {}
+  if (out != in || q.size() != 0 || q.dequeue_bulk(std::back_inserter(out), 8) != 0) {
+    return 8;
+  }
+
+  // A timed batch dequeue wakes on a batch enqueue.
+  out.clear();
+  std::thread producer([&q, &in]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    q.enqueue_bulk(in.begin(), in.begin() + 10);
+  });
+  size_t got = q.dequeue_bulk(std::back_inserter(out), 64, 2000);
+  producer.join();
+  if (got != 10 || out[9] != 9) {
+    return 9;
+  }
+
+  // Moving a range in leaves the source elements empty.
+  Q<std::string> sq;
+  std::vector<std::string> strings(3, "payload");
+  sq.enqueue_bulk(std::make_move_iterator(strings.begin()), std::make_move_iterator(strings.end()));
+  std::string s;
+  if (sq.size() != 3 || !strings[0].empty() || !sq.dequeue(s) || s != "payload") {
+    return 10;
+  }
+
+  return 0;
+}
+
+/// @brief Tests specific to the ring storage
+int TestRingStorage()
+{
+  acl::TSRingQueue<std::string> q(4);
+  if (q.capacity() != 4) {
+    return 1;
+  }
+
+  // Steady-state traffic below the capacity must not grow the storage.
+  std::string value;
+  for (int i = 0; i < 1000; i++) {
+    q.enqueue(std::to_string(i));
+    q.enqueue(std::to_string(i + 1));
+    if (!q.dequeue(value) || value != std::to_string(i)) {
+      return 2;
+    }
+    if (!q.dequeue(value) || value != std::to_string(i + 1)) {
+      return 3;
+    }
+  }
+  if (q.capacity() != 4) {
+    return 4;
+  }
+
+  // Reserving keeps the elements in order.
+  q.enqueue("a");
+  q.enqueue("b");
+  q.reserve(64);
+  if (q.capacity() != 64) {
+    return 5;
+  }
+  if (!q.dequeue(value) || value != "a" || !q.dequeue(value) || value != "b") {
+    return 6;
+  }
+
+  return 0;
+}
+
+/// @brief Tests the bounded lock-free queues.
+/// @param producers Number of producer threads the queue may be used with
+/// @param consumers Number of consumer threads the queue may be used with
+/// @return 0 on success, unique error code on failure.
+template <class Q>
+int TestLockFreeQueue(Q& q, int producers, int consumers)
+{
+  int value = -1;
+
+  if (q.capacity() != 64) {
+    return 1;
+  }
+  if (q.dequeue(value) || !q.empty()) {
+    return 2;
+  }
+
+  // FIFO ordering across several laps of the ring.
+  for (int lap = 0; lap < 10; lap++) {
+    for (int i = 0; i < 40; i++) {
+      if (!q.enqueue(lap * 40 + i)) {
+        return 3;
+      }
+    }
+    for (int i = 0; i < 40; i++) {
+      if (!q.dequeue(value) || value != lap * 40 + i) {
+        return 4;
+      }
+    }
+  }
+
+  // The capacity is a hard limit, max_size is a soft one.
+  for (int i = 0; i < 64; i++) {
+    q.enqueue(i);
+  }
+  if (q.size() != 64 || q.enqueue(64, true)) {
+    return 5;
+  }
+  q.delete_all();
+  if (!q.empty() || !q.wait_until_empty(10)) {
+    return 6;
+  }
+  q.set_max_size(2);
+  if (q.get_max_size() != 2 || !q.enqueue(1) || !q.enqueue(2) || q.enqueue(3)) {
+    return 7;
+  }
+  if (!q.enqueue(3, true) || q.size() != 3) {
+    return 8;
+  }
+  q.delete_all();
+  q.set_max_size(DEFAULT_MAX_SIZE);
+
+  // Timed dequeue wakes up when a producer adds an element.
+  std::thread producer([&q]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    q.enqueue(42);
+  });
+  bool got = q.dequeue(value, 2000);
+  producer.join();
+  if (!got || value != 42) {
+    return 9;
+  }
+
+  // Concurrent traffic through a queue smaller than the element count;
+  // every element must arrive exactly once.
+  const int TOTAL = 40000;
+  int perProducer = TOTAL / producers;
+  int perConsumer = TOTAL / consumers;
+  std::vector<std::thread> threads;
+  std::vector<long long> sums(consumers, 0);
+  for (int t = 0; t < producers; t++) {
+    threads.emplace_back([&q, t, perProducer]() {
+      for (int i = 0; i < perProducer; i++) {
+        while (!q.enqueue(t * perProducer + i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (int t = 0; t < consumers; t++) {
+    threads.emplace_back([&q, &sums, t, perConsumer]() {
+      int v;
+      for (int i = 0; i < perConsumer; i++) {
+        while (!q.dequeue(v, 100)) {}
+        sums[t] += v;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  long long total = 0;
+  for (auto s : sums) {
+    total += s;
+  }
+  long long n = TOTAL;
+  if (total != n * (n - 1) / 2 || !q.empty()) {
+    return 10;
+  }
+
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing TSQueue..." << std::endl;
+  {
+    acl::TSQueue<int> q;
+    if ((ret = TestQueueInterface(q)) != 0) {
+      std::cerr << "TSQueue interface test failed with code " << ret << std::endl;
+      return 100 + ret;
+    }
+    if ((ret = TestMoveAndBulk<acl::TSQueue>()) != 0) {
+      std::cerr << "TSQueue move/bulk test failed with code " << ret << std::endl;
+      return 600 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing TSRingQueue..." << std::endl;
+  {
+    acl::TSRingQueue<int> q;
+    if ((ret = TestQueueInterface(q)) != 0) {
+      std::cerr << "TSRingQueue interface test failed with code " << ret << std::endl;
+      return 200 + ret;
+    }
+    if ((ret = TestRingStorage()) != 0) {
+      std::cerr << "TSRingQueue storage test failed with code " << ret << std::endl;
+      return 300 + ret;
+    }
+    if ((ret = TestMoveAndBulk<acl::TSRingQueue>()) != 0) {
+      std::cerr << "TSRingQueue move/bulk test failed with code " << ret << std::endl;
+      return 700 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing SPSCQueue..." << std::endl;
+  {
+    acl::SPSCQueue<int> q(50);
+    if ((ret = TestLockFreeQueue(q, 1, 1)) != 0) {
+      std::cerr << "SPSCQueue test failed with code " << ret << std::endl;
+      return 400 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing MPMCQueue..." << std::endl;
+  {
+    acl::MPMCQueue<int> q(64);
+    if ((ret = TestLockFreeQueue(q, 4, 4)) != 0) {
+      std::cerr << "MPMCQueue test failed with code " << ret << std::endl;
+      return 500 + ret;
+    }
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,584 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ThreadPool.h>
+#include <ParallelFor.tcc>
+#include <ThreadWorker.h>
+
+/// @brief Tests pushing jobs and waiting for them.
+/// @return 0 on success, unique error code on failure.
+int TestPushJob()
+{
+  acl::ThreadPool pool(4, 100000);
+  pool.Start();
+
+  std::atomic_int count(0);
+  for (int i = 0; i < 10000; i++) {
+    if (!pool.push_job([&count]() { count++; })) {
+      return 1;
+    }
+  }
+  if (!pool.wait_until_empty(5000)) {
+    return 2;
+  }
+  pool.Stop();
+  pool.Join();
+  if (count != 10000 || pool.size() != 0) {
+    return 3;
+  }
+  return 0;
+}
+
+/// @brief Tests futures from submit(), including exceptions.
+int TestSubmit()
+{
+  acl::ThreadPool pool(2, 1000);
+  pool.Start();
+
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < 100; i++) {
+    futures.push_back(pool.submit([](int a, int b) { return a * b; }, i, 2));
+  }
+  for (int i = 0; i < 100; i++) {
+    if (!futures[i].valid() || futures[i].get() != i * 2) {
+      return 1;
+    }
+  }
+
+  std::future<void> failing = pool.submit([]() { throw std::runtime_error("job failed"); });
+  bool threw = false;
+  try {
+    failing.get();
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  if (!threw) {
+    return 2;
+  }
+
+  // Jobs submitted from a worker fan out to the other workers.
+  std::future<int> outer = pool.submit([&pool]() {
+    std::vector<std::future<int>> inner;
+    for (int i = 0; i < 10; i++) {
+      inner.push_back(pool.submit([i]() { return i; }));
+    }
+    int sum = 0;
+    for (auto& f : inner) {
+      while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        pool.try_run_job();
+      }
+      sum += f.get();
+    }
+    return sum;
+  });
+  if (outer.get() != 45) {
+    return 3;
+  }
+  return 0;
+}
+
+/// @brief Tests rejection and back-pressure on a full pool.
+int TestBackPressure()
+{
+  acl::ThreadPool pool(1, 2);
+
+  // Not started: two jobs fit, the third is rejected and gives an invalid future.
+  std::atomic_int count(0);
+  if (!pool.push_job([&count]() { count++; }) || !pool.push_job([&count]() { count++; })) {
+    return 1;
+  }
+  if (pool.push_job([&count]() { count++; }) || pool.submit([]() { return 1; }).valid()) {
+    return 2;
+  }
+  if (pool.size() != 2) {
+    return 3;
+  }
+  pool.delete_all();
+  if (pool.size() != 0) {
+    return 4;
+  }
+
+  // Blocking: a producer waits for room rather than losing jobs.
+  pool.setBlocking(true);
+  pool.Start();
+  for (int i = 0; i < 200; i++) {
+    if (!pool.push_job([&count]() {
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+          count++;
+        })) {
+      return 5;
+    }
+  }
+  pool.wait_until_empty();
+  pool.Stop();
+  pool.Join();
+  if (count != 200) {
+    return 6;
+  }
+  return 0;
+}
+
+/// @brief Tests that idle workers steal work queued on a busy worker.
+int TestStealing()
+{
+  acl::ThreadPool pool(4, 1000);
+  pool.Start();
+
+  // One job queues many children on its own deque, then blocks its worker.
+  std::atomic_int done(0);
+  std::atomic_bool release(false);
+  pool.push_job([&]() {
+    for (int i = 0; i < 40; i++) {
+      pool.push_job([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        done++;
+      });
+    }
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  while (done < 40 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  release = true;
+  pool.Stop();
+  pool.Join();
+
+  if (done != 40) {
+    return 1;
+  }
+  return 0;
+}
+
+/// @brief Tests parallel_for, parallel_reduce and parallel_transform.
+int TestParallelAlgorithms()
+{
+  acl::ThreadPool pool(4, 1000);
+  pool.Start();
+
+  // Every index visited exactly once, with automatic and explicit grains.
+  std::vector<int> hits(10007, 0);
+  acl::parallel_for(pool, 0, 10007, 0, [&hits](int i) { hits[i]++; });
+  acl::parallel_for(pool, 0, 10007, 3, [&hits](int i) { hits[i]++; });
+  for (int h : hits) {
+    if (h != 2) {
+      return 1;
+    }
+  }
+  acl::parallel_for(pool, 5, 5, 0, [&hits](int i) { hits[i]++; });
+
+  long long sum = acl::parallel_reduce(pool, 0LL, 100000LL, 0LL, 0LL,
+      [](long long i) { return i; },
+      [](long long a, long long b) { return a + b; });
+  if (sum != 100000LL * 99999LL / 2) {
+    return 2;
+  }
+
+  std::vector<int> in(1000);
+  for (int i = 0; i < 1000; i++) {
+    in[i] = i;
+  }
+  std::vector<int> out(1000, 0);
+  auto end = acl::parallel_transform(pool, in.begin(), in.end(), out.begin(), 0,
+      [](int v) { return v * v; });
+  if (end != out.end() || out[999] != 999 * 999 || out[10] != 100) {
+    return 3;
+  }
+
+  // Exceptions from a chunk come back to the caller.
+  bool threw = false;
+  try {
+    acl::parallel_for(pool, 0, 100, 1, [](int i) {
+      if (i == 50) {
+        throw std::runtime_error("chunk failed");
+      }
+    });
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  if (!threw) {
+    return 4;
+  }
+
+  // Two batches share the pool; the fast one does not wait on the slow one.
+  acl::TaskGroup slow(pool);
+  std::atomic_bool started(false);
+  std::atomic_bool release(false);
+  slow.run([&started, &release]() {
+    started = true;
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  while (!started) {
+    std::this_thread::yield();
+  }
+  std::atomic_int fast(0);
+  acl::parallel_for(pool, 0, 100, 10, [&fast](int i) { fast++; });
+  bool overlapped = slow.pending() == 1;
+  release = true;
+  slow.wait();
+  if (fast != 100 || !overlapped) {
+    return 5;
+  }
+
+  // Nested loops run from inside pool jobs without deadlocking.
+  std::atomic_int nested(0);
+  acl::parallel_for(pool, 0, 8, 1, [&pool, &nested](int i) {
+    acl::parallel_for(pool, 0, 100, 10, [&nested](int j) { nested++; });
+  });
+  if (nested != 800) {
+    return 6;
+  }
+
+  // A pool with no running workers still completes, on the caller.
+  acl::ThreadPool idle(2, 10);
+  int serial = acl::parallel_reduce(idle, 0, 100, 0, 0,
+      [](int i) { return 1; }, [](int a, int b) { return a + b; });
+  if (serial != 100) {
+    return 7;
+  }
+  return 0;
+}
+
+/// @brief Tests that idle threads stop immediately instead of at a timeout.
+int TestStopLatency()
+{
+  // An idle pool with a long legacy timeout
+  acl::ThreadPool pool(4, 10, 10000);
+  pool.Start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  auto start = std::chrono::steady_clock::now();
+  pool.Stop();
+  pool.Join();
+  if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(500)) {
+    return 1;
+  }
+
+  // A worker whose loop sleeps for a long time
+  acl::ThreadWorker worker;
+  std::atomic_int loops(0);
+  worker.setMainLoopFunction([&worker, &loops]() {
+    loops++;
+    worker.sleep(10);
+  });
+  worker.Start();
+  while (loops == 0) {
+    std::this_thread::yield();
+  }
+
+  // notify() runs the loop again without stopping
+  worker.notify();
+  start = std::chrono::steady_clock::now();
+  while (loops < 2 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    std::this_thread::yield();
+  }
+  if (loops < 2) {
+    return 2;
+  }
+
+  start = std::chrono::steady_clock::now();
+  worker.Stop();
+  worker.Join();
+  if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(500)) {
+    return 3;
+  }
+
+  // A worker with no function sleeps until stopped
+  acl::ThreadWorker empty;
+  empty.Start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  start = std::chrono::steady_clock::now();
+  empty.Stop();
+  empty.Join();
+  if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(500)) {
+    return 4;
+  }
+  return 0;
+}
+
+/// @brief Tests auto-sizing, CPU placement and thread names.
+int TestThreadOptions()
+{
+  unsigned available = acl::available_concurrency();
+  unsigned hardware = std::thread::hardware_concurrency();
+  if (available < 1 || (hardware && available > hardware)) {
+    return 1;
+  }
+  acl::ThreadPool sized(0);
+  if (sized.getNumThreads() != available) {
+    return 2;
+  }
+
+  std::vector<std::vector<int>> nodes = acl::numa_nodes();
+  if (nodes.empty() || nodes[0].empty()) {
+    return 3;
+  }
+
+  // Pinning every thread to one CPU gives each that CPU.
+  acl::ThreadOptions one;
+  one.cpus.push_back(nodes[0][0]);
+  one.pinEach = true;
+  std::vector<acl::ThreadPlacement> plan = acl::plan_thread_placement(one, 3);
+  for (auto& p : plan) {
+    if (p.cpus.size() != 1 || p.cpus[0] != nodes[0][0] || p.node != -1) {
+      return 4;
+    }
+  }
+
+  // Spreading deals threads to nodes in turn.
+  acl::ThreadOptions spread;
+  spread.spreadNuma = true;
+  plan = acl::plan_thread_placement(spread, 4);
+  for (size_t i = 0; i < plan.size(); i++) {
+    if (plan[i].node != static_cast<int>(i % nodes.size()) || plan[i].cpus != nodes[i % nodes.size()]) {
+      return 5;
+    }
+  }
+
+  // Workers carry the names and placement asked for and still run jobs.
+  acl::ThreadOptions options = spread;
+  options.name = "acltest";
+  options.priority = acl::ThreadPriority::Low;
+  acl::ThreadPool pool(2, 1000);
+  pool.setThreadOptions(options);
+  pool.Start();
+  std::mutex mutex;
+  std::set<std::string> names;
+  std::atomic_int ran(0);
+  std::atomic_bool misplaced(false);
+  for (int i = 0; i < 200; i++) {
+    pool.push_job([&]() {
+      int cpu = acl::current_cpu();
+      bool onNode = false;
+      for (auto& node : nodes) {
+        onNode = onNode || std::find(node.begin(), node.end(), cpu) != node.end();
+      }
+      if (cpu >= 0 && !onNode) {
+        misplaced = true;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      names.insert(acl::get_current_thread_name());
+      ran++;
+    });
+  }
+  if (!pool.wait_until_empty(5000)) {
+    return 6;
+  }
+  pool.Stop();
+  pool.Join();
+  if (ran != 200 || misplaced) {
+    return 7;
+  }
+#ifdef __linux__
+  for (auto& name : names) {
+    if (name != "acltest-0" && name != "acltest-1") {
+      return 8;
+    }
+  }
+#endif
+  return 0;
+}
+
+/// @brief Runs the queued jobs of a stopped one-worker pool and returns
+/// the order they ran in.
+static std::vector<int> RunInOrder(acl::ThreadPool& pool, std::vector<int>& order, std::mutex& mutex)
+{
+  pool.Start();
+  pool.wait_until_empty(5000);
+  pool.Stop();
+  pool.Join();
+  std::lock_guard<std::mutex> lock(mutex);
+  return order;
+}
+
+/// @brief Tests priority classes, aging and expired jobs.
+int TestPriorities()
+{
+  typedef acl::ThreadPool::Priority Priority;
+  std::mutex mutex;
+  std::vector<int> order;
+  auto record = [&](int id) {
+    return [&mutex, &order, id]() {
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(id);
+    };
+  };
+
+  // Jobs queued before the worker starts run most urgent class first.
+  {
+    acl::ThreadPool pool(1, 100);
+    pool.setAgingInterval(0);
+    pool.push_job(record(2), Priority::Low);
+    pool.push_job(record(1), Priority::Normal);
+    pool.push_job(record(0), Priority::High);
+    pool.push_job(record(2), Priority::Low);
+    pool.push_job(record(0), Priority::High);
+    if (pool.size(Priority::High) != 2 || pool.size(Priority::Normal) != 1 ||
+        pool.size(Priority::Low) != 2 || pool.size() != 5) {
+      return 1;
+    }
+    std::vector<int> ran = RunInOrder(pool, order, mutex);
+    if (ran != std::vector<int>({0, 0, 1, 2, 2})) {
+      return 2;
+    }
+    if (pool.size(Priority::High) != 0 || pool.size(Priority::Low) != 0) {
+      return 3;
+    }
+  }
+
+  // A Low job that has waited long enough overtakes newer High jobs.
+  order.clear();
+  {
+    acl::ThreadPool pool(1, 100);
+    pool.setAgingInterval(0.01);
+    pool.push_job(record(2), Priority::Low);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    pool.push_job(record(0), Priority::High);
+    pool.push_job(record(0), Priority::High);
+    std::vector<int> ran = RunInOrder(pool, order, mutex);
+    if (ran != std::vector<int>({2, 0, 0})) {
+      return 4;
+    }
+  }
+
+  // Jobs past their deadline are dropped and counted.
+  order.clear();
+  {
+    acl::ThreadPool pool(1, 100);
+    pool.setDropExpired(true);
+    auto now = acl::ThreadPool::Clock::now();
+    pool.push_job(record(1), Priority::Normal, now - std::chrono::milliseconds(1));
+    pool.push_job(record(0), Priority::High, now + std::chrono::seconds(60));
+    pool.push_job(record(2), Priority::Low, now - std::chrono::milliseconds(1));
+    std::vector<int> ran = RunInOrder(pool, order, mutex);
+    if (ran != std::vector<int>({0}) || pool.dropped_count() != 2 || pool.size() != 0) {
+      return 5;
+    }
+  }
+  return 0;
+}
+
+/// @brief Tests that jobs pushed from outside the pool run in submission
+/// order, while jobs a worker pushes itself run newest first.
+int TestSubmissionOrder()
+{
+  acl::ThreadPool pool(1, 100);
+  pool.Start();
+
+  std::mutex mutex;
+  std::vector<int> order;
+  auto record = [&](int id) {
+    return [&mutex, &order, id]() {
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(id);
+    };
+  };
+
+  // Hold the only worker so that everything below queues up behind it.
+  std::atomic_bool started(false);
+  std::atomic_bool release(false);
+  pool.push_job([&]() {
+    started = true;
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  while (!started) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  pool.push_job([&]() {
+    for (int id = 10; id < 13; id++) {
+      pool.push_job(record(id));
+    }
+  });
+  for (int id = 0; id < 5; id++) {
+    pool.push_job(record(id));
+  }
+  release = true;
+
+  if (!pool.wait_until_empty(5000)) {
+    return 1;
+  }
+  pool.Stop();
+  pool.Join();
+  if (order != std::vector<int>({12, 11, 10, 0, 1, 2, 3, 4})) {
+    return 2;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing push_job..." << std::endl;
+  if ((ret = TestPushJob()) != 0) {
+    std::cerr << "push_job test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "Testing submit..." << std::endl;
+  if ((ret = TestSubmit()) != 0) {
+    std::cerr << "submit test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "Testing back-pressure..." << std::endl;
+  if ((ret = TestBackPressure()) != 0) {
+    std::cerr << "back-pressure test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  std::cout << "Testing work stealing..." << std::endl;
+  if ((ret = TestStealing()) != 0) {
+    std::cerr << "work stealing test failed with code " << ret << std::endl;
+    return 400 + ret;
+  }
+
+  std::cout << "Testing parallel algorithms..." << std::endl;
+  if ((ret = TestParallelAlgorithms()) != 0) {
+    std::cerr << "parallel algorithm test failed with code " << ret << std::endl;
+    return 500 + ret;
+  }
+
+  std::cout << "Testing stop latency..." << std::endl;
+  if ((ret = TestStopLatency()) != 0) {
+    std::cerr << "stop latency test failed with code " << ret << std::endl;
+    return 600 + ret;
+  }
+
+  std::cout << "Testing thread options..." << std::endl;
+  if ((ret = TestThreadOptions()) != 0) {
+    std::cerr << "thread options test failed with code " << ret << std::endl;
+    return 700 + ret;
+  }
+
+  std::cout << "Testing priorities..." << std::endl;
+  if ((ret = TestPriorities()) != 0) {
+    std::cerr << "priority test failed with code " << ret << std::endl;
+    return 800 + ret;
+  }
+
+  std::cout << "Testing submission order..." << std::endl;
+  if ((ret = TestSubmissionOrder()) != 0) {
+    std::cerr << "submission order test failed with code " << ret << std::endl;
+    return 900 + ret;
+  }
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
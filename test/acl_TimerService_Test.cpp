@@ -0,0 +1,189 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <ThreadPool.h>
+#include <Timer.h>
+#include <TimerService.h>
+
+/// @brief Waits for a counter to reach a value.
+static bool WaitFor(std::atomic_int& count, int value, double seconds = 5)
+{
+  double start = acl::getMonotonicTime();
+  while (count < value) {
+    if (acl::getMonotonicTime() - start > seconds) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+/// @brief Tests that one-shot timers run in due order and never early,
+/// including ones that cascade down from the upper wheels.
+int TestScheduleAfter()
+{
+  // A 0.1 ms tick makes the first wheel 25.6 ms, so the longer delays cascade.
+  acl::TimerService timers(nullptr, 0.0001);
+  timers.Start();
+
+  std::mutex mutex;
+  std::vector<int> order;
+  std::vector<double> late;
+  std::atomic_int ran(0);
+  const double delays[] = { 0.08, 0.002, 0.03, 0.011, 0.3 };
+  double start = acl::getMonotonicTime();
+  for (int i = 0; i < 5; i++) {
+    double delay = delays[i];
+    if (!timers.schedule_after(delay, [&, i, delay]() {
+          std::lock_guard<std::mutex> lock(mutex);
+          order.push_back(i);
+          late.push_back(acl::getMonotonicTime() - start - delay);
+          ran++;
+        })) {
+      return 1;
+    }
+  }
+  if (timers.size() != 5) {
+    return 2;
+  }
+  if (!WaitFor(ran, 5)) {
+    return 3;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  if (order != std::vector<int>({1, 3, 2, 0, 4})) {
+    return 4;
+  }
+  for (double l : late) {
+    if (l < 0) {
+      std::cerr << "Timer ran " << -l << " s early" << std::endl;
+      return 5;
+    }
+  }
+  if (timers.size() != 0 || timers.schedule_after(1, nullptr) != 0) {
+    return 6;
+  }
+  return 0;
+}
+
+/// @brief Tests periodic timers and cancelling.
+int TestEveryAndCancel()
+{
+  acl::ThreadPool pool(2, 1000);
+  pool.Start();
+  acl::TimerService timers(&pool);
+  timers.Start();
+
+  std::atomic_int cancelled(0);
+  acl::TimerService::TimerId id = timers.schedule_after(0.02, [&cancelled]() { cancelled++; });
+  if (!timers.cancel(id) || timers.cancel(id) || timers.cancel(0) || timers.cancel(12345)) {
+    return 1;
+  }
+
+  std::atomic_int ticks(0);
+  id = timers.schedule_every(0.005, [&ticks]() { ticks++; });
+  if (timers.schedule_every(0, [&ticks]() { ticks++; }) != 0) {
+    return 2;
+  }
+  if (!WaitFor(ticks, 5)) {
+    return 3;
+  }
+  if (!timers.cancel(id) || timers.size() != 0) {
+    return 4;
+  }
+  pool.wait_until_empty(1000);
+  int stopped = ticks;
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  if (ticks != stopped || cancelled != 0) {
+    return 5;
+  }
+
+  // A freed slot is reused without reviving the old id.
+  std::atomic_int reused(0);
+  acl::TimerService::TimerId next = timers.schedule_after(0.001, [&reused]() { reused++; });
+  if (next == id || timers.cancel(id) || !WaitFor(reused, 1)) {
+    return 6;
+  }
+
+  timers.Stop();
+  pool.Stop();
+  pool.Join();
+  return 0;
+}
+
+/// @brief Tests many pending timers with half of them cancelled.
+int TestMany()
+{
+  const int count = 100000;
+  acl::ThreadPool pool(2, count);
+  pool.Start();
+  acl::TimerService timers(&pool);
+
+  std::atomic_int ran(0);
+  std::atomic_int wrong(0);
+  std::vector<acl::TimerService::TimerId> ids;
+  ids.reserve(count);
+  for (int i = 0; i < count; i++) {
+    bool cancel = i % 2 == 1;
+    ids.push_back(timers.schedule_after(0.001 * (i % 300), [&ran, &wrong, cancel]() {
+      if (cancel) {
+        wrong++;
+      }
+      ran++;
+    }));
+  }
+  // A far-off timer stays parked in the upper wheels.
+  timers.schedule_after(3600, [&wrong]() { wrong++; });
+  for (int i = 1; i < count; i += 2) {
+    if (!timers.cancel(ids[i])) {
+      return 1;
+    }
+  }
+  if (timers.size() != count / 2 + 1) {
+    return 2;
+  }
+
+  timers.Start();
+  if (!WaitFor(ran, count / 2, 20)) {
+    return 3;
+  }
+  pool.wait_until_empty(5000);
+  if (wrong != 0 || ran != count / 2 || timers.size() != 1) {
+    return 4;
+  }
+  timers.Stop();
+  pool.Stop();
+  pool.Join();
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing schedule_after..." << std::endl;
+  if ((ret = TestScheduleAfter()) != 0) {
+    std::cerr << "schedule_after test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "Testing schedule_every and cancel..." << std::endl;
+  if ((ret = TestEveryAndCancel()) != 0) {
+    std::cerr << "schedule_every test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  std::cout << "Testing many timers..." << std::endl;
+  if ((ret = TestMany()) != 0) {
+    std::cerr << "many timers test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
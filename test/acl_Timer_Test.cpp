@@ -0,0 +1,104 @@
+/**
+ *    \copyright Copyright 2021 Aqueti, Inc. All rights reserved.
+ *    \license This project is released under the MIT Public License.
+**/
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <Timer.h>
+
+/// @brief Tests that the monotonic and fast clocks never go backwards and
+/// agree with each other.
+int TestClocks()
+{
+  uint64_t lastMono = acl::getMonotonicNsec();
+  uint64_t lastFast = acl::getFastNsec();
+  for (int i = 0; i < 100000; i++) {
+    uint64_t mono = acl::getMonotonicNsec();
+    uint64_t fast = acl::getFastNsec();
+    if (mono < lastMono) {
+      return 1;
+    }
+    if (fast < lastFast) {
+      return 2;
+    }
+    lastMono = mono;
+    lastFast = fast;
+  }
+
+  // The fast clock shares the monotonic clock's reference point.
+  int64_t diff = static_cast<int64_t>(acl::getFastNsec() - acl::getMonotonicNsec());
+  if (diff < -1000000 || diff > 1000000) {
+    std::cerr << "Fast clock is " << diff << " ns from the monotonic clock" << std::endl;
+    return 3;
+  }
+
+  double before = acl::getMonotonicTime();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  double slept = acl::getMonotonicTime() - before;
+  if (slept < 0.019 || slept > 1.0) {
+    return 4;
+  }
+
+  std::cout << "  Fast clock uses TSC: " << (acl::fastClockUsesTSC() ? "yes" : "no") << std::endl;
+  return 0;
+}
+
+/// @brief Tests start/stop/elapsed with a clock.
+int TestTimer(acl::ClockSource clock)
+{
+  acl::Timer timer(clock);
+  if (timer.getClockSource() != clock) {
+    return 1;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  double running = timer.elapsed();
+  if (running < 0.019 || running > 1.0) {
+    return 2;
+  }
+  timer.stop();
+  double stopped = timer.elapsed();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  if (timer.elapsed() != stopped) {
+    return 3;
+  }
+
+  // Switching clocks starts over.
+  timer.setClockSource(acl::ClockSource::Wall);
+  if (timer.getClockSource() != acl::ClockSource::Wall || timer.elapsed() > 0.5) {
+    return 4;
+  }
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int ret;
+
+  std::cout << "Testing clocks..." << std::endl;
+  if ((ret = TestClocks()) != 0) {
+    std::cerr << "Clock test failed with code " << ret << std::endl;
+    return 100 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Testing timer..." << std::endl;
+  if ((ret = TestTimer(acl::ClockSource::Monotonic)) != 0) {
+    std::cerr << "Monotonic timer test failed with code " << ret << std::endl;
+    return 200 + ret;
+  }
+  if ((ret = TestTimer(acl::ClockSource::Fast)) != 0) {
+    std::cerr << "Fast timer test failed with code " << ret << std::endl;
+    return 300 + ret;
+  }
+  if ((ret = TestTimer(acl::ClockSource::Wall)) != 0) {
+    std::cerr << "Wall timer test failed with code " << ret << std::endl;
+    return 400 + ret;
+  }
+  std::cout << "... Completed" << std::endl;
+
+  std::cout << "Success!" << std::endl;
+  return 0;
+}